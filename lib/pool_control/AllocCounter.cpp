@@ -0,0 +1,35 @@
+#include "AllocCounter.h"
+
+volatile unsigned long POOL_ALLOC_COUNT = 0;
+
+//NOTE: These can get called from interrupts (the SDK allocates from its
+//      callbacks), so they have to be in IRAM like the allocator itself
+extern "C" {
+  void* __real_malloc(size_t size);
+  void* __real_calloc(size_t num, size_t size);
+  void* __real_realloc(void* ptr, size_t size);
+
+  void* IRAM_ATTR __wrap_malloc(size_t size){
+    POOL_ALLOC_COUNT++;
+    return __real_malloc(size);
+  }
+
+  void* IRAM_ATTR __wrap_calloc(size_t num, size_t size){
+    POOL_ALLOC_COUNT++;
+    return __real_calloc(num, size);
+  }
+
+  //realloc(ptr, 0) is a free, anything else can hit the heap
+  void* IRAM_ATTR __wrap_realloc(void* ptr, size_t size){
+    if (size > 0) POOL_ALLOC_COUNT++;
+    return __real_realloc(ptr, size);
+  }
+}
+
+PoolAllocWatch::PoolAllocWatch(unsigned long& total)
+: total(total), start(POOL_ALLOC_COUNT){
+}
+
+PoolAllocWatch::~PoolAllocWatch(){
+  total += POOL_ALLOC_COUNT - start;
+}
@@ -0,0 +1,30 @@
+#ifndef _ALLOC_COUNTER_H
+#define _ALLOC_COUNTER_H
+
+#include <Arduino.h>
+
+/*
+  Counts heap allocations (malloc/calloc/realloc, which new and String
+  sit on top of) so we can see whether the control loop makes any. The
+  counting wrappers get linked in front of the real allocator with
+  -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (see platformio.ini).
+*/
+extern volatile unsigned long POOL_ALLOC_COUNT;
+
+/*
+  Adds the allocations made while it's in scope to a counter, e.g.
+    {
+      PoolAllocWatch w(task.allocs);
+      run_the_task();
+    }
+*/
+class PoolAllocWatch {
+  public:
+    unsigned long& total;
+    unsigned long start;
+
+    PoolAllocWatch(unsigned long& total);
+    ~PoolAllocWatch();
+};
+
+#endif
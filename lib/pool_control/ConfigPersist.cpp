@@ -0,0 +1,33 @@
+#include "ConfigPersist.h"
+
+PoolConfigPersist::PoolConfigPersist(){
+  dirty = 0;
+  dirty_since = 0;
+  last_change = 0;
+  save_delay_ms = POOL_CONFIG_SAVE_DELAY;
+  saved_hash = 0;
+  saves = 0;
+  skipped = 0;
+  failures = 0;
+}
+
+void PoolConfigPersist::markDirty(unsigned long now){
+  if (!dirty){
+    dirty = 1;
+    dirty_since = now;
+  }
+  last_change = now;
+}
+
+byte PoolConfigPersist::due(unsigned long now){
+  if (!dirty) return 0;
+  if (now - last_change >= save_delay_ms) return 1;
+
+  //Don't let a steady trickle of changes put it off forever
+  return (now - dirty_since >= save_delay_ms * POOL_CONFIG_SAVE_MAX_WAIT_FACTOR) ? 1 : 0;
+}
+
+void PoolConfigPersist::saved(uint32_t hash){
+  saved_hash = hash;
+  dirty = 0;
+}
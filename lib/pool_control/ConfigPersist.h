@@ -0,0 +1,40 @@
+#ifndef _CONFIG_PERSIST_H
+#define _CONFIG_PERSIST_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  Bookkeeping for writing the config back to flash. Setters just mark
+  the config dirty, the "config" task writes it once the changes have
+  been quiet for save_delay_ms (so a burst of POSTs is one write), and
+  the write is skipped altogether if the config record has the same CRC
+  as what's already on flash.
+*/
+class PoolConfigPersist {
+  public:
+    byte dirty;
+    unsigned long dirty_since; //millis() of the first unsaved change
+    unsigned long last_change; //millis() of the latest unsaved change
+    unsigned long save_delay_ms;
+
+    //CRC of what's on flash (0 if we don't know)
+    uint32_t saved_hash;
+
+    //Stats
+    unsigned long saves;
+    unsigned long skipped;  //writes avoided since nothing actually changed
+    unsigned long failures;
+
+    PoolConfigPersist();
+
+    void markDirty(unsigned long now);
+
+    //Returns 1 if it's time to write
+    byte due(unsigned long now);
+
+    //Note a finished (or unnecessary) write of content with the given hash
+    void saved(uint32_t hash);
+};
+
+#endif
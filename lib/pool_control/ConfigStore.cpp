@@ -0,0 +1,111 @@
+#include "ConfigStore.h"
+
+PoolConfigStore::PoolConfigStore(){
+  memset(&record, 0, sizeof(record));
+  current_slot = -1;
+  generation = 0;
+  writes = 0;
+  failures = 0;
+}
+
+uint32_t PoolConfigStore::slotSector(int slot){
+  int from_end = (slot == 0) ? POOL_CONFIG_SLOT_A_FROM_END : POOL_CONFIG_SLOT_B_FROM_END;
+  return ESP.getFlashChipSize() / POOL_FLASH_SECTOR_SIZE - from_end;
+}
+
+uint32_t PoolConfigStore::slotAddress(int slot){
+  return slotSector(slot) * POOL_FLASH_SECTOR_SIZE + CONFIG_START;
+}
+
+byte PoolConfigStore::readHeader(int slot, PoolConfigHeader& header){
+  if (!ESP.flashRead(slotAddress(slot), (uint32_t*)&header, sizeof(header))){
+    return 0;
+  }
+  return (memcmp(header.version, CONFIG_VERSION, sizeof(header.version)) == 0 &&
+          header.size >= POOL_CONFIG_MIN_RECORD_SIZE &&
+          header.size <= sizeof(PoolConfigRecord) &&
+          header.size % 4 == 0) ? 1 : 0;
+}
+
+byte PoolConfigStore::load(int skip_slot){
+  PoolConfigHeader headers[POOL_CONFIG_NUM_SLOTS];
+  byte valid[POOL_CONFIG_NUM_SLOTS];
+  for (int x = 0; x < POOL_CONFIG_NUM_SLOTS; x++){
+    valid[x] = readHeader(x, headers[x]);
+  }
+
+  //Newest first, fall back to the other one if it doesn't check out
+  int order[POOL_CONFIG_NUM_SLOTS] = {0, 1};
+  if (valid[1] && (!valid[0] || headers[1].generation > headers[0].generation)){
+    order[0] = 1;
+    order[1] = 0;
+  }
+
+  current_slot = -1;
+  for (int x = 0; x < POOL_CONFIG_NUM_SLOTS; x++){
+    int slot = order[x];
+    if (!valid[slot] || slot == skip_slot) continue;
+    //Records from older firmware are shorter, whatever they didn't have is zeroed
+    memset(&record, 0, sizeof(record));
+    if (!ESP.flashRead(slotAddress(slot), (uint32_t*)&record, headers[slot].size)) continue;
+    if (payloadCrc(headers[slot].size) != record.header.crc) continue;
+
+    current_slot = slot;
+    generation = record.header.generation;
+    return 1;
+  }
+  return 0;
+}
+
+byte PoolConfigStore::save(){
+  int slot = (current_slot == 0) ? 1 : 0;
+
+  memcpy(record.header.version, CONFIG_VERSION, sizeof(record.header.version));
+  record.header.generation = generation + 1;
+  record.header.size = sizeof(PoolConfigRecord);
+  record.header.crc = payloadCrc();
+
+  if (!ESP.flashEraseSector(slotSector(slot)) ||
+      !ESP.flashWrite(slotAddress(slot), (uint32_t*)&record, sizeof(record)) ||
+      !verify(slot)){
+    failures++;
+    return 0;
+  }
+
+  current_slot = slot;
+  generation = record.header.generation;
+  writes++;
+  return 1;
+}
+
+byte PoolConfigStore::verify(int slot){
+  //A bit at a time, we don't have the stack for a second record
+  uint32_t buffer[16];
+  uint32_t address = slotAddress(slot);
+  const uint8_t* expected = (const uint8_t*)&record;
+  for (size_t x = 0; x < sizeof(record); x += sizeof(buffer)){
+    size_t n = sizeof(record) - x;
+    if (n > sizeof(buffer)) n = sizeof(buffer);
+    if (!ESP.flashRead(address + x, buffer, n) || memcmp(buffer, expected + x, n) != 0){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+uint32_t PoolConfigStore::payloadCrc(size_t size){
+  return crc32(((const uint8_t*)&record) + sizeof(PoolConfigHeader), size - sizeof(PoolConfigHeader));
+}
+
+uint32_t PoolConfigStore::crc32(const void* data, size_t size){
+  //Bitwise (no table), it only runs on boot and saves
+  const uint8_t* p = (const uint8_t*)data;
+  uint32_t crc = 0xFFFFFFFF;
+  while (size--){
+    crc ^= *p++;
+    for (int x = 0; x < 8; x++){
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
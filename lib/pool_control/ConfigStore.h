@@ -0,0 +1,137 @@
+#ifndef _CONFIG_STORE_H
+#define _CONFIG_STORE_H
+
+#include <Arduino.h>
+#include <stddef.h>
+#include "Constants.h"
+
+/*
+  Packed binary config (everything the JSON config file used to hold).
+  Strings are fixed size and always terminated, schedules are seconds
+  since midnight. Keep it a multiple of 4 bytes (flash writes are 32 bit).
+  New fields only ever go on the end: a record saved by older firmware is
+  loaded as far as it goes and the rest reads as zeros.
+*/
+struct PoolConfigRelay {
+  char name[POOL_RELAY_NAME_LEN];
+  uint32_t on_secs[MAX_SCHEDULES];
+  uint32_t off_secs[MAX_SCHEDULES];
+  uint8_t num_schedules;
+  uint8_t pad[3];
+};
+
+struct PoolConfigTask {
+  uint32_t period_ms;
+  uint32_t deadline_ms;
+  uint8_t priority;
+  uint8_t pad[3];
+};
+
+struct PoolConfigHeader {
+  char version[4];     //CONFIG_VERSION
+  uint32_t generation; //goes up with every save, the highest valid slot wins
+  uint32_t size;       //sizeof(PoolConfigRecord) when it was written (older firmware's is smaller)
+  uint32_t crc;        //CRC32 of everything after the header
+};
+
+struct PoolConfigRecord {
+  PoolConfigHeader header;
+
+  //Wifi/NTP
+  char wifi_ssid[POOL_SSID_LEN];
+  char wifi_pw[POOL_PW_LEN];
+  char ntp_server[POOL_HOST_LEN];
+  int32_t tz_offset;
+
+  PoolConfigRelay relays[MAX_RELAY];
+
+  //Sensors we expect and which one does what
+  char sensors[MAX_SENSORS][POOL_SENSOR_NAME_LEN];
+  char pool_water_sensor[POOL_SENSOR_NAME_LEN];
+  char roof_sensor[POOL_SENSOR_NAME_LEN];
+  char ambient_air_sensor[POOL_SENSOR_NAME_LEN];
+  uint8_t num_sensors;
+
+  //Solar
+  uint8_t solar_enabled;
+  uint8_t pad[2];
+  float solar_target_temp;
+
+  //MQTT (everything from here on is zeroed in a record older firmware saved)
+  char mqtt_host[POOL_HOST_LEN]; //"" if it's off
+  char mqtt_user[POOL_MQTT_USER_LEN];
+  char mqtt_pw[POOL_PW_LEN];
+  char mqtt_prefix[POOL_MQTT_PREFIX_LEN];
+  uint16_t mqtt_port;
+  uint8_t pad2[2];
+  float mqtt_temp_deadband; //Not there in records saved before it was added
+
+  //Settings from /general (all added at once, check for tasks)
+  uint32_t config_save_delay_ms;
+  float events_temp_deadband;
+  float analog_ema_alpha;
+  uint8_t analog_median_depth;
+  uint8_t num_tasks;
+  uint8_t pad3[2];
+  PoolConfigTask tasks[POOL_CONFIG_MAX_TASKS]; //by PoolTaskId
+} __attribute__((aligned(4)));
+
+//Size of the record before the MQTT settings were added (the oldest we still load)
+#define POOL_CONFIG_MIN_RECORD_SIZE offsetof(PoolConfigRecord, mqtt_host)
+
+//Whether the record that was loaded was saved with field in it (header.size
+//is how much the firmware that saved it wrote, new fields only go on the end)
+#define POOL_CONFIG_HAS(r, field) ((r).header.size >= offsetof(PoolConfigRecord, field) + sizeof((r).field))
+
+static_assert(sizeof(PoolConfigRecord) % 4 == 0, "flash writes are 32 bit");
+static_assert(POOL_NUM_TASKS <= POOL_CONFIG_MAX_TASKS, "config record doesn't have room for every task");
+static_assert(CONFIG_START + sizeof(PoolConfigRecord) <= POOL_FLASH_SECTOR_SIZE, "config record doesn't fit in a flash sector");
+
+/*
+  A/B flash storage for the PoolConfigRecord. Each save goes to the slot
+  that isn't holding the newest record (with the next generation), so a
+  reset/power cut mid-write only ever loses the write in progress. Loading
+  takes the newest slot with a good version/size/CRC. No JSON involved.
+*/
+class PoolConfigStore {
+  public:
+    //The record last loaded/saved (fill it in and save())
+    PoolConfigRecord record;
+
+    int current_slot; //slot holding the newest record, -1 if neither is valid
+    uint32_t generation;
+
+    //Stats
+    unsigned long writes;
+    unsigned long failures;
+
+    PoolConfigStore();
+
+    //Load the newest valid slot (other than skip_slot) into record. Returns
+    //1 if there was one.
+    //NOTE: Pass current_slot as skip_slot to fall back to the other one if
+    //      what was loaded turns out to be no good
+    byte load(int skip_slot = -1);
+
+    //Write record to the other slot. Returns 1 if it verified.
+    byte save();
+
+    //CRC32 of the record's contents (after the header) up to size
+    uint32_t payloadCrc(size_t size = sizeof(PoolConfigRecord));
+
+    static uint32_t crc32(const void* data, size_t size);
+
+    //Flash byte offset of a slot's record
+    uint32_t slotAddress(int slot);
+    uint32_t slotSector(int slot);
+
+  private:
+
+    //Read just a slot's header, returns 1 if it looks like one of ours
+    byte readHeader(int slot, PoolConfigHeader& header);
+
+    //Returns 1 if what's in the slot matches record
+    byte verify(int slot);
+};
+
+#endif
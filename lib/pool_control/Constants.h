@@ -5,13 +5,79 @@
 #include <ArduinoJson.h>
 #include "RemoteDebug.h"
 
-#define pdebugA(fmt, ...) if (debug->isActive(debug->ANY)) 		debug->printf("(%s) " fmt, __func__, ##__VA_ARGS__)
-#define pdebugP(fmt, ...) if (debug->isActive(debug->PROFILER)) 	debug->printf("(%s) " fmt, __func__, ##__VA_ARGS__)
-#define pdebugV(fmt, ...) if (debug->isActive(debug->VERBOSE)) 	debug->printf("(%s) " fmt, __func__, ##__VA_ARGS__)
-#define pdebugD(fmt, ...) if (debug->isActive(debug->DEBUG)) 		debug->printf("(%s) " fmt, __func__, ##__VA_ARGS__)
-#define pdebugI(fmt, ...) if (debug->isActive(debug->INFO)) 		debug->printf("(%s) " fmt, __func__, ##__VA_ARGS__)
-#define pdebugW(fmt, ...) if (debug->isActive(debug->WARNING)) 	debug->printf("(%s) " fmt, __func__, ##__VA_ARGS__)
-#define pdebugE(fmt, ...) if (debug->isActive(debug->ERROR)) 		debug->printf("(%s) " fmt, __func__, ##__VA_ARGS__)
+//Debug levels (same numbers as RemoteDebug's, so they can be compared
+//against POOL_LOG_LEVEL in the preprocessor)
+#define POOL_LOG_PROFILER 0
+#define POOL_LOG_VERBOSE 1
+#define POOL_LOG_DEBUG 2
+#define POOL_LOG_INFO 3
+#define POOL_LOG_WARNING 4
+#define POOL_LOG_ERROR 5
+#define POOL_LOG_ANY 6
+
+//Anything below this level is compiled out (set it from build_flags, e.g.
+//-DPOOL_LOG_LEVEL=POOL_LOG_INFO), so it costs nothing at runtime
+#ifndef POOL_LOG_LEVEL
+#define POOL_LOG_LEVEL POOL_LOG_PROFILER
+#endif
+
+//Debug output when a RemoteDebug client is watching at that level (the
+//format strings stay in flash). Levels below POOL_LOG_LEVEL become dead code,
+//so their arguments still get type checked but nothing is left in the binary.
+#define POOL_DEBUG_PRINT(lvl, fmt, ...) if (debug->isActive(debug->lvl)) \
+                                          debug->printf_P(PSTR("(%s) " fmt), __func__, ##__VA_ARGS__)
+#define POOL_DEBUG_NONE(fmt, ...) if (0) debug->printf("(%s) " fmt, __func__, ##__VA_ARGS__)
+
+#define pdebugA(fmt, ...) POOL_DEBUG_PRINT(ANY, fmt, ##__VA_ARGS__)
+#define pdebugE(fmt, ...) POOL_DEBUG_PRINT(ERROR, fmt, ##__VA_ARGS__)
+
+#if POOL_LOG_LEVEL <= POOL_LOG_PROFILER
+#define pdebugP(fmt, ...) POOL_DEBUG_PRINT(PROFILER, fmt, ##__VA_ARGS__)
+#else
+#define pdebugP(fmt, ...) POOL_DEBUG_NONE(fmt, ##__VA_ARGS__)
+#endif
+#if POOL_LOG_LEVEL <= POOL_LOG_VERBOSE
+#define pdebugV(fmt, ...) POOL_DEBUG_PRINT(VERBOSE, fmt, ##__VA_ARGS__)
+#else
+#define pdebugV(fmt, ...) POOL_DEBUG_NONE(fmt, ##__VA_ARGS__)
+#endif
+#if POOL_LOG_LEVEL <= POOL_LOG_DEBUG
+#define pdebugD(fmt, ...) POOL_DEBUG_PRINT(DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define pdebugD(fmt, ...) POOL_DEBUG_NONE(fmt, ##__VA_ARGS__)
+#endif
+#if POOL_LOG_LEVEL <= POOL_LOG_INFO
+#define pdebugI(fmt, ...) POOL_DEBUG_PRINT(INFO, fmt, ##__VA_ARGS__)
+#else
+#define pdebugI(fmt, ...) POOL_DEBUG_NONE(fmt, ##__VA_ARGS__)
+#endif
+#if POOL_LOG_LEVEL <= POOL_LOG_WARNING
+#define pdebugW(fmt, ...) POOL_DEBUG_PRINT(WARNING, fmt, ##__VA_ARGS__)
+#else
+#define pdebugW(fmt, ...) POOL_DEBUG_NONE(fmt, ##__VA_ARGS__)
+#endif
+
+//Hot path events go into the log ring (LogRing.h) as binary records instead
+//(event is a PoolLogEvent, up to POOL_LOG_MAX_ARGS numbers/static strings),
+//and only get formatted when someone reads them
+#define POOL_LOG_ADD(lvl, event, ...) POOL_LOG.add(lvl, event, ##__VA_ARGS__)
+#define POOL_LOG_NONE(event, ...) if (0) POOL_LOG.add(POOL_LOG_ANY, event, ##__VA_ARGS__)
+
+#if POOL_LOG_LEVEL <= POOL_LOG_VERBOSE
+#define plogV(event, ...) POOL_LOG_ADD(POOL_LOG_VERBOSE, event, ##__VA_ARGS__)
+#else
+#define plogV(event, ...) POOL_LOG_NONE(event, ##__VA_ARGS__)
+#endif
+#if POOL_LOG_LEVEL <= POOL_LOG_DEBUG
+#define plogD(event, ...) POOL_LOG_ADD(POOL_LOG_DEBUG, event, ##__VA_ARGS__)
+#else
+#define plogD(event, ...) POOL_LOG_NONE(event, ##__VA_ARGS__)
+#endif
+#if POOL_LOG_LEVEL <= POOL_LOG_INFO
+#define plogI(event, ...) POOL_LOG_ADD(POOL_LOG_INFO, event, ##__VA_ARGS__)
+#else
+#define plogI(event, ...) POOL_LOG_NONE(event, ##__VA_ARGS__)
+#endif
 
 #define HOSTNAME "poolio"
 #define OTA_PASSWORD "REDACTED"
@@ -21,12 +87,46 @@
 //ms to wait before considering a wifi connection as a failure
 #define WIFI_CONNECT_TIMEOUT 10000
 
+//Backoff between failed wifi connection attempts (ms). Doubles after each
+//failure up to the max, resets when we connect.
+#define WIFI_BACKOFF_MIN 1000
+#define WIFI_BACKOFF_MAX 300000
+
+//GET responses are streamed out in chunks of (at most) this many bytes
+//rather than serialized into one big String first
+#define POOL_JSON_CHUNK_SIZE 512
+
 // ID of the settings block (in EEPROM/flash)
+// NOTE: Change this whenever PoolConfigRecord (ConfigStore.h) changes layout,
+//       records with a different version are ignored (fields appended to the
+//       end don't count, older shorter records still load)
 #define CONFIG_VERSION "vb1"
 
 // Tell it where to store your config data in EEPROM
+// (offset of the config record in each of its flash sectors)
 #define CONFIG_START 32
 
+// The binary config lives in two raw flash sectors it alternates between
+// (see ConfigStore.h), counted back from the end of flash: the last 4
+// sectors are the SDK's (RF cal/wifi), the next one is the EEPROM sector
+// (nothing else here uses it) and the one under that is the gap the core
+// leaves between SPIFFS (8K blocks) and EEPROM on the 4MB layouts.
+#define POOL_FLASH_SECTOR_SIZE 4096
+#define POOL_CONFIG_SLOT_A_FROM_END 5
+#define POOL_CONFIG_SLOT_B_FROM_END 6
+#define POOL_CONFIG_NUM_SLOTS 2
+#define POOL_CONFIG_MAX_TASKS 16 //task settings the record has room for (by PoolTaskId)
+
+// Name/credential buffer sizes (including the terminator). These are the
+// controller's fixed in-place buffers and the binary config's fields.
+#define POOL_SSID_LEN 36
+#define POOL_PW_LEN 68
+#define POOL_HOST_LEN 64
+#define POOL_RELAY_NAME_LEN 32
+#define POOL_SENSOR_NAME_LEN 24
+#define POOL_MQTT_USER_LEN 32
+#define POOL_MQTT_PREFIX_LEN 32
+
 
 //error sentinel for HEX string conversion failures
 #define HEX_CONV_ERR 69 //<bill_and_teds_excellent_adventure>What number are you thinking of? 69 DUDE!</bill_and_teds_excellent_adventure>
@@ -35,6 +135,9 @@
 //Maximum number of on/off times per relay per day
 #define MAX_SCHEDULES 4
 
+//PoolDailySchedule::nextTransition() for an empty schedule
+#define POOL_SCHEDULE_NO_TRANSITION 0xFFFFFFFFUL
+
 //size of error tracking array
 #define MAX_POOL_ERRORS 8
 
@@ -140,13 +243,147 @@ static const char DEFAULT_WIFI_CONFIG[] PROGMEM = R"json(
 #define DEFAULT_NTP_SERVER "us.pool.ntp.org"
 //#define DEFAULT_NTP_UPDATE_SECS 300
 #define DEFAULT_NTP_UPDATE_SECS 120
+#define NTP_RESPONSE_TIMEOUT 1500 //ms to wait on a reply before resending
+#define NTP_MAX_RETRIES 3 //requests per sync before we call it a failure
+#define NTP_RETRY_INTERVAL 30 //secs to wait after a failed sync before trying again
+#define NTP_DNS_TIMEOUT 5000 //ms to wait on a DNS lookup for the NTP server
+#define NTP_DNS_TTL_SECS 3600 //how long we trust a resolved NTP server IP
 
 //Number of hours to distrust our time schedule without
 //an NTP update
 #define TIME_UNRELIABLE_AFTER_HOURS 48
 
-//Ms between updates for the pool controller
-#define POOL_UPDATE_INTERVAL 5000 
+//Task scheduler limits (see TaskScheduler.h)
+#define MAX_POOL_TASKS 12
+#define POOL_TASK_MIN_PERIOD 50 //ms
+#define POOL_TASK_MAX_PERIOD 3600000 //ms (1 hour)
+#define POOL_TASK_MAX_PRIORITY 15
+
+//Default task periods/priorities/deadlines (ms). The control pipeline (pool
+//state, schedules, solar, relays) runs often so switches feel responsive,
+//the slow stuff is spread out.
+#define POOL_TASK_WIFI_PERIOD 500
+#define POOL_TASK_WIFI_PRIORITY 4
+#define POOL_TASK_WIFI_DEADLINE 1000
+#define POOL_TASK_SENSORS_PERIOD 5000
+#define POOL_TASK_SENSORS_PRIORITY 3
+#define POOL_TASK_SENSORS_DEADLINE 5000
+#define POOL_TASK_NTP_PERIOD 1000
+#define POOL_TASK_NTP_PRIORITY 5
+#define POOL_TASK_NTP_DEADLINE 10000
+#define POOL_TASK_CONTROL_PERIOD 250 //also runs right away when an input changes
+#define POOL_TASK_CONTROL_PRIORITY 0
+#define POOL_TASK_CONTROL_DEADLINE 250
+#define POOL_TASK_ANALOG_PERIOD 200
+#define POOL_TASK_ANALOG_PRIORITY 2
+#define POOL_TASK_ANALOG_DEADLINE 200
+#define POOL_TASK_CONFIG_PERIOD 1000
+#define POOL_TASK_CONFIG_PRIORITY 6
+#define POOL_TASK_CONFIG_DEADLINE 5000
+#define POOL_TASK_DISCOVERY_PERIOD 60000
+#define POOL_TASK_DISCOVERY_PRIORITY 7
+#define POOL_TASK_DISCOVERY_DEADLINE 60000
+#define POOL_TASK_HISTORY_PERIOD (POOL_HISTORY_SAMPLE_SECS * 1000UL)
+#define POOL_TASK_HISTORY_PRIORITY 6
+#define POOL_TASK_HISTORY_DEADLINE 5000
+#define POOL_TASK_RELAY_STATS_PERIOD 60000
+#define POOL_TASK_RELAY_STATS_PRIORITY 7
+#define POOL_TASK_RELAY_STATS_DEADLINE 60000
+#define POOL_TASK_MQTT_PERIOD 100
+#define POOL_TASK_MQTT_PRIORITY 5
+#define POOL_TASK_MQTT_DEADLINE 1000
+
+//Temperature/relay history (see History.h). Raw samples for the last
+//hour, 5 minute rollups for the last day, POOL_HISTORY_LONG_SECS ones for
+//the last POOL_HISTORY_DAYS. Every bucket is 16 bytes, so the defaults take
+//~10KB (it all comes out of the same ~80KB of DRAM as the heap).
+//NOTE: -DPOOL_HISTORY_LONG_SECS=3600 keeps hourly rollups for the month,
+//      but that's ~18KB
+#ifndef POOL_HISTORY_LONG_SECS
+#define POOL_HISTORY_LONG_SECS (3 * 3600)
+#endif
+#define POOL_HISTORY_SAMPLE_SECS 30 //raw sample period (the "history" task)
+#define POOL_HISTORY_DAYS 31
+#define POOL_HISTORY_NUM_TIERS 3
+#define POOL_HISTORY_RAW_BUCKETS (3600 / POOL_HISTORY_SAMPLE_SECS)
+#define POOL_HISTORY_5MIN_BUCKETS (24 * 12)
+#define POOL_HISTORY_LONG_BUCKETS (POOL_HISTORY_DAYS * 24 * 3600 / POOL_HISTORY_LONG_SECS)
+#define POOL_HISTORY_TEMP_SERIES 3 //water, roof, ambient (TSR_STRINGS order)
+#define POOL_HISTORY_NO_DATA -32768
+#define POOL_HISTORY_DUTY_STEPS 14 //relay on-time resolution (15 marks an empty bucket)
+#define POOL_HISTORY_EMPTY_DUTY 0xFFFFFFFFUL
+#define POOL_HISTORY_MIN_TIME 1577836800UL //2020, anything before means the clock isn't set
+
+//Relay runtime/switch counters (see RelayStats.h). They're copied to RTC
+//memory (survives resets, not power cuts) on every change and every
+//relay_stats task run, and to a SPIFFS file every
+//POOL_RELAY_STATS_SAVE_SECS so a power cut loses at most that much.
+//NOTE: The first 128 bytes of RTC user memory belong to the OTA
+//      bootloader, so we start after them
+#define POOL_RELAY_STATS_SAVE_SECS 3600
+#define POOL_RELAY_STATS_RTC_OFFSET 32 //4 byte blocks
+#define POOL_RELAY_STATS_MAGIC 0x504C5231UL //"PLR1"
+#define POOL_RELAY_STATS_FILE_PATH "/relay_stats.bin"
+#define POOL_RELAY_STATS_FROM_NONE 0 //where they came from at boot
+#define POOL_RELAY_STATS_FROM_RTC 1
+#define POOL_RELAY_STATS_FROM_FILE 2
+
+//Server-Sent Events (GET /events, see EventStream.h). Each subscriber gets
+//its own send buffer; one that falls that far behind gets dropped (it can
+//reconnect and GET /everything to catch up).
+#define POOL_EVENTS_MAX_CLIENTS 3
+#define POOL_EVENTS_CLIENT_BUFFER 512
+#define POOL_EVENTS_MAX_EVENT 160   //biggest single event (id/event/data lines)
+#define POOL_EVENTS_KEEPALIVE_MS 15000
+#define POOL_EVENTS_RETRY_MS 5000   //how long browsers wait to reconnect
+#define POOL_EVENTS_TEMP_DEADBAND 0.5 //degF a sensor has to move before we send it
+#define POOL_EVENTS_MAX_DEADBAND 20.0
+static const char POOL_EVENT_RELAY[] = "relay";   //{name, state, cause}
+static const char POOL_EVENT_SENSOR[] = "sensor"; //{name, temp_f}
+static const char POOL_EVENT_SOLAR[] = "solar";   //{state}
+static const char POOL_EVENT_MODE[] = "mode";     //{mode}
+static const char POOL_EVENT_ERROR[] = "error";   //{error} (new ones only)
+
+//MQTT client (see Mqtt.h). One connection to the broker set from /mqtt,
+//state published retained under the topic prefix when it changes.
+#define POOL_MQTT_PORT 1883
+#define POOL_MQTT_PREFIX "pool"
+#define POOL_MQTT_KEEPALIVE_SECS 60
+#define POOL_MQTT_BUFFER 512           //biggest packet we send or take in
+#define POOL_MQTT_TOPIC_LEN 96
+#define POOL_MQTT_CONNECT_TIMEOUT_MS 2000 //TCP connect (blocks) and then the CONNACK
+#define POOL_MQTT_DNS_TIMEOUT_MS 5000
+#define POOL_MQTT_MIN_BACKOFF_MS 2000
+#define POOL_MQTT_MAX_BACKOFF_MS 300000
+#define POOL_MQTT_TEMP_DEADBAND 0.5    //degF a sensor has to move before it's republished
+#define POOL_MQTT_MAX_DEADBAND 20.0
+#define POOL_MQTT_ONLINE "online"      //<prefix>/status (the will sets it offline)
+#define POOL_MQTT_OFFLINE "offline"
+
+//Prometheus GET /metrics (see Metrics.h)
+#define POOL_METRICS_LINE_LEN 160      //longest sample line (name, labels, value)
+#define POOL_METRICS_RATE_MIN_MS 1000  //loop rate is averaged over at least this long
+
+//Config changes are written to flash once they've been quiet this long
+//(ms, settable from /general), or after the max if they keep coming
+#define POOL_CONFIG_SAVE_DELAY 5000
+#define POOL_CONFIG_SAVE_MIN_DELAY 0
+#define POOL_CONFIG_SAVE_MAX_DELAY 600000
+#define POOL_CONFIG_SAVE_MAX_WAIT_FACTOR 4 //never sit dirty longer than this many delays
+
+//Deferred log ring (see LogRing.h)
+#define POOL_LOG_RING_SIZE 64 //records kept (the oldest get overwritten)
+#define POOL_LOG_MAX_ARGS 4
+#define POOL_LOG_LINE_LEN 160 //one formatted record
+#define POOL_LOG_TAIL_MAX 8 //records sent to the remote debugger per loop() pass
+
+//Loop latency profiler (see Profiler.h)
+#define POOL_PROFILE_BUCKETS 20 //power-of-2 us buckets (tops out around 0.5s)
+#define POOL_PROFILE_SLOW_US 50000 //stages slower than this get logged (PROFILER level)
+
+//Heap/stack telemetry (see MemoryStats.h)
+#define POOL_MEMORY_MAX_HANDLERS 32 //HTTP handlers that can be tracked
+#define POOL_MEMORY_JSON_LINE_LEN 320 //one stage/handler's JSON for GET /memory
 
 //TODO: Figure out which pins we can actually use here
 //      (for all the pins below)
@@ -154,6 +391,16 @@ static const char DEFAULT_WIFI_CONFIG[] PROGMEM = R"json(
 //DS1820 digital temerature probe (1-wire) input pin
 #define DEFAULT_DIGITAL_TEMP_PIN D2
 
+//Extra ms past the datasheet conversion time we'll wait for a DS18B20
+//conversion before giving up on it and starting another
+#define POOL_SENSOR_CONVERSION_SLACK 250
+
+//1-wire sensor registry (see SensorRegistry.h). The bus is only searched
+//by the "discovery" task (and GET /sensors/scan), a sensor that fails this
+//many reads in a row in between counts as gone until it's found again.
+#define POOL_SENSOR_DROPOUT_READS 3
+#define POOL_SENSOR_ROM_HEX_LEN 17 //16 hex digits + terminator
+
 //Default thermister pin (only one on the ESP8266)
 #define DEFAULT_ANALOG_THERM_PIN A0
 #define POOL_THERM_SERIES_RES 150000 //series resister (should be 47K)
@@ -162,8 +409,19 @@ static const char DEFAULT_WIFI_CONFIG[] PROGMEM = R"json(
 #define POOL_THERM_NOM_RES 10000 //resistance at nominal temp (usually 10K)
 #define POOL_THERM_NOM_TEMP_C 25 //Nominal temp C (25C usually)
 #define POOL_THERM_BETA 3950 //Beta
-#define POOL_THERM_NUM_SAMPLES 7 //number of samples to avg
-#define POOL_THERM_SAMPLE_DELAY 20 //ms delay between samples
+//NOTE: VCC/VREF/ADC_MAX are what the old Thermistor library was set up
+//      with, test/test_thermistor checks we still convert the same way
+#define POOL_THERM_VCC 3.3 //divider supply voltage
+#define POOL_THERM_VREF 1.0 //internal ADC reference voltage
+#define POOL_THERM_ADC_MAX 1023 //max digital num
+
+//Thermistor filtering (see FilteredThermistor.h). The sample rate is the
+//period of the "analog" task.
+//NOTE: Don't sample much faster than this, hammering analogRead() on the
+//      ESP8266 upsets the wifi
+#define POOL_THERM_MAX_FILTER_DEPTH 15 //ring buffer size
+#define POOL_THERM_DEFAULT_FILTER_DEPTH 7 //number of samples to take the median of
+#define POOL_THERM_DEFAULT_EMA_ALPHA 0.2 //exponential smoothing factor (1.0 is none)
 
 //switch inputs
 //NOTE: The MODE_PIN controls if we're in AP vs STA mode on the wifi
@@ -177,7 +435,16 @@ static const char DEFAULT_WIFI_CONFIG[] PROGMEM = R"json(
 #define RESET_SWITCH_FLIPS 6
 
 //Relay output pins (defaults)
-#define MAX_RELAY 8 //number of relays for the controller
+//NOTE: The '595 is bit-banged on the CLK/DATA pins below. Boards wired
+//      for HSPI instead (data = D7, clock = D5, i.e. swapped from these)
+//      can build with -DPOOL_RELAY_HW_SPI=1, which only uses the latch pin
+//      from here. Don't turn it on for a board wired the old way, the
+//      relays would latch garbage.
+#define MAX_RELAY 8 //number of relays for the controller (one 74HC595)
+#ifndef POOL_RELAY_HW_SPI
+#define POOL_RELAY_HW_SPI 0
+#endif
+#define POOL_RELAY_SPI_FREQ 1000000 //1MHz, plenty for 8 bits and kind to long wires
 #define DEFAULT_POOL_RELAY_SHIFT_CLK D7
 #define DEFAULT_POOL_RELAY_SHIFT_DATA D5
 #define DEFAULT_POOL_RELAY_SHIFT_LATCH D6
@@ -217,6 +484,63 @@ enum SolarState {
   SOLAR_BYPASS    //solar heating activated, but either the pump is off or the roof is cold
 };
 
+static const char SOLAR_DISABLED_STR[] = "disabled";
+static const char SOLAR_HEATING_STR[] = "heating";
+static const char SOLAR_BYPASS_STR[] = "bypass";
+static const char *SOLAR_STATE_STRINGS[] = {SOLAR_DISABLED_STR,
+                                            SOLAR_HEATING_STR,
+                                            SOLAR_BYPASS_STR};
+
+//Non-blocking DS18B20 conversion tracking
+enum SensorConversionState {
+  POOL_SENSORS_IDLE,       //No conversion in flight, next sensors task starts one
+  POOL_SENSORS_CONVERTING  //Conversion requested, waiting for the sensors to finish
+};
+
+//Wifi connection manager states (see PoolController::connect_wifi())
+//NOTE: Keep these in parity with POOL_WIFI_STATE_STRINGS below
+enum WifiConnState {
+  POOL_WIFI_IDLE,       //Not connected, the next wifi task starts an attempt
+  POOL_WIFI_CONNECTING, //WiFi.begin() called, waiting for an IP
+  POOL_WIFI_CONNECTED,
+  POOL_WIFI_BACKOFF,    //Last attempt failed, waiting a bit before the next one
+  POOL_WIFI_AP_MODE     //Running our own hotspot (manual mode)
+};
+
+static const char POOL_WIFI_IDLE_STR[] = "idle";
+static const char POOL_WIFI_CONNECTING_STR[] = "connecting";
+static const char POOL_WIFI_CONNECTED_STR[] = "connected";
+static const char POOL_WIFI_BACKOFF_STR[] = "backoff";
+static const char POOL_WIFI_AP_MODE_STR[] = "access_point";
+static const char *POOL_WIFI_STATE_STRINGS[] = {POOL_WIFI_IDLE_STR,
+                                                POOL_WIFI_CONNECTING_STR,
+                                                POOL_WIFI_CONNECTED_STR,
+                                                POOL_WIFI_BACKOFF_STR,
+                                                POOL_WIFI_AP_MODE_STR};
+
+//Non-blocking NTP client states (see PoolController::update_ntp())
+enum NtpState {
+  POOL_NTP_IDLE,         //Nothing in flight, waiting for the next sync
+  POOL_NTP_RESOLVING,    //Waiting on DNS for the NTP server IP
+  POOL_NTP_WAIT_RESPONSE //Request sent, waiting on the reply
+};
+
+//MQTT connection states (see PoolMqttClient::handle())
+//NOTE: Keep these in parity with POOL_MQTT_STATE_STRINGS
+enum MqttState {
+  POOL_MQTT_DISABLED,   //No broker set
+  POOL_MQTT_IDLE,       //Waiting on wifi/the backoff before connecting
+  POOL_MQTT_RESOLVING,  //Waiting on DNS for the broker IP
+  POOL_MQTT_CONNECTING, //CONNECT sent, waiting on the CONNACK
+  POOL_MQTT_CONNECTED
+};
+
+static const char *POOL_MQTT_STATE_STRINGS[] = {"disabled",
+                                                "idle",
+                                                "resolving",
+                                                "connecting",
+                                                "connected"};
+
 enum TimeState {
   POOL_TIME_UNINITIALIZED, //Right after startup, we haven' talked to an NPT server yet
   POOL_TIME_NO_INTERNET,
@@ -231,10 +555,121 @@ enum Pool_Error_Code {
   POOL_ERR_NO_DIGITAL_TEMP_SENSORS,
   POOL_ERR_ROOF_TEMP_SENSOR_PROBLEM,
   POOL_ERR_AMBIENT_TEMP_SENSOR_PROBLEM,
-  POOL_ERR_POOL_WATER_SENSOR_PROBLEM
+  POOL_ERR_POOL_WATER_SENSOR_PROBLEM,
+  POOL_NUM_ERRORS
 };
 
-  
+//Sections of GET /everything, each versioned/cached on its own (see Snapshot.h)
+//NOTE: Keep these in parity with POOL_SNAPSHOT_SECTION_STRINGS below
+enum PoolSnapshotSection {
+  POOL_SNAPSHOT_WIFI = 0,
+  POOL_SNAPSHOT_RELAYS,
+  POOL_SNAPSHOT_SENSORS,
+  POOL_SNAPSHOT_SOLAR,
+  POOL_SNAPSHOT_GENERAL,
+  POOL_NUM_SNAPSHOT_SECTIONS
+};
+
+static const char *POOL_SNAPSHOT_SECTION_STRINGS[] = {"wifi",
+                                                      "relays",
+                                                      "sensors",
+                                                      "solar",
+                                                      "general"};
+
+//Counters/timings in the general section (task stats, clock, etc) only
+//count as a change this often (ms), otherwise they'd change every loop()
+#define POOL_SNAPSHOT_TELEMETRY_PERIOD 10000
+
+//How far a temperature (deg F) or the RSSI (dBm) has to move from what's
+//in the snapshot before it counts as a change
+#define POOL_SNAPSHOT_TEMP_DELTA 0.1
+#define POOL_SNAPSHOT_RSSI_DELTA 3
+
+//Stages of PoolController::update() run by the task scheduler
+//NOTE: Keep these in parity with POOL_TASK_STRINGS below
+enum PoolTaskId {
+  POOL_TASK_WIFI = 0,
+  POOL_TASK_SENSORS,
+  POOL_TASK_NTP,
+  POOL_TASK_CONTROL,
+  POOL_TASK_ANALOG,
+  POOL_TASK_CONFIG,
+  POOL_TASK_DISCOVERY,
+  POOL_TASK_HISTORY,
+  POOL_TASK_RELAY_STATS,
+  POOL_TASK_MQTT,
+  POOL_NUM_TASKS
+};
+
+static const char POOL_TASK_WIFI_STR[] = "wifi";
+static const char POOL_TASK_SENSORS_STR[] = "sensors";
+static const char POOL_TASK_NTP_STR[] = "ntp";
+static const char POOL_TASK_CONTROL_STR[] = "control";
+static const char POOL_TASK_ANALOG_STR[] = "analog";
+static const char POOL_TASK_CONFIG_STR[] = "config";
+static const char POOL_TASK_DISCOVERY_STR[] = "discovery";
+static const char POOL_TASK_HISTORY_STR[] = "history";
+static const char POOL_TASK_RELAY_STATS_STR[] = "relay_stats";
+static const char POOL_TASK_MQTT_STR[] = "mqtt";
+static const char *POOL_TASK_STRINGS[] = {POOL_TASK_WIFI_STR,
+                                          POOL_TASK_SENSORS_STR,
+                                          POOL_TASK_NTP_STR,
+                                          POOL_TASK_CONTROL_STR,
+                                          POOL_TASK_ANALOG_STR,
+                                          POOL_TASK_CONFIG_STR,
+                                          POOL_TASK_DISCOVERY_STR,
+                                          POOL_TASK_HISTORY_STR,
+                                          POOL_TASK_RELAY_STATS_STR,
+                                          POOL_TASK_MQTT_STR};
+
+//Stages of loop() we keep latency histograms for
+//NOTE: The first entries line up with PoolTaskId (tasks are profiled under
+//      their own index). Keep these in parity with POOL_PROFILE_STAGE_STRINGS below
+enum PoolProfileStage {
+  POOL_PROFILE_HARVEST_SENSORS = POOL_NUM_TASKS,
+  POOL_PROFILE_POLL_NTP,
+  POOL_PROFILE_UPDATE,
+  POOL_PROFILE_MDNS,
+  POOL_PROFILE_OTA,
+  POOL_PROFILE_HTTP,
+  POOL_PROFILE_EVENTS,
+  POOL_PROFILE_DEBUG,
+  POOL_PROFILE_LOOP,
+  POOL_PROFILE_INPUT_TO_RELAY, //not a stage, an input changing -> the relays it affects latched
+  POOL_NUM_PROFILE_STAGES
+};
+
+static const char POOL_PROFILE_HARVEST_SENSORS_STR[] = "sensor_harvest";
+static const char POOL_PROFILE_POLL_NTP_STR[] = "ntp_poll";
+static const char POOL_PROFILE_UPDATE_STR[] = "update";
+static const char POOL_PROFILE_MDNS_STR[] = "mdns";
+static const char POOL_PROFILE_OTA_STR[] = "ota";
+static const char POOL_PROFILE_HTTP_STR[] = "http";
+static const char POOL_PROFILE_EVENTS_STR[] = "events";
+static const char POOL_PROFILE_DEBUG_STR[] = "remote_debug";
+static const char POOL_PROFILE_LOOP_STR[] = "loop";
+static const char POOL_PROFILE_INPUT_TO_RELAY_STR[] = "input_to_relay";
+static const char *POOL_PROFILE_STAGE_STRINGS[] = {POOL_TASK_WIFI_STR,
+                                                   POOL_TASK_SENSORS_STR,
+                                                   POOL_TASK_NTP_STR,
+                                                   POOL_TASK_CONTROL_STR,
+                                                   POOL_TASK_ANALOG_STR,
+                                                   POOL_TASK_CONFIG_STR,
+                                                   POOL_TASK_DISCOVERY_STR,
+                                                   POOL_TASK_HISTORY_STR,
+                                                   POOL_TASK_RELAY_STATS_STR,
+                                                   POOL_TASK_MQTT_STR,
+                                                   POOL_PROFILE_HARVEST_SENSORS_STR,
+                                                   POOL_PROFILE_POLL_NTP_STR,
+                                                   POOL_PROFILE_UPDATE_STR,
+                                                   POOL_PROFILE_MDNS_STR,
+                                                   POOL_PROFILE_OTA_STR,
+                                                   POOL_PROFILE_HTTP_STR,
+                                                   POOL_PROFILE_EVENTS_STR,
+                                                   POOL_PROFILE_DEBUG_STR,
+                                                   POOL_PROFILE_LOOP_STR,
+                                                   POOL_PROFILE_INPUT_TO_RELAY_STR};
+
 enum RelayState {
   POOL_RELAY_ON = 0,
   POOL_RELAY_OFF,
@@ -242,6 +677,16 @@ enum RelayState {
   POOL_RELAY_MANUAL_OFF, //ditto except until the next "on"
 };
 
+//What switched a relay (on/off time and switches are counted per cause)
+//NOTE: Keep these in parity with POOL_RELAY_CAUSE_STRINGS below
+enum PoolRelayCause {
+  POOL_RELAY_CAUSE_SCHEDULE = 0,
+  POOL_RELAY_CAUSE_MANUAL,  //POST /relays or the manual mode switch
+  POOL_RELAY_CAUSE_SOLAR,   //the solar heating logic
+  POOL_RELAY_CAUSE_SYSTEM,  //everything forced off (idle, no NTP, config load)
+  POOL_RELAY_NUM_CAUSES
+};
+
 static const char POOL_ERR_OK_STR[] = "no error";
 static const char POOL_ERR_NO_NTP_STR[] = "no NTP time";
 static const char POOL_ERR_NO_WIFI_STR[] = "no wifi";
@@ -299,5 +744,107 @@ static const char *POOL_RELAY_STATE_STRINGS[] = {POOL_RELAY_STATE_ON_STR,
                                             POOL_RELAY_STATE_MAN_ON_STR,
                                             POOL_RELAY_STATE_MAN_OFF_STR};
 
+static const char POOL_RELAY_CAUSE_SCHEDULE_STR[] = "schedule";
+static const char POOL_RELAY_CAUSE_MANUAL_STR[] = "manual";
+static const char POOL_RELAY_CAUSE_SOLAR_STR[] = "solar";
+static const char POOL_RELAY_CAUSE_SYSTEM_STR[] = "system";
+static const char *POOL_RELAY_CAUSE_STRINGS[] = {POOL_RELAY_CAUSE_SCHEDULE_STR,
+                                                 POOL_RELAY_CAUSE_MANUAL_STR,
+                                                 POOL_RELAY_CAUSE_SOLAR_STR,
+                                                 POOL_RELAY_CAUSE_SYSTEM_STR};
+
+static const char POOL_LOG_PROFILER_STR[] = "profiler";
+static const char POOL_LOG_VERBOSE_STR[] = "verbose";
+static const char POOL_LOG_DEBUG_STR[] = "debug";
+static const char POOL_LOG_INFO_STR[] = "info";
+static const char POOL_LOG_WARNING_STR[] = "warning";
+static const char POOL_LOG_ERROR_STR[] = "error";
+static const char POOL_LOG_ANY_STR[] = "any";
+static const char *POOL_LOG_LEVEL_STRINGS[] = {POOL_LOG_PROFILER_STR,
+                                               POOL_LOG_VERBOSE_STR,
+                                               POOL_LOG_DEBUG_STR,
+                                               POOL_LOG_INFO_STR,
+                                               POOL_LOG_WARNING_STR,
+                                               POOL_LOG_ERROR_STR,
+                                               POOL_LOG_ANY_STR};
+#define POOL_NUM_LOG_LEVELS 7
+
+//Deferred log events (see LogRing.h)
+//NOTE: Keep these in parity with POOL_LOG_EVENT_FORMATS below. The formats
+//      can only use d/i/u/x/X/c, f/e/g and s (any length modifier is ignored),
+//      and %s args have to be strings that never change (no name buffers)
+enum PoolLogEvent {
+  POOL_LOG_UPDATE_UNINITIALIZED = 0,
+  POOL_LOG_TASK_RUN,
+  POOL_LOG_SCHEDULE_EVALUATED,
+  POOL_LOG_SCHEDULE_COMPARE,
+  POOL_LOG_SCHEDULE_NO_OVERLAP,
+  POOL_LOG_SOLAR_NOT_SCHEDULED,
+  POOL_LOG_SOLAR_PUMP_OFF,
+  POOL_LOG_SOLAR_DISABLED,
+  POOL_LOG_SOLAR_ROOF_COLD,
+  POOL_LOG_SOLAR_WATER_HOT,
+  POOL_LOG_SOLAR_BYPASS,
+  POOL_LOG_SOLAR_ROOF_HOT,
+  POOL_LOG_SOLAR_WATER_COLD,
+  POOL_LOG_SOLAR_HEATING,
+  POOL_LOG_CONTROL_PASS,
+  POOL_LOG_RELAY_OUTPUTS,
+  POOL_LOG_SENSORS_CONVERT,
+  POOL_LOG_SENSORS_READ,
+  POOL_LOG_SENSORS_PROBLEMS,
+  POOL_LOG_ANALOG_TEMP,
+  POOL_LOG_ANALOG_INVALID,
+  POOL_LOG_ANALOG_RAW,
+  POOL_LOG_HISTORY_NO_CLOCK,
+  POOL_NUM_LOG_EVENTS
+};
+
+static const char POOL_LOG_UPDATE_UNINITIALIZED_STR[] PROGMEM = "update() called with uninitialized PoolController, bailing...";
+static const char POOL_LOG_TASK_RUN_STR[] PROGMEM = "Running task \"%s\"";
+static const char POOL_LOG_SCHEDULE_EVALUATED_STR[] PROGMEM = "Schedule evaluated at %lu (bits 0x%02x), next transition at %lu";
+static const char POOL_LOG_SCHEDULE_COMPARE_STR[] PROGMEM = "Compare overlap: %lu/%lu and %lu/%lu";
+static const char POOL_LOG_SCHEDULE_NO_OVERLAP_STR[] PROGMEM = "No overlap found!";
+static const char POOL_LOG_SOLAR_NOT_SCHEDULED_STR[] PROGMEM = "Pool state is not set to run schedule. Disabling solar logic";
+static const char POOL_LOG_SOLAR_PUMP_OFF_STR[] PROGMEM = "Pool pump is not running, disabling solar logic";
+static const char POOL_LOG_SOLAR_DISABLED_STR[] PROGMEM = "Solar heating is disabled, ensuring our solar relay is off";
+static const char POOL_LOG_SOLAR_ROOF_COLD_STR[] PROGMEM = "Roof temperature (%.2f) is lower than the setpoint (%.2f) + fudge (%.2f)";
+static const char POOL_LOG_SOLAR_WATER_HOT_STR[] PROGMEM = "Water temperature (%.2f) is higher than the setpoint (%.2f) + fudge (%.2f)";
+static const char POOL_LOG_SOLAR_BYPASS_STR[] PROGMEM = "Solar bypass engaged";
+static const char POOL_LOG_SOLAR_ROOF_HOT_STR[] PROGMEM = "Roof temperature (%.2f) is hot enough above the setpoint (%.2f) + fudge (%.2f)";
+static const char POOL_LOG_SOLAR_WATER_COLD_STR[] PROGMEM = "Water temperature (%.2f) is below than the setpoint (%.2f) + fudge (%.2f)";
+static const char POOL_LOG_SOLAR_HEATING_STR[] PROGMEM = "Solar heating engaged";
+static const char POOL_LOG_CONTROL_PASS_STR[] PROGMEM = "Control pass (mode %s, solar %s)";
+static const char POOL_LOG_RELAY_OUTPUTS_STR[] PROGMEM = "Relay outputs changed (0x%02x)";
+static const char POOL_LOG_SENSORS_CONVERT_STR[] PROGMEM = "Starting 1-wire temperature conversion";
+static const char POOL_LOG_SENSORS_READ_STR[] PROGMEM = "Reading finished 1-wire temperature conversion";
+static const char POOL_LOG_SENSORS_PROBLEMS_STR[] PROGMEM = "Logging any sensor problems";
+static const char POOL_LOG_ANALOG_TEMP_STR[] PROGMEM = "Analog sensor temp(f): %f";
+static const char POOL_LOG_ANALOG_INVALID_STR[] PROGMEM = "Invalid temperature from analog sensor detected (%f), setting it to an error value";
+static const char POOL_LOG_ANALOG_RAW_STR[] PROGMEM = "Thermistor raw (0-%d): %d filtered: %.1f";
+static const char POOL_LOG_HISTORY_NO_CLOCK_STR[] PROGMEM = "Clock isn't set yet, not recording history";
+static const char *POOL_LOG_EVENT_FORMATS[] = {POOL_LOG_UPDATE_UNINITIALIZED_STR,
+                                               POOL_LOG_TASK_RUN_STR,
+                                               POOL_LOG_SCHEDULE_EVALUATED_STR,
+                                               POOL_LOG_SCHEDULE_COMPARE_STR,
+                                               POOL_LOG_SCHEDULE_NO_OVERLAP_STR,
+                                               POOL_LOG_SOLAR_NOT_SCHEDULED_STR,
+                                               POOL_LOG_SOLAR_PUMP_OFF_STR,
+                                               POOL_LOG_SOLAR_DISABLED_STR,
+                                               POOL_LOG_SOLAR_ROOF_COLD_STR,
+                                               POOL_LOG_SOLAR_WATER_HOT_STR,
+                                               POOL_LOG_SOLAR_BYPASS_STR,
+                                               POOL_LOG_SOLAR_ROOF_HOT_STR,
+                                               POOL_LOG_SOLAR_WATER_COLD_STR,
+                                               POOL_LOG_SOLAR_HEATING_STR,
+                                               POOL_LOG_CONTROL_PASS_STR,
+                                               POOL_LOG_RELAY_OUTPUTS_STR,
+                                               POOL_LOG_SENSORS_CONVERT_STR,
+                                               POOL_LOG_SENSORS_READ_STR,
+                                               POOL_LOG_SENSORS_PROBLEMS_STR,
+                                               POOL_LOG_ANALOG_TEMP_STR,
+                                               POOL_LOG_ANALOG_INVALID_STR,
+                                               POOL_LOG_ANALOG_RAW_STR,
+                                               POOL_LOG_HISTORY_NO_CLOCK_STR};
 
 #endif
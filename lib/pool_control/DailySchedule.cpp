@@ -1,5 +1,11 @@
 #include "DailySchedule.h"
 
+unsigned long timeOfDay(int h, int m, int s){
+  return (long)h * SECS_PER_HOUR +
+         (long)m * SECS_PER_MIN +
+         (long)s;
+}
+
 PoolDailySchedule::PoolDailySchedule(){
   num_schedules = 0;
 }
@@ -13,3 +19,69 @@ byte PoolDailySchedule::PoolValidateSchedule(){
   return 0;
 }
 
+byte PoolDailySchedule::add(unsigned long on_sod, unsigned long off_sod){
+  if (num_schedules >= MAX_SCHEDULES || on_sod >= SECS_PER_DAY || off_sod >= SECS_PER_DAY){
+    return 0;
+  }
+  on_time[num_schedules].Hour = on_sod / SECS_PER_HOUR;
+  on_time[num_schedules].Minute = (on_sod / SECS_PER_MIN) % 60;
+  on_time[num_schedules].Second = on_sod % 60;
+  off_time[num_schedules].Hour = off_sod / SECS_PER_HOUR;
+  off_time[num_schedules].Minute = (off_sod / SECS_PER_MIN) % 60;
+  off_time[num_schedules].Second = off_sod % 60;
+  num_schedules++;
+  return 1;
+}
+
+void PoolDailySchedule::compile(){
+  for (int x=0;x<num_schedules;x++){
+    on_secs[x] = timeOfDay(on_time[x].Hour,on_time[x].Minute,on_time[x].Second);
+    off_secs[x] = timeOfDay(off_time[x].Hour,off_time[x].Minute,off_time[x].Second);
+  }
+
+  //Insertion sort by on time (there's only ever a handful of entries)
+  for (int x=1;x<num_schedules;x++){
+    TimeElements on = on_time[x], off = off_time[x];
+    unsigned long ons = on_secs[x], ofs = off_secs[x];
+    int y = x - 1;
+    while (y >= 0 && on_secs[y] > ons){
+      on_time[y+1] = on_time[y];
+      off_time[y+1] = off_time[y];
+      on_secs[y+1] = on_secs[y];
+      off_secs[y+1] = off_secs[y];
+      y--;
+    }
+    on_time[y+1] = on;
+    off_time[y+1] = off;
+    on_secs[y+1] = ons;
+    off_secs[y+1] = ofs;
+  }
+}
+
+int PoolDailySchedule::entryAt(unsigned long sod){
+  int lo = 0, hi = num_schedules;
+  while (lo < hi){
+    int mid = (lo + hi) / 2;
+    if (on_secs[mid] <= sod) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo - 1;
+}
+
+byte PoolDailySchedule::isOnAt(unsigned long sod){
+  int x = entryAt(sod);
+  return (x >= 0 && sod < off_secs[x]) ? 1 : 0;
+}
+
+unsigned long PoolDailySchedule::nextTransition(unsigned long sod){
+  if (num_schedules == 0) return POOL_SCHEDULE_NO_TRANSITION;
+
+  int x = entryAt(sod);
+
+  //In the middle of a range, it ends next
+  if (x >= 0 && sod < off_secs[x]) return off_secs[x];
+
+  //Otherwise the next one starts (or the first one tomorrow)
+  if (x + 1 < num_schedules) return on_secs[x + 1];
+  return SECS_PER_DAY + on_secs[0];
+}
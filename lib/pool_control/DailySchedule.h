@@ -5,17 +5,43 @@
 #include <TimeLib.h>
 #include "Constants.h"
 
+//Seconds since midnight
+unsigned long timeOfDay(int h, int m, int s);
+
 class PoolDailySchedule{
   public:
     TimeElements on_time[MAX_SCHEDULES];
     TimeElements off_time[MAX_SCHEDULES];
     int num_schedules;
 
+    //Compiled form of the above (seconds since midnight, sorted by on time).
+    //Filled in by compile(), the ranges can't overlap (parseDailySchedule()
+    //rejects that) so both arrays end up sorted.
+    unsigned long on_secs[MAX_SCHEDULES];
+    unsigned long off_secs[MAX_SCHEDULES];
+
     PoolDailySchedule();
     void clear();
     byte PoolValidateSchedule();
 
-  
+    //Sort the entries and build on_secs/off_secs (call after changing on/off_time)
+    void compile();
+
+    //Append an entry given in seconds since midnight (call compile() after).
+    //Returns 0 if it's full or the times are out of range.
+    byte add(unsigned long on_sod, unsigned long off_sod);
+
+    //Returns 1 if the schedule has us on at sod (seconds since midnight)
+    byte isOnAt(unsigned long sod);
+
+    //Returns the next on/off edge after sod (seconds since midnight, values
+    //past SECS_PER_DAY are tomorrow) or POOL_SCHEDULE_NO_TRANSITION if the
+    //schedule is empty
+    unsigned long nextTransition(unsigned long sod);
+
+  private:
+    //Index of the last entry that turns on at or before sod, -1 if none
+    int entryAt(unsigned long sod);
 };
 
 #endif
@@ -0,0 +1,160 @@
+#include "EventStream.h"
+
+static const char POOL_EVENTS_HEADERS[] PROGMEM =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-Type: text/event-stream\r\n"
+  "Cache-Control: no-cache\r\n"
+  "Connection: keep-alive\r\n"
+  "Access-Control-Allow-Origin: *\r\n\r\n";
+
+PoolEventStream::PoolEventStream(){
+  for (int x = 0; x < POOL_EVENTS_MAX_CLIENTS; x++){
+    clients[x].active = 0;
+    clients[x].length = 0;
+    clients[x].last_write = 0;
+  }
+  for (int x = 0; x < MAX_SENSORS; x++){
+    sent_sensor_names[x] = 0;
+    sent_sensor_temps[x] = 0;
+  }
+  temp_deadband = POOL_EVENTS_TEMP_DEADBAND;
+  event_length = 0;
+  event_overflow = 0;
+  next_id = 1;
+  subscribes = 0;
+  rejected = 0;
+  overflows = 0;
+  disconnects = 0;
+  bytes_sent = 0;
+}
+
+byte PoolEventStream::subscribe(WiFiClient& client, unsigned long now){
+  for (int x = 0; x < POOL_EVENTS_MAX_CLIENTS; x++){
+    PoolEventClient& c = clients[x];
+    if (c.active) continue;
+
+    c.client = client;
+    c.client.setNoDelay(true);
+    c.active = 1;
+    c.length = 0;
+    c.last_write = now;
+
+    //Headers go out through the buffer like everything else
+    char retry[24];
+    int n = snprintf(retry, sizeof(retry), "retry: %d\n\n", POOL_EVENTS_RETRY_MS);
+    queue(c, POOL_EVENTS_HEADERS, strlen_P(POOL_EVENTS_HEADERS));
+    queue(c, retry, n);
+    subscribes++;
+    return 1;
+  }
+  rejected++;
+  return 0;
+}
+
+int PoolEventStream::numClients(){
+  int n = 0;
+  for (int x = 0; x < POOL_EVENTS_MAX_CLIENTS; x++){
+    if (clients[x].active) n++;
+  }
+  return n;
+}
+
+byte PoolEventStream::begin(const char* name){
+  if (numClients() == 0) return 0;
+
+  event_overflow = 0;
+  event_length = snprintf(event, sizeof(event), "id: %lu\nevent: %s\ndata: ", next_id, name);
+  if (event_length >= sizeof(event)) event_overflow = 1;
+  return 1;
+}
+
+size_t PoolEventStream::write(uint8_t c){
+  return write(&c, 1);
+}
+
+size_t PoolEventStream::write(const uint8_t* data, size_t size){
+  //Leave room for the blank line that ends the event
+  if (event_overflow || event_length + size > sizeof(event) - 2){
+    event_overflow = 1;
+    return 0;
+  }
+  memcpy(event + event_length, data, size);
+  event_length += size;
+  return size;
+}
+
+void PoolEventStream::end(){
+  if (event_overflow){
+    return;
+  }
+  event[event_length++] = '\n';
+  event[event_length++] = '\n';
+  next_id++;
+
+  for (int x = 0; x < POOL_EVENTS_MAX_CLIENTS; x++){
+    PoolEventClient& c = clients[x];
+    if (!c.active) continue;
+
+    if (c.length + event_length > sizeof(c.buffer)){
+      overflows++;
+      drop(c);
+      continue;
+    }
+    queue(c, event, event_length);
+  }
+}
+
+void PoolEventStream::queue(PoolEventClient& c, const char* data, size_t size){
+  if (c.length + size > sizeof(c.buffer)) return;
+  memcpy_P(c.buffer + c.length, data, size);
+  c.length += size;
+}
+
+void PoolEventStream::drop(PoolEventClient& c){
+  c.client.stop();
+  c.client = WiFiClient();
+  c.active = 0;
+  c.length = 0;
+}
+
+void PoolEventStream::handle(unsigned long now){
+  for (int x = 0; x < POOL_EVENTS_MAX_CLIENTS; x++){
+    PoolEventClient& c = clients[x];
+    if (!c.active) continue;
+
+    if (!c.client.connected()){
+      disconnects++;
+      drop(c);
+      continue;
+    }
+
+    //A comment line every so often, so we notice clients that went away
+    if (c.length == 0 && now - c.last_write >= POOL_EVENTS_KEEPALIVE_MS){
+      queue(c, ":\n\n", 3);
+    }
+    if (c.length == 0) continue;
+
+    //Only what fits in the socket's send window (write() would block)
+    size_t n = c.client.availableForWrite();
+    if (n > c.length) n = c.length;
+    if (n == 0) continue;
+
+    size_t sent = c.client.write((const uint8_t*)c.buffer, n);
+    if (sent > 0){
+      memmove(c.buffer, c.buffer + sent, c.length - sent);
+      c.length -= sent;
+      c.last_write = now;
+      bytes_sent += sent;
+    }
+  }
+}
+
+byte PoolEventStream::tempChanged(int sensor, uint32_t name_hash, float temp){
+  if (name_hash == sent_sensor_names[sensor] &&
+      fabs(temp - sent_sensor_temps[sensor]) < temp_deadband){
+    return 0;
+  }
+  sent_sensor_names[sensor] = name_hash;
+  sent_sensor_temps[sensor] = temp;
+  return 1;
+}
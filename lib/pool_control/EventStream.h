@@ -0,0 +1,81 @@
+#ifndef _EVENT_STREAM_H
+#define _EVENT_STREAM_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include "Constants.h"
+
+//One GET /events subscriber
+struct PoolEventClient {
+  WiFiClient client;
+  byte active;
+  char buffer[POOL_EVENTS_CLIENT_BUFFER]; //waiting to go out
+  size_t length;
+  unsigned long last_write; //millis()
+};
+
+/*
+  Server-Sent Events to up to POOL_EVENTS_MAX_CLIENTS subscribers. The
+  HTTP handler hands the request's connection to subscribe() and returns;
+  from then on the connection belongs to us. Events are written in one go
+  to every subscriber's buffer:
+
+    if (events.begin("relay")){
+      serializeJson(doc, events); //the data (one line)
+      events.end();
+    }
+
+  and handle() (every loop()) sends as much of each buffer as the socket
+  will take without blocking, so a slow client never holds up the loop.
+  A subscriber whose buffer can't take an event is dropped rather than
+  sent a stream with holes in it.
+*/
+class PoolEventStream : public Print {
+  public:
+    PoolEventClient clients[POOL_EVENTS_MAX_CLIENTS];
+
+    //Sensor temperatures have to move this far (degF) to be sent
+    float temp_deadband;
+
+    //Stats
+    unsigned long next_id;     //id of the next event
+    unsigned long subscribes;
+    unsigned long rejected;    //turned away, every slot was taken
+    unsigned long overflows;   //dropped for falling too far behind
+    unsigned long disconnects;
+    unsigned long bytes_sent;
+
+    PoolEventStream();
+
+    //Take over a request's connection (sends the response headers).
+    //Returns 0 if there's no room for another subscriber.
+    byte subscribe(WiFiClient& client, unsigned long now);
+
+    int numClients();
+
+    //Start an event, returns 0 (skip building it) if nobody's listening
+    byte begin(const char* event);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* data, size_t size);
+    void end();
+
+    //Send what's buffered, keep idle connections alive, reap closed ones
+    void handle(unsigned long now);
+
+    //Returns 1 if a sensor moved past the deadband since it was last sent
+    //(and remembers temp as sent)
+    byte tempChanged(int sensor, uint32_t name_hash, float temp);
+
+  private:
+    char event[POOL_EVENTS_MAX_EVENT];
+    size_t event_length;
+    byte event_overflow;
+
+    uint32_t sent_sensor_names[MAX_SENSORS];
+    float sent_sensor_temps[MAX_SENSORS];
+
+    void queue(PoolEventClient& c, const char* data, size_t size);
+    void drop(PoolEventClient& c);
+};
+
+#endif
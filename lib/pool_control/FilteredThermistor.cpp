@@ -0,0 +1,97 @@
+#include "FilteredThermistor.h"
+#include <math.h>
+
+FilteredThermistor::FilteredThermistor(int pin){
+  this->pin = pin;
+  next_sample = 0;
+  num_samples = 0;
+  median_depth = POOL_THERM_DEFAULT_FILTER_DEPTH;
+  ema_alpha = POOL_THERM_DEFAULT_EMA_ALPHA;
+  filtered_adc = 0.0;
+  last_raw = 0;
+}
+
+void FilteredThermistor::sample(){
+  last_raw = analogRead(pin);
+
+  samples[next_sample] = last_raw;
+  next_sample = (next_sample + 1) % POOL_THERM_MAX_FILTER_DEPTH;
+  if (num_samples < POOL_THERM_MAX_FILTER_DEPTH){
+    num_samples++;
+  }
+
+  float median = medianOfRecent();
+
+  //Prime the smoother with the first reading so we don't ramp up from 0
+  if (num_samples == 1){
+    filtered_adc = median;
+  }
+  else{
+    filtered_adc += ema_alpha * (median - filtered_adc);
+  }
+}
+
+byte FilteredThermistor::validFilter(int median_depth, float ema_alpha){
+  if (median_depth < 1 || median_depth > POOL_THERM_MAX_FILTER_DEPTH) return 0;
+  if (!(ema_alpha > 0.0 && ema_alpha <= 1.0)) return 0; //NaN too
+  return 1;
+}
+
+byte FilteredThermistor::setFilter(int median_depth, float ema_alpha){
+  if (!validFilter(median_depth, ema_alpha)) return 0;
+
+  this->median_depth = median_depth;
+  this->ema_alpha = ema_alpha;
+  return 1;
+}
+
+float FilteredThermistor::medianOfRecent(){
+  int sorted[POOL_THERM_MAX_FILTER_DEPTH];
+  int n = (num_samples < median_depth) ? num_samples : median_depth;
+
+  //Copy the newest n samples (walking back from the write index)
+  //and insertion sort them (n is tiny)
+  for (int x = 0;x < n; x++){
+    int idx = (next_sample - 1 - x + POOL_THERM_MAX_FILTER_DEPTH) % POOL_THERM_MAX_FILTER_DEPTH;
+    int v = samples[idx];
+    int y = x - 1;
+    while (y >= 0 && sorted[y] > v){
+      sorted[y+1] = sorted[y];
+      y--;
+    }
+    sorted[y+1] = v;
+  }
+
+  if (n & 1){
+    return sorted[n/2];
+  }
+  return (sorted[n/2 - 1] + sorted[n/2]) / 2.0;
+}
+
+float FilteredThermistor::adcToTempF(float adc){
+  //Same math (and doubles) as the Thermistor library's readTempC() this
+  //replaced, just on our filtered reading instead of its blocking average.
+  //The thermistor is the bottom of the divider:
+  //  R = series / ((adc_max * vcc) / (vref * adc) - 1)
+  if (adc <= 0.0){
+    return POOL_TEMP_SENSOR_MISSING;
+  }
+  double ratio = ((double)POOL_THERM_ADC_MAX * POOL_THERM_VCC) / (POOL_THERM_VREF * adc) - 1.0;
+  if (ratio <= 0.0){
+    return POOL_TEMP_SENSOR_MISSING;
+  }
+  double resistance = POOL_THERM_SERIES_RES / ratio;
+
+  //Beta equation: 1/T = 1/T0 + ln(R/R0)/B
+  double steinhart = log(resistance / POOL_THERM_NOM_RES) / POOL_THERM_BETA;
+  steinhart += 1.0 / (POOL_THERM_NOM_TEMP_C + 273.15);
+  double celsius = 1.0 / steinhart - 273.15;
+  return celsius * 9.0 / 5.0 + 32.0;
+}
+
+float FilteredThermistor::readTempF(){
+  if (num_samples == 0){
+    return POOL_TEMP_SENSOR_MISSING;
+  }
+  return adcToTempF(filtered_adc);
+}
@@ -0,0 +1,52 @@
+#ifndef _FILTERED_THERMISTOR_H
+#define _FILTERED_THERMISTOR_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  FilteredThermistor replaces the blocking Thermistor::readTempF() (which took
+  several samples with delay()s in between). Instead, sample() takes a single ADC
+  reading and is called at a fixed rate (the "analog" task). Readings go into a
+  ring buffer, we take the median of the last median_depth of them (the ESP8266
+  ADC is noisy/spiky) and run that through an exponential smoother. readTempF()
+  just hands back the latest filtered value, so it costs nothing.
+*/
+class FilteredThermistor {
+  public:
+    int pin;
+
+    //Ring buffer of raw ADC readings
+    int samples[POOL_THERM_MAX_FILTER_DEPTH];
+    int next_sample;
+    int num_samples;
+
+    //Filter settings
+    int median_depth;
+    float ema_alpha; //0 < alpha <= 1, 1 is no smoothing
+
+    //Latest filtered ADC value (0 - POOL_THERM_ADC_MAX)
+    float filtered_adc;
+    int last_raw;
+
+    FilteredThermistor(int pin);
+
+    //Take one reading and update the filtered value
+    void sample();
+
+    //Returns 1 if the settings are valid (and applied), 0 otherwise
+    byte setFilter(int median_depth, float ema_alpha);
+    static byte validFilter(int median_depth, float ema_alpha);
+
+    //Latest filtered temp (deg F), or POOL_TEMP_SENSOR_MISSING if we don't have
+    //any samples yet
+    float readTempF();
+
+    //Median of the last median_depth raw readings
+    float medianOfRecent();
+
+    //Voltage divider + beta equation conversion
+    float adcToTempF(float adc);
+};
+
+#endif
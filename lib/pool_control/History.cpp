@@ -0,0 +1,226 @@
+#include "History.h"
+#include "Names.h"
+#include <TimeLib.h>
+#include <math.h>
+
+void PoolHistoryTier::begin(unsigned long bucket_secs, PoolHistoryBucket* storage, int capacity){
+  this->bucket_secs = bucket_secs;
+  this->buckets = storage;
+  this->capacity = capacity;
+  clear();
+}
+
+void PoolHistoryTier::clear(){
+  head = capacity - 1;
+  count = 0;
+  newest = 0;
+  acc.samples = 0;
+}
+
+byte PoolHistoryTier::add(unsigned long t, const int16_t* temps, byte relay_bits){
+  unsigned long b = t / bucket_secs;
+  byte cleared = 0;
+
+  if (acc.samples > 0 && b != acc.bucket){
+    if (b > acc.bucket){
+      close();
+    }
+    //The clock went back a little (NTP nudging it), keep filling the open bucket
+    else if (acc.bucket - b <= 1){
+      b = acc.bucket;
+    }
+    //Or a lot (time zone change, someone set it by hand), start over
+    else {
+      clear();
+      cleared = 1;
+    }
+  }
+
+  if (acc.samples == 0){
+    acc.bucket = b;
+    for (int x = 0; x < POOL_HISTORY_TEMP_SERIES; x++){
+      acc.sum[x] = 0;
+      acc.readings[x] = 0;
+    }
+    for (int x = 0; x < MAX_RELAY; x++){
+      acc.on[x] = 0;
+    }
+  }
+
+  acc.samples++;
+  for (int x = 0; x < POOL_HISTORY_TEMP_SERIES; x++){
+    int16_t v = temps[x];
+    if (v == POOL_HISTORY_NO_DATA) continue;
+    if (acc.readings[x] == 0 || v < acc.min[x]) acc.min[x] = v;
+    if (acc.readings[x] == 0 || v > acc.max[x]) acc.max[x] = v;
+    acc.sum[x] += v;
+    acc.readings[x]++;
+  }
+  for (int x = 0; x < MAX_RELAY; x++){
+    acc.on[x] += (relay_bits >> x) & 1;
+  }
+  return cleared;
+}
+
+//Half degrees (rounded up, so min/max are never inside the real range)
+static uint8_t tenthsToHalfDegrees(int32_t tenths){
+  int32_t halves = (tenths + 4) / 5;
+  return (halves > 255) ? 255 : (uint8_t)halves;
+}
+
+void PoolHistoryTier::rollup(PoolHistoryBucket& b){
+  for (int x = 0; x < POOL_HISTORY_TEMP_SERIES; x++){
+    PoolTempRollup& r = b.temps[x];
+    if (acc.readings[x] == 0){
+      r.avg = POOL_HISTORY_NO_DATA;
+      r.below = 0;
+      r.above = 0;
+      continue;
+    }
+    int32_t n = acc.readings[x];
+    int32_t avg = (acc.sum[x] >= 0) ? (acc.sum[x] + n / 2) / n : (acc.sum[x] - n / 2) / n;
+    r.avg = avg;
+    r.below = tenthsToHalfDegrees(avg - acc.min[x]);
+    r.above = tenthsToHalfDegrees(acc.max[x] - avg);
+  }
+
+  b.relay_duty = 0;
+  for (int x = 0; x < MAX_RELAY; x++){
+    uint32_t duty = (acc.on[x] * POOL_HISTORY_DUTY_STEPS + acc.samples / 2) / acc.samples;
+    b.relay_duty |= duty << (x * 4);
+  }
+}
+
+void PoolHistoryTier::push(PoolHistoryBucket& b){
+  head = (head + 1) % capacity;
+  buckets[head] = b;
+  if (count < capacity) count++;
+}
+
+void PoolHistoryTier::close(){
+  PoolHistoryBucket b;
+  rollup(b);
+
+  //Keep the ring contiguous across anything we missed
+  if (count > 0){
+    PoolHistoryBucket empty;
+    for (int x = 0; x < POOL_HISTORY_TEMP_SERIES; x++){
+      empty.temps[x].avg = POOL_HISTORY_NO_DATA;
+      empty.temps[x].below = 0;
+      empty.temps[x].above = 0;
+    }
+    empty.relay_duty = POOL_HISTORY_EMPTY_DUTY;
+
+    unsigned long gap = acc.bucket - newest;
+    for (unsigned long x = 1; x < gap && x <= (unsigned long)capacity; x++){
+      push(empty);
+    }
+  }
+
+  push(b);
+  newest = acc.bucket;
+  acc.samples = 0;
+}
+
+byte PoolHistoryTier::writeJSONPoint(Print& out, int series, unsigned long bucket, PoolHistoryBucket& b, byte first){
+  unsigned long t = bucket * bucket_secs;
+  const char* sep = first ? "" : ",";
+
+  if (series < POOL_HISTORY_TEMP_SERIES){
+    PoolTempRollup& r = b.temps[series];
+    if (r.avg == POOL_HISTORY_NO_DATA) return 0;
+    out.printf("%s[%lu,%.1f,%.1f,%.1f]", sep, t,
+               (r.avg - r.below * 5) / 10.0, r.avg / 10.0, (r.avg + r.above * 5) / 10.0);
+    return 1;
+  }
+
+  if (b.relay_duty == POOL_HISTORY_EMPTY_DUTY) return 0;
+  int duty = (b.relay_duty >> ((series - POOL_HISTORY_TEMP_SERIES) * 4)) & 0xF;
+  out.printf("%s[%lu,%d,%.2f,%d]", sep, t, (duty == POOL_HISTORY_DUTY_STEPS) ? 1 : 0,
+             (float)duty / POOL_HISTORY_DUTY_STEPS, (duty > 0) ? 1 : 0);
+  return 1;
+}
+
+int PoolHistoryTier::writeJSONPoints(Print& out, int series, unsigned long from, unsigned long to){
+  unsigned long first = from / bucket_secs;
+  unsigned long last = to / bucket_secs;
+  int n = 0;
+
+  //Straight to the buckets in range, nothing else gets looked at
+  if (count > 0){
+    unsigned long oldest = newest - count + 1;
+    unsigned long b = (first > oldest) ? first : oldest;
+    unsigned long end = (last < newest) ? last : newest;
+    for (; b <= end; b++){
+      int idx = (head - (int)(newest - b) + capacity) % capacity;
+      if (writeJSONPoint(out, series, b, buckets[idx], n == 0)) n++;
+    }
+  }
+
+  //The bucket we're still filling
+  if (acc.samples > 0 && acc.bucket >= first && acc.bucket <= last){
+    PoolHistoryBucket open;
+    rollup(open);
+    if (writeJSONPoint(out, series, acc.bucket, open, n == 0)) n++;
+  }
+  return n;
+}
+
+PoolHistory::PoolHistory(){
+  tiers[0].begin(POOL_HISTORY_SAMPLE_SECS, raw, POOL_HISTORY_RAW_BUCKETS);
+  tiers[1].begin(5 * SECS_PER_MIN, five_min, POOL_HISTORY_5MIN_BUCKETS);
+  tiers[2].begin(POOL_HISTORY_LONG_SECS, long_term, POOL_HISTORY_LONG_BUCKETS);
+  samples = 0;
+  clears = 0;
+}
+
+void PoolHistory::clear(){
+  for (int x = 0; x < POOL_HISTORY_NUM_TIERS; x++){
+    tiers[x].clear();
+  }
+}
+
+void PoolHistory::record(unsigned long t, const float* temps, byte relay_bits){
+  int16_t tenths[POOL_HISTORY_TEMP_SERIES];
+  for (int x = 0; x < POOL_HISTORY_TEMP_SERIES; x++){
+    float f = temps[x];
+    if (f == (float)POOL_TEMP_SENSOR_MISSING || f < -1000.0 || f > 1000.0){
+      tenths[x] = POOL_HISTORY_NO_DATA;
+    }
+    else {
+      tenths[x] = (int16_t)lroundf(f * 10.0);
+    }
+  }
+
+  byte cleared = 0;
+  for (int x = 0; x < POOL_HISTORY_NUM_TIERS; x++){
+    cleared |= tiers[x].add(t, tenths, relay_bits);
+  }
+  clears += cleared;
+  samples++;
+}
+
+int PoolHistory::pickTier(unsigned long resolution_secs, unsigned long from, unsigned long now){
+  for (int x = 0; x < POOL_HISTORY_NUM_TIERS; x++){
+    PoolHistoryTier& t = tiers[x];
+    if (resolution_secs > 0){
+      if (t.bucket_secs >= resolution_secs) return x;
+    }
+    else if (from >= now || now - from <= t.bucket_secs * (unsigned long)t.capacity){
+      return x;
+    }
+  }
+  return POOL_HISTORY_NUM_TIERS - 1;
+}
+
+int PoolHistory::tempSeries(const char* role){
+  for (int x = 0; x < POOL_HISTORY_TEMP_SERIES; x++){
+    if (POOL_NAME_IS(role, TSR_STRINGS[x])) return x;
+  }
+  return -1;
+}
+
+size_t PoolHistory::memoryUsed(){
+  return sizeof(PoolHistoryBucket) *
+         (POOL_HISTORY_RAW_BUCKETS + POOL_HISTORY_5MIN_BUCKETS + POOL_HISTORY_LONG_BUCKETS);
+}
@@ -0,0 +1,118 @@
+#ifndef _HISTORY_H
+#define _HISTORY_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  A temperature rollup in 4 bytes: the average in tenths of a degF and
+  how far below/above it the min/max were (half degrees, clamped).
+*/
+struct PoolTempRollup {
+  int16_t avg;   //POOL_HISTORY_NO_DATA if there weren't any readings
+  uint8_t below; //avg - min
+  uint8_t above; //max - avg
+};
+
+/*
+  One bucket of one tier, for every series: the temperature roles
+  (POOL_HISTORY_TEMP_SERIES, in TSR_STRINGS order) and the relays, whose
+  on-time is kept in POOL_HISTORY_DUTY_STEPS-ths of the bucket, 4 bits
+  each (relay x in bits 4x..4x+3). Min/max for a relay fall out of the
+  duty (it was on the whole time/at some point).
+*/
+struct PoolHistoryBucket {
+  PoolTempRollup temps[POOL_HISTORY_TEMP_SERIES];
+  uint32_t relay_duty; //POOL_HISTORY_EMPTY_DUTY if there weren't any samples
+};
+
+static_assert(MAX_RELAY * 4 <= 32, "relay duties are 4 bits each in a uint32_t");
+static_assert((24 * 3600UL) % POOL_HISTORY_LONG_SECS == 0, "long term rollups have to line up with days");
+
+/*
+  Running min/sum/max of the samples in the bucket that's still open
+*/
+struct PoolHistoryAccumulator {
+  unsigned long bucket; //bucket number (unix secs / bucket_secs)
+  unsigned int samples;
+  int32_t sum[POOL_HISTORY_TEMP_SERIES]; //tenths
+  int16_t min[POOL_HISTORY_TEMP_SERIES];
+  int16_t max[POOL_HISTORY_TEMP_SERIES];
+  unsigned int readings[POOL_HISTORY_TEMP_SERIES]; //samples the sensor was there for
+  unsigned int on[MAX_RELAY];
+};
+
+/*
+  Ring of fixed-width buckets (newest at head). Every sample goes straight
+  into the open bucket's accumulator and the bucket is rolled up when a
+  sample lands past it, so nothing ever rescans older data. Buckets are
+  contiguous in time; one with no samples (the clock jumped, the task
+  stalled) is stored empty.
+*/
+class PoolHistoryTier {
+  public:
+    unsigned long bucket_secs;
+    PoolHistoryBucket* buckets;
+    int capacity;
+    int head;              //newest closed bucket
+    int count;             //closed buckets held
+    unsigned long newest;  //bucket number of buckets[head]
+    PoolHistoryAccumulator acc;
+
+    void begin(unsigned long bucket_secs, PoolHistoryBucket* storage, int capacity);
+    void clear();
+
+    //Returns 1 if the clock went backwards far enough that we started over
+    byte add(unsigned long t, const int16_t* temps, byte relay_bits);
+
+    //Stream the buckets between from and to (unix secs, inclusive, the open
+    //bucket included) for one series as [time,min,avg,max] JSON arrays
+    //NOTE: series < POOL_HISTORY_TEMP_SERIES is a temperature, otherwise
+    //      it's relay (series - POOL_HISTORY_TEMP_SERIES)
+    //Returns the number of points written
+    int writeJSONPoints(Print& out, int series, unsigned long from, unsigned long to);
+
+  private:
+    void close();
+    void push(PoolHistoryBucket& b);
+    void rollup(PoolHistoryBucket& b);
+    byte writeJSONPoint(Print& out, int series, unsigned long bucket, PoolHistoryBucket& b, byte first);
+};
+
+/*
+  Temperature/relay history for the last POOL_HISTORY_DAYS days in fixed
+  memory: raw samples (every POOL_HISTORY_SAMPLE_SECS) for the last hour,
+  5 minute rollups for the last day and POOL_HISTORY_LONG_SECS (3 hour)
+  ones for the rest. Each
+  sample feeds all three tiers.
+*/
+class PoolHistory {
+  public:
+    PoolHistoryTier tiers[POOL_HISTORY_NUM_TIERS]; //finest first
+    unsigned long samples;
+    unsigned long clears; //times the clock went backwards and we started over
+
+    PoolHistory();
+    void clear();
+
+    //temps are deg F (POOL_TEMP_SENSOR_MISSING if not available), bit x of
+    //relay_bits is relay x being on
+    void record(unsigned long t, const float* temps, byte relay_bits);
+
+    //Returns the tier whose bucket is resolution_secs (or the finest one
+    //coarser than that), or if it's 0 the finest one that goes back to from
+    int pickTier(unsigned long resolution_secs, unsigned long from, unsigned long now);
+
+    //Returns the series for a TSR_* role name, -1 if it isn't one
+    static int tempSeries(const char* role);
+
+    //Bytes of samples/rollups we hold on to
+    static size_t memoryUsed();
+
+  private:
+    PoolHistoryBucket raw[POOL_HISTORY_RAW_BUCKETS];
+    PoolHistoryBucket five_min[POOL_HISTORY_5MIN_BUCKETS];
+    PoolHistoryBucket long_term[POOL_HISTORY_LONG_BUCKETS];
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "JsonArena.h"
+
+#define POOL_JSON_ARENA_ROUND(x) (((x) + POOL_JSON_ARENA_ALIGN - 1) & ~(size_t)(POOL_JSON_ARENA_ALIGN - 1))
+
+static uint8_t arena_buffer[POOL_JSON_ARENA_SIZE] __attribute__((aligned(POOL_JSON_ARENA_ALIGN)));
+
+PoolJsonArena POOL_JSON_ARENA;
+
+PoolJsonArena::PoolJsonArena(){
+  used = 0;
+  high_water = 0;
+  allocations = 0;
+  failures = 0;
+  num_blocks = 0;
+  debug = 0;
+}
+
+void* PoolJsonArena::allocate(size_t size){
+  size_t start = POOL_JSON_ARENA_ROUND(used);
+  if (num_blocks >= POOL_JSON_ARENA_MAX_DOCS || start + size > POOL_JSON_ARENA_SIZE){
+    failures++;
+    if (debug){
+      pdebugE("No room for a %u byte JSON document (%u/%u used, %d docs)\n",
+              (unsigned)size,(unsigned)used,(unsigned)POOL_JSON_ARENA_SIZE,num_blocks);
+    }
+    return 0;
+  }
+
+  blocks[num_blocks++] = start;
+  used = start + size;
+  if (used > high_water){
+    high_water = used;
+  }
+  allocations++;
+  return arena_buffer + start;
+}
+
+void PoolJsonArena::deallocate(void* ptr){
+  if (ptr == 0) return;
+  size_t start = (uint8_t*)ptr - arena_buffer;
+
+  //Normally the top document, but drop everything above it if not
+  //(anything up there is gone with it)
+  while (num_blocks > 0){
+    num_blocks--;
+    if (blocks[num_blocks] == start) break;
+    if (debug){
+      pdebugE("JSON document freed out of order\n");
+    }
+  }
+  used = start;
+}
+
+void* PoolJsonArena::reallocate(void* ptr, size_t size){
+  //Only the top document can change size
+  size_t start = (uint8_t*)ptr - arena_buffer;
+  if (num_blocks == 0 || blocks[num_blocks - 1] != start || start + size > POOL_JSON_ARENA_SIZE){
+    return 0;
+  }
+  used = start + size;
+  if (used > high_water){
+    high_water = used;
+  }
+  return ptr;
+}
+
+void PoolJsonArena::getJSONArenaDetails(JsonObject& parent){
+  JsonObject a = parent.createNestedObject("json_arena");
+  a["size"] = (unsigned long)POOL_JSON_ARENA_SIZE;
+  a["used"] = (unsigned long)used;
+  a["high_water"] = (unsigned long)high_water;
+  a["allocations"] = allocations;
+  a["failures"] = failures;
+}
@@ -0,0 +1,133 @@
+#ifndef _JSON_ARENA_H
+#define _JSON_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "RemoteDebug.h"
+#include "Constants.h"
+
+/*
+  JSON document sizes, worked out from the table sizes instead of guessed.
+  Only strings ArduinoJson has to copy count against a document (String
+  values, char buffers, F() strings and, when parsing, keys), keys/values
+  we set from string literals are stored by pointer.
+*/
+#define POOL_JSON_NAME_LEN 32   //relay/sensor names, ssid, ntp server, error strings
+#define POOL_JSON_PW_LEN 64
+#define POOL_JSON_TIME_LEN 8    //"hh:mm:ss"
+#define POOL_JSON_KEYS_SIZE 512 //distinct keys in a parsed config (they get deduplicated)
+
+#define POOL_JSON_NAME_SIZE JSON_STRING_SIZE(POOL_JSON_NAME_LEN)
+#define POOL_JSON_TIME_SIZE JSON_STRING_SIZE(POOL_JSON_TIME_LEN)
+
+//Every GET wraps its section in a root object alongside "now"
+#define POOL_JSON_ROOT_SIZE JSON_OBJECT_SIZE(2)
+#define POOL_JSON_SMALL_SIZE POOL_JSON_ROOT_SIZE
+
+//{"wifi":{ssid, pw, ntp_server, tz_offset, status:{7 counters/states}}}
+#define POOL_JSON_WIFI_SIZE (POOL_JSON_ROOT_SIZE + JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(7) + \
+                             2 * POOL_JSON_NAME_SIZE + JSON_STRING_SIZE(POOL_JSON_PW_LEN))
+
+//{"mqtt":{host, port, user, pw, prefix, temp_deadband, status:{9 counters/states}}}
+#define POOL_JSON_MQTT_SIZE (POOL_JSON_ROOT_SIZE + JSON_OBJECT_SIZE(7) + JSON_OBJECT_SIZE(9) + \
+                             JSON_STRING_SIZE(POOL_HOST_LEN) + 2 * POOL_JSON_NAME_SIZE + JSON_STRING_SIZE(POOL_JSON_PW_LEN))
+
+//{"relays":[{name, state, schedule:[{on, off} x MAX_SCHEDULES]} x MAX_RELAY]}
+#define POOL_JSON_SCHEDULE_SIZE (JSON_OBJECT_SIZE(2) + 2 * POOL_JSON_TIME_SIZE)
+#define POOL_JSON_RELAY_SIZE (JSON_OBJECT_SIZE(3) + POOL_JSON_NAME_SIZE + \
+                              JSON_ARRAY_SIZE(MAX_SCHEDULES) + MAX_SCHEDULES * POOL_JSON_SCHEDULE_SIZE)
+#define POOL_JSON_RELAYS_SIZE (POOL_JSON_ROOT_SIZE + JSON_ARRAY_SIZE(MAX_RELAY) + MAX_RELAY * POOL_JSON_RELAY_SIZE)
+
+//GET /relays adds runtime:{on_secs, switches, secs_since_change} to each relay
+#define POOL_JSON_RELAYS_RUNTIME_SIZE (POOL_JSON_RELAYS_SIZE + MAX_RELAY * (JSON_OBJECT_SIZE(1) + JSON_OBJECT_SIZE(3)))
+
+//{"relay_stats":{source, file_saves, save_failures, relays:[{name, on, cause, secs_since_change,
+//  on_secs:{per cause}, switches:{per cause}} x MAX_RELAY]}}
+#define POOL_JSON_RELAY_STATS_SIZE (POOL_JSON_ROOT_SIZE + JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(MAX_RELAY) + \
+                                    MAX_RELAY * (JSON_OBJECT_SIZE(6) + POOL_JSON_NAME_SIZE + \
+                                                 2 * JSON_OBJECT_SIZE(POOL_RELAY_NUM_CAUSES)))
+
+//{"sensors":[{name, role, temp_f, type} x MAX_SENSORS]}
+#define POOL_JSON_SENSOR_SIZE (JSON_OBJECT_SIZE(4) + 3 * POOL_JSON_NAME_SIZE)
+#define POOL_JSON_SENSORS_SIZE (POOL_JSON_ROOT_SIZE + JSON_ARRAY_SIZE(MAX_SENSORS) + MAX_SENSORS * POOL_JSON_SENSOR_SIZE)
+
+//{"solar":{enabled, state, target_temp}}
+#define POOL_JSON_SOLAR_SIZE (POOL_JSON_ROOT_SIZE + JSON_OBJECT_SIZE(3) + POOL_JSON_NAME_SIZE)
+
+//{"general":{mode, time, ..., errors:[], tasks:[], analog_filter:{}, sensor_registry:{}, history:{}, events:{}, relay_output:{}, heap:{}, json_arena:{}, config:{}, snapshot:{}}}
+#define POOL_JSON_TASK_SIZE JSON_OBJECT_SIZE(9)
+#define POOL_JSON_REGISTRY_SIZE (JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(MAX_SENSORS) + \
+                                 MAX_SENSORS * (JSON_OBJECT_SIZE(5) + POOL_JSON_NAME_SIZE))
+#define POOL_JSON_GENERAL_SIZE (POOL_JSON_ROOT_SIZE + JSON_OBJECT_SIZE(19) + POOL_JSON_TIME_SIZE + \
+                                3 * POOL_JSON_NAME_SIZE + JSON_ARRAY_SIZE(MAX_POOL_ERRORS) + \
+                                JSON_ARRAY_SIZE(MAX_POOL_TASKS) + MAX_POOL_TASKS * POOL_JSON_TASK_SIZE + \
+                                JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(5) + \
+                                JSON_OBJECT_SIZE(8) + JSON_OBJECT_SIZE(4) + POOL_JSON_REGISTRY_SIZE + JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(7))
+
+//One /events event's data ({name, state, cause} is the biggest)
+#define POOL_JSON_EVENT_SIZE (JSON_OBJECT_SIZE(3) + POOL_JSON_NAME_SIZE)
+
+//{"profile":{since_reset_ms, stages:[{7 stats} x stages]}}
+#define POOL_JSON_PROFILE_SIZE (POOL_JSON_ROOT_SIZE + JSON_OBJECT_SIZE(2) + \
+                                JSON_ARRAY_SIZE(POOL_NUM_PROFILE_STAGES) + POOL_NUM_PROFILE_STAGES * JSON_OBJECT_SIZE(7))
+
+//GET /config (and the config file older firmware left in SPIFFS)
+#define POOL_JSON_CONFIG_SIZE (POOL_JSON_WIFI_SIZE + POOL_JSON_RELAYS_SIZE + POOL_JSON_SENSORS_SIZE + POOL_JSON_SOLAR_SIZE + \
+                               POOL_JSON_MQTT_SIZE)
+
+//Anything we parse (a POST body or the config file), biggest is a whole config
+#define POOL_JSON_REQUEST_SIZE (POOL_JSON_CONFIG_SIZE + POOL_JSON_KEYS_SIZE)
+
+//Most documents alive at once
+#define POOL_JSON_ARENA_MAX_DOCS 4
+
+//Every document starts pointer-aligned
+#define POOL_JSON_ARENA_ALIGN 8
+
+//The most that's ever alive at once is one parsed request/config
+//NOTE: Saving the config happens later (from the config task), and /everything
+//      is built a section at a time, so neither stacks on top of a request
+#define POOL_JSON_ARENA_SIZE (POOL_JSON_REQUEST_SIZE + POOL_JSON_ARENA_MAX_DOCS * POOL_JSON_ARENA_ALIGN)
+
+/*
+  One statically reserved block that every JSON document comes out of, so
+  handling requests never touches the heap (weeks of polling otherwise
+  leaves it too fragmented for the bigger documents).
+
+  It's a stack: documents are always locals, so they're freed in the
+  reverse order they were created and a free just drops the top.
+*/
+class PoolJsonArena {
+  public:
+    size_t used;       //bytes handed out right now
+    size_t high_water; //most ever handed out at once
+    unsigned long allocations;
+    unsigned long failures; //documents we couldn't fit
+
+    //Start of each live document (in allocation order)
+    size_t blocks[POOL_JSON_ARENA_MAX_DOCS];
+    int num_blocks;
+
+    RemoteDebug* debug;
+
+    PoolJsonArena();
+    void* allocate(size_t size);
+    void deallocate(void* ptr);
+    void* reallocate(void* ptr, size_t size);
+
+    //"json_arena" stats
+    void getJSONArenaDetails(JsonObject& parent);
+};
+extern PoolJsonArena POOL_JSON_ARENA;
+
+//ArduinoJson allocator that hands out POOL_JSON_ARENA
+struct PoolJsonArenaAllocator {
+  void* allocate(size_t size) { return POOL_JSON_ARENA.allocate(size); }
+  void deallocate(void* ptr) { POOL_JSON_ARENA.deallocate(ptr); }
+  void* reallocate(void* ptr, size_t size) { return POOL_JSON_ARENA.reallocate(ptr, size); }
+};
+
+//Use this (with one of the sizes above) for every JSON document
+typedef BasicJsonDocument<PoolJsonArenaAllocator> PoolJsonDocument;
+
+#endif
@@ -0,0 +1,45 @@
+#include "JsonStream.h"
+
+PoolJsonChunkWriter::PoolJsonChunkWriter(ESP8266WebServer& server) : server(server){
+  length = 0;
+  total = 0;
+  chunks = 0;
+}
+
+size_t PoolJsonChunkWriter::write(uint8_t c){
+  if (length >= POOL_JSON_CHUNK_SIZE){
+    flush();
+  }
+  buffer[length++] = c;
+  total++;
+  return 1;
+}
+
+size_t PoolJsonChunkWriter::write(const uint8_t* data, size_t size){
+  size_t left = size;
+  while (left > 0){
+    if (length >= POOL_JSON_CHUNK_SIZE){
+      flush();
+    }
+    size_t n = POOL_JSON_CHUNK_SIZE - length;
+    if (n > left) n = left;
+    memcpy(buffer + length, data, n);
+    length += n;
+    data += n;
+    left -= n;
+  }
+  total += size;
+  return size;
+}
+
+void PoolJsonChunkWriter::flush(){
+  if (length == 0) return;
+  server.sendContent(buffer, length);
+  length = 0;
+  chunks++;
+}
+
+void PoolJsonChunkWriter::finish(){
+  flush();
+  server.sendContent("");
+}
@@ -0,0 +1,41 @@
+#ifndef _JSON_STREAM_H
+#define _JSON_STREAM_H
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include "Constants.h"
+
+/*
+  Print that serializeJson() can write straight into an HTTP response.
+  Output is collected in a small fixed buffer and handed to the server as
+  one chunk (chunked transfer encoding) each time it fills, so a response
+  never needs more RAM than the buffer no matter how big it gets.
+
+  The response has to be started with an unknown content length, e.g.
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "application/json", "");
+    PoolJsonChunkWriter out(server);
+    serializeJson(doc, out);
+    out.finish();
+*/
+class PoolJsonChunkWriter : public Print {
+  public:
+    ESP8266WebServer& server;
+    char buffer[POOL_JSON_CHUNK_SIZE];
+    size_t length;        //bytes waiting in buffer
+    size_t total;         //bytes written overall
+    unsigned long chunks; //chunks sent
+
+    PoolJsonChunkWriter(ESP8266WebServer& server);
+
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* data, size_t size);
+
+    //Send whatever is buffered as a chunk
+    void flush();
+
+    //Send the rest and end the response (the zero length chunk)
+    void finish();
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "LogRing.h"
+
+PoolLogRing POOL_LOG;
+
+PoolLogRing::PoolLogRing(){
+  next = 0;
+  first = 0;
+  tailed = 0;
+}
+
+void PoolLogRing::add(uint8_t level, uint16_t event, PoolLogArg a, PoolLogArg b, PoolLogArg c, PoolLogArg d){
+  PoolLogRecord& r = records[next % POOL_LOG_RING_SIZE];
+  r.ms = millis();
+  r.event = event;
+  r.level = level;
+  r.args[0] = a;
+  r.args[1] = b;
+  r.args[2] = c;
+  r.args[3] = d;
+  next++;
+}
+
+void PoolLogRing::clear(){
+  first = next;
+  tailed = next;
+}
+
+unsigned long PoolLogRing::oldest(){
+  unsigned long wrapped = (next > POOL_LOG_RING_SIZE) ? next - POOL_LOG_RING_SIZE : 0;
+  return (first > wrapped) ? first : wrapped;
+}
+
+size_t PoolLogRing::formatMessage(PoolLogRecord& r, char* buf, size_t size){
+  if (r.event >= POOL_NUM_LOG_EVENTS){
+    int n = snprintf(buf, size, "unknown event %u", (unsigned)r.event);
+    return (n < 0) ? 0 : ((size_t)n < size ? n : size - 1);
+  }
+
+  //Walk the format (it's in flash) copying the text, and hand each
+  //conversion to snprintf with the arg read as the type it asks for
+  const char* fmt = POOL_LOG_EVENT_FORMATS[r.event];
+  size_t len = 0;
+  int arg = 0;
+  char spec[16];
+  char c;
+  buf[0] = 0;
+  while ((c = pgm_read_byte(fmt++)) != 0 && len + 1 < size){
+    if (c != '%'){
+      buf[len++] = c;
+      continue;
+    }
+
+    //Flags/width/precision are kept, any length modifier is replaced with our own
+    size_t n = 0;
+    spec[n++] = '%';
+    while ((c = pgm_read_byte(fmt)) != 0 && strchr("-+ #0123456789.", c) && n < sizeof(spec) - 3){
+      spec[n++] = c;
+      fmt++;
+    }
+    while ((c = pgm_read_byte(fmt)) == 'l' || c == 'h' || c == 'z'){
+      fmt++;
+    }
+    if (c == 0){
+      break;
+    }
+    fmt++;
+    if (c == '%'){
+      buf[len++] = '%';
+      continue;
+    }
+
+    PoolLogArg a = (arg < POOL_LOG_MAX_ARGS) ? r.args[arg] : PoolLogArg();
+    arg++;
+    int w = 0;
+    switch (c){
+      case 'd':
+      case 'i':
+        spec[n++] = 'l';
+        spec[n++] = c;
+        spec[n] = 0;
+        w = snprintf(buf + len, size - len, spec, a.i);
+        break;
+      case 'u':
+      case 'x':
+      case 'X':
+        spec[n++] = 'l';
+        spec[n++] = c;
+        spec[n] = 0;
+        w = snprintf(buf + len, size - len, spec, a.u);
+        break;
+      case 'c':
+        spec[n++] = c;
+        spec[n] = 0;
+        w = snprintf(buf + len, size - len, spec, (int)a.i);
+        break;
+      case 'f':
+      case 'e':
+      case 'g':
+        spec[n++] = c;
+        spec[n] = 0;
+        w = snprintf(buf + len, size - len, spec, (double)a.f);
+        break;
+      case 's':
+        spec[n++] = c;
+        spec[n] = 0;
+        w = snprintf(buf + len, size - len, spec, a.s ? a.s : "(null)");
+        break;
+    }
+    if (w > 0){
+      len += ((size_t)w < size - len) ? (size_t)w : size - len - 1;
+    }
+  }
+  buf[len] = 0;
+  return len;
+}
+
+size_t PoolLogRing::format(unsigned long seq, char* buf, size_t size){
+  if (seq < oldest() || seq >= next){
+    return 0;
+  }
+  PoolLogRecord& r = records[seq % POOL_LOG_RING_SIZE];
+  int n = snprintf(buf, size, "%lu %lu.%03lu %s ", seq, (unsigned long)r.ms / 1000,
+                   (unsigned long)r.ms % 1000, (r.level < POOL_NUM_LOG_LEVELS) ? POOL_LOG_LEVEL_STRINGS[r.level] : "?");
+  if (n < 0 || (size_t)n >= size){
+    return 0;
+  }
+  return n + formatMessage(r, buf + n, size - n);
+}
+
+unsigned long PoolLogRing::print(Print& out, unsigned long since, uint8_t min_level){
+  char line[POOL_LOG_LINE_LEN];
+  unsigned long seq = (since > oldest()) ? since : oldest();
+  for (; seq < next; seq++){
+    if (records[seq % POOL_LOG_RING_SIZE].level < min_level) continue;
+    size_t n = format(seq, line, sizeof(line) - 1);
+    if (n == 0) continue;
+    line[n++] = '\n';
+    out.write((const uint8_t*)line, n);
+  }
+  return next;
+}
+
+void PoolLogRing::tail(RemoteDebug& debug){
+  if (tailed < oldest()){
+    tailed = oldest();
+  }
+
+  char line[POOL_LOG_LINE_LEN];
+  for (int x = 0; x < POOL_LOG_TAIL_MAX && tailed < next; x++, tailed++){
+    PoolLogRecord& r = records[tailed % POOL_LOG_RING_SIZE];
+    if (!debug.isActive(r.level)) continue;
+    size_t n = format(tailed, line, sizeof(line) - 1);
+    if (n == 0) continue;
+    line[n++] = '\n';
+    debug.write((const uint8_t*)line, n);
+  }
+}
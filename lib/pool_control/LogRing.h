@@ -0,0 +1,80 @@
+#ifndef _LOG_RING_H
+#define _LOG_RING_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+static_assert(RemoteDebug::PROFILER == POOL_LOG_PROFILER && RemoteDebug::DEBUG == POOL_LOG_DEBUG &&
+              RemoteDebug::ANY == POOL_LOG_ANY, "POOL_LOG_* levels have to match RemoteDebug's");
+
+//One argument of a logged event: a number, or a string that's around for
+//good (a literal or one of the Constants.h tables, never a name buffer)
+union PoolLogArg {
+  long i;
+  unsigned long u;
+  float f;
+  const char* s;
+
+  PoolLogArg() : i(0) {}
+  PoolLogArg(int v) : i(v) {}
+  PoolLogArg(unsigned int v) : u(v) {}
+  PoolLogArg(long v) : i(v) {}
+  PoolLogArg(unsigned long v) : u(v) {}
+  PoolLogArg(double v) : f(v) {}
+  PoolLogArg(const char* v) : s(v) {}
+};
+
+struct PoolLogRecord {
+  uint32_t ms;     //millis() when it was added
+  uint16_t event;  //PoolLogEvent
+  uint8_t level;   //POOL_LOG_*
+  PoolLogArg args[POOL_LOG_MAX_ARGS];
+};
+
+/*
+  Fixed RAM ring of binary log records (event id, time, args), for the
+  control path's chatty debug output. Adding one is a handful of stores;
+  the printf formatting (from the event's format in POOL_LOG_EVENT_FORMATS)
+  only happens when something reads them: the remote debugger (tail() from
+  loop(), at whatever level it's watching), its "log" command or GET /log.
+
+  Every record gets a sequence number (the count added before it), so a
+  reader can ask for everything after the last one it saw; once the ring
+  wraps the oldest are overwritten.
+*/
+class PoolLogRing {
+  public:
+    PoolLogRecord records[POOL_LOG_RING_SIZE];
+    unsigned long next;    //sequence number the next record gets
+    unsigned long first;   //oldest one clear() left (older ones are gone)
+    unsigned long tailed;  //next one tail() looks at
+
+    PoolLogRing();
+
+    void add(uint8_t level, uint16_t event, PoolLogArg a = PoolLogArg(), PoolLogArg b = PoolLogArg(),
+             PoolLogArg c = PoolLogArg(), PoolLogArg d = PoolLogArg());
+    void clear();
+
+    //Sequence number of the oldest record still in the ring
+    unsigned long oldest();
+
+    //"<seq> <secs.ms> <level> <message>" (no newline), returns its length
+    //(0 if seq isn't in the ring any more)
+    size_t format(unsigned long seq, char* buf, size_t size);
+
+    //Records from since on, at or above min_level, one per line. Returns the
+    //sequence number to ask for next time.
+    unsigned long print(Print& out, unsigned long since, uint8_t min_level);
+
+    //Send anything new the remote debugger's watching for (at most
+    //POOL_LOG_TAIL_MAX records a call)
+    void tail(RemoteDebug& debug);
+
+  private:
+    //The event's message into buf (returns its length)
+    size_t formatMessage(PoolLogRecord& r, char* buf, size_t size);
+};
+
+extern PoolLogRing POOL_LOG;
+
+#endif
@@ -0,0 +1,162 @@
+#include "MemoryStats.h"
+
+void PoolMemoryStats::reset(){
+  count = 0;
+  min_free_heap = 0;
+  min_max_block = 0;
+  max_fragmentation = 0;
+  min_free_stack = 0;
+  last_delta = 0;
+  min_delta = 0;
+  max_delta = 0;
+  total_delta = 0;
+}
+
+void PoolMemoryStats::record(PoolMemorySample& before, PoolMemorySample& after){
+  uint32_t free_heap = (before.free_heap < after.free_heap) ? before.free_heap : after.free_heap;
+  uint32_t max_block = (before.max_block < after.max_block) ? before.max_block : after.max_block;
+  uint8_t fragmentation = (before.fragmentation > after.fragmentation) ? before.fragmentation : after.fragmentation;
+  int32_t delta = (int32_t)after.free_heap - (int32_t)before.free_heap;
+
+  if (count == 0 || free_heap < min_free_heap) min_free_heap = free_heap;
+  if (count == 0 || max_block < min_max_block) min_max_block = max_block;
+  if (count == 0 || fragmentation > max_fragmentation) max_fragmentation = fragmentation;
+  if (count == 0 || after.free_stack < min_free_stack) min_free_stack = after.free_stack;
+  if (count == 0 || delta < min_delta) min_delta = delta;
+  if (count == 0 || delta > max_delta) max_delta = delta;
+  last_delta = delta;
+  total_delta += delta;
+  count++;
+}
+
+PoolMemoryTracker::PoolMemoryTracker(){
+  for (int x = 0; x < POOL_MEMORY_MAX_ENTRIES; x++){
+    entries[x].name = (x < POOL_MEMORY_UPDATE_STAGES) ? POOL_PROFILE_STAGE_STRINGS[x] : "";
+    entries[x].method = 0;
+  }
+  num_handlers = 0;
+  depth = 0;
+
+  sample(lowest);
+  lowest_free_heap_at = -1;
+  lowest_max_block_at = -1;
+  highest_fragmentation_at = -1;
+  lowest_free_stack_at = -1;
+  reset();
+}
+
+void PoolMemoryTracker::reset(){
+  for (int x = 0; x < POOL_MEMORY_MAX_ENTRIES; x++){
+    entries[x].reset();
+  }
+  last_reset = millis();
+}
+
+int PoolMemoryTracker::addHandler(const char* uri, const char* method){
+  if (num_handlers >= POOL_MEMORY_MAX_HANDLERS){
+    return -1;
+  }
+  int entry = POOL_MEMORY_UPDATE_STAGES + num_handlers++;
+  entries[entry].name = uri;
+  entries[entry].method = method;
+  return entry;
+}
+
+void PoolMemoryTracker::sample(PoolMemorySample& s){
+  s.free_heap = ESP.getFreeHeap();
+  s.max_block = ESP.getMaxFreeBlockSize();
+  s.fragmentation = ESP.getHeapFragmentation();
+  s.free_stack = ESP.getFreeContStack();
+}
+
+void PoolMemoryTracker::record(int entry, PoolMemorySample& before, PoolMemorySample& after){
+  entries[entry].record(before, after);
+
+  if (after.free_heap < lowest.free_heap){
+    lowest.free_heap = after.free_heap;
+    lowest_free_heap_at = entry;
+  }
+  if (after.max_block < lowest.max_block){
+    lowest.max_block = after.max_block;
+    lowest_max_block_at = entry;
+  }
+  if (after.fragmentation > lowest.fragmentation){
+    lowest.fragmentation = after.fragmentation;
+    highest_fragmentation_at = entry;
+  }
+  if (after.free_stack < lowest.free_stack){
+    lowest.free_stack = after.free_stack;
+    lowest_free_stack_at = entry;
+  }
+}
+
+//Where a lifetime low happened ("" if it was before anything was probed)
+static const char* entryName(PoolMemoryTracker& t, int entry){
+  return (entry < 0) ? "" : t.entries[entry].name;
+}
+
+void PoolMemoryTracker::writeJSONEntries(Print& out, const char* key, int first, int last){
+  char line[POOL_MEMORY_JSON_LINE_LEN];
+
+  snprintf(line, sizeof(line), ",\"%s\":[", key);
+  out.print(line);
+  for (int x = first; x < last; x++){
+    PoolMemoryStats& e = entries[x];
+    int n = snprintf(line, sizeof(line),
+                     "%s{\"name\":\"%s\",%s%s%s\"count\":%lu,\"min_free_heap\":%u,\"min_max_block\":%u,"
+                     "\"max_fragmentation\":%u,\"min_free_stack\":%u,\"last_delta\":%d,\"min_delta\":%d,"
+                     "\"max_delta\":%d,\"total_delta\":%.0f}",
+                     (x > first) ? "," : "", e.name,
+                     e.method ? "\"method\":\"" : "", e.method ? e.method : "", e.method ? "\"," : "",
+                     e.count, (unsigned)e.min_free_heap, (unsigned)e.min_max_block,
+                     (unsigned)e.max_fragmentation, (unsigned)e.min_free_stack, (int)e.last_delta,
+                     (int)e.min_delta, (int)e.max_delta, (double)e.total_delta);
+    if (n > 0 && n < (int)sizeof(line)){
+      out.print(line);
+    }
+  }
+  out.print("]");
+}
+
+void PoolMemoryTracker::writeJSON(Print& out){
+  char line[POOL_MEMORY_JSON_LINE_LEN];
+  PoolMemorySample now;
+  sample(now);
+
+  snprintf(line, sizeof(line),
+           "{\"memory\":{\"since_reset_ms\":%lu,\"now\":{\"free_heap\":%u,\"max_block\":%u,"
+           "\"fragmentation\":%u,\"free_stack\":%u},",
+           millis() - last_reset, (unsigned)now.free_heap, (unsigned)now.max_block,
+           (unsigned)now.fragmentation, (unsigned)now.free_stack);
+  out.print(line);
+
+  snprintf(line, sizeof(line),
+           "\"lowest\":{\"free_heap\":%u,\"free_heap_at\":\"%s\",\"max_block\":%u,\"max_block_at\":\"%s\","
+           "\"fragmentation\":%u,\"fragmentation_at\":\"%s\",\"free_stack\":%u,\"free_stack_at\":\"%s\"}",
+           (unsigned)lowest.free_heap, entryName(*this, lowest_free_heap_at),
+           (unsigned)lowest.max_block, entryName(*this, lowest_max_block_at),
+           (unsigned)lowest.fragmentation, entryName(*this, highest_fragmentation_at),
+           (unsigned)lowest.free_stack, entryName(*this, lowest_free_stack_at));
+  out.print(line);
+
+  writeJSONEntries(out, "stages", 0, POOL_MEMORY_UPDATE_STAGES);
+  writeJSONEntries(out, "handlers", POOL_MEMORY_UPDATE_STAGES, POOL_MEMORY_UPDATE_STAGES + num_handlers);
+  out.print("}");
+}
+
+PoolMemoryProbe::PoolMemoryProbe(PoolMemoryTracker& tracker, int entry)
+: tracker(tracker), entry(entry){
+  if (tracker.depth++ == 0){
+    ESP.resetFreeContStack();
+  }
+  tracker.sample(before);
+}
+
+PoolMemoryProbe::~PoolMemoryProbe(){
+  PoolMemorySample after;
+  tracker.sample(after);
+  tracker.depth--;
+  if (entry >= 0){
+    tracker.record(entry, before, after);
+  }
+}
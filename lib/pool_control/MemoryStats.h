@@ -0,0 +1,112 @@
+#ifndef _MEMORY_STATS_H
+#define _MEMORY_STATS_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+//update() stages get the profiler's stage numbers (every task, the sensor
+//harvest and the NTP reply), HTTP handlers come after them
+#define POOL_MEMORY_UPDATE_STAGES POOL_PROFILE_UPDATE
+#define POOL_MEMORY_MAX_ENTRIES (POOL_MEMORY_UPDATE_STAGES + POOL_MEMORY_MAX_HANDLERS)
+
+//Heap/stack numbers at one point in time
+struct PoolMemorySample {
+  uint32_t free_heap;
+  uint32_t max_block;     //largest free block
+  uint8_t fragmentation;  //%
+  uint32_t free_stack;    //loop() stack never touched since it was last painted
+};
+
+/*
+  What one update() stage or HTTP handler has done to the heap/stack.
+  Free heap is sampled going in and coming out, so anything it allocated
+  and freed again in between only shows up in the stack/fragmentation
+  numbers, while anything it held on to (or let go of) is the delta.
+*/
+struct PoolMemoryStats {
+  const char* name;   //stage name or handler uri
+  const char* method; //"GET"/"POST" for handlers, 0 for update() stages
+
+  unsigned long count;
+  uint32_t min_free_heap;
+  uint32_t min_max_block;
+  uint8_t max_fragmentation;
+  uint32_t min_free_stack;
+
+  //Free heap coming out - going in (negative is heap it kept)
+  int32_t last_delta;
+  int32_t min_delta;
+  int32_t max_delta;
+  int64_t total_delta; //keeps going down if it leaks
+
+  void reset();
+  void record(PoolMemorySample& before, PoolMemorySample& after);
+};
+
+/*
+  Heap and stack high-water tracking for update() stages and HTTP
+  handlers (indexed by PoolProfileStage for the stages, addHandler()'s
+  return for handlers), plus the lowest numbers seen since boot.
+
+  The stack numbers come from stack painting: the unused part of loop()'s
+  stack is filled with a known pattern when a probe starts and whatever
+  is still intact when it ends is how close that stage came to the
+  bottom. Painting costs a few us per KB, which is why only the tasks
+  and handlers are probed, not every loop() pass.
+*/
+class PoolMemoryTracker {
+  public:
+    PoolMemoryStats entries[POOL_MEMORY_MAX_ENTRIES];
+    int num_handlers;
+
+    //Lowest since boot (reset() leaves these alone), and the entry it happened in
+    PoolMemorySample lowest;
+    int lowest_free_heap_at;
+    int lowest_max_block_at;
+    int highest_fragmentation_at;
+    int lowest_free_stack_at;
+
+    unsigned long last_reset; //millis() of the last reset
+
+    //Probes currently running (only the outermost one repaints the stack)
+    byte depth;
+
+    PoolMemoryTracker();
+    void reset();
+
+    //Returns the entry for a handler (or -1 if they're all taken)
+    //NOTE: uri and method are kept, not copied
+    int addHandler(const char* uri, const char* method);
+
+    void sample(PoolMemorySample& s);
+    void record(int entry, PoolMemorySample& before, PoolMemorySample& after);
+
+    //{"memory":{...} straight onto out, a stage/handler at a time (the
+    //caller adds anything else and closes the outer object)
+    void writeJSON(Print& out);
+
+  private:
+    void writeJSONEntries(Print& out, const char* key, int first, int last);
+};
+
+/*
+  Tracks the heap/stack used by the scope it lives in, e.g.
+    {
+      PoolMemoryProbe m(memory, POOL_TASK_WIFI);
+      connect_wifi();
+    }
+  NOTE: A probe inside another one can't repaint the stack without losing
+        the outer one's high-water, so its stack number is the deepest
+        since the outer one started
+*/
+class PoolMemoryProbe {
+  public:
+    PoolMemoryTracker& tracker;
+    int entry;
+    PoolMemorySample before;
+
+    PoolMemoryProbe(PoolMemoryTracker& tracker, int entry);
+    ~PoolMemoryProbe();
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "Metrics.h"
+#include <stdarg.h>
+
+PoolMetricsWriter::PoolMetricsWriter(Print& out) : out(out){
+  dropped = 0;
+  length = 0;
+  labels = 0;
+  overflow = 0;
+}
+
+void PoolMetricsWriter::append(const char* s){
+  size_t n = strlen(s);
+  if (length + n >= sizeof(line)){
+    overflow = 1;
+    return;
+  }
+  memcpy(line + length, s, n);
+  length += n;
+}
+
+void PoolMetricsWriter::appendf(const char* fmt, ...){
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(line + length, sizeof(line) - length, fmt, args);
+  va_end(args);
+  if (n < 0 || length + n >= sizeof(line)){
+    overflow = 1;
+    return;
+  }
+  length += n;
+}
+
+void PoolMetricsWriter::family(const char* name, const char* type, const char* help){
+  length = 0;
+  overflow = 0;
+  appendf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+  if (!overflow){
+    out.write((const uint8_t*)line, length);
+  }
+  length = 0;
+}
+
+void PoolMetricsWriter::begin(const char* name){
+  length = 0;
+  labels = 0;
+  overflow = 0;
+  append(name);
+}
+
+void PoolMetricsWriter::label(const char* name, const char* value){
+  append(labels++ ? "," : "{");
+  append(name);
+  append("=\"");
+
+  //Backslash, quote and newline are the only things that need escaping
+  for (const char* p = value; *p && !overflow; p++){
+    if (length + 2 >= sizeof(line)){
+      overflow = 1;
+      break;
+    }
+    if (*p == '\\' || *p == '"'){
+      line[length++] = '\\';
+      line[length++] = *p;
+    }
+    else if (*p == '\n'){
+      line[length++] = '\\';
+      line[length++] = 'n';
+    }
+    else {
+      line[length++] = *p;
+    }
+  }
+  append("\"");
+}
+
+void PoolMetricsWriter::value(double v, int decimals){
+  if (labels) append("}");
+  if (isnan(v)) append(" NaN\n");
+  else if (decimals >= 0) appendf(" %.*f\n", decimals, v);
+  else appendf(" %.10g\n", v);
+
+  if (overflow){
+    dropped++;
+  }
+  else {
+    out.write((const uint8_t*)line, length);
+  }
+  length = 0;
+  labels = 0;
+}
+
+void PoolMetricsWriter::gauge(const char* name, double v, int decimals){
+  begin(name);
+  value(v, decimals);
+}
+
+void PoolMetricsWriter::histogram(const char* name, LatencyHistogram& h){
+  char sample[64];
+  char le[16];
+
+  //Bucket b is everything under 2^(b+1) us, the last one is +Inf
+  snprintf(sample, sizeof(sample), "%s_bucket", name);
+  unsigned long cumulative = 0;
+  for (int b = 0; b < POOL_PROFILE_BUCKETS; b++){
+    cumulative += h.buckets[b];
+    if (b < POOL_PROFILE_BUCKETS - 1){
+      snprintf(le, sizeof(le), "%.6f", (double)(2UL << b) / 1000000.0);
+    }
+    else {
+      strcpy(le, "+Inf");
+    }
+    begin(sample);
+    label("le", le);
+    value(cumulative);
+  }
+
+  snprintf(sample, sizeof(sample), "%s_sum", name);
+  gauge(sample, (double)h.total_us / 1000000.0, 6);
+  snprintf(sample, sizeof(sample), "%s_count", name);
+  gauge(sample, h.count);
+}
+
+void PoolLoopRate::update(unsigned long count, unsigned long since, unsigned long now){
+  //First scrape or the profiler was reset, the window starts from the reset
+  if (last_ms == 0 || count < last_count){
+    last_count = 0;
+    last_ms = since;
+  }
+  if (now - last_ms < POOL_METRICS_RATE_MIN_MS) return;
+
+  rate = (float)(count - last_count) * 1000.0 / (now - last_ms);
+  last_count = count;
+  last_ms = now;
+}
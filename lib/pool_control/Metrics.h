@@ -0,0 +1,67 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <Arduino.h>
+#include "Constants.h"
+#include "Profiler.h"
+
+/*
+  Prometheus text exposition format straight onto a Print (the chunked
+  response writer), one line at a time through a fixed buffer, so a
+  scrape never touches the heap:
+
+    m.family("pool_relay_on", "gauge", "1 if the relay is on");
+    m.begin("pool_relay_on");
+    m.label("relay", "pump");
+    m.value(1);
+
+  Label values are escaped. A line that doesn't fit in
+  POOL_METRICS_LINE_LEN is left out (and counted in dropped).
+*/
+class PoolMetricsWriter {
+  public:
+    Print& out;
+    unsigned long dropped;
+
+    PoolMetricsWriter(Print& out);
+
+    //# HELP and # TYPE for the samples that follow
+    void family(const char* name, const char* type, const char* help);
+
+    //Sample line: begin(), any label()s, then value() writes it out
+    //NOTE: decimals < 0 is as many as it takes (integers come out as integers)
+    void begin(const char* name);
+    void label(const char* name, const char* value);
+    void value(double v, int decimals = -1);
+
+    //A sample with no labels
+    void gauge(const char* name, double v, int decimals = -1);
+
+    //Cumulative _bucket/_sum/_count samples (in seconds) from a latency histogram
+    void histogram(const char* name, LatencyHistogram& h);
+
+  private:
+    char line[POOL_METRICS_LINE_LEN];
+    size_t length;
+    byte labels;    //label()s since begin()
+    byte overflow;
+
+    void append(const char* s);
+    void appendf(const char* fmt, ...);
+};
+
+/*
+  Loop iterations/sec between scrapes (from the profiler's loop count),
+  held over until at least POOL_METRICS_RATE_MIN_MS has gone by so
+  back-to-back scrapes don't give nonsense.
+*/
+struct PoolLoopRate {
+  unsigned long last_count;
+  unsigned long last_ms;
+  float rate;
+
+  //count is the profiler's loop count since it was reset at since (millis())
+  void update(unsigned long count, unsigned long since, unsigned long now);
+};
+
+#endif
@@ -0,0 +1,457 @@
+#include "Mqtt.h"
+#include <lwip/dns.h>
+
+//Packet types (fixed header high nibble)
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82 //flags are fixed at 0010
+#define MQTT_SUBACK 0x90
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+//CONNECT flags
+#define MQTT_CLEAN_SESSION 0x02
+#define MQTT_WILL 0x04
+#define MQTT_WILL_RETAIN 0x20
+#define MQTT_PASSWORD 0x40
+#define MQTT_USERNAME 0x80
+
+//lwIP DNS callback for the broker lookup (called from the SDK)
+static void mqtt_dns_found(const char*, const ip_addr_t* ipaddr, void* arg){
+  PoolMqttClient* m = (PoolMqttClient*)arg;
+  if (ipaddr){
+    m->dns_result = IPAddress(ipaddr);
+    m->dns_ok = 1;
+  }
+  else{
+    m->dns_ok = 0;
+  }
+  m->dns_done = 1;
+}
+
+//Length-prefixed string, returns the bytes used
+static size_t mqtt_put_string(uint8_t* p, const char* s, size_t size){
+  p[0] = (uint8_t)(size >> 8);
+  p[1] = (uint8_t)size;
+  memcpy(p + 2, s, size);
+  return size + 2;
+}
+
+PoolMqttClient::PoolMqttClient(){
+  host[0] = 0;
+  port = POOL_MQTT_PORT;
+  user[0] = 0;
+  pw[0] = 0;
+  strcpy(prefix, POOL_MQTT_PREFIX);
+
+  state = POOL_MQTT_DISABLED;
+  state_since = 0;
+  backoff_ms = 0;
+  session = 0;
+
+  connects = 0;
+  failures = 0;
+  disconnects = 0;
+  published = 0;
+  received = 0;
+  dropped = 0;
+  last_error = 0;
+
+  dns_done = 0;
+  dns_ok = 0;
+
+  callback = NULL;
+  callback_context = NULL;
+  length = 0;
+  skip = 0;
+  last_sent = 0;
+  last_received = 0;
+  ping_outstanding = 0;
+  next_packet_id = 1;
+}
+
+void PoolMqttClient::onMessage(PoolMqttCallback callback, void* context){
+  this->callback = callback;
+  this->callback_context = context;
+}
+
+void PoolMqttClient::setState(MqttState s, unsigned long now){
+  state = s;
+  state_since = now;
+}
+
+void PoolMqttClient::reset(){
+  unsigned long now = millis();
+  disconnect();
+  backoff_ms = 0;
+  setState(enabled() ? POOL_MQTT_IDLE : POOL_MQTT_DISABLED, now);
+}
+
+void PoolMqttClient::disconnect(){
+  //Going away on purpose, so the will won't say so for us
+  if (state == POOL_MQTT_CONNECTED){
+    publish("status", POOL_MQTT_OFFLINE, 1);
+    send(MQTT_DISCONNECT, 0);
+    disconnects++;
+  }
+  client.stop();
+  length = 0;
+  skip = 0;
+}
+
+void PoolMqttClient::failed(int error, unsigned long now){
+  client.stop();
+  failures++;
+  last_error = error;
+  backoff_ms = (backoff_ms == 0) ? POOL_MQTT_MIN_BACKOFF_MS : backoff_ms * 2;
+  if (backoff_ms > POOL_MQTT_MAX_BACKOFF_MS) backoff_ms = POOL_MQTT_MAX_BACKOFF_MS;
+  setState(POOL_MQTT_IDLE, now);
+}
+
+void PoolMqttClient::connectionLost(unsigned long now){
+  client.stop();
+  disconnects++;
+  last_error = -1;
+  backoff_ms = POOL_MQTT_MIN_BACKOFF_MS;
+  setState(POOL_MQTT_IDLE, now);
+}
+
+void PoolMqttClient::connectBroker(IPAddress ip, unsigned long now){
+  client.stop();
+  client.setTimeout(POOL_MQTT_CONNECT_TIMEOUT_MS);
+  if (!client.connect(ip, port)){
+    failed(-1, now);
+    return;
+  }
+  client.setNoDelay(true);
+  length = 0;
+  skip = 0;
+  ping_outstanding = 0;
+
+  char client_id[16];
+  snprintf(client_id, sizeof(client_id), "pool-%08lx", (unsigned long)ESP.getChipId());
+
+  //Variable header: protocol name/level, flags, keepalive
+  uint8_t* p = out + POOL_MQTT_HEADER_ROOM;
+  size_t n = mqtt_put_string(p, "MQTT", 4);
+  uint8_t flags = MQTT_CLEAN_SESSION | MQTT_WILL | MQTT_WILL_RETAIN;
+  if (user[0]){
+    flags |= MQTT_USERNAME;
+    if (pw[0]) flags |= MQTT_PASSWORD;
+  }
+  p[n++] = 4;
+  p[n++] = flags;
+  p[n++] = (uint8_t)(POOL_MQTT_KEEPALIVE_SECS >> 8);
+  p[n++] = (uint8_t)POOL_MQTT_KEEPALIVE_SECS;
+
+  //Payload: client id, will topic/message, credentials (the settings
+  //lengths keep all of it well inside the buffer)
+  n += mqtt_put_string(p + n, client_id, strlen(client_id));
+  n += putTopic(p + n, "status");
+  n += mqtt_put_string(p + n, POOL_MQTT_OFFLINE, strlen(POOL_MQTT_OFFLINE));
+  if (flags & MQTT_USERNAME){
+    n += mqtt_put_string(p + n, user, strlen(user));
+  }
+  if (flags & MQTT_PASSWORD){
+    n += mqtt_put_string(p + n, pw, strlen(pw));
+  }
+
+  if (!send(MQTT_CONNECT, n)){
+    failed(-1, now);
+    return;
+  }
+  last_received = now;
+  setState(POOL_MQTT_CONNECTING, now);
+}
+
+void PoolMqttClient::handle(unsigned long now, byte network_up){
+  if (!enabled()){
+    if (state != POOL_MQTT_DISABLED){
+      disconnect();
+      setState(POOL_MQTT_DISABLED, now);
+    }
+    return;
+  }
+  if (state == POOL_MQTT_DISABLED){
+    setState(POOL_MQTT_IDLE, now);
+  }
+
+  if (!network_up){
+    if (state == POOL_MQTT_CONNECTED){
+      connectionLost(now);
+    }
+    else if (state != POOL_MQTT_IDLE){
+      client.stop();
+      setState(POOL_MQTT_IDLE, now);
+    }
+    return;
+  }
+
+  switch (state){
+    case POOL_MQTT_IDLE: {
+      if (now - state_since < backoff_ms) return;
+
+      ip_addr_t addr;
+      dns_done = 0;
+      dns_ok = 0;
+      err_t err = dns_gethostbyname(host, &addr, mqtt_dns_found, this);
+      if (err == ERR_OK){
+        //lwIP already had it (or it's an IP)
+        connectBroker(IPAddress(&addr), now);
+      }
+      else if (err == ERR_INPROGRESS){
+        setState(POOL_MQTT_RESOLVING, now);
+      }
+      else{
+        failed(-1, now);
+      }
+      break;
+    }
+
+    case POOL_MQTT_RESOLVING:
+      if (dns_done){
+        if (dns_ok){
+          connectBroker(dns_result, now);
+        }
+        else{
+          failed(-1, now);
+        }
+      }
+      else if (now - state_since >= POOL_MQTT_DNS_TIMEOUT_MS){
+        failed(-1, now);
+      }
+      break;
+
+    case POOL_MQTT_CONNECTING:
+      read(now);
+      if (state == POOL_MQTT_CONNECTING &&
+          (!client.connected() || now - state_since >= POOL_MQTT_CONNECT_TIMEOUT_MS)){
+        failed(-1, now);
+      }
+      break;
+
+    case POOL_MQTT_CONNECTED:
+      read(now);
+      if (state != POOL_MQTT_CONNECTED) break;
+
+      //The broker answers a ping well inside the keepalive, so if it's
+      //gone quiet that long the connection's dead (whether or not TCP noticed)
+      if (!client.connected() || now - last_received >= POOL_MQTT_KEEPALIVE_SECS * 1000UL){
+        connectionLost(now);
+        break;
+      }
+      if (!ping_outstanding && now - last_sent >= POOL_MQTT_KEEPALIVE_SECS * 500UL){
+        if (send(MQTT_PINGREQ, 0)){
+          ping_outstanding = 1;
+        }
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+void PoolMqttClient::read(unsigned long now){
+  int available;
+  while ((available = client.available()) > 0){
+    //Rest of a packet we couldn't hold
+    if (skip > 0){
+      size_t n = ((size_t)available < skip) ? available : skip;
+      if (n > POOL_MQTT_BUFFER) n = POOL_MQTT_BUFFER;
+      n = client.read(buffer, n);
+      skip -= n;
+      last_received = now;
+      continue;
+    }
+
+    size_t n = POOL_MQTT_BUFFER - length;
+    if ((size_t)available < n) n = available;
+    int got = client.read(buffer + length, n);
+    if (got <= 0) break;
+    length += got;
+    last_received = now;
+
+    //Every whole packet we've got
+    while (length >= 2){
+      size_t remaining = 0;
+      size_t header = 1;
+      byte complete = 0;
+      for (int shift = 0; header < length && shift <= 21; shift += 7){
+        uint8_t digit = buffer[header++];
+        remaining |= (size_t)(digit & 0x7F) << shift;
+        if (!(digit & 0x80)){
+          complete = 1;
+          break;
+        }
+      }
+      if (!complete){
+        //Not all of the length yet, or a bad one
+        if (header >= 5){
+          connectionLost(now);
+          return;
+        }
+        break;
+      }
+
+      size_t total = header + remaining;
+      if (total > POOL_MQTT_BUFFER){
+        dropped++;
+        skip = total - length;
+        length = 0;
+        break;
+      }
+      if (length < total) break;
+
+      dispatch(buffer[0], buffer + header, remaining, now);
+      if (state != POOL_MQTT_CONNECTING && state != POOL_MQTT_CONNECTED) return;
+
+      memmove(buffer, buffer + total, length - total);
+      length -= total;
+    }
+  }
+}
+
+void PoolMqttClient::dispatch(uint8_t header, uint8_t* body, size_t size, unsigned long now){
+  switch (header & 0xF0){
+    case MQTT_CONNACK:
+      if (state != POOL_MQTT_CONNECTING) return;
+      if (size < 2 || body[1] != 0){
+        failed((size < 2) ? -1 : body[1], now);
+        return;
+      }
+      setState(POOL_MQTT_CONNECTED, now);
+      connects++;
+      session++;
+      backoff_ms = 0;
+      last_error = 0;
+      publish("status", POOL_MQTT_ONLINE, 1);
+      break;
+
+    case MQTT_PINGRESP:
+      ping_outstanding = 0;
+      break;
+
+    case MQTT_PUBLISH: {
+      if (size < 2) return;
+      size_t topic_size = ((size_t)body[0] << 8) | body[1];
+      size_t at = 2 + topic_size;
+      byte qos = (header >> 1) & 3;
+      if (qos > 0) at += 2; //packet id
+      if (at > size) return;
+
+      char topic[POOL_MQTT_TOPIC_LEN];
+      if (topic_size >= sizeof(topic)){
+        dropped++;
+        return;
+      }
+      memcpy(topic, body + 2, topic_size);
+      topic[topic_size] = 0;
+
+      if (qos == 1){
+        uint8_t* p = out + POOL_MQTT_HEADER_ROOM;
+        p[0] = body[2 + topic_size];
+        p[1] = body[3 + topic_size];
+        send(MQTT_PUBACK, 2);
+      }
+      received++;
+
+      //Hand it over without our prefix
+      size_t prefix_len = strlen(prefix);
+      if (strncmp(topic, prefix, prefix_len) != 0 || topic[prefix_len] != '/') return;
+
+      //There's always room for a terminator after the packet (it's put
+      //back since the next packet may start there)
+      char* payload = (char*)body + at;
+      size_t payload_size = size - at;
+      char saved = payload[payload_size];
+      payload[payload_size] = 0;
+      if (callback){
+        callback(callback_context, topic + prefix_len + 1, payload, payload_size);
+      }
+      payload[payload_size] = saved;
+      break;
+    }
+
+    default:
+      //SUBACK etc, nothing to do
+      break;
+  }
+}
+
+size_t PoolMqttClient::putTopic(uint8_t* p, const char* topic){
+  size_t prefix_len = strlen(prefix);
+  size_t topic_len = strlen(topic);
+  size_t size = prefix_len + 1 + topic_len;
+  if (size >= POOL_MQTT_TOPIC_LEN) return 0;
+
+  p[0] = (uint8_t)(size >> 8);
+  p[1] = (uint8_t)size;
+  memcpy(p + 2, prefix, prefix_len);
+  p[2 + prefix_len] = '/';
+  memcpy(p + 3 + prefix_len, topic, topic_len);
+  return size + 2;
+}
+
+byte PoolMqttClient::publish(const char* topic, const char* payload, byte retain){
+  if (state != POOL_MQTT_CONNECTED) return 0;
+
+  uint8_t* p = out + POOL_MQTT_HEADER_ROOM;
+  size_t n = putTopic(p, topic);
+  size_t payload_size = strlen(payload);
+  if (n == 0 || POOL_MQTT_HEADER_ROOM + n + payload_size > POOL_MQTT_BUFFER){
+    dropped++;
+    return 0;
+  }
+  memcpy(p + n, payload, payload_size);
+
+  if (!send(MQTT_PUBLISH | (retain ? 1 : 0), n + payload_size)){
+    dropped++;
+    return 0;
+  }
+  published++;
+  return 1;
+}
+
+byte PoolMqttClient::subscribe(const char* topic){
+  if (state != POOL_MQTT_CONNECTED) return 0;
+
+  uint8_t* p = out + POOL_MQTT_HEADER_ROOM;
+  p[0] = (uint8_t)(next_packet_id >> 8);
+  p[1] = (uint8_t)next_packet_id;
+  if (++next_packet_id == 0) next_packet_id = 1;
+
+  size_t n = putTopic(p + 2, topic);
+  if (n == 0) return 0;
+  p[2 + n] = 0; //QoS 0
+  return send(MQTT_SUBSCRIBE, n + 3);
+}
+
+byte PoolMqttClient::send(uint8_t header, size_t size){
+  //Remaining length goes right before the body, the type before that
+  uint8_t encoded[4];
+  int digits = 0;
+  size_t x = size;
+  do {
+    uint8_t digit = x % 128;
+    x /= 128;
+    if (x > 0) digit |= 0x80;
+    encoded[digits++] = digit;
+  } while (x > 0 && digits < 4);
+
+  uint8_t* start = out + POOL_MQTT_HEADER_ROOM - 1 - digits;
+  start[0] = header;
+  memcpy(start + 1, encoded, digits);
+
+  size_t total = 1 + digits + size;
+  if (client.write(start, total) != total){
+    //Half a packet on the wire, the connection's no good now
+    client.stop();
+    return 0;
+  }
+  last_sent = millis();
+  return 1;
+}
@@ -0,0 +1,126 @@
+#ifndef _MQTT_H
+#define _MQTT_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiClient.h>
+#include "Constants.h"
+
+//Room left at the front of a packet for its fixed header (type + up to 4
+//bytes of remaining length)
+#define POOL_MQTT_HEADER_ROOM 5
+
+//Incoming PUBLISH on one of our subscriptions (topic and payload are
+//terminated, the payload is length bytes)
+typedef void (*PoolMqttCallback)(void* context, const char* topic, const char* payload, size_t length);
+
+//What the controller last published (see PoolController::publish_mqtt_state()),
+//so it only sends what's changed
+struct PoolMqttPublished {
+  unsigned long session; //PoolMqttClient::session it all went out in
+  byte relay_on[MAX_RELAY];
+  uint32_t sensor_names[MAX_SENSORS]; //PoolSnapshot::hash() of the name
+  float sensor_temps[MAX_SENSORS];
+  SolarState solar_state;
+  byte solar_enabled;
+  float solar_target_temp;
+  PoolState pool_state;
+
+  //Sensor temperatures have to move this far (degF) to be republished
+  float temp_deadband;
+};
+
+/*
+  Just enough MQTT 3.1.1 for the controller: one connection (clean
+  session, QoS 0 both ways), retained publishes, subscriptions and a will
+  that sets <prefix>/status offline if we drop off. handle() steps the
+  connection (resolve -> connect -> wait for the CONNACK), reads whatever
+  the broker has sent without waiting on it and keeps the connection
+  alive; a failed attempt backs off (doubling up to POOL_MQTT_MAX_BACKOFF_MS)
+  before the next one. Topics are given without the prefix:
+
+    mqtt.publish("relay/pump/state", "on", 1);
+
+  NOTE: The TCP connect itself blocks (up to POOL_MQTT_CONNECT_TIMEOUT_MS),
+        the broker's expected to be on the LAN
+*/
+class PoolMqttClient {
+  public:
+    //Settings (call reset() after changing them)
+    char host[POOL_HOST_LEN]; //"" turns it off
+    uint16_t port;
+    char user[POOL_MQTT_USER_LEN];
+    char pw[POOL_PW_LEN];
+    char prefix[POOL_MQTT_PREFIX_LEN];
+
+    MqttState state;
+    unsigned long state_since; //millis() when we entered state
+    unsigned long backoff_ms;
+
+    //Goes up with every (re)connect, so whoever publishes through us can
+    //tell it needs to send everything again
+    unsigned long session;
+
+    //Stats
+    unsigned long connects;
+    unsigned long failures;    //attempts that didn't get to connected
+    unsigned long disconnects; //connections lost after they were up
+    unsigned long published;
+    unsigned long received;
+    unsigned long dropped;     //publishes that didn't fit/couldn't be written
+    int last_error;            //CONNACK return code, or -1 for a network problem
+
+    PoolMqttClient();
+
+    void onMessage(PoolMqttCallback callback, void* context);
+
+    //Drop the connection and start over with the current settings
+    void reset();
+
+    byte enabled() { return host[0] != 0; }
+    byte connected() { return state == POOL_MQTT_CONNECTED; }
+
+    //Step the connection (network_up is whether wifi's connected)
+    void handle(unsigned long now, byte network_up);
+
+    //Returns 0 if we're not connected or it couldn't be sent
+    byte publish(const char* topic, const char* payload, byte retain);
+    byte subscribe(const char* topic);
+
+    //Set from the lwIP DNS callback
+    volatile byte dns_done;
+    volatile byte dns_ok;
+    IPAddress dns_result;
+
+  private:
+    WiFiClient client;
+    PoolMqttCallback callback;
+    void* callback_context;
+
+    uint8_t buffer[POOL_MQTT_BUFFER + 1]; //incoming bytes (one packet at most, +1 to terminate the payload)
+    uint8_t out[POOL_MQTT_BUFFER];    //packet being sent (body after POOL_MQTT_HEADER_ROOM)
+    size_t length;
+    size_t skip;                      //bytes left of a packet too big for buffer
+
+    unsigned long last_sent;
+    unsigned long last_received;
+    byte ping_outstanding;
+    uint16_t next_packet_id;
+
+    void setState(MqttState s, unsigned long now);
+    void connectBroker(IPAddress ip, unsigned long now);
+    void connectionLost(unsigned long now);
+    void failed(int error, unsigned long now);
+    void disconnect();
+    void read(unsigned long now);
+    void dispatch(uint8_t header, uint8_t* body, size_t size, unsigned long now);
+
+    //Put prefix/topic (length first) at p, returns the bytes used (0 if it doesn't fit)
+    size_t putTopic(uint8_t* p, const char* topic);
+
+    //Send the packet whose body (size bytes) has been put in out after the
+    //fixed header's room. Returns 0 if it didn't all go.
+    byte send(uint8_t header, size_t size);
+};
+
+#endif
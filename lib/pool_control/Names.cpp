@@ -0,0 +1,12 @@
+#include "Names.h"
+
+void poolCopyName(char* dest, size_t size, const char* src){
+  if (src == 0) src = "";
+  if (src == dest){
+    //Already there (setters pass the current value for anything not given)
+    dest[size - 1] = 0;
+    return;
+  }
+  strncpy(dest, src, size - 1);
+  dest[size - 1] = 0;
+}
@@ -0,0 +1,23 @@
+#ifndef _POOL_NAMES_H
+#define _POOL_NAMES_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  Relay/sensor names, wifi credentials etc. live in fixed size char buffers
+  (sized in Constants.h) rather than Strings, so looking things up and
+  copying them around in the control loop never touches the heap.
+*/
+
+//Copy src into a name buffer of the given size (truncating, always
+//terminated, a null src is "")
+void poolCopyName(char* dest, size_t size, const char* src);
+
+//Same thing for a char array member
+#define POOL_SET_NAME(dest, src) poolCopyName((dest), sizeof(dest), (src))
+
+//Compare a name against one of the PROGMEM name constants
+#define POOL_NAME_IS(name, progmem_name) (strcmp_P((name), (progmem_name)) == 0)
+
+#endif
@@ -3,13 +3,24 @@
 #include <PoolController.h>
 #include <math.h>
 #include <FS.h>
+#include <lwip/dns.h>
 
 
-PoolController::PoolController(RemoteDebug* debug){
+//MQTT command topic callback (from inside mqtt.handle())
+static void mqtt_message(void* context, const char* topic, const char* payload, size_t){
+  ((PoolController*)context)->mqtt_command(topic, payload);
+}
+
+PoolController::PoolController(RemoteDebug* debug)
+  : relay_output(DEFAULT_POOL_RELAY_SHIFT_DATA,
+                 DEFAULT_POOL_RELAY_SHIFT_CLK,
+                 DEFAULT_POOL_RELAY_SHIFT_LATCH){
   this->debug = debug;
+  profiler.debug = debug;
+  POOL_JSON_ARENA.debug = debug;
+  snapshot.boot_id = ESP.random();
 
   //Set all the initial state variables
-  relay_output =  0;
   this->num_errors =0;
   pool_state = POOL_STATE_UNINITIALIZED;
   solar_state = SOLAR_DISABLED;
@@ -19,9 +30,40 @@ PoolController::PoolController(RemoteDebug* debug){
   this->num_sensors=0;
   last_ntp_update = 0;
   ntp_update_seconds = DEFAULT_NTP_UPDATE_SECS;
-  pool_water_sensor_name = "";
-  roof_sensor_name = "";
-  ambient_air_sensor_name = "";
+  ntp_state = POOL_NTP_IDLE;
+  ntp_state_since = 0;
+  ntp_request_sent = 0;
+  ntp_failed_at = 0;
+  ntp_retries = 0;
+  ntp_last_rtt_ms = 0;
+  ntp_dns_resolved_at = 0;
+  ntp_dns_valid = 0;
+  ntp_dns_done = 0;
+  ntp_dns_ok = 0;
+  pool_water_sensor_name[0] = 0;
+  roof_sensor_name[0] = 0;
+  ambient_air_sensor_name[0] = 0;
+  invalidate_handles();
+  wifi_ssid[0] = 0;
+  wifi_pw[0] = 0;
+  wifi_fallback_ssid[0] = 0;
+  wifi_fallback_pw[0] = 0;
+  ntp_server_name[0] = 0;
+  update_allocs = 0;
+
+  //Wifi connection manager
+  //NOTE: The event handlers get registered on the first connect_wifi() 
+  //      (the WiFi object may not be constructed yet)
+  wifi_state = POOL_WIFI_IDLE;
+  wifi_state_since = 0;
+  wifi_backoff_ms = 0;
+  wifi_attempts = 0;
+  wifi_connects = 0;
+  wifi_disconnects = 0;
+  wifi_failures = 0;
+  wifi_got_ip = 0;
+  wifi_lost = 0;
+  wifi_verifying = 0;
 
   //Set up manual mode switch
   pinMode(POOL_MANUAL_MODE_PIN,INPUT);
@@ -37,32 +79,68 @@ PoolController::PoolController(RemoteDebug* debug){
   digital_temp_sensors.setOneWire(&one_wire);
   digital_temp_sensors.begin();
 
-  //Set the analog pin to INPUT (we always use it)
-  analog_temp = new Thermistor(DEFAULT_ANALOG_THERM_PIN,
-                               3.3, //VCC
-                               1.0, //internal vRef
-                               1023, //max digital num
-                               POOL_THERM_SERIES_RES, //series resister (should be 47K)
-                               POOL_THERM_NOM_RES, //resistance at nominal temp (usually 10K)
-                               POOL_THERM_NOM_TEMP_C, //Nominal temp C (25C usually)
-                               POOL_THERM_BETA, //Beta
-                               POOL_THERM_NUM_SAMPLES, //number of samples to avg
-                               POOL_THERM_SAMPLE_DELAY); //ms delay between samples
-  //pinMode(DEFAULT_ANALOG_THERM_PIN,INPUT);
-
-  //Set up the relay shift register
-  relay_output = new ShiftRegister74HC595<1>(
-      DEFAULT_POOL_RELAY_SHIFT_DATA,
-      DEFAULT_POOL_RELAY_SHIFT_CLK,
-      DEFAULT_POOL_RELAY_SHIFT_LATCH);
-  relay_output->setAllHigh();
+  //Don't let requestTemperatures() block for the conversion time, we poll for it instead
+  digital_temp_sensors.setWaitForConversion(false);
+  sensor_conversion_state = POOL_SENSORS_IDLE;
+  sensor_conversion_start = 0;
+  sensor_conversion_wait = 0;
+  sensor_scan_requested = 0;
+
+  //Set up the analog thermistor (the "analog" task samples it)
+  analog_temp = new FilteredThermistor(DEFAULT_ANALOG_THERM_PIN);
+
+  //Set up the relay shift register (all off)
+  relay_output.begin();
+
+  loop_rate.last_count = 0;
+  loop_rate.last_ms = 0;
+  loop_rate.rate = 0;
+
+  //Nothing published yet (and commands come in through mqtt_command())
+  memset(&mqtt_published, 0, sizeof(mqtt_published));
+  mqtt_published.temp_deadband = POOL_MQTT_TEMP_DEADBAND;
+  mqtt.onMessage(mqtt_message, this);
+
+  //Nothing imported from SPIFFS (yet)
+  legacy_config_imported = 0;
+
+  //Nothing evaluated yet
+  schedule_bits = 0;
+  schedule_evaluated_at = 0;
+  schedule_next_transition = 0;
+  schedule_dirty = 1;
+  control_requested = 0;
+  control_input_us = 0;
+
+  //Register the update() stages with the scheduler
+  //NOTE: These have to be added in PoolTaskId order since we dispatch on the index
+  scheduler.addTask(POOL_TASK_WIFI_STR, POOL_TASK_WIFI_PERIOD,
+                    POOL_TASK_WIFI_PRIORITY, POOL_TASK_WIFI_DEADLINE);
+  scheduler.addTask(POOL_TASK_SENSORS_STR, POOL_TASK_SENSORS_PERIOD,
+                    POOL_TASK_SENSORS_PRIORITY, POOL_TASK_SENSORS_DEADLINE);
+  scheduler.addTask(POOL_TASK_NTP_STR, POOL_TASK_NTP_PERIOD,
+                    POOL_TASK_NTP_PRIORITY, POOL_TASK_NTP_DEADLINE);
+  scheduler.addTask(POOL_TASK_CONTROL_STR, POOL_TASK_CONTROL_PERIOD,
+                    POOL_TASK_CONTROL_PRIORITY, POOL_TASK_CONTROL_DEADLINE);
+  scheduler.addTask(POOL_TASK_ANALOG_STR, POOL_TASK_ANALOG_PERIOD,
+                    POOL_TASK_ANALOG_PRIORITY, POOL_TASK_ANALOG_DEADLINE);
+  scheduler.addTask(POOL_TASK_CONFIG_STR, POOL_TASK_CONFIG_PERIOD,
+                    POOL_TASK_CONFIG_PRIORITY, POOL_TASK_CONFIG_DEADLINE);
+  scheduler.addTask(POOL_TASK_DISCOVERY_STR, POOL_TASK_DISCOVERY_PERIOD,
+                    POOL_TASK_DISCOVERY_PRIORITY, POOL_TASK_DISCOVERY_DEADLINE);
+  scheduler.addTask(POOL_TASK_HISTORY_STR, POOL_TASK_HISTORY_PERIOD,
+                    POOL_TASK_HISTORY_PRIORITY, POOL_TASK_HISTORY_DEADLINE);
+  scheduler.addTask(POOL_TASK_RELAY_STATS_STR, POOL_TASK_RELAY_STATS_PERIOD,
+                    POOL_TASK_RELAY_STATS_PRIORITY, POOL_TASK_RELAY_STATS_DEADLINE);
+  scheduler.addTask(POOL_TASK_MQTT_STR, POOL_TASK_MQTT_PERIOD,
+                    POOL_TASK_MQTT_PRIORITY, POOL_TASK_MQTT_DEADLINE);
 
   //Attempt to load the config from SPIFFS
   //load_config();
 }
 
 void PoolController::reset_config(){
-  DynamicJsonDocument doc(2048);
+  PoolJsonDocument doc(POOL_JSON_REQUEST_SIZE);
   byte all_good=1;
   String err="";
 
@@ -93,25 +171,20 @@ void PoolController::reset_config(){
     this->pool_state = POOL_STATE_RUN_SCHEDULE;
   }
 
-  //Save a copy of the config
-  save_config();
+  //Save a copy of the config (once the config task gets to it)
+  mark_config_dirty();
 }
 
-byte PoolController::save_config(){
-  File configFile = SPIFFS.open(CONFIG_FILE_PATH,"w");
-  if (!configFile){
-    pdebugE("Unable to create config file path in SPIFFS: \"%s\". Config NOT saved\n",CONFIG_FILE_PATH);
-    return 0;
-  }
-  
-  pdebugI("Saving configuration to SPIFFS\n");
-  DynamicJsonDocument config(4096);
+void PoolController::getJSONConfig(JsonDocument& config){
   getJSONWifiDetails(config);
   getJSONRelayDetails(config);
   getJSONSensorsDetails(config);
-  getJSONRelayDetails(config);
-  getJSONSensorsDetails(config);
   getJSONSolarDetails(config);
+  getJSONMqttDetails(config);
+
+  //Don't save the wifi/MQTT connection status
+  config["wifi"].remove("status");
+  config["mqtt"].remove("status");
 
   //Set all relay states to "off" for saving
   JsonArray relays = config["relays"];
@@ -119,61 +192,114 @@ byte PoolController::save_config(){
     JsonObject relay = r.as<JsonObject>(); 
     relay["state"]="off"; 
   }
+}
 
-  /*
-  String nukeme;
-  serializeJsonPretty(config,nukeme);
-  pdebugI("MM:\n%s\n",nukeme.c_str());
-  */
- 
-  if (serializeJsonPretty(config,configFile) == 0){
-    pdebugE("Failed to write configuration to \"%s\"\n",CONFIG_FILE_PATH);
+void PoolController::mark_config_dirty(){
+  config_persist.markDirty(millis());
+}
+
+void PoolController::persist_config(){
+  if (config_persist.due(millis())){
+    save_config();
+  }
+}
+
+byte PoolController::save_config(){
+  fill_config_record(config_store.record);
+
+  //Nothing to do if it's the same as what's already on flash
+  uint32_t crc = config_store.payloadCrc();
+  if (crc == config_persist.saved_hash){
+    pdebugD("Configuration unchanged, not saving\n");
+    config_persist.skipped++;
+    config_persist.saved(crc);
+    return 1;
+  }
+
+  pdebugI("Saving configuration to flash\n");
+  if (!config_store.save()){
+    pdebugE("Failed to write configuration to flash. Config NOT saved\n");
+    config_persist.failures++;
     return 0;
   }
+  pdebugI("Saved config generation %lu to slot %d\n",(unsigned long)config_store.generation,config_store.current_slot);
+  config_persist.saves++;
+  config_persist.saved(crc);
+
+  //The old SPIFFS config is on flash now, don't import it again next boot
+  if (legacy_config_imported){
+    pdebugI("Removing \"%s\"\n",CONFIG_FILE_PATH);
+    SPIFFS.remove(CONFIG_FILE_PATH);
+    legacy_config_imported = 0;
+  }
   return 1;
 }
 
 byte PoolController::load_config ()
 {
-    pdebugI("Attempting to load config from SPIFFS \"%s\"",CONFIG_FILE_PATH);
+    pdebugI("Loading config from flash\n");
 
-    //First, try to load a config from SPIFFS
-    File configFile = SPIFFS.open(CONFIG_FILE_PATH,"r");
-    DynamicJsonDocument config(4096);
-    
-    DeserializationError error = deserializeJson(config,configFile);
-    //if the SPIFFS load failed, roll with the defaults
-    if (error){
-      pdebugE("Error loading SPIFFS config file. Reverting to default config\n");
-      reset_config();
-      return 0;
+    //Relay counters carry on from before the reset/power cut
+    if (relay_stats.load()){
+      pdebugI("Loaded relay stats from %s\n",
+              (relay_stats.loaded_from == POOL_RELAY_STATS_FROM_RTC) ? "RTC memory" : "SPIFFS");
     }
 
-    String err; 
-    JsonObject o = config["wifi"];
-    if (!setJSONWifiDetails(o,err,1)){
-      pdebugE("Error loading wifi details from config file. Reverting to default config. Err:\n%s",err.c_str());
-      reset_config();
-      return 0;
+    //Newest first. If its settings don't make sense (the CRC only says
+    //it's what we wrote) try the other slot before giving up on flash.
+    byte loaded = 0;
+    int skip_slot = -1;
+    while (!loaded && config_store.load(skip_slot)){
+      if (apply_config_record(config_store.record)){
+        pdebugI("Loaded config generation %lu from slot %d\n",(unsigned long)config_store.generation,config_store.current_slot);
+
+        //What's on flash matches what we have, so there's nothing to save
+        //until something actually changes
+        config_persist.saved(config_store.record.header.crc);
+        loaded = 1;
+      }
+      else {
+        pdebugE("Config in slot %d has invalid settings\n",config_store.current_slot);
+        if (skip_slot >= 0) break;
+        skip_slot = config_store.current_slot;
+      }
+    }
+    if (!loaded && skip_slot >= 0){
+      pdebugE("No usable config on flash. Reverting to default config\n");
     }
 
-    JsonArray a = config["relays"];
-    if (!setJSONRelayDetails(a,err,1)){
-      pdebugE("Error loading relay details from config file. Reverting to default config. Err:\n%s",err.c_str());
-      reset_config();
-      return 0;
+    //Flash already has everything the old file did (we lost power before
+    //save_config() got to remove it)
+    else if (loaded && SPIFFS.exists(CONFIG_FILE_PATH)){
+      pdebugI("Config is on flash, removing \"%s\"\n",CONFIG_FILE_PATH);
+      SPIFFS.remove(CONFIG_FILE_PATH);
     }
 
-    a = config["sensors"];
-    if (!setJSONSensorsDetails(a,err,1)){
-      pdebugE("Error loading sensors details from config file. Reverting to default config. Err:\n%s",err.c_str());
-      reset_config();
-      return 0;
+    //Nothing on flash yet, pick up the JSON config an older firmware left in
+    //SPIFFS (it gets written to flash by the config task, which removes it)
+    //NOTE: The parsed file has to be out of the JSON arena before we fall back
+    //to reset_config() (which needs room for its own defaults)
+    else if (!loaded && skip_slot < 0 && SPIFFS.exists(CONFIG_FILE_PATH)){
+      pdebugI("No config in flash, importing \"%s\"\n",CONFIG_FILE_PATH);
+      File configFile = SPIFFS.open(CONFIG_FILE_PATH,"r");
+      PoolJsonDocument config(POOL_JSON_REQUEST_SIZE);
+      String err;
+
+      DeserializationError error = deserializeJson(config,configFile);
+      if (error){
+        pdebugE("Error loading SPIFFS config file. Reverting to default config\n");
+      }
+      else if (!importJSONConfig(config,err)){
+        pdebugE("Error importing config file. Reverting to default config. Err:\n%s",err.c_str());
+      }
+      else {
+        mark_config_dirty();
+        legacy_config_imported = 1;
+        loaded = 1;
+      }
     }
-    
-    o = config["solar"];
-    if (!setJSONSolarDetails(o,err,1)){
-      pdebugE("Error loading solar details from config file. Reverting to default config. Err:\n%s",err.c_str());
+
+    if (!loaded){
       reset_config();
       return 0;
     }
@@ -182,52 +308,233 @@ byte PoolController::load_config ()
   if (this->pool_state == POOL_STATE_UNINITIALIZED){
     this->pool_state = POOL_STATE_RUN_SCHEDULE;
   }
+  return 1;
 }
 
-unsigned long timeOfDay(int h, int m, int s){
-  return (long)h * SECS_PER_HOUR +
-         (long)m * SECS_PER_MIN +
-         (long)s;
+byte PoolController::importJSONConfig(JsonDocument& config, String& err){
+  JsonObject wifi = config["wifi"];
+  JsonArray relays = config["relays"];
+  JsonArray sensors = config["sensors"];
+  JsonObject solar = config["solar"];
+  JsonObject mqtt = config["mqtt"];
+
+  //Check every section before we touch any of them, so a bad import
+  //doesn't leave half a config behind
+  if ((!wifi.isNull() && !validateJSONWifiDetails(wifi,err)) ||
+      (!relays.isNull() && !validateJSONRelayDetails(relays,err,1)) ||
+      (!sensors.isNull() && !validateJSONSensorsUpdate(sensors,err)) ||
+      (!solar.isNull() && !validateJSONSolarDetails(solar,err)) ||
+      (!mqtt.isNull() && !validateJSONMqttDetails(mqtt,err))){
+    return 0;
+  }
+
+  //NOTE: These can't fail now
+  if (!wifi.isNull()) setJSONWifiDetails(wifi,err,1);
+  if (!relays.isNull()) setJSONRelayDetails(relays,err,1);
+  if (!sensors.isNull()) setJSONSensorsDetails(sensors,err,1);
+  if (!solar.isNull()) setJSONSolarDetails(solar,err,1);
+  if (!mqtt.isNull()) setJSONMqttDetails(mqtt,err,1);
+  return 1;
 }
 
-//Assumes we have a reliable time from NTP
-//Returns 1 if relay should be on (according to schedule), 0 otherwise
-byte determineRelayFromSchedule(PoolDailySchedule& sched){
+void PoolController::fill_config_record(PoolConfigRecord& r){
+  //Zero everything (padding included) so the CRC only depends on the settings
+  memset(&r, 0, sizeof(r));
 
-  //get the current time
-  int h = hour();  
-  int m = minute();
-  int s = second(); 
-  unsigned long nowToday = timeOfDay(h,m,s);
+  POOL_SET_NAME(r.wifi_ssid, wifi_ssid);
+  POOL_SET_NAME(r.wifi_pw, wifi_pw);
+  POOL_SET_NAME(r.ntp_server, ntp_server_name);
+  r.tz_offset = gmt_offset;
+
+  for (int x = 0; x < MAX_RELAY; x++){
+    PoolConfigRelay& cr = r.relays[x];
+    POOL_SET_NAME(cr.name, relays[x].name);
+    cr.num_schedules = relays[x].schedule.num_schedules;
+    for (int y = 0; y < relays[x].schedule.num_schedules; y++){
+      cr.on_secs[y] = relays[x].schedule.on_secs[y];
+      cr.off_secs[y] = relays[x].schedule.off_secs[y];
+    }
+  }
 
-  unsigned long on_buff, off_buff;
-  //iterate the schedule and see if it's between any on/off sections
-  for (int x = 0;x < sched.num_schedules; x++){
-      on_buff = timeOfDay(sched.on_time[x].Hour,
-                          sched.on_time[x].Minute,
-                          sched.on_time[x].Second);
-      off_buff = timeOfDay(sched.off_time[x].Hour,
-                           sched.off_time[x].Minute,
-                           sched.off_time[x].Second);
+  r.num_sensors = num_sensors;
+  for (int x = 0; x < num_sensors; x++){
+    POOL_SET_NAME(r.sensors[x], temp_sensors[x].name);
+  }
+  POOL_SET_NAME(r.pool_water_sensor, pool_water_sensor_name);
+  POOL_SET_NAME(r.roof_sensor, roof_sensor_name);
+  POOL_SET_NAME(r.ambient_air_sensor, ambient_air_sensor_name);
+
+  r.solar_enabled = solar_enabled;
+  r.solar_target_temp = solar_target_temp;
+
+  POOL_SET_NAME(r.mqtt_host, mqtt.host);
+  POOL_SET_NAME(r.mqtt_user, mqtt.user);
+  POOL_SET_NAME(r.mqtt_pw, mqtt.pw);
+  POOL_SET_NAME(r.mqtt_prefix, mqtt.prefix);
+  r.mqtt_port = mqtt.port;
+  r.mqtt_temp_deadband = mqtt_published.temp_deadband;
+
+  r.config_save_delay_ms = config_persist.save_delay_ms;
+  r.events_temp_deadband = events.temp_deadband;
+  r.analog_ema_alpha = analog_temp->ema_alpha;
+  r.analog_median_depth = analog_temp->median_depth;
+  r.num_tasks = scheduler.num_tasks;
+  for (int x = 0; x < scheduler.num_tasks; x++){
+    r.tasks[x].period_ms = scheduler.tasks[x].period_ms;
+    r.tasks[x].deadline_ms = scheduler.tasks[x].deadline_ms;
+    r.tasks[x].priority = scheduler.tasks[x].priority;
+  }
+}
 
-      if (on_buff <= nowToday && nowToday < off_buff)
-        return 1;
+byte PoolController::apply_config_record(PoolConfigRecord& r){
+  //The CRC says it's what we wrote, this is just in case what we wrote was nonsense
+  if (r.num_sensors > MAX_SENSORS ||
+      r.solar_target_temp < POOL_SOLAR_MIN_TEMP || r.solar_target_temp > POOL_SOLAR_MAX_TEMP){
+    return 0;
+  }
+  if (POOL_CONFIG_HAS(r, mqtt_temp_deadband) &&
+      !(r.mqtt_temp_deadband >= 0 && r.mqtt_temp_deadband <= POOL_MQTT_MAX_DEADBAND)){
+    return 0;
+  }
+  if (POOL_CONFIG_HAS(r, tasks)){
+    if (r.config_save_delay_ms > POOL_CONFIG_SAVE_MAX_DELAY ||
+        !(r.events_temp_deadband >= 0 && r.events_temp_deadband <= POOL_EVENTS_MAX_DEADBAND) ||
+        !FilteredThermistor::validFilter(r.analog_median_depth, r.analog_ema_alpha) ||
+        r.num_tasks > POOL_CONFIG_MAX_TASKS){
+      return 0;
+    }
+    for (int x = 0; x < r.num_tasks; x++){
+      if (!scheduler.validateTask(r.tasks[x].period_ms, r.tasks[x].priority, r.tasks[x].deadline_ms)) return 0;
+    }
+  }
+  //NOTE: All of it is checked before we change anything, so a bad one
+  //      doesn't leave half of itself behind for the other slot/defaults
+  for (int x = 0; x < MAX_RELAY; x++){
+    PoolConfigRelay& cr = r.relays[x];
+    if (cr.num_schedules > MAX_SCHEDULES) return 0;
+    for (int y = 0; y < cr.num_schedules; y++){
+      if (cr.on_secs[y] >= cr.off_secs[y] || cr.off_secs[y] >= SECS_PER_DAY) return 0;
+    }
   }
 
-  return 0;
+  POOL_SET_NAME(wifi_ssid, r.wifi_ssid);
+  POOL_SET_NAME(wifi_pw, r.wifi_pw);
+  POOL_SET_NAME(ntp_server_name, r.ntp_server);
+  gmt_offset = r.tz_offset;
+  time_state = POOL_TIME_UNINITIALIZED;
+  ntp_dns_valid = 0;
+  snapshot.touch(POOL_SNAPSHOT_WIFI);
+
+  for (int x = 0; x < MAX_RELAY; x++){
+    PoolConfigRelay& cr = r.relays[x];
+    if (cr.name[0] != 0){
+      POOL_SET_NAME(relays[x].name, cr.name);
+    }
+    relays[x].setState(POOL_RELAY_OFF, POOL_RELAY_CAUSE_SYSTEM);
+    relays[x].schedule.clear();
+    for (int y = 0; y < cr.num_schedules; y++){
+      relays[x].schedule.add(cr.on_secs[y], cr.off_secs[y]);
+    }
+    relays[x].schedule.compile();
+  }
+  schedule_dirty = 1;
+  snapshot.touch(POOL_SNAPSHOT_RELAYS);
 
+  num_sensors = 0;
+  for (int x = 0; x < r.num_sensors; x++){
+    addSensor(r.sensors[x], POOL_TEMP_SENSOR_MISSING);
+    remember_sensor(r.sensors[x]);
+  }
+  POOL_SET_NAME(pool_water_sensor_name, r.pool_water_sensor);
+  POOL_SET_NAME(roof_sensor_name, r.roof_sensor);
+  POOL_SET_NAME(ambient_air_sensor_name, r.ambient_air_sensor);
+  invalidate_handles();
+  snapshot.touch(POOL_SNAPSHOT_SENSORS);
+  snapshot.touch(POOL_SNAPSHOT_GENERAL);
+
+  solar_enabled = r.solar_enabled ? 1 : 0;
+  solar_target_temp = r.solar_target_temp;
+  solar_state = solar_enabled ? SOLAR_BYPASS : SOLAR_DISABLED;
+  snapshot.touch(POOL_SNAPSHOT_SOLAR);
+
+  //Records from before MQTT have all of it zeroed (no broker)
+  mqtt.reset();
+  POOL_SET_NAME(mqtt.host, r.mqtt_host);
+  POOL_SET_NAME(mqtt.user, r.mqtt_user);
+  POOL_SET_NAME(mqtt.pw, r.mqtt_pw);
+  POOL_SET_NAME(mqtt.prefix, r.mqtt_prefix[0] ? r.mqtt_prefix : POOL_MQTT_PREFIX);
+  mqtt.port = r.mqtt_port ? r.mqtt_port : POOL_MQTT_PORT;
+  mqtt_published.temp_deadband = POOL_CONFIG_HAS(r, mqtt_temp_deadband) ? r.mqtt_temp_deadband : POOL_MQTT_TEMP_DEADBAND;
+
+  //Records from before these were saved keep whatever we booted with (the defaults)
+  if (POOL_CONFIG_HAS(r, tasks)){
+    config_persist.save_delay_ms = r.config_save_delay_ms;
+    events.temp_deadband = r.events_temp_deadband;
+    analog_temp->setFilter(r.analog_median_depth, r.analog_ema_alpha);
+
+    //Tasks added since the record was saved aren't in it (they go on the
+    //end of PoolTaskId), and ones it has that we don't are ignored
+    for (int x = 0; x < r.num_tasks && x < scheduler.num_tasks; x++){
+      scheduler.tasks[x].period_ms = r.tasks[x].period_ms;
+      scheduler.tasks[x].deadline_ms = r.tasks[x].deadline_ms;
+      scheduler.tasks[x].priority = r.tasks[x].priority;
+    }
+    snapshot.touch(POOL_SNAPSHOT_GENERAL);
+  }
+  return 1;
 }
 
-void PoolController::update_solar_heating(){
-  String solar_valve_name((const __FlashStringHelper*)POOL_RELAY_SOLAR_VALVE_NAME);
-  String pump_relay_name((const __FlashStringHelper*)POOL_RELAY_PUMP_NAME);
+byte PoolController::update_schedule(){
+  time_t t = now();
+
+  //Nothing can have flipped since we last looked
+  if (!schedule_dirty && t >= schedule_evaluated_at && t < schedule_next_transition){
+    return 0;
+  }
+
+  time_t midnight = previousMidnight(t);
+  unsigned long sod = t - midnight;
+
+  //With no transitions at all, look again tomorrow
+  unsigned long next = SECS_PER_DAY;
+  schedule_bits = 0;
+  for (int x = 0;x < MAX_RELAY; x++){
+    if (relays[x].schedule.isOnAt(sod)){
+      schedule_bits |= (1 << x);
+    }
+    unsigned long n = relays[x].schedule.nextTransition(sod);
+    if (n < next){
+      next = n;
+    }
+  }
+
+  schedule_evaluated_at = t;
+  schedule_next_transition = midnight + next;
+  schedule_dirty = 0;
+  plogD(POOL_LOG_SCHEDULE_EVALUATED, (unsigned long)t, schedule_bits, (unsigned long)schedule_next_transition);
+  return 1;
+}
 
+//Manually override a relay on/off, unless it's already that way
+//NOTE: Re-overriding one that's already on/off would just flip it between
+//      the manual and scheduled states every time we ran
+static void overrideRelay(Relay* r, byte on, PoolRelayCause cause){
+  byte is_on = (r->state == POOL_RELAY_ON || r->state == POOL_RELAY_MANUAL_ON);
+  if (on && !is_on) r->setState(POOL_RELAY_MANUAL_ON, cause);
+  else if (!on && is_on) r->setState(POOL_RELAY_MANUAL_OFF, cause);
+}
+
+void PoolController::update_solar_heating(){
   //Get a ref to the solar valve relay (to toggle)
-  Relay* solar_relay = getRelayByName(solar_valve_name);
-  Relay* pump_relay = getRelayByName(pump_relay_name);
+  resolve_handles();
+  Relay* solar_relay = relayAt(solar_valve_relay_idx);
+  Relay* pump_relay = relayAt(pump_relay_idx);
+
+  TempSensor* water_sensor = sensorAt(water_sensor_idx);
+  TempSensor* roof_sensor = sensorAt(roof_sensor_idx);
 
-  TempSensor* water_sensor = getSensorByName(pool_water_sensor_name);
-  TempSensor* roof_sensor = getSensorByName(roof_sensor_name);
+  //We run every control pass, only say why it's off when it turns off
+  SolarState was = solar_state;
 
   //Don't evaluate if solar isn't turned on
   if (!solar_enabled){
@@ -256,14 +563,14 @@ void PoolController::update_solar_heating(){
 
   //Also bail if we aren't in the pool state to run the schedule
   else if (pool_state != POOL_STATE_RUN_SCHEDULE){
-    pdebugI("Pool state is not set to run schedule. Disabing solar logic\n");
+    if (was != SOLAR_DISABLED) plogI(POOL_LOG_SOLAR_NOT_SCHEDULED);
     solar_state = SOLAR_DISABLED;
   }
 
   //Also disable if the pump isn't running
   else if (pump_relay->state != POOL_RELAY_ON &&
            pump_relay->state != POOL_RELAY_MANUAL_ON){
-    pdebugI("Pool pump is not running, disabling solar logic\n");
+    if (was != SOLAR_DISABLED) plogI(POOL_LOG_SOLAR_PUMP_OFF);
     solar_state = SOLAR_DISABLED;
   }
 
@@ -276,12 +583,12 @@ void PoolController::update_solar_heating(){
 
   switch (solar_state){
     case SOLAR_DISABLED: //solar heating isn't activated
-      pdebugD("Solar heating is disabled, ensuring our solar relay is off\n");
-      solar_relay->state = POOL_RELAY_MANUAL_OFF;
+      if (was != SOLAR_DISABLED) plogD(POOL_LOG_SOLAR_DISABLED);
+      overrideRelay(solar_relay, 0, POOL_RELAY_CAUSE_SOLAR);
       break;
     case SOLAR_HEATING: //solar heating activated and circulating
       //Turn on the relay
-      solar_relay->state = POOL_RELAY_MANUAL_ON;
+      overrideRelay(solar_relay, 1, POOL_RELAY_CAUSE_SOLAR);
 
       //If the roof cools off too much or the pump isn't running, close the valve
       //assess the roof
@@ -292,25 +599,23 @@ void PoolController::update_solar_heating(){
       else if(roof_sensor->temp < (solar_target_temp + POOL_SOLAR_OFF_ROOF_DELTA)){
         roof_too_cold = 1;
         roof_temp = roof_sensor->temp;
-        pdebugI("Roof temperature (%.2f) is lower than the setpoint (%.2f) + fudge (%.2f)\n",
-                 roof_sensor->temp, solar_target_temp, POOL_SOLAR_OFF_ROOF_DELTA);
+        plogI(POOL_LOG_SOLAR_ROOF_COLD, roof_sensor->temp, solar_target_temp, POOL_SOLAR_OFF_ROOF_DELTA);
       }
 
       //assess the water
       if (water_sensor->temp > (solar_target_temp + POOL_SOLAR_OFF_WATER_DELTA)){
         water_too_hot = 1;
-        pdebugI("Water temperature (%.2f) is higher than the setpoint (%.2f) + fudge (%.2f)\n",
-                 water_sensor->temp, solar_target_temp, POOL_SOLAR_OFF_WATER_DELTA);
+        plogI(POOL_LOG_SOLAR_WATER_HOT, water_sensor->temp, solar_target_temp, POOL_SOLAR_OFF_WATER_DELTA);
       }
 
       if (roof_too_cold || water_too_hot){
-        pdebugI("Solar bypass engaged\n");
+        plogI(POOL_LOG_SOLAR_BYPASS);
         solar_state = SOLAR_BYPASS;
       }
       break;
     case SOLAR_BYPASS: //solar heating activated, but either the pump is off or the roof is cold
-      //Turn on the relay
-      solar_relay->state = POOL_RELAY_MANUAL_OFF;
+      //Turn off the relay
+      overrideRelay(solar_relay, 0, POOL_RELAY_CAUSE_SOLAR);
 
       //If the roof cools off too much, we switch to bypassing
       if (roof_sensor == 0){
@@ -328,11 +633,9 @@ void PoolController::update_solar_heating(){
       }
 
       if (roof_hot_enough && water_too_cold){
-        pdebugI("Roof temperature (%.2f) is hot enough above the setpoint (%.2f) + fudge (%.2f)\n",
-                 roof_temp, solar_target_temp, POOL_SOLAR_ON_ROOF_DELTA);
-        pdebugI("Water temperature (%.2f) is below than the setpoint (%.2f) + fudge (%.2f)\n",
-                 water_sensor->temp, solar_target_temp, POOL_SOLAR_ON_WATER_DELTA);
-        pdebugI("Solar heating engaged\n");
+        plogI(POOL_LOG_SOLAR_ROOF_HOT, roof_temp, solar_target_temp, POOL_SOLAR_ON_ROOF_DELTA);
+        plogI(POOL_LOG_SOLAR_WATER_COLD, water_sensor->temp, solar_target_temp, POOL_SOLAR_ON_WATER_DELTA);
+        plogI(POOL_LOG_SOLAR_HEATING);
         solar_state = SOLAR_HEATING;
       }
       break;
@@ -340,13 +643,38 @@ void PoolController::update_solar_heating(){
     
 }
 
-void PoolController::update_relays(){
+void PoolController::run_control(){
+  unsigned long pending = control_input_us;
+  byte requested = control_requested;
+  control_requested = 0;
+
+  //Inputs: sensor readings are harvested as conversions finish and the
+  //manual switch is debounced every update(), so they're already current.
+  //Then everything that depends on them, in order:
+  update_pool_state();
+  apply_schedule();
+  update_solar_heating();
+  commit_relays();
+
+  plogD(POOL_LOG_CONTROL_PASS, POOL_STATE_STRINGS[pool_state], SOLAR_STATE_STRINGS[solar_state]);
+
+  //How long the input that asked for this pass took to reach the relays
+  if (requested){
+    profiler.record(POOL_PROFILE_INPUT_TO_RELAY, micros() - pending);
+  }
+}
+
+void PoolController::request_control(){
+  if (!control_requested){
+    control_requested = 1;
+    control_input_us = micros();
+  }
+}
+
+void PoolController::apply_schedule(){
 
   byte scheduled_on=0;
   RelayState s;
-  byte anything_changed = 0;
-
-  pdebugD("PoolController::update_relays() called\n");
 
   //DEBUG (comment out for production) (hardware debug logic)
   /*unsigned long now = millis();
@@ -364,13 +692,12 @@ void PoolController::update_relays(){
 
   pdebugD("Updating relay outputs: (");
   for (int x=0;x<MAX_RELAY;x++){
-    pdebugD("%s=%s\n",relays[x].name.c_str(),POOL_RELAY_STATE_STRINGS[relays[x].state]);
-    //NOTE: The relays we're using are active-low
-    relay_output->setNoUpdate(x, (relays[x].state == POOL_RELAY_ON ||
-          relays[x].state == POOL_RELAY_MANUAL_ON) ? LOW : HIGH);
+    pdebugD("%s=%s\n",relays[x].name,POOL_RELAY_STATE_STRINGS[relays[x].state]);
+    relay_output.set(x, relays[x].state == POOL_RELAY_ON ||
+                        relays[x].state == POOL_RELAY_MANUAL_ON);
   }
   pdebugD(")\n");
-  relay_output->updateRegisters();
+  relay_output.commit();
 
   return;*/ 
   //END DEBUG
@@ -383,20 +710,19 @@ void PoolController::update_relays(){
     case POOL_STATE_NO_NTP:
     case POOL_STATE_UNINITIALIZED:
       for (int x=0;x<MAX_RELAY;x++){
-        //record if we changed anything 
-        if (relays[x].state != POOL_RELAY_OFF && 
-            relays[x].state != POOL_RELAY_MANUAL_OFF){
-          anything_changed=1;
-        }
-        relays[x].state = POOL_RELAY_OFF;
+        relays[x].setState(POOL_RELAY_OFF,
+                      (pool_state == POOL_STATE_MANUAL) ? POOL_RELAY_CAUSE_MANUAL : POOL_RELAY_CAUSE_SYSTEM);
       }
       break; 
 
     case POOL_STATE_RUN_SCHEDULE:
       
-      //iterate the schedule and update relay states appropriately
+      //Only recomputes at a transition, otherwise this is a no-op
+      update_schedule();
+
+      //update relay states appropriately
       for (int x = 0;x < MAX_RELAY; x++){
-        scheduled_on = determineRelayFromSchedule(relays[x].schedule);
+        scheduled_on = (schedule_bits >> x) & 1;
 
         switch (relays[x].state){
           //Handle manually set relays (and let them reset to running the schedule
@@ -414,82 +740,323 @@ void PoolController::update_relays(){
         }        
 
         //Update the relay state
-        if (s != relays[x].state){
-          anything_changed=1;
-          relays[x].state = s;
-        }
+        relays[x].setState(s, POOL_RELAY_CAUSE_SCHEDULE);
       }
       break;
   }
+}
 
-  //If we changed any relay states, update the shift register
-  //if (anything_changed){
-  if (1){
-    pdebugD("Updating relay outputs: (");
-    for (int x=0;x<MAX_RELAY;x++){
-      pdebugD("%s=%s\n",relays[x].name.c_str(),POOL_RELAY_STATE_STRINGS[relays[x].state]);
-      //NOTE: The relays we're using are active-low
-      relay_output->setNoUpdate(x, (relays[x].state == POOL_RELAY_ON ||
-                                   relays[x].state == POOL_RELAY_MANUAL_ON) ? LOW : HIGH);
+void PoolController::commit_relays(){
+  //Push the states into the output image, the driver only shifts/latches
+  //if that actually changed the byte. Edges get counted against whatever
+  //caused them.
+  unsigned long ms = millis();
+  byte edges = 0;
+  for (int x=0;x<MAX_RELAY;x++){
+    byte on = relays[x].isOn();
+    relay_output.set(x, on);
+    if (on != relay_stats.on[x]){
+      relay_stats.changed(x, on, relays[x].cause, ms);
+      edges = 1;
     }
-    pdebugD(")\n");
-    relay_output->updateRegisters();
-    
-  } 
+  }
+  if (edges){
+    relay_stats.saveRtc();
+  }
+  if (relay_output.commit()){
+    plogD(POOL_LOG_RELAY_OUTPUTS, relay_output.latched);
+  }
 }
 
 void PoolController::update()
 {
-  unsigned long now = millis();
+  PoolProfileTimer timer(profiler, POOL_PROFILE_UPDATE);
+  PoolAllocWatch allocs(update_allocs);
 
   //Bail if we're unitialized
   if (this->pool_state == POOL_STATE_UNINITIALIZED){
-    pdebugD("update() called with uninitialized PoolController, bailing...\n");
+    plogD(POOL_LOG_UPDATE_UNINITIALIZED);
     return;
   }
 
-  //Debounce our manual mode switch (need to call this often regardless of update
-  //interval)
-  manualModeSwitch.update();
-
-  //Bail if we just updated the state (restrict updates to a set interval)
-  if (now - this->last_update <= POOL_UPDATE_INTERVAL){
-    return;
+  //Debounce our manual mode switch (need to call this often regardless of
+  //which tasks are due)
+  if (manualModeSwitch.update()){
+    request_control();
   }
-  pdebugD("PoolController::update() running at %lu\n",now);
 
-  //Ensure our wifi state is up to date
-  connect_wifi(wifi_ssid,wifi_pw); 
+  //Pick up an NTP reply as soon as it lands (the round trip math depends on it)
+  poll_ntp();
 
-  //update our sensors and switch states
-  update_temperature_sensors();
+  //Fire relay schedule transitions the second they're due, and anything
+  //that changed an input, rather than waiting for the control task's period
+  if (pool_state == POOL_STATE_RUN_SCHEDULE && now() >= schedule_next_transition){
+    request_control();
+  }
+  if (control_requested){
+    run_task(POOL_TASK_CONTROL);
+    return;
+  }
 
-  //Update our ntp state (if it's time)
-  update_ntp();
+  //If a 1-wire conversion just finished, publishing the readings is all
+  //we do this pass
+  if (poll_temperature_sensors()){
+    return;
+  }
 
-  //Figure out what to do with the relays based on all we know
-  update_relays();
+  //Search the bus as soon as it's free if someone asked
+  if (sensor_scan_requested && sensor_conversion_state != POOL_SENSORS_CONVERTING){
+    run_task(POOL_TASK_DISCOVERY);
+    return;
+  }
 
-  //Get the next state based on our updates (provided we haven't gone critical)
-  update_pool_state();
+  //Run (at most) one stage per call so no single loop() pass takes the
+  //hit for everything at once
+  int task = scheduler.nextDueTask(millis());
+  if (task < 0){
+    return;
+  }
+  run_task(task);
+}
 
-  //Update the solar heating logic
-  update_solar_heating();
+void PoolController::run_task(int id){
+  PoolProfileTimer timer(profiler, id);
+  PoolMemoryProbe memory_probe(memory, id);
+  PoolAllocWatch allocs(scheduler.tasks[id].allocs);
+  scheduler.taskStarted(id, millis());
+  plogV(POOL_LOG_TASK_RUN, scheduler.tasks[id].name);
+
+  switch (id){
+    case POOL_TASK_WIFI:
+      //Ensure our wifi state is up to date
+      connect_wifi(wifi_ssid,wifi_pw); 
+      break;
+    case POOL_TASK_SENSORS:
+      //update our sensors and switch states
+      update_temperature_sensors();
+      break;
+    case POOL_TASK_NTP:
+      //Update our ntp state (if it's time)
+      update_ntp();
+      break;
+    case POOL_TASK_CONTROL:
+      //Pool state, schedules and solar into the relays, all in one pass
+      run_control();
+      break;
+    case POOL_TASK_ANALOG:
+      //Sample/filter the analog thermistor
+      update_analog_sensor();
+      break;
+    case POOL_TASK_CONFIG:
+      //Write out config changes once they've settled
+      persist_config();
+      break;
+    case POOL_TASK_DISCOVERY:
+      //Look for 1-wire sensors that came or went
+      discover_temperature_sensors();
+      break;
+    case POOL_TASK_HISTORY:
+      //Sample temperatures/relays into the history
+      update_history();
+      break;
+    case POOL_TASK_RELAY_STATS:
+      //Checkpoint/persist the relay counters
+      update_relay_stats();
+      break;
+    case POOL_TASK_MQTT:
+      //Keep the broker connection up and publish what changed
+      update_mqtt();
+      break;
+  }
 
   //Log the update time to now (since it probably took a little time to do all that)
   last_update = millis();
+  scheduler.taskFinished(id, last_update);
+
+  check_snapshot();
+}
+
+void PoolController::publish_event(const char* name, JsonDocument& data){
+  if (!events.begin(name)) return;
+  serializeJson(data, events);
+  events.end();
+}
+
+void PoolController::check_snapshot(){
+  //Wifi connection state/counters/signal
+  unsigned long wifi_events = wifi_attempts + wifi_connects + wifi_disconnects + wifi_failures;
+  long rssi = WiFi.RSSI();
+  if (wifi_state != snapshot.last_wifi_state ||
+      wifi_events != snapshot.last_wifi_events ||
+      labs(rssi - snapshot.last_rssi) >= POOL_SNAPSHOT_RSSI_DELTA){
+    snapshot.last_wifi_state = wifi_state;
+    snapshot.last_wifi_events = wifi_events;
+    snapshot.last_rssi = rssi;
+    snapshot.touch(POOL_SNAPSHOT_WIFI);
+  }
+
+  //Relay states
+  byte changed = 0;
+  byte listening = (events.numClients() > 0);
+  for (int x = 0; x < MAX_RELAY; x++){
+    if (relays[x].state != snapshot.last_relay_states[x]){
+      snapshot.last_relay_states[x] = relays[x].state;
+      changed = 1;
+
+      if (listening){
+        PoolJsonDocument e(POOL_JSON_EVENT_SIZE);
+        e["name"] = (const char*)relays[x].name;
+        e["state"] = POOL_RELAY_STATE_STRINGS[relays[x].state];
+        e["cause"] = POOL_RELAY_CAUSE_STRINGS[relays[x].cause];
+        publish_event(POOL_EVENT_RELAY, e);
+      }
+    }
+  }
+  if (changed){
+    snapshot.touch(POOL_SNAPSHOT_RELAYS);
+  }
+
+  //Sensors coming/going and temperatures
+  changed = (num_sensors != snapshot.last_num_sensors);
+  snapshot.last_num_sensors = num_sensors;
+  for (int x = 0; x < num_sensors; x++){
+    uint32_t name = PoolSnapshot::hash(temp_sensors[x].name);
+    if (name != snapshot.last_sensor_names[x] ||
+        fabs(temp_sensors[x].temp - snapshot.last_sensor_temps[x]) >= POOL_SNAPSHOT_TEMP_DELTA){
+      snapshot.last_sensor_names[x] = name;
+      snapshot.last_sensor_temps[x] = temp_sensors[x].temp;
+      changed = 1;
+    }
+  }
+  if (changed){
+    snapshot.touch(POOL_SNAPSHOT_SENSORS);
+  }
+
+  //Temperatures for /events go by their own (coarser) deadband
+  for (int x = 0; x < num_sensors; x++){
+    if (events.tempChanged(x, snapshot.last_sensor_names[x], temp_sensors[x].temp) && listening){
+      PoolJsonDocument e(POOL_JSON_EVENT_SIZE);
+      e["name"] = (const char*)temp_sensors[x].name;
+      e["temp_f"] = temp_sensors[x].temp;
+      publish_event(POOL_EVENT_SENSOR, e);
+    }
+  }
+
+  //Solar heating state
+  if (solar_state != snapshot.last_solar_state){
+    snapshot.last_solar_state = solar_state;
+    snapshot.touch(POOL_SNAPSHOT_SOLAR);
+
+    if (listening){
+      PoolJsonDocument e(POOL_JSON_EVENT_SIZE);
+      e["state"] = SOLAR_STATE_STRINGS[solar_state];
+      publish_event(POOL_EVENT_SOLAR, e);
+    }
+  }
+
+  //Mode/errors/time sync, and the counters every so often
+  unsigned long errors = 0;
+  for (int x = 0; x < num_errors; x++){
+    errors |= (1UL << pool_errors[x]);
+  }
+  if (listening && pool_state != snapshot.last_pool_state){
+    PoolJsonDocument e(POOL_JSON_EVENT_SIZE);
+    e["mode"] = POOL_STATE_STRINGS[pool_state];
+    publish_event(POOL_EVENT_MODE, e);
+  }
+  unsigned long new_errors = errors & ~snapshot.last_errors;
+  for (int x = 0; listening && new_errors != 0 && x < POOL_NUM_ERRORS; x++){
+    if (new_errors & (1UL << x)){
+      PoolJsonDocument e(POOL_JSON_EVENT_SIZE);
+      e["error"] = POOL_ERR_STRINGS[x];
+      publish_event(POOL_EVENT_ERROR, e);
+    }
+  }
+
+  unsigned long now = millis();
+  if (pool_state != snapshot.last_pool_state ||
+      errors != snapshot.last_errors ||
+      last_ntp_update != snapshot.last_ntp_update ||
+      now - snapshot.last_telemetry >= POOL_SNAPSHOT_TELEMETRY_PERIOD){
+    snapshot.last_pool_state = pool_state;
+    snapshot.last_errors = errors;
+    snapshot.last_ntp_update = last_ntp_update;
+    snapshot.last_telemetry = now;
+    snapshot.touch(POOL_SNAPSHOT_GENERAL);
+  }
+}
+
+void PoolController::refresh_snapshot(){
+  check_snapshot();
+
+  byte rebuilt = 0;
+  for (int x = 0; x < POOL_NUM_SNAPSHOT_SECTIONS; x++){
+    if (!snapshot.isStale(x)) continue;
+
+    switch (x){
+      case POOL_SNAPSHOT_WIFI: {
+        PoolJsonDocument doc(POOL_JSON_WIFI_SIZE);
+        getJSONWifiDetails(doc);
+        //NOTE Don't return our wifi password (if somebody puts the controller in manual
+        // it could result in a real-world security issue)
+        doc["wifi"].remove("pw");
+        snapshot.store(x, doc);
+        break;
+      }
+      case POOL_SNAPSHOT_RELAYS: {
+        PoolJsonDocument doc(POOL_JSON_RELAYS_SIZE);
+        getJSONRelayDetails(doc);
+        snapshot.store(x, doc);
+        break;
+      }
+      case POOL_SNAPSHOT_SENSORS: {
+        PoolJsonDocument doc(POOL_JSON_SENSORS_SIZE);
+        getJSONSensorsDetails(doc);
+        snapshot.store(x, doc);
+        break;
+      }
+      case POOL_SNAPSHOT_SOLAR: {
+        PoolJsonDocument doc(POOL_JSON_SOLAR_SIZE);
+        getJSONSolarDetails(doc);
+        snapshot.store(x, doc);
+        break;
+      }
+      case POOL_SNAPSHOT_GENERAL: {
+        PoolJsonDocument doc(POOL_JSON_GENERAL_SIZE);
+        getJSONGeneralDetails(doc);
+        snapshot.store(x, doc);
+        break;
+      }
+    }
+    rebuilt = 1;
+  }
+
+  if (!rebuilt){
+    snapshot.hits++;
+  }
 }
-void PoolController::getJSONWifiDetails(DynamicJsonDocument& info){
+
+void PoolController::getJSONWifiDetails(JsonDocument& info){
   //DynamicJsonDocument info(512);
   JsonObject wifi = info.createNestedObject("wifi");
   wifi["ssid"] = wifi_ssid;
   wifi["pw"] = wifi_pw;
   wifi["ntp_server"] = ntp_server_name;
   wifi["tz_offset"] = gmt_offset;
+
+  //Connection manager status
+  JsonObject status = wifi.createNestedObject("status");
+  status["state"] = POOL_WIFI_STATE_STRINGS[wifi_state];
+  status["rssi"] = WiFi.RSSI();
+  status["attempts"] = wifi_attempts;
+  status["connects"] = wifi_connects;
+  status["disconnects"] = wifi_disconnects;
+  status["failures"] = wifi_failures;
+  status["backoff_ms"] = wifi_backoff_ms;
   //return info;
 }
 
-void PoolController::getJSONSensorsDetails(DynamicJsonDocument& info){
+void PoolController::getJSONSensorsDetails(JsonDocument& info){
   //DynamicJsonDocument info(512);
   
   JsonArray d_sensors = info.createNestedArray("sensors");
@@ -497,15 +1064,15 @@ void PoolController::getJSONSensorsDetails(DynamicJsonDocument& info){
   for (int x=0;x<num_sensors;x++){
     JsonObject t = d_sensors.createNestedObject();
     t["name"] = temp_sensors[x].name;
-    t["role"] = getSensorRole(temp_sensors[x].name); 
+    t["role"] = (const __FlashStringHelper*)getSensorRole(temp_sensors[x].name);
     t["temp_f"] = temp_sensors[x].temp;
-    if (isSensorDigital(temp_sensors[x].name.c_str())) t["type"] = F("DS1820 Digital Sensor");
-    else if (isSensorAnalog(temp_sensors[x].name.c_str())) t["type"] = F("Analog Thermistor");
+    if (isSensorDigital(temp_sensors[x].name)) t["type"] = F("DS1820 Digital Sensor");
+    else if (isSensorAnalog(temp_sensors[x].name)) t["type"] = F("Analog Thermistor");
     else t["type"] = F("not set"); 
   }
 }
 
-void PoolController::getJSONRelayDetails(DynamicJsonDocument& info){
+void PoolController::getJSONRelayDetails(JsonDocument& info){
   //DynamicJsonDocument info(2048);
   char timebuffer[32];
   
@@ -532,6 +1099,46 @@ void PoolController::getJSONRelayDetails(DynamicJsonDocument& info){
   }
 }
 
+void PoolController::getJSONRelayRuntime(JsonDocument& info){
+  unsigned long ms = millis();
+  JsonArray json_relays = info["relays"];
+  int x = 0;
+  for (JsonObject r : json_relays){
+    if (x >= MAX_RELAY) break;
+    JsonObject rt = r.createNestedObject("runtime");
+    rt["on_secs"] = relay_stats.totalOnSecs(x, ms);
+    rt["switches"] = relay_stats.totalSwitches(x);
+    rt["secs_since_change"] = (ms - relay_stats.last_change[x]) / 1000;
+    x++;
+  }
+}
+
+void PoolController::getJSONRelayStats(JsonDocument& info){
+  static const char* sources[] = {"none", "rtc", "file"};
+  unsigned long ms = millis();
+
+  JsonObject stats = info.createNestedObject("relay_stats");
+  stats["source"] = sources[relay_stats.loaded_from];
+  stats["file_saves"] = relay_stats.file_saves;
+  stats["save_failures"] = relay_stats.save_failures;
+
+  JsonArray json_relays = stats.createNestedArray("relays");
+  for (int x = 0; x < MAX_RELAY; x++){
+    JsonObject r = json_relays.createNestedObject();
+    r["name"] = relays[x].name;
+    r["on"] = relay_stats.on[x];
+    r["cause"] = POOL_RELAY_CAUSE_STRINGS[relays[x].cause];
+    r["secs_since_change"] = (ms - relay_stats.last_change[x]) / 1000;
+
+    JsonObject on_secs = r.createNestedObject("on_secs");
+    JsonObject switches = r.createNestedObject("switches");
+    for (int y = 0; y < POOL_RELAY_NUM_CAUSES; y++){
+      on_secs[POOL_RELAY_CAUSE_STRINGS[y]] = relay_stats.onSecs(x, y, ms);
+      switches[POOL_RELAY_CAUSE_STRINGS[y]] = relay_stats.record.relays[x].switches[y];
+    }
+  }
+}
+
 //Returns: 0 on failure, 1 on success (and puts time-of-day in target)
 int createElements(const char *str,tmElements_t *target)
 {
@@ -540,8 +1147,8 @@ int createElements(const char *str,tmElements_t *target)
 
   if (ret != 3) return 0;
   if (h < 0 || h >23) return 0;
-  if (m < 0 || m > 60) return 0;
-  if (s < 0 || s > 60) return 0;
+  if (m < 0 || m > 59) return 0;
+  if (s < 0 || s > 59) return 0;
 
   target->Hour = h;
   target->Minute = m;
@@ -550,14 +1157,63 @@ int createElements(const char *str,tmElements_t *target)
 }
 
 //Returns 0 or a matching relay
-Relay* PoolController::getRelayByName(String name){
+Relay* PoolController::getRelayByName(const char* name){
+  if (name == 0) return 0;
+  for (int x = 0;x< MAX_RELAY;x++){
+    if (!strcmp(relays[x].name,name))
+      return &(relays[x]);
+  } 
+  return 0;
+}
+
+Relay* PoolController::getRelayByName_P(PGM_P name){
   for (int x = 0;x< MAX_RELAY;x++){
-    if (relays[x].name == name)
+    if (POOL_NAME_IS(relays[x].name,name))
       return &(relays[x]);
   } 
   return 0;
 }
 
+void PoolController::invalidate_handles(){
+  handles_valid = 0;
+}
+
+//Returns the index of the sensor with the given name or -1
+static int sensorIndex(TempSensor* sensors, int num_sensors, const char* name){
+  if (name[0] == 0) return -1;
+  for (int x = 0; x < num_sensors; x++){
+    if (!strcmp(sensors[x].name, name)) return x;
+  }
+  return -1;
+}
+
+void PoolController::resolve_handles(){
+  if (handles_valid) return;
+
+  Relay* r = getRelayByName_P(POOL_RELAY_PUMP_NAME);
+  pump_relay_idx = r ? (r - relays) : -1;
+  r = getRelayByName_P(POOL_RELAY_SOLAR_VALVE_NAME);
+  solar_valve_relay_idx = r ? (r - relays) : -1;
+
+  water_sensor_idx = sensorIndex(temp_sensors, num_sensors, pool_water_sensor_name);
+  roof_sensor_idx = sensorIndex(temp_sensors, num_sensors, roof_sensor_name);
+  ambient_sensor_idx = sensorIndex(temp_sensors, num_sensors, ambient_air_sensor_name);
+  analog_sensor_idx = sensorIndex(temp_sensors, num_sensors, "analog");
+
+  pdebugD("Resolved handles: pump=%d solar_valve=%d water=%d roof=%d ambient=%d analog=%d\n",
+          pump_relay_idx, solar_valve_relay_idx, water_sensor_idx, roof_sensor_idx,
+          ambient_sensor_idx, analog_sensor_idx);
+  handles_valid = 1;
+}
+
+Relay* PoolController::relayAt(int idx){
+  return (idx >= 0) ? &(relays[idx]) : 0;
+}
+
+TempSensor* PoolController::sensorAt(int idx){
+  return (idx >= 0 && idx < num_sensors) ? &(temp_sensors[idx]) : 0;
+}
+
 byte PoolController::parseDailySchedule(PoolDailySchedule& d, JsonArray& schedule,String& err){
   TimeElements on_time,off_time;
   unsigned long on_secs,off_secs;
@@ -583,19 +1239,25 @@ byte PoolController::parseDailySchedule(PoolDailySchedule& d, JsonArray& schedul
       return 0;
     }
 
+    //bail if there's no room for it (the config record only holds MAX_SCHEDULES)
+    if (d.num_schedules >= MAX_SCHEDULES){
+      err = "Too many schedule entries";
+      return 0;
+    }
+
     //bail if the off/on range intersects any other ranges already stored
     for (int x=0;x<d.num_schedules;x++){
       ofs = timeOfDay(d.off_time[x].Hour,d.off_time[x].Minute,d.off_time[x].Second);
       ons = timeOfDay(d.on_time[x].Hour,d.on_time[x].Minute,d.on_time[x].Second);
 
-      pdebugD("Compare overlap: %d/%d and %d/%d\n",on_secs,off_secs,ons,ofs);
+      plogD(POOL_LOG_SCHEDULE_COMPARE, on_secs, off_secs, ons, ofs);
 
       if (max(on_secs,ons) < min(off_secs,ofs)){
         err = "Time ranges can not overlap";
         return 0;
       }
 
-      pdebugD("No overlap found!\n");
+      plogD(POOL_LOG_SCHEDULE_NO_OVERLAP);
     }
 
     //If we get here, the schedule entry is valid, add it to the list
@@ -604,47 +1266,51 @@ byte PoolController::parseDailySchedule(PoolDailySchedule& d, JsonArray& schedul
     d.num_schedules++;
   }
 
+  //Sort/convert for the schedule engine
+  d.compile();
   pdebugD("Added %d schedule entries\n",d.num_schedules);
 
   return 1;
 
 }
 
-byte PoolController::setJSONRelayDetails(JsonArray& relays, String& err, byte loading_config){
-  pdebugI("Got request to update relay schedule\n");
-
-  //Make sure the update has the right number of relay elements
-  /*if (relays.size() != MAX_RELAY){
-    err = "Incorrect number of relays";
+byte PoolController::validateJSONRelayDetails(JsonArray& relays, String& err, byte loading_config){
+  //A config sets the relays up in order, so it can't have more than we do
+  if (relays.size() > MAX_RELAY){
+    err = "Too many relays";
     pdebugE("%s\n",err.c_str());
     return 0;
-  }*/
+  }
 
-  //Iterate the schedule (validation only)
   PoolDailySchedule sched_buffer;
   JsonArray s;
   String state;
-  String name;
-  Relay* rp = 0;
+  const char* name;
   for (JsonVariant r : relays){
     JsonObject relay = r.as<JsonObject>(); 
 
     //Ensure the relay has a name (that's how we find it)
-    if (relay["name"].isNull()){
+    name = relay["name"].as<const char*>();
+    if (name == 0){
         err = "Missing \"name\" field for relay specified";
         pdebugE("%s\n",err.c_str());
         return 0;
     }
-    if (!loading_config){
-      name = relay["name"].as<String>(); 
-      rp = getRelayByName(relay["name"]);
-      if (rp == 0){
-          err = "Relay name specified doesn't match any known relay";
-          pdebugE("%s\n",err.c_str());
-          return 0;
+    if (!loading_config && getRelayByName(name) == 0){
+        err = "Relay name specified doesn't match any known relay";
+        pdebugE("%s\n",err.c_str());
+        return 0;
+    }
+
+    //Parse the state and check it for sanity
+    if (!relay["state"].isNull()){
+      state = relay["state"].as<String>(); 
+      if (state != "on" && state != "off"){
+        err = "Invalid \"state\" provided, must be \"on\" or \"off\"";
+        pdebugE("%s\n",err.c_str());
+        return 0;
       }
     }
-    
 
     //Parse the schedule and check it for sanity
     s = relay["schedule"];
@@ -654,24 +1320,29 @@ byte PoolController::setJSONRelayDetails(JsonArray& relays, String& err, byte lo
       pdebugE("%s\n",err.c_str());
       return 0;
     }  
+  }
+  return 1;
+}
 
-    //Parse the state and check it for sanity
-    if (!relay["state"].isNull()){
-      state = relay["state"].as<String>(); 
-      if (state != "on" && state != "off"){
-        err = "Invalid \"state\" provided, must be \"on\" or \"off\"";
-        pdebugE("%s\n",err.c_str());
-        return 0;
-      }
-    }
+byte PoolController::setJSONRelayDetails(JsonArray& relays, String& err, byte loading_config){
+  pdebugI("Got request to update relay schedule\n");
+
+  if (!validateJSONRelayDetails(relays, err, loading_config)){
+    return 0; //NOTE: the validate method logs the error reason
   }
 
   //Iterate the schedule again and update (if we make it here
   //the schedule is valid)
+  PoolDailySchedule sched_buffer;
+  JsonArray s;
+  String state;
+  const char* name;
+  Relay* rp = 0;
   int x = 0;
   RelayState rstate;
-  String name_buff;
   for (JsonVariant relay : relays){
+    //NOTE: validateJSONRelayDetails() already turned away anything longer
+    if (x >= MAX_RELAY) break;
 
     //Get our internal relay object
     //NOTE: If we're loading our config, we assume there
@@ -681,8 +1352,8 @@ byte PoolController::setJSONRelayDetails(JsonArray& relays, String& err, byte lo
     }
     //Otherwise, we just match the relays by name
     else{
-      name = relay["name"].as<String>(); 
-      rp = getRelayByName(relay["name"]);
+      name = relay["name"].as<const char*>();
+      rp = getRelayByName(name);
     }
 
     //Parse the schedule and update it if present
@@ -693,6 +1364,7 @@ byte PoolController::setJSONRelayDetails(JsonArray& relays, String& err, byte lo
        
       //Update our relay
       rp->schedule = sched_buffer;
+      schedule_dirty = 1;
     }
 
     //parse the relay state and update it if present
@@ -704,14 +1376,14 @@ byte PoolController::setJSONRelayDetails(JsonArray& relays, String& err, byte lo
       //Otherwise, note that the state change is a manual override of the schedule
       else
         rstate = (state == "on") ? POOL_RELAY_MANUAL_ON : POOL_RELAY_MANUAL_OFF;
-      rp->state = rstate;
+      rp->setState(rstate, loading_config ? POOL_RELAY_CAUSE_SYSTEM : POOL_RELAY_CAUSE_MANUAL);
     }
 
     //If we set to update names (config loading only)
     if (loading_config){
-      name_buff = relay["name"].as<String>();
-      if (name_buff != ""){
-        rp->name = name_buff;
+      name = relay["name"].as<const char*>();
+      if (name != 0 && name[0] != 0){
+        POOL_SET_NAME(rp->name, name);
       }
     }
       
@@ -719,117 +1391,324 @@ byte PoolController::setJSONRelayDetails(JsonArray& relays, String& err, byte lo
   }
 
   pdebugI("Successfully updated relays schedule/states\n");
+  snapshot.touch(POOL_SNAPSHOT_RELAYS);
+  invalidate_handles();
+  request_control();
 
   //Save the config
-  return save_config();
+  if (!loading_config) mark_config_dirty();
+  return 1;
+}
+
+void PoolController::set_wifi_state(WifiConnState state){
+  pdebugD("Wifi state %s -> %s\n",POOL_WIFI_STATE_STRINGS[wifi_state],POOL_WIFI_STATE_STRINGS[state]);
+  wifi_state = state;
+  wifi_state_since = millis();
 }
 
 /*
     Sets up the wifi in either AP (manual mode) or STA (regular mode)
     depending on the pool state.
+
+    This never waits on the radio. Each call looks at what the wifi event
+    callbacks told us and moves the connection state machine along:
+      IDLE -> CONNECTING -> CONNECTED
+                  |              |
+                  v              v (link dropped)
+               BACKOFF -------> IDLE
+    Failed attempts back off exponentially (WIFI_BACKOFF_MIN/MAX).
 */
-//returns success on connection, 0 on failure
+//returns 1 if connected, 0 otherwise
 //static DNSServer         dnsServer;              // Create the DNS object
-byte PoolController::connect_wifi(String ssid, String pw){
-  byte connected = 0;
+byte PoolController::connect_wifi(const char* ssid, const char* pw){
+  unsigned long now = millis();
+
+  //Hook up the event callbacks the first time through
+  //NOTE: These are called from the SDK, so they only set flags
+  if (!wifi_got_ip_handler){
+    wifi_got_ip_handler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP&){
+      wifi_got_ip = 1;
+    });
+    wifi_disconnected_handler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected&){
+      wifi_lost = 1;
+    });
+  }
 
-  if (ssid == nullptr || ssid == ""){
+  if (ssid == nullptr || ssid[0] == 0){
     pdebugE("Invalid SSID (null or empty) passed. failing\n");
     return 0;
   }
 
-  switch (pool_state){
-    case POOL_STATE_MANUAL:
-      if (WiFi.getMode() != WIFI_AP_STA){
-        WiFi.disconnect();
-        WiFi.hostname(HOSTNAME);
-        WiFi.mode(WIFI_AP_STA);
-        IPAddress apIP(10, 10, 10, 1);    // Private network for server
-        pdebugI("Configuring AP Mode: %d\n",WiFi.softAPConfig(apIP, apIP, IPAddress(255, 255, 255, 0)));
-        pdebugI("Starting softAP: %d\n", WiFi.softAP("Poolnet"));
+  if (pool_state == POOL_STATE_MANUAL){
+    if (wifi_state != POOL_WIFI_AP_MODE || WiFi.getMode() != WIFI_AP_STA){
+      WiFi.disconnect();
+      WiFi.hostname(HOSTNAME);
+      WiFi.mode(WIFI_AP_STA);
+      IPAddress apIP(10, 10, 10, 1);    // Private network for server
+      pdebugI("Configuring AP Mode: %d\n",WiFi.softAPConfig(apIP, apIP, IPAddress(255, 255, 255, 0)));
+      pdebugI("Starting softAP: %d\n", WiFi.softAP("Poolnet"));
+      set_wifi_state(POOL_WIFI_AP_MODE);
+    }
+    return 1;
+  }
+
+  //We just left manual mode, start over as a station
+  if (wifi_state == POOL_WIFI_AP_MODE){
+    set_wifi_state(POOL_WIFI_IDLE);
+  }
+
+  //Catch up on what the event callbacks saw
+  if (wifi_got_ip){
+    wifi_got_ip = 0;
+    if (wifi_state == POOL_WIFI_CONNECTING){
+      wifi_connects++;
+      wifi_backoff_ms = 0;
+      wifi_verifying = 0;
+      clear_error(POOL_ERR_NO_WIFI);
+      pdebugI("Connected to %s after %lu ms! IP Address is %s\n",ssid,now - wifi_state_since,
+              WiFi.localIP().toString().c_str());
+      set_wifi_state(POOL_WIFI_CONNECTED);
+    }
+  }
+  if (wifi_lost){
+    wifi_lost = 0;
+    if (wifi_state == POOL_WIFI_CONNECTED){
+      wifi_disconnects++;
+      log_error(POOL_ERR_NO_WIFI);
+      pdebugW("Lost connection to %s, reconnecting\n",ssid);
+      set_wifi_state(POOL_WIFI_IDLE);
+    }
+  }
+
+  switch (wifi_state){
+    case POOL_WIFI_CONNECTED:
+      //Make sure we're still connected
+      //NOTE: No need to compare WiFi.SSID() (which builds a String every time),
+      //      new credentials always send us back through POOL_WIFI_IDLE
+      if (WiFi.status() != WL_CONNECTED){
+        pdebugI("Wifi no longer connected to %s, reconnecting\n",ssid);
+        set_wifi_state(POOL_WIFI_IDLE);
+        return 0;
       }
-      else{
-        pdebugD("Already running AP mode, ignoring request\n");
-        connected = 1;
+      return 1;
+
+    case POOL_WIFI_CONNECTING:
+      if (now - wifi_state_since < WIFI_CONNECT_TIMEOUT){
+        return 0;
+      }
+      wifi_failures++;
+      log_error(POOL_ERR_NO_WIFI);
+
+      //If we were trying out new credentials, go back to the ones we had before
+      if (wifi_verifying){
+        pdebugE("Unable to connect to %s, reverting to previous settings (%s)\n",
+                ssid,wifi_fallback_ssid);
+        wifi_verifying = 0;
+        POOL_SET_NAME(wifi_ssid, wifi_fallback_ssid);
+        POOL_SET_NAME(wifi_pw, wifi_fallback_pw);
+        snapshot.touch(POOL_SNAPSHOT_WIFI);
+        mark_config_dirty();
+        set_wifi_state(POOL_WIFI_IDLE);
+        return 0;
       }
-      break;
-    default:
-      //If we aren't in STA mode, let's try to connect
-      if (WiFi.getMode() != WIFI_STA ||
-          WiFi.SSID() != ssid ||
-          WiFi.status() != WL_CONNECTED){
-        pdebugI("Current WiFi mode is %d\n",WiFi.getMode());
-        pdebugI("Attempting to connect to wifi SSID=%s\n",ssid.c_str());
-
-        WiFi.disconnect();
-        WiFi.mode(WIFI_STA);
-        WiFi.hostname(HOSTNAME);
-        WiFi.begin(ssid.c_str(),pw.c_str());
-        unsigned long now = millis();
-        // Wait for connection
-        while (millis() - now < WIFI_CONNECT_TIMEOUT){
-          if (WiFi.status() != WL_CONNECTED) {
-            connected = 1;
-            break;
-          }
-          delay(1000);
-        }
 
-        if (connected){
-          pdebugI("Connected! IP Address is %s\n",WiFi.localIP().toString().c_str());         // Send the IP address of the ESP8266 to the computer
-        }  
-        else{
-          pdebugE("Connection failed!\n");
-        }
+      wifi_backoff_ms = (wifi_backoff_ms == 0) ? WIFI_BACKOFF_MIN : wifi_backoff_ms * 2;
+      if (wifi_backoff_ms > WIFI_BACKOFF_MAX){
+        wifi_backoff_ms = WIFI_BACKOFF_MAX;
       }
-      else{
-        pdebugD("Already connected to %s, ignoring request\n",ssid.c_str());
-        connected = 1;
+      pdebugE("Connection to %s failed! Trying again in %lu ms\n",ssid,wifi_backoff_ms);
+      set_wifi_state(POOL_WIFI_BACKOFF);
+      return 0;
+
+    case POOL_WIFI_BACKOFF:
+      if (now - wifi_state_since < wifi_backoff_ms){
+        return 0;
       }
+      //Otherwise, try again
+      //fall through
+
+    default:
+      pdebugI("Current WiFi mode is %d\n",WiFi.getMode());
+      pdebugI("Attempting to connect to wifi SSID=%s (attempt %lu)\n",ssid,wifi_attempts + 1);
+      WiFi.disconnect();
+      WiFi.mode(WIFI_STA);
+      WiFi.hostname(HOSTNAME);
+
+      //Ignore anything the callbacks saw before this attempt (e.g. our own disconnect)
+      wifi_got_ip = 0;
+      wifi_lost = 0;
+      set_wifi_state(POOL_WIFI_CONNECTING);
+
+      WiFi.begin(ssid,pw);
+      wifi_attempts++;
+      return 0;
   }
-  return connected;
+}
+
+byte PoolController::validateJSONWifiDetails(JsonObject& wifi, String& err){
+  //Anything given has to be a string that fits (a cut off password is no use)
+  if ((!wifi["ssid"].isNull() && !wifi["ssid"].is<const char*>()) ||
+      (!wifi["pw"].isNull() && !wifi["pw"].is<const char*>()) ||
+      (!wifi["ntp_server"].isNull() && !wifi["ntp_server"].is<const char*>())){
+    err = F("Wifi ssid/pw/ntp_server must be strings");
+  }
+  else if ((!wifi["ssid"].isNull() && strlen(wifi["ssid"].as<const char*>()) >= sizeof(wifi_ssid)) ||
+           (!wifi["pw"].isNull() && strlen(wifi["pw"].as<const char*>()) >= sizeof(wifi_pw)) ||
+           (!wifi["ntp_server"].isNull() && strlen(wifi["ntp_server"].as<const char*>()) >= sizeof(ntp_server_name))){
+    err = F("Wifi ssid/pw/ntp_server is too long");
+  }
+  else if (!wifi["tz_offset"].isNull() && !wifi["tz_offset"].is<int>()){
+    err = F("Invalid tz_offset");
+  }
+  if (err.length() > 0){
+    pdebugE("%s\n",err.c_str());
+    return 0;
+  }
+  return 1;
 }
 
 byte PoolController::setJSONWifiDetails(JsonObject& wifi, String& err, byte loading_config){
   pdebugI("Got request to update wifi details\n");
 
-  String ssid = wifi["ssid"];
-  String pw = wifi["pw"];
+  if (!validateJSONWifiDetails(wifi, err)){
+    return 0;
+  }
+
+  const char* ssid = wifi["ssid"].isNull() ? "" : wifi["ssid"].as<const char*>();
+  const char* pw = wifi["pw"].isNull() ? "" : wifi["pw"].as<const char*>();
 
   //Attempt to update the NTP settings
   if (!wifi["ntp_server"].isNull()){
-    ntp_server_name=wifi["ntp_server"].as<String>();
+    POOL_SET_NAME(ntp_server_name, wifi["ntp_server"].as<const char*>());
     time_state = POOL_TIME_UNINITIALIZED;
+    ntp_dns_valid = 0;
   }
   //Update the tz_offset if it's set
   if (!wifi["tz_offset"].isNull()){
     gmt_offset = wifi["tz_offset"].as<int>();
   }
 
-  //Attempt to reconnect using the given details (if we're not in the manual pool state)
+  //Switch over to the given details (the wifi task does the connecting)
   if (!wifi["ssid"].isNull() &&
       !wifi["pw"].isNull()){
   //if (ssid != "" && pw != ""){
-    pdebugI("Attempting to update wifi details to SSID: \"%s\" PW: \"%s\"\n",ssid.c_str(),pw.c_str());
-    byte connected = connect_wifi(ssid,pw);
-    if (connected){ 
-      pdebugI("Successfully connected (or bypassed because we're in manual mode)\n");
-      wifi_ssid = ssid;
-      wifi_pw = pw;
-    }
-    //If that didn't work got back to what we had before
-    else{
-      pdebugE("Error connecting, reverting to previous settings\n");
-      connect_wifi(wifi_ssid,wifi_pw);
+    pdebugI("Attempting to update wifi details to SSID: \"%s\" PW: \"%s\"\n",ssid,pw);
+
+    byte changed = (strcmp(ssid, wifi_ssid) || strcmp(pw, wifi_pw));
+
+    //If these are new credentials from a user, hang on to the old ones in case
+    //the new ones don't connect (connect_wifi() reverts them)
+    if (changed && !loading_config && wifi_ssid[0] != 0){
+      POOL_SET_NAME(wifi_fallback_ssid, wifi_ssid);
+      POOL_SET_NAME(wifi_fallback_pw, wifi_pw);
+      wifi_verifying = 1;
+    }
+    POOL_SET_NAME(wifi_ssid, ssid);
+    POOL_SET_NAME(wifi_pw, pw);
+
+    //Start over with the new details (unless we're running our AP)
+    if (changed && wifi_state != POOL_WIFI_AP_MODE){
+      wifi_backoff_ms = 0;
+      set_wifi_state(POOL_WIFI_IDLE);
     }
   }
+  snapshot.touch(POOL_SNAPSHOT_WIFI);
 
   //Save the config
-  save_config();
+  if (!loading_config) mark_config_dirty();
 
   return 1;
 }
-void PoolController::getJSONSolarDetails(DynamicJsonDocument& info){
+void PoolController::getJSONMqttDetails(JsonDocument& info){
+  JsonObject m = info.createNestedObject("mqtt");
+  m["host"] = mqtt.host;
+  m["port"] = mqtt.port;
+  m["user"] = mqtt.user;
+  m["pw"] = mqtt.pw;
+  m["prefix"] = mqtt.prefix;
+  m["temp_deadband"] = mqtt_published.temp_deadband;
+
+  //Connection status
+  JsonObject status = m.createNestedObject("status");
+  status["state"] = POOL_MQTT_STATE_STRINGS[mqtt.state];
+  status["connects"] = mqtt.connects;
+  status["failures"] = mqtt.failures;
+  status["disconnects"] = mqtt.disconnects;
+  status["published"] = mqtt.published;
+  status["received"] = mqtt.received;
+  status["dropped"] = mqtt.dropped;
+  status["last_error"] = mqtt.last_error;
+  status["backoff_ms"] = mqtt.backoff_ms;
+}
+
+byte PoolController::validateJSONMqttDetails(JsonObject& m, String& err){
+  //Anything not given stays as it is
+  const char* host = m["host"].isNull() ? mqtt.host : m["host"].as<const char*>();
+  const char* user = m["user"].isNull() ? mqtt.user : m["user"].as<const char*>();
+  const char* pw = m["pw"].isNull() ? mqtt.pw : m["pw"].as<const char*>();
+  const char* prefix = m["prefix"].isNull() ? mqtt.prefix : m["prefix"].as<const char*>();
+  long port = m["port"].isNull() ? mqtt.port : m["port"].as<long>();
+  float deadband = m["temp_deadband"].isNull() ? mqtt_published.temp_deadband : m["temp_deadband"].as<float>();
+
+  if (host == 0 || user == 0 || pw == 0 || prefix == 0){
+    err = F("MQTT host/user/pw/prefix must be strings");
+  }
+  else if (strlen(host) >= sizeof(mqtt.host) || strlen(user) >= sizeof(mqtt.user) ||
+           strlen(pw) >= sizeof(mqtt.pw) || strlen(prefix) >= sizeof(mqtt.prefix)){
+    err = F("MQTT host/user/pw/prefix is too long");
+  }
+  else if (prefix[0] == 0 || strpbrk(prefix, "+#") != 0 || prefix[strlen(prefix) - 1] == '/'){
+    err = F("Invalid MQTT prefix (it can't be empty, end in '/' or have wildcards)");
+  }
+  else if (port < 1 || port > 65535){
+    err = F("Invalid MQTT port");
+  }
+  else if (deadband < 0 || deadband > POOL_MQTT_MAX_DEADBAND){
+    err = F("Invalid MQTT temp_deadband");
+  }
+  if (err.length() > 0){
+    pdebugE("%s\n",err.c_str());
+    return 0;
+  }
+  return 1;
+}
+
+byte PoolController::setJSONMqttDetails(JsonObject& m, String& err, byte loading_config){
+  pdebugI("Got request to update MQTT details\n");
+
+  //Validate everything before we change anything
+  if (!validateJSONMqttDetails(m, err)){
+    return 0;
+  }
+
+  //Anything not given stays as it is
+  const char* host = m["host"].isNull() ? mqtt.host : m["host"].as<const char*>();
+  const char* user = m["user"].isNull() ? mqtt.user : m["user"].as<const char*>();
+  const char* pw = m["pw"].isNull() ? mqtt.pw : m["pw"].as<const char*>();
+  const char* prefix = m["prefix"].isNull() ? mqtt.prefix : m["prefix"].as<const char*>();
+  long port = m["port"].isNull() ? mqtt.port : m["port"].as<long>();
+  float deadband = m["temp_deadband"].isNull() ? mqtt_published.temp_deadband : m["temp_deadband"].as<float>();
+
+  //Start over if the connection settings changed (the old connection is
+  //closed first, so it says we're going offline under the old prefix)
+  if (strcmp(host, mqtt.host) || strcmp(user, mqtt.user) || strcmp(pw, mqtt.pw) ||
+      strcmp(prefix, mqtt.prefix) || port != mqtt.port){
+    pdebugI("MQTT broker now \"%s:%ld\" (prefix \"%s\")\n",host,port,prefix);
+    mqtt.reset();
+    POOL_SET_NAME(mqtt.host, host);
+    POOL_SET_NAME(mqtt.user, user);
+    POOL_SET_NAME(mqtt.pw, pw);
+    POOL_SET_NAME(mqtt.prefix, prefix);
+    mqtt.port = port;
+  }
+  mqtt_published.temp_deadband = deadband;
+
+  //Save the config
+  if (!loading_config) mark_config_dirty();
+  return 1;
+}
+
+void PoolController::getJSONSolarDetails(JsonDocument& info){
   //DynamicJsonDocument info(256);
   JsonObject solar = info.createNestedObject("solar");
   String solar_state_str="internal error";
@@ -849,9 +1728,7 @@ void PoolController::getJSONSolarDetails(DynamicJsonDocument& info){
   solar["target_temp"] = solar_target_temp;
 }
 
-byte PoolController::setJSONSolarDetails(JsonObject& solar, String& err, byte loading_config){
-  pdebugI("Got request to update solar details\n");
-
+byte PoolController::validateJSONSolarDetails(JsonObject& solar, String& err){
   String enabled = solar["enabled"];
   float target_temp = solar["target_temp"].as<float>();
 
@@ -870,167 +1747,546 @@ byte PoolController::setJSONSolarDetails(JsonObject& solar, String& err, byte lo
       return 0;
     }
   }
+  return 1;
+}
+
+byte PoolController::setJSONSolarDetails(JsonObject& solar, String& err, byte loading_config){
+  pdebugI("Got request to update solar details\n");
+
+  if (!validateJSONSolarDetails(solar, err)){
+    return 0;
+  }
+
+  String enabled = solar["enabled"];
+  float target_temp = solar["target_temp"].as<float>();
 
   //Update the settings
   solar_enabled = (enabled == "on") ? 1 : 0;
   solar_target_temp = target_temp;
   solar_state = solar_enabled ? SOLAR_BYPASS : SOLAR_DISABLED; //NOTE: we set it to bypass since it may have been disabled
   pdebugI("Solar enabled: %d\nSolar target temp (f): %.2f\n",solar_enabled,solar_target_temp);
+  snapshot.touch(POOL_SNAPSHOT_SOLAR);
+  request_control();
 
   //Save the config
-  return save_config();
+  if (!loading_config) mark_config_dirty();
+  return 1;
 }
 
-byte PoolController::validateJSONSensorsUpdate(JsonArray& sensors){
-  String unused((const __FlashStringHelper*)TSR_UNUSED_STR);
-  String pool=((const __FlashStringHelper*)TSR_WATER_STR);
-  String roof=((const __FlashStringHelper*)TSR_SOLAR_STR);
-  String ambient=((const __FlashStringHelper*)TSR_AMBIENT_STR);
-
-  //TODO: Make sure there is only one of each role
-
-  //TODO: Make sure only legit roles are present
-
-  //TODO: Make sure there isn't to many sensors
+byte PoolController::validateJSONSensorsUpdate(JsonArray& sensors, String& err){
+  //Make sure there isn't to many sensors
+  if (sensors.size() > MAX_SENSORS){
+    err = "Too many sensors";
+    pdebugE("%s\n",err.c_str());
+    return 0;
+  }
 
-  //TODO: Make sure we don't have duplicate names
+  byte water = 0, roof = 0, ambient = 0;
+  const char* role;
+  const char* name;
+  int x = 0;
+  for (JsonVariant s : sensors){
+    JsonObject sensor = s.as<JsonObject>();
+    role = sensor["role"].isNull() ? "" : sensor["role"].as<const char*>();
+    name = sensor["name"].isNull() ? "" : sensor["name"].as<const char*>();
+    if (role == 0 || name == 0){
+      err = "Sensor \"name\" and \"role\" must be strings";
+    }
+    //Make sure only legit roles are present
+    else if (role[0] != 0 && !POOL_NAME_IS(role,TSR_UNUSED_STR) && !POOL_NAME_IS(role,TSR_WATER_STR) &&
+             !POOL_NAME_IS(role,TSR_SOLAR_STR) && !POOL_NAME_IS(role,TSR_AMBIENT_STR)){
+      err = "Invalid sensor \"role\"";
+    }
+    //Make sure there is only one of each role
+    else if ((POOL_NAME_IS(role,TSR_WATER_STR) && water++) ||
+             (POOL_NAME_IS(role,TSR_SOLAR_STR) && roof++) ||
+             (POOL_NAME_IS(role,TSR_AMBIENT_STR) && ambient++)){
+      err = "Only one sensor can have each \"role\"";
+    }
+    //Make sure we don't have duplicate names
+    else {
+      int y = 0;
+      for (JsonVariant o : sensors){
+        if (y++ >= x) break;
+        const char* other = o["name"].isNull() ? "" : o["name"].as<const char*>();
+        if (other != 0 && !strcmp(name, other)){
+          err = "Duplicate sensor \"name\"";
+          break;
+        }
+      }
+    }
+    if (err.length() > 0){
+      pdebugE("%s\n",err.c_str());
+      return 0;
+    }
+    x++;
+  }
   return 1;
 }
 
-void PoolController::assignSensorRole(String name, String role){
-  String pool=((const __FlashStringHelper*)TSR_WATER_STR);
-  String roof=((const __FlashStringHelper*)TSR_SOLAR_STR);
-  String ambient=((const __FlashStringHelper*)TSR_AMBIENT_STR);
-  if (role == pool)
-    pool_water_sensor_name = name;
-  else if (role == roof)
-    roof_sensor_name = name;
-  else if (role == ambient)
-    ambient_air_sensor_name = name;
+void PoolController::assignSensorRole(const char* name, const char* role){
+  if (POOL_NAME_IS(role,TSR_WATER_STR))
+    POOL_SET_NAME(pool_water_sensor_name, name);
+  else if (POOL_NAME_IS(role,TSR_SOLAR_STR))
+    POOL_SET_NAME(roof_sensor_name, name);
+  else if (POOL_NAME_IS(role,TSR_AMBIENT_STR))
+    POOL_SET_NAME(ambient_air_sensor_name, name);
+  invalidate_handles();
+
+  //Roles show up in both
+  snapshot.touch(POOL_SNAPSHOT_SENSORS);
+  snapshot.touch(POOL_SNAPSHOT_GENERAL);
 }
     
-TempSensor* PoolController::getSensorByName(String name){
-  if (name == ""){
+TempSensor* PoolController::getSensorByName(const char* name){
+  if (name == 0 || name[0] == 0){
     return 0;
   }
 
-  for (int x=0;x<MAX_SENSORS;x++){
-    if (temp_sensors[x].name == name){
+  for (int x=0;x<num_sensors;x++){
+    if (!strcmp(temp_sensors[x].name,name)){
       return &(temp_sensors[x]);
     }
   }
   return 0;
 }
 
-String PoolController::getSensorRole(String name){
-  String unused((const __FlashStringHelper*)TSR_UNUSED_STR);
-  String pool=((const __FlashStringHelper*)TSR_WATER_STR);
-  String roof=((const __FlashStringHelper*)TSR_SOLAR_STR);
-  String ambient=((const __FlashStringHelper*)TSR_AMBIENT_STR);
-
-  if (pool_water_sensor_name == name)
-    return pool;
-  else if (roof_sensor_name == name)
-    return roof;
-  else if (ambient_air_sensor_name == name)
-    return ambient;
+const char* PoolController::getSensorRole(const char* name){
+  if (!strcmp(pool_water_sensor_name,name))
+    return TSR_WATER_STR;
+  else if (!strcmp(roof_sensor_name,name))
+    return TSR_SOLAR_STR;
+  else if (!strcmp(ambient_air_sensor_name,name))
+    return TSR_AMBIENT_STR;
 
-  return unused;
+  return TSR_UNUSED_STR;
 }
 
 byte PoolController::setJSONSensorsDetails(JsonArray& sensors, String& err, byte loading_config){
-  String role = "";
-  String name = ""; 
-  byte present=0;
+  const char* role;
+  const char* name;
 
   pdebugI("Setting new JSON sensor details (config_loading=%d)\n",loading_config);
 
-  if (!validateJSONSensorsUpdate(sensors)){
+  if (!validateJSONSensorsUpdate(sensors, err)){
     return 0; //NOTE: the validate method logs the error reason
   }
 
   pdebugI("Setting %d sensor entries\n",sensors.size());
   this->num_sensors = 0;
+  invalidate_handles();
   for (JsonVariant s : sensors){
     JsonObject sensor = s.as<JsonObject>(); 
-    role = sensor["role"].as<String>();
-    name = sensor["name"].as<String>();
+    role = sensor["role"].isNull() ? "" : sensor["role"].as<const char*>();
+    name = sensor["name"].isNull() ? "" : sensor["name"].as<const char*>();
 
-    pdebugI("Adding sensor name=\"%s\"\n", name.c_str());
+    pdebugI("Adding sensor name=\"%s\"\n", name);
     addSensor(name, POOL_TEMP_SENSOR_MISSING);
+    remember_sensor(name);
 
-    if (role != ""){
+    if (role[0] != 0){
       assignSensorRole(name,role);
     }
   }
+  snapshot.touch(POOL_SNAPSHOT_SENSORS);
+
+  //The registry's indexes into temp_sensors are gone, the next harvest
+  //puts the list back to what's actually on the bus
+  sensor_registry.changed = 1;
 
   //Save a copy of the config
-  save_config();
+  if (!loading_config) mark_config_dirty();
   
   return 1; 
 }
 
 void PoolController::update_temperature_sensors(){
+  unsigned long now = millis();
+
+  //If the last conversion never finished, give up on it and start over
+  if (sensor_conversion_state == POOL_SENSORS_CONVERTING){
+    if (now - sensor_conversion_start < sensor_conversion_wait + POOL_SENSOR_CONVERSION_SLACK){
+      pdebugD("1-wire conversion still in progress, not starting another\n");
+      return;
+    }
+    pdebugW("1-wire conversion didn't finish after %lu ms, restarting it\n",now - sensor_conversion_start);
+  }
 
-  pdebugD("Updating 1-wire temperature sensors\n");
-  int device_count = digital_temp_sensors.getDeviceCount();
+  plogD(POOL_LOG_SENSORS_CONVERT);
   digital_temp_sensors.requestTemperatures();
+  sensor_conversion_wait = digital_temp_sensors.millisToWaitForConversion(digital_temp_sensors.getResolution());
+  sensor_conversion_start = now;
+  sensor_conversion_state = POOL_SENSORS_CONVERTING;
+}
+
+byte PoolController::poll_temperature_sensors(){
+  if (sensor_conversion_state != POOL_SENSORS_CONVERTING){
+    return 0;
+  }
+
+  //Don't touch the bus until the conversion could possibly be done
+  if (millis() - sensor_conversion_start < sensor_conversion_wait){
+    return 0;
+  }
+
+  if (!digital_temp_sensors.isConversionComplete()){
+    return 0;
+  }
+
+  PoolProfileTimer timer(profiler, POOL_PROFILE_HARVEST_SENSORS);
+  PoolMemoryProbe memory_probe(memory, POOL_PROFILE_HARVEST_SENSORS);
+  sensor_conversion_state = POOL_SENSORS_IDLE;
+  harvest_temperature_sensors();
+
+  //New temperatures, solar might want to do something about them
+  request_control();
+  return 1;
+}
+
+void PoolController::harvest_temperature_sensors(){
+  unsigned long now = millis();
   DeviceAddress sensor_addr; //this is a uint[8] buffer....
-  String hex_name;
-  float temp_buffer;
 
-  //Nuke all the sensors
-  this->num_sensors = 0;
+  plogD(POOL_LOG_SENSORS_READ);
 
-  pdebugD("Iterating found digital 1-wire sensors (%d)\n", device_count);
+  //Sensors came/went (or the list was replaced) since we last looked
+  if (sensor_registry.changed){
+    rebuild_sensor_list();
+  }
 
-  //Add back digital sensors we find
-  for (int x =0;x<device_count;x++){
-    if (digital_temp_sensors.getAddress(sensor_addr,x)){
-      hex_name=digitalTempAddrToHex(sensor_addr);
-      temp_buffer= digital_temp_sensors.getTempFByIndex(x);
-      if (temp_buffer != DEVICE_DISCONNECTED_F){
-        pdebugD("Calling addSensor(\"%s\", %f)\n",hex_name.c_str(),temp_buffer);
-        addSensor(hex_name,temp_buffer);
-      }
-      else
-        pdebugE("Sensor \"%s\" could not be read. skipping.\n",hex_name.c_str());
+  //Read the sensors we know are there by ROM (no bus search)
+  for (int x = 0; x < MAX_SENSORS; x++){
+    PoolSensorSlot& s = sensor_registry.slots[x];
+    if (!s.present) continue;
+
+    PoolSensorRegistry::romToAddress(s.rom, sensor_addr);
+    float temp = digital_temp_sensors.getTempF(sensor_addr);
+    if (temp == (float)DEVICE_DISCONNECTED_F){
+      //NOTE: Keep the last reading for now, it's dropped from the list
+      //      after POOL_SENSOR_DROPOUT_READS misses in a row
+      pdebugE("Sensor in slot %d could not be read (%d in a row)\n",x,s.misses + 1);
+      sensor_registry.readFailed(x);
+      continue;
+    }
+    sensor_registry.readOk(x, now);
+    TempSensor* t = sensorAt(s.sensor_idx);
+    if (t != 0){
+      t->temp = temp;
     }
   }
-
-  //Update analog thermistor
-  pdebugD("Getting analog thermistor value\n");
-  float tempF = this->analog_temp->readTempF();
-  int adc = analogRead(A0);
-  pdebugD("Thermistor raw (0-1023): %d\n",adc);
-  if (tempF < 0.0 || tempF > 212.0){
-      pdebugW("Invalid temperator from analog sensor detected (%f), setting it to an error value\n",tempF);
-      tempF = POOL_TEMP_SENSOR_MISSING;
+  if (sensor_registry.changed){
+    rebuild_sensor_list();
   }
-  else{
-    pdebugI("Analog sensor temp(f): %f\n",tempF);
+
+  //The analog thermistor is filtered in the background, no I/O here
+  resolve_handles();
+  TempSensor* analog = sensorAt(analog_sensor_idx);
+  if (analog != 0){
+    analog->temp = analog_temp_f();
+    plogI(POOL_LOG_ANALOG_TEMP, analog->temp);
   }
-  addSensor("analog",tempF);
 
-  pdebugD("loggging any sensor problems\n");
+  plogD(POOL_LOG_SENSORS_PROBLEMS);
 
   //Update sensor errors
-  if (!isSensorPresent(pool_water_sensor_name))
+  if (water_sensor_idx < 0)
     log_error(POOL_ERR_POOL_WATER_SENSOR_PROBLEM);
   else
     clear_error(POOL_ERR_POOL_WATER_SENSOR_PROBLEM);
 
-  if (!isSensorPresent(roof_sensor_name))
+  if (roof_sensor_idx < 0)
     log_error(POOL_ERR_ROOF_TEMP_SENSOR_PROBLEM);
   else
     clear_error(POOL_ERR_ROOF_TEMP_SENSOR_PROBLEM);
 
-  if (!isSensorPresent(ambient_air_sensor_name))
+  if (ambient_sensor_idx < 0)
     log_error(POOL_ERR_AMBIENT_TEMP_SENSOR_PROBLEM);
   else
     clear_error(POOL_ERR_AMBIENT_TEMP_SENSOR_PROBLEM);
 }
 
+void PoolController::request_sensor_scan(){
+  sensor_scan_requested = 1;
+}
+
+void PoolController::discover_temperature_sensors(){
+  //A search in the middle of a conversion would hold up the harvest, go
+  //right after it instead
+  if (sensor_conversion_state == POOL_SENSORS_CONVERTING){
+    pdebugD("1-wire conversion in progress, searching the bus after it\n");
+    sensor_scan_requested = 1;
+    return;
+  }
+  sensor_scan_requested = 0;
+
+  unsigned long now = millis();
+  unsigned long hotplugs = sensor_registry.hotplugs;
+  unsigned long dropouts = sensor_registry.dropouts;
+  DeviceAddress addr;
+
+  sensor_registry.beginScan();
+  one_wire.reset_search();
+  while (one_wire.search(addr)){
+    if (OneWire::crc8(addr, 7) != addr[7]){
+      pdebugW("Ignoring 1-wire device with a bad ROM CRC\n");
+      continue;
+    }
+    if (!digital_temp_sensors.validFamily(addr)){
+      continue;
+    }
+    uint64_t rom = PoolSensorRegistry::romFromAddress(addr);
+    if (sensor_registry.find(rom) < 0 && sensor_registry.numPresent() >= MAX_SENSORS){
+      pdebugE("Too many 1-wire sensors, ignoring the rest\n");
+      break;
+    }
+    sensor_registry.seen(rom, now);
+  }
+  sensor_registry.endScan(now);
+
+  pdebugD("1-wire search took %lu ms (%d sensors, %lu new, %lu gone)\n",millis() - now,
+          sensor_registry.numPresent(),sensor_registry.hotplugs - hotplugs,
+          sensor_registry.dropouts - dropouts);
+  if (sensor_registry.changed){
+    rebuild_sensor_list();
+  }
+}
+
+void PoolController::rebuild_sensor_list(){
+  //Hang on to the readings we have (indexed by slot) while the list moves
+  float temps[MAX_SENSORS];
+  for (int x = 0; x < MAX_SENSORS; x++){
+    PoolSensorSlot& s = sensor_registry.slots[x];
+    TempSensor* t = sensorAt(s.sensor_idx);
+    temps[x] = (t != 0) ? t->temp : POOL_TEMP_SENSOR_MISSING;
+    s.sensor_idx = -1;
+  }
+
+  char hex_name[POOL_SENSOR_ROM_HEX_LEN];
+  num_sensors = 0;
+  for (int x = 0; x < MAX_SENSORS; x++){
+    PoolSensorSlot& s = sensor_registry.slots[x];
+    if (!s.present) continue;
+    PoolSensorRegistry::romToHex(s.rom, hex_name);
+    s.sensor_idx = num_sensors;
+    addSensor(hex_name, temps[x]);
+  }
+  addSensor("analog", analog_temp_f());
+
+  pdebugI("1-wire sensors changed, now tracking %d sensors\n", num_sensors);
+  sensor_registry.changed = 0;
+  invalidate_handles();
+}
+
+void PoolController::remember_sensor(const char* name){
+  uint64_t rom;
+  if (PoolSensorRegistry::romFromHex(name, rom)){
+    sensor_registry.add(rom);
+  }
+}
+
+void PoolController::update_history(){
+  time_t t = now();
+
+  //Buckets are by wall clock, nothing to file them under until it's set
+  if ((unsigned long)t < POOL_HISTORY_MIN_TIME){
+    plogD(POOL_LOG_HISTORY_NO_CLOCK);
+    return;
+  }
+
+  resolve_handles();
+  int roles[POOL_HISTORY_TEMP_SERIES] = {water_sensor_idx, roof_sensor_idx, ambient_sensor_idx};
+  float temps[POOL_HISTORY_TEMP_SERIES];
+  for (int x = 0; x < POOL_HISTORY_TEMP_SERIES; x++){
+    TempSensor* s = sensorAt(roles[x]);
+    temps[x] = (s != 0) ? s->temp : POOL_TEMP_SENSOR_MISSING;
+  }
+
+  byte relay_bits = 0;
+  for (int x = 0; x < MAX_RELAY; x++){
+    if (relays[x].state == POOL_RELAY_ON || relays[x].state == POOL_RELAY_MANUAL_ON){
+      relay_bits |= (1 << x);
+    }
+  }
+
+  history.record(t, temps, relay_bits);
+}
+
+void PoolController::update_relay_stats(){
+  unsigned long ms = millis();
+  relay_stats.checkpoint(ms);
+  relay_stats.saveRtc();
+
+  if (ms - relay_stats.last_file_save >= POOL_RELAY_STATS_SAVE_SECS * 1000UL){
+    if (!relay_stats.saveFile(ms)){
+      pdebugE("Unable to save relay stats to \"%s\"\n", POOL_RELAY_STATS_FILE_PATH);
+    }
+  }
+}
+
+void PoolController::reset_relay_stats(){
+  unsigned long ms = millis();
+  relay_stats.reset(ms);
+  relay_stats.saveRtc();
+  relay_stats.saveFile(ms);
+}
+
+void PoolController::update_mqtt(){
+  mqtt.handle(millis(), WiFi.status() == WL_CONNECTED);
+  if (!mqtt.connected()) return;
+
+  //New connection (clean session), so subscribe again and send it all
+  byte everything = (mqtt_published.session != mqtt.session);
+  if (everything){
+    pdebugI("Connected to MQTT broker %s:%u\n",mqtt.host,mqtt.port);
+    mqtt.subscribe("relay/+/set");
+    mqtt.subscribe("solar/set");
+    mqtt.subscribe("mode/set");
+    mqtt_published.session = mqtt.session;
+  }
+  publish_mqtt_state(everything);
+}
+
+void PoolController::publish_mqtt_state(byte everything){
+  PoolMqttPublished& p = mqtt_published;
+  char topic[POOL_MQTT_TOPIC_LEN];
+  char value[16];
+
+  //Anything that doesn't go out stays as it was, so it's retried next time
+  for (int x = 0; x < MAX_RELAY; x++){
+    byte on = relays[x].isOn();
+    if (relays[x].name[0] == 0) continue;
+    if (!everything && on == p.relay_on[x]) continue;
+    snprintf(topic, sizeof(topic), "relay/%s/state", relays[x].name);
+    if (mqtt.publish(topic, on ? "on" : "off", 1)) p.relay_on[x] = on;
+  }
+
+  for (int x = 0; x < num_sensors; x++){
+    float temp = temp_sensors[x].temp;
+    if (temp == (float)POOL_TEMP_SENSOR_MISSING) continue;
+    uint32_t name = PoolSnapshot::hash(temp_sensors[x].name);
+    if (!everything && name == p.sensor_names[x] &&
+        fabs(temp - p.sensor_temps[x]) < p.temp_deadband){
+      continue;
+    }
+    snprintf(topic, sizeof(topic), "sensor/%s/temp_f", temp_sensors[x].name);
+    snprintf(value, sizeof(value), "%.1f", temp);
+    if (mqtt.publish(topic, value, 1)){
+      p.sensor_names[x] = name;
+      p.sensor_temps[x] = temp;
+    }
+  }
+
+  if (everything || solar_state != p.solar_state){
+    if (mqtt.publish("solar/state", SOLAR_STATE_STRINGS[solar_state], 1)) p.solar_state = solar_state;
+  }
+  if (everything || solar_enabled != p.solar_enabled){
+    if (mqtt.publish("solar/enabled", solar_enabled ? "on" : "off", 1)) p.solar_enabled = solar_enabled;
+  }
+  if (everything || solar_target_temp != p.solar_target_temp){
+    snprintf(value, sizeof(value), "%.1f", solar_target_temp);
+    if (mqtt.publish("solar/target_temp", value, 1)) p.solar_target_temp = solar_target_temp;
+  }
+
+  if (everything || pool_state != p.pool_state){
+    if (mqtt.publish("mode", POOL_STATE_STRINGS[pool_state], 1)) p.pool_state = pool_state;
+  }
+}
+
+void PoolController::mqtt_command(const char* topic, const char* payload){
+  pdebugI("MQTT command %s: \"%s\"\n",topic,payload);
+  PoolJsonDocument doc(POOL_JSON_REQUEST_SIZE);
+  String err;
+  byte success = 0;
+
+  //relay/<name>/set on|off (a manual override, same as POST /relays)
+  if (strncmp(topic, "relay/", 6) == 0){
+    const char* name = topic + 6;
+    const char* end = strchr(name, '/');
+    char relay_name[POOL_RELAY_NAME_LEN];
+    if (end == 0 || strcmp(end, "/set") != 0 || (size_t)(end - name) >= sizeof(relay_name)){
+      return;
+    }
+    memcpy(relay_name, name, end - name);
+    relay_name[end - name] = 0;
+
+    if (strcmp(payload, "on") != 0 && strcmp(payload, "off") != 0){
+      err = "Invalid relay state, must be \"on\" or \"off\"";
+    }
+    else {
+      JsonArray relays = doc.to<JsonArray>();
+      JsonObject r = relays.createNestedObject();
+      r["name"] = (const char*)relay_name;
+      r["state"] = payload;
+      success = setJSONRelayDetails(relays, err);
+    }
+  }
+
+  //solar/set on|off, or the same JSON as POST /solar
+  else if (strcmp(topic, "solar/set") == 0){
+    if (payload[0] == '{'){
+      if (deserializeJson(doc, payload) != DeserializationError::Ok){
+        err = "Invalid JSON";
+      }
+    }
+    else {
+      doc["enabled"] = payload;
+    }
+
+    if (err.length() == 0){
+      //Leave the target alone unless it's given
+      JsonObject solar = doc.as<JsonObject>();
+      if (!solar.containsKey("target_temp")){
+        solar["target_temp"] = solar_target_temp;
+      }
+      success = setJSONSolarDetails(solar, err);
+    }
+  }
+
+  //mode/set run_schedule|idle
+  else if (strcmp(topic, "mode/set") == 0){
+    doc["mode"] = payload;
+    JsonObject general = doc.as<JsonObject>();
+    success = setJSONGeneralDetails(general, err);
+  }
+  else {
+    return;
+  }
+
+  //Changes go out with the next publish_mqtt_state(), failures get reported
+  if (!success){
+    pdebugW("MQTT command %s failed: %s\n",topic,err.c_str());
+    mqtt.publish("error", err.c_str(), 0);
+  }
+}
+
+int PoolController::historySeries(const char* name){
+  int series = PoolHistory::tempSeries(name);
+  if (series >= 0) return series;
+
+  Relay* r = getRelayByName(name);
+  return (r != 0) ? POOL_HISTORY_TEMP_SERIES + (r - relays) : -1;
+}
+
+float PoolController::analog_temp_f(){
+  float tempF = analog_temp->readTempF();
+  if (tempF < 0.0 || tempF > 212.0){
+    plogV(POOL_LOG_ANALOG_INVALID, tempF);
+    return POOL_TEMP_SENSOR_MISSING;
+  }
+  return tempF;
+}
+
+void PoolController::update_analog_sensor(){
+  analog_temp->sample();
+  plogV(POOL_LOG_ANALOG_RAW, POOL_THERM_ADC_MAX, analog_temp->last_raw, analog_temp->filtered_adc);
+
+  //Keep the published value current between 1-wire harvests
+  resolve_handles();
+  TempSensor* t = sensorAt(analog_sensor_idx);
+  if (t != 0){
+    t->temp = analog_temp_f();
+  }
+}
 
 // send an NTP request to the time server at the given address
 void PoolController::sendNTPpacket(IPAddress &address)
@@ -1055,62 +2311,203 @@ void PoolController::sendNTPpacket(IPAddress &address)
   udp.endPacket();
 }
 
+//lwIP DNS callback for the NTP server lookup (called from the SDK)
+static void ntp_dns_found(const char*, const ip_addr_t* ipaddr, void* arg){
+  PoolController* p = (PoolController*)arg;
+  if (ipaddr){
+    p->ntp_dns_result = IPAddress(ipaddr);
+    p->ntp_dns_ok = 1;
+  }
+  else{
+    p->ntp_dns_ok = 0;
+  }
+  p->ntp_dns_done = 1;
+}
+
+//Big-endian 32 bit field from an NTP packet
+static unsigned long ntp_read32(byte* buf, int offset){
+  return ((unsigned long)buf[offset] << 24) |
+         ((unsigned long)buf[offset+1] << 16) |
+         ((unsigned long)buf[offset+2] << 8) |
+         (unsigned long)buf[offset+3];
+}
+
+//NTP fraction of a second (units of 2^-32 s) to ms
+static unsigned long ntp_frac_to_ms(unsigned long frac){
+  return (unsigned long)(((uint64_t)frac * 1000ULL) >> 32);
+}
+
+void PoolController::send_ntp_request(){
+  while (udp.parsePacket() > 0) ; // discard any previously received packets
+  pdebugD("Requesting NTP time from %s (%s), try %d\n",ntp_server_name,
+          ntp_server_ip.toString().c_str(),ntp_retries + 1);
+  sendNTPpacket(ntp_server_ip);
+  ntp_request_sent = millis();
+  ntp_state = POOL_NTP_WAIT_RESPONSE;
+  ntp_state_since = ntp_request_sent;
+}
+
+void PoolController::ntp_failed(TimeState state){
+  time_state = state;
+  log_error(POOL_ERR_NO_NTP);
+  ntp_failed_at = millis();
+  ntp_state = POOL_NTP_IDLE;
+  ntp_state_since = ntp_failed_at;
+}
+
 void PoolController::update_ntp(){
+  unsigned long now = millis();
 
   //if we are in manual mode, don't try to update (we're running a hotspot)
   if (pool_state == POOL_STATE_MANUAL){
+    ntp_state = POOL_NTP_IDLE;
     return;
   } 
 
-  //Do nothing if we aren't due to ping the server yet and we're already initilized
-  if (time_state == POOL_TIME_OK &&
-      millis() - this->last_ntp_update < ((unsigned long)(ntp_update_seconds) * 1000L)){
-    //pdebugD("Time state already intialized and it's too soon to do it again, skipping\n");
-    return;
+  switch (ntp_state){
+    case POOL_NTP_IDLE:
+      //Do nothing if we aren't due to ping the server yet and we're already initilized
+      if (time_state == POOL_TIME_OK &&
+          now - this->last_ntp_update < ((unsigned long)(ntp_update_seconds) * 1000L)){
+        return;
+      }
+
+      //Give the server/network a break after a failed sync
+      if (ntp_failed_at != 0 && now - ntp_failed_at < NTP_RETRY_INTERVAL * 1000UL){
+        return;
+      }
+
+      ntp_retries = 0;
+
+      //Use the cached server IP if it's still good
+      if (ntp_dns_valid && now - ntp_dns_resolved_at < NTP_DNS_TTL_SECS * 1000UL){
+        send_ntp_request();
+        return;
+      }
+
+      //Otherwise look it up (without waiting on it)
+      {
+        ip_addr_t addr;
+        ntp_dns_done = 0;
+        ntp_dns_ok = 0;
+        err_t err = dns_gethostbyname(ntp_server_name, &addr, ntp_dns_found, this);
+        if (err == ERR_OK){
+          //lwIP already had it
+          ntp_dns_result = IPAddress(&addr);
+          ntp_dns_ok = 1;
+          ntp_dns_done = 1;
+        }
+        else if (err != ERR_INPROGRESS){
+          pdebugE("Unable to start DNS lookup for NTP server %s (%d)\n",ntp_server_name,err);
+          ntp_failed(POOL_TIME_NO_INTERNET);
+          return;
+        }
+      }
+      ntp_state = POOL_NTP_RESOLVING;
+      ntp_state_since = now;
+      //In case the lookup finished already
+      //fall through
+
+    case POOL_NTP_RESOLVING:
+      if (ntp_dns_done){
+        if (!ntp_dns_ok){
+          pdebugE("DNS lookup for NTP server %s failed\n",ntp_server_name);
+          ntp_failed(POOL_TIME_NO_INTERNET);
+          return;
+        }
+        ntp_server_ip = ntp_dns_result;
+        ntp_dns_resolved_at = now;
+        ntp_dns_valid = 1;
+        pdebugD("Using NTP Server: %s\nIP: %s\n",ntp_server_name, ntp_server_ip.toString().c_str());
+        send_ntp_request();
+      }
+      else if (now - ntp_state_since > NTP_DNS_TIMEOUT){
+        pdebugE("DNS lookup for NTP server %s timed out\n",ntp_server_name);
+        ntp_failed(POOL_TIME_NO_INTERNET);
+      }
+      break;
+
+    case POOL_NTP_WAIT_RESPONSE:
+      //NOTE: poll_ntp() handles the reply, we just deal with it not showing up
+      if (now - ntp_request_sent < NTP_RESPONSE_TIMEOUT){
+        return;
+      }
+
+      ntp_retries++;
+      if (ntp_retries < NTP_MAX_RETRIES){
+        pdebugW("No NTP response after %d ms, retrying\n",NTP_RESPONSE_TIMEOUT);
+        send_ntp_request();
+        return;
+      }
+
+      //If we get here, we failed. Log the error and move on
+      //NOTE: Forget the server IP too, the pool may have moved it
+      pdebugD("NTP Response failure\n");
+      ntp_dns_valid = 0;
+      ntp_failed(POOL_TIME_ERR);
+      break;
+  }
+}
+
+byte PoolController::poll_ntp(){
+  if (ntp_state != POOL_NTP_WAIT_RESPONSE){
+    return 0;
   }
+  PoolProfileTimer timer(profiler, POOL_PROFILE_POLL_NTP);
 
-  IPAddress ntpServerIP; // NTP server's ip address
+  int size = udp.parsePacket();
+  if (size <= 0){
+    return 0;
+  }
+  unsigned long received = millis();
 
-  while (udp.parsePacket() > 0) ; // discard any previously received packets
-  pdebugD("Requesting NTP time\n");
-  // get a random server from the pool
-  
-  int err = WiFi.hostByName(ntp_server_name.c_str(), ntpServerIP);
-  if (err != 1){
-    time_state = POOL_TIME_NO_INTERNET;
-    log_error(POOL_ERR_NO_NTP);
-  }
-  pdebugD("Using NTP Server: %s\nIP: %s",ntp_server_name.c_str(), ntpServerIP.toString().c_str());
-
-  sendNTPpacket(ntpServerIP);
-  uint32_t beginWait = millis();
-  while (millis() - beginWait < 1500) {
-    int size = udp.parsePacket();
-    if (size >= NTP_PACKET_SIZE) {
-      pdebugD("Receive NTP Response\n");
-      udp.read(udp_packet_buffer, NTP_PACKET_SIZE);  // read packet into the buffer
-      unsigned long secsSince1900;
-      // convert four bytes starting at location 40 to a long integer
-      secsSince1900 =  (unsigned long)udp_packet_buffer[40] << 24;
-      secsSince1900 |= (unsigned long)udp_packet_buffer[41] << 16;
-      secsSince1900 |= (unsigned long)udp_packet_buffer[42] << 8;
-      secsSince1900 |= (unsigned long)udp_packet_buffer[43];
-      time_t now = secsSince1900 - 2208988800UL + gmt_offset * SECS_PER_HOUR;
-      setTime(now);
-      this->last_ntp_update = millis();
-      time_state = POOL_TIME_OK;
-
-      //Remove any NTP errors from the list (since it just worked)
-      clear_error(POOL_ERR_NO_NTP);
+  //Only probed once something's arrived (painting the stack every pass
+  //while we wait would cost more than the wait)
+  PoolMemoryProbe memory_probe(memory, POOL_PROFILE_POLL_NTP);
 
-      return;
-    }
+  //Ignore anything that isn't a reply from our server
+  if (size < NTP_PACKET_SIZE || udp.remoteIP() != ntp_server_ip){
+    pdebugW("Ignoring unexpected UDP packet (%d bytes from %s)\n",size,udp.remoteIP().toString().c_str());
+    udp.flush();
+    return 0;
   }
 
-  //If we get here, we failed. Log the error and move on
-  time_state = POOL_TIME_ERR;
-  log_error(POOL_ERR_NO_NTP);
-  pdebugD("NTP Response failure\n");
+  pdebugD("Receive NTP Response\n");
+  udp.read(udp_packet_buffer, NTP_PACKET_SIZE);  // read packet into the buffer
+
+  //Stratum 0 is a "kiss of death" (the server wants us to go away)
+  if (udp_packet_buffer[1] == 0){
+    pdebugW("NTP server sent a kiss-of-death, treating it as no response\n");
+    return 0;
+  }
+
+  //Server receive (32) and transmit (40) timestamps, seconds since 1900 + fraction
+  unsigned long rx_secs = ntp_read32(udp_packet_buffer, 32);
+  unsigned long rx_ms = ntp_frac_to_ms(ntp_read32(udp_packet_buffer, 36));
+  unsigned long tx_secs = ntp_read32(udp_packet_buffer, 40);
+  unsigned long tx_ms = ntp_frac_to_ms(ntp_read32(udp_packet_buffer, 44));
+
+  //Round trip is our wall time minus however long the server sat on it.
+  //The reply spent (about) half of that in flight, so add it on.
+  long server_ms = (long)(tx_secs - rx_secs) * 1000L + (long)tx_ms - (long)rx_ms;
+  long rtt = (long)(received - ntp_request_sent) - server_ms;
+  if (rtt < 0) rtt = 0;
+  unsigned long ms = tx_ms + rtt / 2;
+
+  time_t now = tx_secs - 2208988800UL + gmt_offset * SECS_PER_HOUR + (ms + 500) / 1000;
+  setTime(now);
+  this->last_ntp_update = millis();
+  ntp_last_rtt_ms = rtt;
+  time_state = POOL_TIME_OK;
+  ntp_failed_at = 0;
+  ntp_state = POOL_NTP_IDLE;
+  ntp_state_since = last_ntp_update;
+  pdebugD("NTP time set (round trip %ld ms, %d tries)\n",rtt,ntp_retries + 1);
+
+  //Remove any NTP errors from the list (since it just worked)
+  clear_error(POOL_ERR_NO_NTP);
+
+  return 1;
 }
 
 
@@ -1190,12 +2587,10 @@ void PoolController::clear_error(Pool_Error_Code err){
 }
 
 
-String PoolController::digitalTempAddrToHex(DeviceAddress d){
-  String hex_name="";
+void PoolController::digitalTempAddrToHex(DeviceAddress d, char* out){
   for (int b = 0;b < sizeof(DeviceAddress); b++){
-    hex_name+=byteToHex(d[b]);
+    byteToHex(d[b],out + (b * 2));
   }
-  return hex_name;
 }
 
 
@@ -1207,27 +2602,24 @@ byte ascii_hex_2_bin_nibble(char nibble)
   return HEX_CONV_ERR;
 }
 
-byte PoolController::ascii_hex_2_bin(String s){
-  if (s.length() != 2){
+byte PoolController::ascii_hex_2_bin(const char* s){
+  if (strlen(s) != 2){
    return HEX_CONV_ERR;
   }
   return (ascii_hex_2_bin_nibble(s[0])<<4)|ascii_hex_2_bin_nibble(s[1]);
 }
 
-//MM: You might be stupid here passing the return as a value (you've been writing too much java)
-String PoolController::byteToHex(byte num) {
-  char hexDigits[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8',
+void PoolController::byteToHex(byte num, char* out) {
+  static const char hexDigits[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8',
     '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-  char buff[3];
-  buff[0] = hexDigits[num >> 4 & 0xF];
-  buff[1] = hexDigits[num & 0xF];
-  buff[2] = 0;
-  return String(buff);
+  out[0] = hexDigits[num >> 4 & 0xF];
+  out[1] = hexDigits[num & 0xF];
+  out[2] = 0;
 }
 
-byte PoolController::isSensorPresent(String name){
+byte PoolController::isSensorPresent(const char* name){
   for (int x=0;x<num_sensors;x++){
-    if (temp_sensors[x].name == name)
+    if (!strcmp(temp_sensors[x].name,name))
       return 1;
   }
   return 0;
@@ -1244,21 +2636,132 @@ byte PoolController::isSensorAnalog(const char* name){
 }
 
 
-byte PoolController::addSensor(String name, float temp){
+byte PoolController::addSensor(const char* name, float temp){
   //bail if we're tracking too many sensors
   if (num_sensors >= MAX_SENSORS){  
-    pdebugE("too many temp sensors, ignoring: %s",name.c_str());
+    pdebugE("too many temp sensors, ignoring: %s",name);
     return 0;
   }
 
 
-  temp_sensors[num_sensors].name = name;
+  if (strcmp(temp_sensors[num_sensors].name, name)){
+    POOL_SET_NAME(temp_sensors[num_sensors].name, name);
+    invalidate_handles();
+  }
   temp_sensors[num_sensors].temp = temp;
   num_sensors++;
   return 1;
 }
 
-void PoolController::getJSONGeneralDetails(DynamicJsonDocument& info){
+void PoolController::writeMetrics(Print& out){
+  PoolMetricsWriter m(out);
+  unsigned long ms = millis();
+  char role[POOL_SENSOR_NAME_LEN];
+
+  //Temperatures by role (sensors without one aren't controlling anything)
+  resolve_handles();
+  int roles[POOL_HISTORY_TEMP_SERIES] = {water_sensor_idx, roof_sensor_idx, ambient_sensor_idx};
+  m.family("pool_temperature_fahrenheit", "gauge", "Temperature of the sensor in each role");
+  for (int x = 0; x < POOL_HISTORY_TEMP_SERIES; x++){
+    TempSensor* s = sensorAt(roles[x]);
+    if (s == 0 || s->temp == (float)POOL_TEMP_SENSOR_MISSING) continue;
+    strncpy_P(role, TSR_STRINGS[x], sizeof(role) - 1);
+    role[sizeof(role) - 1] = 0;
+    m.begin("pool_temperature_fahrenheit");
+    m.label("role", role);
+    m.label("sensor", s->name);
+    m.value(s->temp, 2);
+  }
+
+  //Relays
+  m.family("pool_relay_on", "gauge", "1 if the relay is on");
+  for (int x = 0; x < MAX_RELAY; x++){
+    if (relays[x].name[0] == 0) continue;
+    m.begin("pool_relay_on");
+    m.label("relay", relays[x].name);
+    m.value(relays[x].isOn());
+  }
+  m.family("pool_relay_manual", "gauge", "1 if the relay is manually overridden");
+  for (int x = 0; x < MAX_RELAY; x++){
+    if (relays[x].name[0] == 0) continue;
+    m.begin("pool_relay_manual");
+    m.label("relay", relays[x].name);
+    m.value(relays[x].state == POOL_RELAY_MANUAL_ON || relays[x].state == POOL_RELAY_MANUAL_OFF);
+  }
+
+  //Solar/pool state (one series per state, 1 for the current one)
+  m.family("pool_solar_enabled", "gauge", "1 if solar heating is enabled");
+  m.gauge("pool_solar_enabled", solar_enabled);
+  m.family("pool_solar_state", "gauge", "1 for the current solar heating state");
+  for (int x = 0; x < (int)(sizeof(SOLAR_STATE_STRINGS) / sizeof(SOLAR_STATE_STRINGS[0])); x++){
+    m.begin("pool_solar_state");
+    m.label("state", SOLAR_STATE_STRINGS[x]);
+    m.value(solar_state == x);
+  }
+  m.family("pool_mode", "gauge", "1 for the current pool mode");
+  for (int x = 0; x < (int)(sizeof(POOL_STATE_STRINGS) / sizeof(POOL_STATE_STRINGS[0])); x++){
+    m.begin("pool_mode");
+    m.label("mode", POOL_STATE_STRINGS[x]);
+    m.value(pool_state == x);
+  }
+
+  //Errors
+  m.family("pool_error", "gauge", "1 if the error is active");
+  for (int x = POOL_ERR_OK + 1; x < POOL_NUM_ERRORS; x++){
+    byte active = 0;
+    for (int y = 0; y < num_errors; y++){
+      if (pool_errors[y] == x) active = 1;
+    }
+    m.begin("pool_error");
+    m.label("error", POOL_ERR_STRINGS[x]);
+    m.value(active);
+  }
+
+  //Time/network
+  m.family("pool_ntp_sync_age_seconds", "gauge", "Seconds since the clock was last set (NaN if it never was)");
+  m.gauge("pool_ntp_sync_age_seconds", (last_ntp_update != 0) ? (ms - last_ntp_update) / 1000.0 : NAN, 1);
+  m.family("pool_wifi_connected", "gauge", "1 if connected to the wifi network");
+  m.gauge("pool_wifi_connected", WiFi.status() == WL_CONNECTED);
+  if (WiFi.status() == WL_CONNECTED){
+    m.family("pool_wifi_rssi_dbm", "gauge", "Wifi signal strength");
+    m.gauge("pool_wifi_rssi_dbm", WiFi.RSSI());
+  }
+  m.family("pool_wifi_connects_total", "counter", "Wifi connections made");
+  m.gauge("pool_wifi_connects_total", wifi_connects);
+  m.family("pool_wifi_disconnects_total", "counter", "Wifi connections lost");
+  m.gauge("pool_wifi_disconnects_total", wifi_disconnects);
+
+  //Memory
+  m.family("pool_heap_free_bytes", "gauge", "Free heap");
+  m.gauge("pool_heap_free_bytes", ESP.getFreeHeap());
+  m.family("pool_heap_max_free_block_bytes", "gauge", "Largest free heap block");
+  m.gauge("pool_heap_max_free_block_bytes", ESP.getMaxFreeBlockSize());
+  m.family("pool_heap_allocs_total", "counter", "Heap allocations made");
+  m.gauge("pool_heap_allocs_total", POOL_ALLOC_COUNT);
+  m.family("pool_heap_free_min_bytes", "gauge", "Lowest free heap seen by the memory probes since boot");
+  m.gauge("pool_heap_free_min_bytes", memory.lowest.free_heap);
+  m.family("pool_heap_fragmentation_percent", "gauge", "Heap fragmentation");
+  m.gauge("pool_heap_fragmentation_percent", ESP.getHeapFragmentation());
+  m.family("pool_stack_free_min_bytes", "gauge", "Least loop() stack left unused since boot");
+  m.gauge("pool_stack_free_min_bytes", memory.lowest.free_stack);
+
+  //Loop/update timing
+  LatencyHistogram& loops = profiler.stages[POOL_PROFILE_LOOP];
+  loop_rate.update(loops.count, profiler.last_reset, ms);
+  m.family("pool_loop_iterations_per_second", "gauge", "loop() passes per second since the last scrape");
+  m.gauge("pool_loop_iterations_per_second", loop_rate.rate, 1);
+  m.family("pool_loop_iterations_total", "counter", "loop() passes since the profiler was reset");
+  m.gauge("pool_loop_iterations_total", loops.count);
+  m.family("pool_update_duration_seconds", "histogram", "Time spent in each controller update()");
+  m.histogram("pool_update_duration_seconds", profiler.stages[POOL_PROFILE_UPDATE]);
+  m.family("pool_input_to_relay_seconds", "histogram", "Time from an input changing to the relay outputs being written");
+  m.histogram("pool_input_to_relay_seconds", profiler.stages[POOL_PROFILE_INPUT_TO_RELAY]);
+
+  m.family("pool_uptime_seconds", "counter", "Seconds since boot");
+  m.gauge("pool_uptime_seconds", ms / 1000);
+}
+
+void PoolController::getJSONGeneralDetails(JsonDocument& info){
   //DynamicJsonDocument info(512);
   char timebuffer[32];
   sprintf(timebuffer,"%02d:%02d:%02d",hour(),minute(),second());
@@ -1266,6 +2769,7 @@ void PoolController::getJSONGeneralDetails(DynamicJsonDocument& info){
   g["mode"] = POOL_STATE_STRINGS[pool_state];
   g["time"] = timebuffer;
   g["last_time_update"] = last_ntp_update;
+  g["ntp_rtt_ms"] = ntp_last_rtt_ms;
   g["last_status_update"] = last_update;
   g["pool_water_sensor_name"] = pool_water_sensor_name;
   g["roof_sensor_name"] = roof_sensor_name;
@@ -1274,22 +2778,259 @@ void PoolController::getJSONGeneralDetails(DynamicJsonDocument& info){
   for (int x = 0 ;x < num_errors;x++){
     e.add(POOL_ERR_STRINGS[pool_errors[x]]);
   }
+  getJSONTaskDetails(g);
+  getJSONAnalogFilterDetails(g);
+  getJSONSensorRegistryDetails(g);
+  getJSONHistoryDetails(g);
+  getJSONEventDetails(g);
+
+  JsonObject o = g.createNestedObject("relay_output");
+  o["latched"] = relay_output.latched;
+  o["writes"] = relay_output.writes;
+  o["skipped"] = relay_output.skipped;
+
+  JsonObject h = g.createNestedObject("heap");
+  h["allocs"] = POOL_ALLOC_COUNT;
+  h["update_allocs"] = update_allocs;
+
+  POOL_JSON_ARENA.getJSONArenaDetails(g);
+
+  JsonObject p = g.createNestedObject("config");
+  p["dirty"] = config_persist.dirty;
+  p["save_delay_ms"] = config_persist.save_delay_ms;
+  p["saves"] = config_persist.saves;
+  p["skipped"] = config_persist.skipped;
+  p["failures"] = config_persist.failures;
+  p["generation"] = config_store.generation;
+  p["slot"] = config_store.current_slot;
+  p["flash_writes"] = config_store.writes;
+
+  JsonObject c = g.createNestedObject("snapshot");
+  c["generation"] = snapshot.generation;
+  c["rebuilds"] = snapshot.rebuilds;
+  c["hits"] = snapshot.hits;
+  c["not_modified"] = snapshot.not_modified;
+}
+
+void PoolController::getJSONHistoryDetails(JsonObject& general){
+  JsonObject h = general.createNestedObject("history");
+  h["bytes"] = PoolHistory::memoryUsed();
+  h["samples"] = history.samples;
+  h["clears"] = history.clears;
+}
+
+void PoolController::getJSONEventDetails(JsonObject& general){
+  JsonObject e = general.createNestedObject("events");
+  e["clients"] = events.numClients();
+  e["max_clients"] = POOL_EVENTS_MAX_CLIENTS;
+  e["temp_deadband"] = events.temp_deadband;
+  e["sent"] = events.next_id - 1;
+  e["rejected"] = events.rejected;
+  e["overflows"] = events.overflows;
+  e["bytes_sent"] = events.bytes_sent;
+}
+
+byte PoolController::validateJSONEventDetails(JsonObject& e, String& err){
+  if (!e["temp_deadband"].isNull()){
+    float deadband = e["temp_deadband"].as<float>();
+    if (deadband < 0 || deadband > POOL_EVENTS_MAX_DEADBAND){
+      err = F("Invalid events temp_deadband");
+      pdebugE("%s\n",err.c_str());
+      return 0;
+    }
+  }
+  return 1;
+}
+
+byte PoolController::setJSONEventDetails(JsonObject& e, String& err){
+  if (!validateJSONEventDetails(e, err)){
+    return 0;
+  }
+
+  if (!e["temp_deadband"].isNull()){
+    events.temp_deadband = e["temp_deadband"].as<float>();
+  }
+  return 1;
+}
+
+void PoolController::getJSONSensorRegistryDetails(JsonObject& general){
+  JsonObject r = general.createNestedObject("sensor_registry");
+  r["scans"] = sensor_registry.scans;
+  r["last_scan"] = sensor_registry.last_scan;
+  r["hotplugs"] = sensor_registry.hotplugs;
+  r["dropouts"] = sensor_registry.dropouts;
+  r["read_failures"] = sensor_registry.read_failures;
+
+  char hex_name[POOL_SENSOR_ROM_HEX_LEN];
+  JsonArray a = r.createNestedArray("slots");
+  for (int x = 0; x < MAX_SENSORS; x++){
+    PoolSensorSlot& s = sensor_registry.slots[x];
+    if (s.rom == 0) continue;
+    PoolSensorRegistry::romToHex(s.rom, hex_name);
+    JsonObject j = a.createNestedObject();
+    j["rom"] = hex_name;
+    j["present"] = s.present;
+    j["last_seen"] = s.last_seen;
+    j["last_read"] = s.last_read;
+    j["misses"] = s.misses;
+  }
+}
+
+void PoolController::getJSONAnalogFilterDetails(JsonObject& general){
+  JsonObject f = general.createNestedObject("analog_filter");
+  f["median_depth"] = analog_temp->median_depth;
+  f["ema_alpha"] = analog_temp->ema_alpha;
+  f["raw"] = analog_temp->last_raw;
+  f["filtered"] = analog_temp->filtered_adc;
+}
+
+byte PoolController::validateJSONAnalogFilterDetails(JsonObject& filter, String& err){
+  int depth = filter["median_depth"].isNull() ? analog_temp->median_depth : filter["median_depth"].as<int>();
+  float alpha = filter["ema_alpha"].isNull() ? analog_temp->ema_alpha : filter["ema_alpha"].as<float>();
+
+  if (!FilteredThermistor::validFilter(depth,alpha)){
+    err = F("Invalid analog filter settings (median_depth or ema_alpha out of range)");
+    pdebugE("%s\n",err.c_str());
+    return 0;
+  }
+  return 1;
+}
+
+byte PoolController::setJSONAnalogFilterDetails(JsonObject& filter, String& err){
+  if (!validateJSONAnalogFilterDetails(filter, err)){
+    return 0;
+  }
+
+  int depth = filter["median_depth"].isNull() ? analog_temp->median_depth : filter["median_depth"].as<int>();
+  float alpha = filter["ema_alpha"].isNull() ? analog_temp->ema_alpha : filter["ema_alpha"].as<float>();
+  analog_temp->setFilter(depth,alpha);
+  pdebugI("Analog filter now median_depth=%d ema_alpha=%.2f\n",depth,alpha);
+  return 1;
+}
+
+void PoolController::getJSONTaskDetails(JsonObject& general){
+  JsonArray tasks = general.createNestedArray("tasks");
+  for (int x = 0;x < scheduler.num_tasks; x++){
+    PoolTask& t = scheduler.tasks[x];
+    JsonObject j = tasks.createNestedObject();
+    j["name"] = t.name;
+    j["period_ms"] = t.period_ms;
+    j["priority"] = t.priority;
+    j["deadline_ms"] = t.deadline_ms;
+    j["runs"] = t.runs;
+    j["deadline_misses"] = t.deadline_misses;
+    j["last_duration_ms"] = t.last_duration_ms;
+    j["max_duration_ms"] = t.max_duration_ms;
+    j["allocs"] = t.allocs;
+  }
+}
+
+byte PoolController::validateJSONTaskDetails(JsonArray& tasks, String& err){
+  for (JsonVariant t : tasks){
+    int id = scheduler.getTaskByName(t["name"].as<const char*>());
+    if (id < 0){
+      err = F("Task name specified doesn't match any known task");
+      pdebugE("%s\n",err.c_str());
+      return 0;
+    }
+
+    PoolTask& task = scheduler.tasks[id];
+    unsigned long period = t["period_ms"].isNull() ? task.period_ms : t["period_ms"].as<unsigned long>();
+    int priority = t["priority"].isNull() ? task.priority : t["priority"].as<int>();
+    unsigned long deadline = t["deadline_ms"].isNull() ? task.deadline_ms : t["deadline_ms"].as<unsigned long>();
+    if (!scheduler.validateTask(period,priority,deadline)){
+      err = F("Invalid task period/priority/deadline");
+      pdebugE("%s (task \"%s\")\n",err.c_str(),task.name);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+byte PoolController::setJSONTaskDetails(JsonArray& tasks, String& err){
+  //Validate everything first so we don't half-apply an update
+  if (!validateJSONTaskDetails(tasks, err)){
+    return 0;
+  }
+
+  for (JsonVariant t : tasks){
+    PoolTask& task = scheduler.tasks[scheduler.getTaskByName(t["name"].as<const char*>())];
+    if (!t["period_ms"].isNull()) task.period_ms = t["period_ms"].as<unsigned long>();
+    if (!t["priority"].isNull()) task.priority = t["priority"].as<int>();
+    if (!t["deadline_ms"].isNull()) task.deadline_ms = t["deadline_ms"].as<unsigned long>();
+    pdebugI("Task \"%s\" now period=%lu priority=%d deadline=%lu\n",
+            task.name,task.period_ms,task.priority,task.deadline_ms);
+  }
+  return 1;
+}
+
+byte PoolController::validateJSONGeneralDetails(JsonObject& general, String& err){
+  String mode = general["mode"].isNull() ? "" : general["mode"].as<String>();
+  String time = general["time"].isNull() ? "" : general["time"].as<String>();
+
+  //Only allow setting of IDLE/RUN_SCHEDULE modes
+  if (mode != "" && mode != POOL_STATE_RUN_SCHEDULE_STR && mode != POOL_STATE_IDLE_STR){
+    err = F("Invalid pool mode passed (only 'run_schedule' and 'idle' accepted)");
+    pdebugE("%s: passed: \"%s\"\n",err.c_str(),mode.c_str());
+    return 0;
+  }
+
+  TimeElements t;
+  if (time != "" && !createElements(time.c_str(),&t)){
+    err = F("Invalid time string (must be HH:MM:SS 24 hour format)");
+    pdebugE("%s: passed: \"%s\"\n",err.c_str(),time.c_str());
+    return 0;
+  }
+
+  JsonArray tasks = general["tasks"];
+  if (!tasks.isNull() && !validateJSONTaskDetails(tasks,err)){
+    return 0; //NOTE: error is logged in validateJSONTaskDetails
+  }
+
+  JsonObject config = general["config"];
+  if (!config.isNull() && !config["save_delay_ms"].isNull()){
+    long delay_ms = config["save_delay_ms"].as<long>();
+    if (delay_ms < POOL_CONFIG_SAVE_MIN_DELAY || delay_ms > POOL_CONFIG_SAVE_MAX_DELAY){
+      err = F("Invalid config save_delay_ms");
+      pdebugE("%s\n",err.c_str());
+      return 0;
+    }
+  }
+
+  JsonObject e = general["events"];
+  if (!e.isNull() && !validateJSONEventDetails(e,err)){
+    return 0; //NOTE: error is logged in validateJSONEventDetails
+  }
+
+  JsonObject filter = general["analog_filter"];
+  if (!filter.isNull() && !validateJSONAnalogFilterDetails(filter,err)){
+    return 0; //NOTE: error is logged in validateJSONAnalogFilterDetails
+  }
+  return 1;
 }
 
 byte PoolController::setJSONGeneralDetails(JsonObject& general, String& err, byte loading_config){
-  pdebugI("Got request to update general details (mode/time)\n");
-  //NOTE: This method only lets callers set time and several operating modes
-  String mode = general["mode"];
-  String time = general["time"];
+  pdebugI("Got request to update general details (mode/time/tasks/filter)\n");
+  //NOTE: This method only lets callers set time, several operating modes,
+  //      the task scheduler settings and the analog filter. Each is optional.
+  //      All of it is checked before we change anything.
+  if (!validateJSONGeneralDetails(general, err)){
+    return 0;
+  }
+  snapshot.touch(POOL_SNAPSHOT_GENERAL);
+
+  String mode = general["mode"].isNull() ? "" : general["mode"].as<String>();
+  String time = general["time"].isNull() ? "" : general["time"].as<String>();
+
+  PoolState new_state = POOL_STATE_UNINITIALIZED;
+  if (mode == POOL_STATE_RUN_SCHEDULE_STR)
+    new_state = POOL_STATE_RUN_SCHEDULE; 
+  else if (mode == POOL_STATE_IDLE_STR)
+    new_state = POOL_STATE_IDLE;
 
   if (time != ""){
     TimeElements t;
-    int valid_time = createElements(time.c_str(),&t);
-    if (!valid_time){
-      err = F("Invalid time string (must be HH:MM:SS 24 hour format)");
-      pdebugE("%s: passed: \"%s\"\n",err.c_str(),time.c_str());
-      return 0;
-    }
+    createElements(time.c_str(),&t);
 
     //Set the time as if it were from an NTP service
     //HACK: just set the date to Jan 1 2020 (since we don't care about date)
@@ -1299,29 +3040,49 @@ byte PoolController::setJSONGeneralDetails(JsonObject& general, String& err, byt
     //TODO
   }
 
-  //Only allow setting of IDLE/RUN_SCHEDULE modes
-  PoolState new_state = POOL_STATE_UNINITIALIZED;
-  if (mode == POOL_STATE_RUN_SCHEDULE_STR)
-    new_state = POOL_STATE_RUN_SCHEDULE; 
-  else if (mode == POOL_STATE_IDLE_STR)
-    new_state = POOL_STATE_IDLE;
-  else{
-    err = F("Invalid pool mode passed (only 'run_schedule' and 'idle' accepted)");
-    pdebugE("%s: passed: \"%s\"\n",err.c_str(),mode.c_str());
-    return 0;
+  //NOTE: None of these can fail now
+  //Update the task scheduler settings (if present)
+  JsonArray tasks = general["tasks"];
+  if (!tasks.isNull()){
+    setJSONTaskDetails(tasks,err);
+  }
+
+  //Update the config save delay (if present)
+  JsonObject config = general["config"];
+  if (!config.isNull() && !config["save_delay_ms"].isNull()){
+    config_persist.save_delay_ms = config["save_delay_ms"].as<long>();
+  }
+
+  //Update the event stream settings (if present)
+  JsonObject e = general["events"];
+  if (!e.isNull()){
+    setJSONEventDetails(e,err);
+  }
+
+  //Update the analog thermistor filter (if present)
+  JsonObject filter = general["analog_filter"];
+  if (!filter.isNull()){
+    setJSONAnalogFilterDetails(filter,err);
+  }
+
+  //Save the config (the mode and time aren't part of it)
+  if (!loading_config && (!tasks.isNull() || !config.isNull() || !e.isNull() || !filter.isNull())){
+    mark_config_dirty();
   }
 
   if (new_state != POOL_STATE_UNINITIALIZED){
     pdebugI("Setting pool to state: %s\n",mode.c_str());
     pool_state = new_state;
+    request_control();
   }
 
   //We save/load the sensor role names here since the sensors might not be
   //present at the time of start/stop (but only for config load/save)
   if (loading_config){
-    if (!general["pool_water_sensor_name"].isNull()) pool_water_sensor_name=general["pool_water_sensor_name"].as<String>();
-    if (!general["roof_sensor_name"].isNull()) roof_sensor_name=general["roof_sensor_name"].as<String>();
-    if (!general["ambient_air_sensor_name"].isNull()) ambient_air_sensor_name=general["ambient_air_sensor_name"].as<String>();
+    if (!general["pool_water_sensor_name"].isNull()) POOL_SET_NAME(pool_water_sensor_name, general["pool_water_sensor_name"].as<const char*>());
+    if (!general["roof_sensor_name"].isNull()) POOL_SET_NAME(roof_sensor_name, general["roof_sensor_name"].as<const char*>());
+    if (!general["ambient_air_sensor_name"].isNull()) POOL_SET_NAME(ambient_air_sensor_name, general["ambient_air_sensor_name"].as<const char*>());
+    invalidate_handles();
   }
   return 1;
 }
@@ -2,62 +2,152 @@
 #define _POOLCONTROLLER_H
 
 #include <Arduino.h>
+#include <ESP8266WiFi.h>
 #include <WiFiUdp.h>
 #include <ArduinoJson.h>
 #include <OneWire.h>
 #include <DallasTemperature.h>
-#include <ShiftRegister74HC595.h>
 #include <Bounce2.h>
 #include <TimeLib.h>
-#include <thermistor.h>
 #include "Constants.h"
 #include "Relay.h"
+#include "RelayOutput.h"
 #include "DailySchedule.h"
+#include "TaskScheduler.h"
+#include "FilteredThermistor.h"
+#include "Profiler.h"
+#include "JsonArena.h"
+#include "Snapshot.h"
+#include "ConfigPersist.h"
+#include "ConfigStore.h"
+#include "Names.h"
+#include "AllocCounter.h"
+#include "SensorRegistry.h"
+#include "History.h"
+#include "RelayStats.h"
+#include "EventStream.h"
+#include "Mqtt.h"
+#include "Metrics.h"
+#include "MemoryStats.h"
+#include "LogRing.h"
 
 struct TempSensor{
   //"analog" for the analog pin
   //"<some hex string>" for DS1820 sensors
-  String name;
+  char name[POOL_SENSOR_NAME_LEN];
   float temp;
 };
 
 struct PoolController
 {
     //Wifi details
-    String wifi_ssid;
-    String wifi_pw;
+    char wifi_ssid[POOL_SSID_LEN];
+    char wifi_pw[POOL_PW_LEN];
+
+    //Wifi connection manager (see connect_wifi())
+    WifiConnState wifi_state;
+    unsigned long wifi_state_since; //millis() when we entered wifi_state
+    unsigned long wifi_backoff_ms;
+    unsigned long wifi_attempts;
+    unsigned long wifi_connects;
+    unsigned long wifi_disconnects;
+    unsigned long wifi_failures;
+
+    //Set from the wifi event callbacks, consumed by connect_wifi()
+    volatile byte wifi_got_ip;
+    volatile byte wifi_lost;
+    WiFiEventHandler wifi_got_ip_handler;
+    WiFiEventHandler wifi_disconnected_handler;
+
+    //Previous credentials to revert to if new ones (from a /wifi POST) don't connect
+    char wifi_fallback_ssid[POOL_SSID_LEN];
+    char wifi_fallback_pw[POOL_PW_LEN];
+    byte wifi_verifying;
 
     //Temperature sensor trackers (roles/presence/temp)
-    String pool_water_sensor_name;
-    String roof_sensor_name;
-    String ambient_air_sensor_name;
+    char pool_water_sensor_name[POOL_SENSOR_NAME_LEN];
+    char roof_sensor_name[POOL_SENSOR_NAME_LEN];
+    char ambient_air_sensor_name[POOL_SENSOR_NAME_LEN];
     TempSensor temp_sensors[MAX_SENSORS];
     int num_sensors;
 
+    //Cached handles for the relays/sensors the control logic uses (indexes
+    //into relays[]/temp_sensors[], -1 if there isn't one). resolve_handles()
+    //looks them up by name once, anything that renames relays, changes the
+    //sensor list or reassigns roles calls invalidate_handles().
+    int pump_relay_idx;
+    int solar_valve_relay_idx;
+    int water_sensor_idx;
+    int roof_sensor_idx;
+    int ambient_sensor_idx;
+    int analog_sensor_idx;
+    byte handles_valid;
+
     //Digital temperature probe(s) (DS1820)
     OneWire one_wire;
     DallasTemperature digital_temp_sensors;
 
-    //Analog thermistor tracker
-    Thermistor* analog_temp;
+    //Known 1-wire sensors by ROM (the bus is only searched by discovery)
+    PoolSensorRegistry sensor_registry;
+    byte sensor_scan_requested; //discovery asked for (GET /sensors/scan or mid-conversion)
+
+    //Non-blocking conversion tracking for the DS1820s
+    SensorConversionState sensor_conversion_state;
+    unsigned long sensor_conversion_start; //millis() when we requested the conversion
+    unsigned long sensor_conversion_wait;  //ms the conversion takes at our resolution
+
+    //Analog thermistor tracker (sampled/filtered by the "analog" task)
+    FilteredThermistor* analog_temp;
 
     //Relays to control equipment
     //NOTE: These are just state trackers, not 
     //      actual I/O objects
     Relay relays[MAX_RELAY];
 
-    //I/O object for a 74HC595 shift register
+    //Driver for the 74HC595 shift register
     //that actually controls the relay outputs
-    ShiftRegister74HC595<1>* relay_output;
+    RelayOutput relay_output;
+
+    //Compiled relay schedule state (see update_schedule()). Nothing in the
+    //schedules can change until schedule_next_transition, so until then the
+    //scheduled on/off states just come from schedule_bits.
+    byte schedule_bits;              //bit x set if relays[x] is scheduled on
+    time_t schedule_evaluated_at;    //now() when schedule_bits was computed
+    time_t schedule_next_transition; //now() of the next on/off edge on any relay
+    byte schedule_dirty;             //set when a schedule changes
+
+    //Set when an input the control pipeline depends on changed (sensor
+    //readings, the manual switch, a relay/solar/mode change), so it runs on
+    //the next update() rather than waiting for its period
+    byte control_requested;
+    unsigned long control_input_us;  //micros() of the oldest input it hasn't applied yet
 
 
     //Time tracking stuff (NTP and manual settings)
     int ntp_update_seconds;
-    String ntp_server_name;    
+    char ntp_server_name[POOL_HOST_LEN];
     int gmt_offset;
     WiFiUDP udp;
     byte udp_packet_buffer[NTP_PACKET_SIZE];
     unsigned long last_ntp_update;
+
+    //Non-blocking NTP client state
+    NtpState ntp_state;
+    unsigned long ntp_state_since;  //millis() when we entered ntp_state
+    unsigned long ntp_request_sent; //millis() when the last request went out
+    unsigned long ntp_failed_at;    //millis() of the last failed sync (0 if the last one worked)
+    int ntp_retries;
+    long ntp_last_rtt_ms;           //round trip (minus server time) of the last good sync
+
+    //Cached NTP server address
+    IPAddress ntp_server_ip;
+    unsigned long ntp_dns_resolved_at;
+    byte ntp_dns_valid;
+
+    //Set from the lwIP DNS callback
+    volatile byte ntp_dns_done;
+    volatile byte ntp_dns_ok;
+    IPAddress ntp_dns_result;
     TimeState time_state;
 
     //Error code Tracker
@@ -73,8 +163,51 @@ struct PoolController
     SolarState solar_state;
     float solar_target_temp;
 
-    //Runtime ms counter for the last time update() was run
+    //Runtime ms counter for the last time update() ran a task
     unsigned long last_update;
+
+    //Cooperative scheduler for the update() stages (indexed by PoolTaskId)
+    PoolTaskScheduler scheduler;
+
+    //Per-stage latency histograms (for update() and the rest of loop())
+    PoolProfiler profiler;
+
+    //Heap/stack usage per update() stage and HTTP handler (GET /memory)
+    PoolMemoryTracker memory;
+
+    //Loop iterations/sec as of the last GET /metrics
+    PoolLoopRate loop_rate;
+
+    //Heap allocations made inside update() (should stay 0, the per-task
+    //counts are in scheduler.tasks[x].allocs)
+    unsigned long update_allocs;
+
+    //Versioned/cached GET /everything sections
+    PoolSnapshot snapshot;
+
+    //Deferred/deduplicated config saves (see persist_config())
+    PoolConfigPersist config_persist;
+
+    //A/B binary config slots in flash
+    PoolConfigStore config_store;
+
+    //Set when load_config() imported CONFIG_FILE_PATH, the file is removed
+    //once save_config() has it on flash
+    byte legacy_config_imported;
+
+    //Temperature/relay history (GET /history)
+    PoolHistory history;
+
+    //Relay on-time/switch counters (GET /relays/stats)
+    PoolRelayStats relay_stats;
+
+    //Server-Sent Events subscribers (GET /events), fed from check_snapshot()
+    PoolEventStream events;
+
+    //MQTT broker connection (settings from /mqtt) and what's been published
+    //to it, see update_mqtt()
+    PoolMqttClient mqtt;
+    PoolMqttPublished mqtt_published;
     
     //Remote debugger
     RemoteDebug* debug;
@@ -85,23 +218,55 @@ struct PoolController
     //NOTE: defaults are saved to SPIFFS after
     void reset_config();
 
-    //JSON Config file save/load/reset
+    //Config save/load (flash)/reset
+    //NOTE: save_config() writes right away (unless nothing changed), everything
+    //      else should mark_config_dirty() and let the config task save it
     byte save_config ();
     byte load_config ();
+    void mark_config_dirty();
+
+    //Config task: save the config if changes have settled
+    void persist_config();
+
+    //Config export/import (JSON is only used over HTTP, and to pick up the
+    //config file older firmware kept in SPIFFS)
+    void getJSONConfig(JsonDocument& config);
+    byte importJSONConfig(JsonDocument& config, String& err);
+
+    //Binary config <-> our settings. apply returns 0 if the record doesn't make sense.
+    void fill_config_record(PoolConfigRecord& r);
+    byte apply_config_record(PoolConfigRecord& r);
 
     //Main loop updated method for updating the pool states
+    //NOTE: Runs at most one due task per call (see TaskScheduler.h)
     void update();
 
+    //Run a single update() stage by PoolTaskId
+    void run_task(int id);
+
+    //Bump the snapshot version of any section whose runtime state has moved
+    //since we last looked (cheap, it's run after every task), and send the
+    //changed fields to the /events subscribers
+    //NOTE: Config changes (the setJSON* methods) touch their sections directly
+    void check_snapshot();
+
+    //Send one event (data is doc) to the /events subscribers
+    void publish_event(const char* name, JsonDocument& data);
+
+    //Re-serialize any snapshot sections that changed since they were last built
+    void refresh_snapshot();
+
 
     //Utility methods for ascii hex <-> binary conversion
-    String digitalTempAddrToHex(DeviceAddress d);
-    byte ascii_hex_2_bin(String s);
-    String byteToHex(byte num);
+    //NOTE: out needs room for 2 hex digits per byte + the terminator
+    void digitalTempAddrToHex(DeviceAddress d, char* out);
+    byte ascii_hex_2_bin(const char* s);
+    void byteToHex(byte num, char* out);
 
     // Internal Utility methods
 
     //Returns whether a sensor name is present in the list of sensors
-    byte isSensorPresent(String name);
+    byte isSensorPresent(const char* name);
 
     //Returns non-zero if the name is non-null and not "analog"
     byte isSensorDigital(const char* name);
@@ -109,24 +274,102 @@ struct PoolController
     //Returns whether the sensor is analog or not (the string "analog")
     byte isSensorAnalog(const char* name);
   
-    //Update the list of one-wire sensors, set any error states
-    //and update our internal name-listing
+    //Start a 1-wire temperature conversion (without waiting on it)
+    //NOTE: This is the sensors task, the results come in via poll_temperature_sensors()
     void update_temperature_sensors();
 
+    //Cheap check (every update() call) for a finished conversion. 
+    //Returns 1 if readings were harvested, 0 otherwise
+    byte poll_temperature_sensors();
+
+    //Read the known 1-wire sensors from a finished conversion and set any
+    //error states
+    void harvest_temperature_sensors();
+
+    //Discovery task: search the 1-wire bus for sensors that came or went
+    //NOTE: Waits for an in-flight conversion to be harvested first
+    void discover_temperature_sensors();
+
+    //Ask for a bus search as soon as the bus is free
+    void request_sensor_scan();
+
+    //Rebuild temp_sensors from the present registry slots (plus "analog")
+    //after sensors came/went
+    void rebuild_sensor_list();
+
+    //Keep a configured sensor name's ROM in the registry (so it gets the
+    //same slot once discovery finds it)
+    void remember_sensor(const char* name);
+
+    //History task: record the role temperatures and relay states
+    void update_history();
+
+    //History series for a role name (water_temp, ...) or relay name, -1 if
+    //it's neither
+    int historySeries(const char* name);
+
+    //Relay stats task: fold running relays' on-time into the counters and
+    //persist them (RTC memory every time, SPIFFS every POOL_RELAY_STATS_SAVE_SECS)
+    void update_relay_stats();
+
+    //Zero the relay counters (and the saved copies)
+    void reset_relay_stats();
+
+    //MQTT task: step the broker connection and publish (retained) whatever
+    //changed, everything after a (re)connect
+    void update_mqtt();
+    void publish_mqtt_state(byte everything);
+
+    //A message on one of our command topics (topic is without the prefix)
+    void mqtt_command(const char* topic, const char* payload);
+
+    //Take one analog thermistor sample and publish the filtered temp
+    void update_analog_sensor();
+
+    //Filtered analog thermistor temp (or POOL_TEMP_SENSOR_MISSING if it's out of range)
+    float analog_temp_f();
+
+    //The control task: one pass through the pipeline, in dependency order
+    //  inputs -> pool state -> schedules -> overlays (solar) -> outputs
+    //so anything decided along the way reaches the relays in the same pass
+    void run_control();
+
+    //Run the control pipeline on the next update() (an input changed)
+    void request_control();
+
     //Update the state of the solar heating based on temperatures, 
-    //activation settings and the pump running.
+    //activation settings and the pump running (overrides the solar valve
+    //on top of what apply_schedule() set)
     void update_solar_heating();
 
-    //Update the relay states based on the sensors, time, ntp state
-    //and manual control status (manual control means we turn everything off
-    //and let the hardware do what it does. 
-    void update_relays();
+    //Set the relay states from the schedules, ntp state and manual
+    //control status (manual control means we turn everything off and let
+    //the hardware do what it does). Only the states, commit_relays() does
+    //the outputs.
+    void apply_schedule();
+
+    //Latch the relay states into the shift register (if they changed) and
+    //count the edges against their causes
+    void commit_relays();
+
+    //Re-evaluate the relay schedules if we've reached the next transition
+    //(or the clock went backwards, or a schedule changed). Returns 1 if it did.
+    byte update_schedule();
 
     //If we're on a network, attempt to update the NTP time according
     //to our timezone offset and update our time state
+    //NOTE: This never waits on the network, it steps the NTP state machine
+    //      (resolve -> send -> wait/retry) and poll_ntp() picks up the reply
     void sendNTPPacket(IPAddress &address);
     void update_ntp();
 
+    //Cheap check (every update() call) for an NTP reply
+    //Returns 1 if we set the time, 0 otherwise
+    byte poll_ntp();
+
+    void send_ntp_request();
+    void ntp_failed(TimeState state);
+
     /*
       Based on the current time, manual-mode switch and any other factors,
       determine what the current pool state should be.
@@ -143,46 +386,99 @@ struct PoolController
     void log_error(Pool_Error_Code err);
     void clear_error(Pool_Error_Code err);
 
-    byte addSensor(String name,float temp = POOL_TEMP_SENSOR_MISSING);
+    byte addSensor(const char* name,float temp = POOL_TEMP_SENSOR_MISSING);
 
-    void assignSensorRole(String name, String role);
+    void assignSensorRole(const char* name, const char* role);
 
-    TempSensor* getSensorByName(String name);
-    String getSensorRole(String name);
+    TempSensor* getSensorByName(const char* name);
 
-    Relay* getRelayByName(String name);
+    //Returns one of the (PROGMEM) TSR_*_STR role names
+    const char* getSensorRole(const char* name);
+
+    //Cached handle management (see pump_relay_idx)
+    void invalidate_handles();
+    void resolve_handles();
+    Relay* relayAt(int idx);
+    TempSensor* sensorAt(int idx);
+
+    Relay* getRelayByName(const char* name);
+    Relay* getRelayByName_P(PGM_P name); //name is one of the PROGMEM POOL_RELAY_*_NAMEs
     byte parseDailySchedule(PoolDailySchedule& d, JsonArray& schedule,String& err);
 
-    byte connect_wifi(String ssid, String pw);
+    //Non-blocking wifi connection manager (run from the wifi task)
+    //Returns 1 if we're connected (or running our AP in manual mode), 0 otherwise
+    byte connect_wifi(const char* ssid, const char* pw);
+    void set_wifi_state(WifiConnState state);
 
     /////// JSON serialize/deserialize methods
 
     //Relay names/schedules (loading_config is flag for loading from internal config)
+    //NOTE: The validate* methods only check an update (setting err), the
+    //      set* ones check it the same way and then apply it
+    byte validateJSONRelayDetails(JsonArray& relays, String& err, byte loading_config = 0);
     byte setJSONRelayDetails(JsonArray& relays, String& err, byte loading_config = 0);
     //DynamicJsonDocument getJSONRelayDetails();
-    void getJSONRelayDetails(DynamicJsonDocument& info);
+    void getJSONRelayDetails(JsonDocument& info);
+
+    //Relay counters: totals added to getJSONRelayDetails()'s relays, or the
+    //full per-cause breakdown
+    void getJSONRelayRuntime(JsonDocument& info);
+    void getJSONRelayStats(JsonDocument& info);
  
     //Temp Sensors
-    byte validateJSONSensorsUpdate(JsonArray& sensors);
+    byte validateJSONSensorsUpdate(JsonArray& sensors, String& err);
     //DynamicJsonDocument getJSONSensorsDetails();
-    void getJSONSensorsDetails(DynamicJsonDocument& info);
+    void getJSONSensorsDetails(JsonDocument& info);
     byte setJSONSensorsDetails(JsonArray& sensors, String& err, byte loading_config = 0); 
 
     //Wifi/NTP (ssid, password, ntp server/interval, UTC offset)
     //DynamicJsonDocument getJSONWifiDetails();
-    void getJSONWifiDetails(DynamicJsonDocument& info);
+    void getJSONWifiDetails(JsonDocument& info);
+    byte validateJSONWifiDetails(JsonObject& wifi, String& err);
     byte setJSONWifiDetails(JsonObject& wifi, String& err, byte loading_config = 0);
 
+    //MQTT broker/topic prefix/deadband (and the connection status)
+    void getJSONMqttDetails(JsonDocument& info);
+    byte validateJSONMqttDetails(JsonObject& mqtt, String& err);
+    byte setJSONMqttDetails(JsonObject& mqtt, String& err, byte loading_config = 0);
+
     //Solar heating settings
     //DynamicJsonDocument getJSONSolarDetails();
-    void getJSONSolarDetails(DynamicJsonDocument& info);
+    void getJSONSolarDetails(JsonDocument& info);
+    byte validateJSONSolarDetails(JsonObject& solar, String& err);
     byte setJSONSolarDetails(JsonObject& solar, String& err, byte loading_config = 0);
 
     //General settings/mode settings
     //DynamicJsonDocument getJSONGeneralDetails();
-    void getJSONGeneralDetails(DynamicJsonDocument& info);
+    void getJSONGeneralDetails(JsonDocument& info);
+    byte validateJSONGeneralDetails(JsonObject& general, String& err);
     byte setJSONGeneralDetails(JsonObject& general, String& err, byte loading_config = 0);
 
+    //Task scheduler periods/priorities/deadlines (part of the "general" section)
+    void getJSONTaskDetails(JsonObject& general);
+    byte validateJSONTaskDetails(JsonArray& tasks, String& err);
+    byte setJSONTaskDetails(JsonArray& tasks, String& err);
+
+    //Everything worth graphing, in Prometheus text format (GET /metrics)
+    void writeMetrics(Print& out);
+
+    //History memory/sample counts (part of the "general" section)
+    void getJSONHistoryDetails(JsonObject& general);
+
+    //Event stream subscribers/stats and the temperature deadband (part of
+    //the "general" section)
+    void getJSONEventDetails(JsonObject& general);
+    byte validateJSONEventDetails(JsonObject& events, String& err);
+    byte setJSONEventDetails(JsonObject& events, String& err);
+
+    //1-wire sensor registry (part of the "general" section)
+    void getJSONSensorRegistryDetails(JsonObject& general);
+
+    //Analog thermistor filter settings (part of the "general" section)
+    void getJSONAnalogFilterDetails(JsonObject& general);
+    byte validateJSONAnalogFilterDetails(JsonObject& filter, String& err);
+    byte setJSONAnalogFilterDetails(JsonObject& filter, String& err);
+
   
 };
 
@@ -0,0 +1,102 @@
+#include "Profiler.h"
+
+void LatencyHistogram::reset(){
+  memset(buckets, 0, sizeof(buckets));
+  count = 0;
+  min_us = 0;
+  max_us = 0;
+  total_us = 0;
+}
+
+void LatencyHistogram::record(unsigned long us){
+  //Bucket is the position of the highest set bit
+  int b = 0;
+  unsigned long v = us;
+  while (v > 1 && b < POOL_PROFILE_BUCKETS - 1){
+    v >>= 1;
+    b++;
+  }
+  buckets[b]++;
+
+  if (count == 0 || us < min_us) min_us = us;
+  if (us > max_us) max_us = us;
+  total_us += us;
+  count++;
+}
+
+unsigned long LatencyHistogram::percentile(int pct){
+  if (count == 0){
+    return 0;
+  }
+
+  unsigned long target = ((unsigned long long)count * pct + 99) / 100;
+  unsigned long seen = 0;
+  for (int b = 0;b < POOL_PROFILE_BUCKETS; b++){
+    seen += buckets[b];
+    if (seen >= target){
+      //Report the top of the bucket, but don't go outside what we've actually seen
+      unsigned long top = (2UL << b) - 1;
+      if (top > max_us) top = max_us;
+      if (top < min_us) top = min_us;
+      return top;
+    }
+  }
+  return max_us;
+}
+
+PoolProfiler::PoolProfiler(){
+  debug = 0;
+  reset();
+}
+
+void PoolProfiler::reset(){
+  for (int x = 0;x < POOL_NUM_PROFILE_STAGES; x++){
+    stages[x].reset();
+  }
+  last_reset = millis();
+}
+
+void PoolProfiler::record(int stage, unsigned long us){
+  stages[stage].record(us);
+
+  if (debug != 0 && us > POOL_PROFILE_SLOW_US){
+    pdebugP("Slow stage \"%s\": %lu us\n",POOL_PROFILE_STAGE_STRINGS[stage],us);
+  }
+}
+
+void PoolProfiler::print(){
+  pdebugA("%-14s %8s %8s %8s %8s %8s %8s\n","stage","count","min","avg","p50","p99","max");
+  for (int x = 0;x < POOL_NUM_PROFILE_STAGES; x++){
+    LatencyHistogram& h = stages[x];
+    pdebugA("%-14s %8lu %8lu %8lu %8lu %8lu %8lu\n",POOL_PROFILE_STAGE_STRINGS[x],h.count,h.min_us,
+            h.count ? (unsigned long)(h.total_us / h.count) : 0UL,
+            h.percentile(50),h.percentile(99),h.max_us);
+  }
+  pdebugA("(all times in us over the last %lu ms)\n",millis() - last_reset);
+}
+
+void PoolProfiler::getJSONProfileDetails(JsonDocument& info){
+  JsonObject p = info.createNestedObject("profile");
+  p["since_reset_ms"] = millis() - last_reset;
+  JsonArray a = p.createNestedArray("stages");
+  for (int x = 0;x < POOL_NUM_PROFILE_STAGES; x++){
+    LatencyHistogram& h = stages[x];
+    JsonObject s = a.createNestedObject();
+    s["name"] = POOL_PROFILE_STAGE_STRINGS[x];
+    s["count"] = h.count;
+    s["min_us"] = h.min_us;
+    s["avg_us"] = h.count ? (unsigned long)(h.total_us / h.count) : 0UL;
+    s["p50_us"] = h.percentile(50);
+    s["p99_us"] = h.percentile(99);
+    s["max_us"] = h.max_us;
+  }
+}
+
+PoolProfileTimer::PoolProfileTimer(PoolProfiler& profiler, int stage)
+: profiler(profiler), stage(stage){
+  start = micros();
+}
+
+PoolProfileTimer::~PoolProfileTimer(){
+  profiler.record(stage, micros() - start);
+}
@@ -0,0 +1,65 @@
+#ifndef _PROFILER_H
+#define _PROFILER_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  Fixed-memory latency histogram. Bucket N counts samples between 2^N and
+  2^(N+1) microseconds (the last bucket catches everything bigger), so
+  percentiles are only accurate to within a factor of 2, but it never
+  allocates and recording a sample is a handful of instructions.
+*/
+struct LatencyHistogram {
+  unsigned long buckets[POOL_PROFILE_BUCKETS];
+  unsigned long count;
+  unsigned long min_us;
+  unsigned long max_us;
+  unsigned long long total_us;
+
+  void reset();
+  void record(unsigned long us);
+
+  //Returns the (approximate) latency at or below which pct% of samples fall
+  unsigned long percentile(int pct);
+};
+
+/*
+  Per-stage loop() latency tracking (indexed by PoolProfileStage).
+*/
+class PoolProfiler {
+  public:
+    LatencyHistogram stages[POOL_NUM_PROFILE_STAGES];
+    unsigned long last_reset; //millis() of the last reset
+
+    //Remote debugger (used to flag slow stages)
+    RemoteDebug* debug;
+
+    PoolProfiler();
+    void reset();
+    void record(int stage, unsigned long us);
+
+    //Dump every stage to the remote debugger
+    void print();
+
+    void getJSONProfileDetails(JsonDocument& info);
+};
+
+/*
+  Times the scope it lives in, e.g.
+    {
+      PoolProfileTimer t(profiler, POOL_PROFILE_MDNS);
+      MDNS.update();
+    }
+*/
+class PoolProfileTimer {
+  public:
+    PoolProfiler& profiler;
+    int stage;
+    unsigned long start;
+
+    PoolProfileTimer(PoolProfiler& profiler, int stage);
+    ~PoolProfileTimer();
+};
+
+#endif
@@ -2,11 +2,25 @@
 #include "Constants.h"
 
 Relay::Relay(){
-  this->name = "";
+  this->name[0] = 0;
   this->state=POOL_RELAY_OFF;
+  this->cause=POOL_RELAY_CAUSE_SYSTEM;
 }
-Relay::Relay(String _name, int _initially_on)
-: name{_name}{
+Relay::Relay(const char* _name, int _initially_on){
+  POOL_SET_NAME(name, _name);
   state = (_initially_on ? POOL_RELAY_ON : POOL_RELAY_OFF);
+  cause = POOL_RELAY_CAUSE_SYSTEM;
+}
+
+byte Relay::isOn(){
+  return (state == POOL_RELAY_ON || state == POOL_RELAY_MANUAL_ON) ? 1 : 0;
+}
+
+void Relay::setState(RelayState s, PoolRelayCause cause){
+  byte was_on = isOn();
+  state = s;
+  if (isOn() != was_on){
+    this->cause = cause;
+  }
 }
 
@@ -4,6 +4,7 @@
 #include <Arduino.h>
 #include "Constants.h"
 #include "DailySchedule.h"
+#include "Names.h"
 
 /*
   Relay represents one of a bank of relays that turn on and off for various
@@ -13,11 +14,18 @@
 */
 class Relay {
   public:
-    String name;
+    char name[POOL_RELAY_NAME_LEN];
     RelayState state;
+    PoolRelayCause cause; //what last switched state between on and off
     PoolDailySchedule schedule;
     Relay();
-    Relay(String _name, int _initially_on);
+    Relay(const char* _name, int _initially_on);
+
+    //On or manually on
+    byte isOn();
+
+    //Change state, noting cause if that turns it on/off
+    void setState(RelayState s, PoolRelayCause cause);
 };
 
 #endif
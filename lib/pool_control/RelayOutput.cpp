@@ -0,0 +1,66 @@
+#include "RelayOutput.h"
+#if POOL_RELAY_HW_SPI
+#include <SPI.h>
+#endif
+
+RelayOutput::RelayOutput(int data_pin, int clock_pin, int latch_pin){
+  this->latch_pin = latch_pin;
+#if POOL_RELAY_HW_SPI
+  (void)data_pin;
+  (void)clock_pin;
+#else
+  this->data_pin = data_pin;
+  this->clock_pin = clock_pin;
+#endif
+
+  //Active-low, so all off
+  image = 0xFF;
+  latched = 0xFF;
+  writes = 0;
+  skipped = 0;
+}
+
+void RelayOutput::begin(){
+#if POOL_RELAY_HW_SPI
+  SPI.begin();
+  SPI.beginTransaction(SPISettings(POOL_RELAY_SPI_FREQ, MSBFIRST, SPI_MODE0));
+#else
+  pinMode(data_pin, OUTPUT);
+  pinMode(clock_pin, OUTPUT);
+#endif
+
+  //NOTE: This has to come after SPI.begin(), which claims D6 for MISO
+  pinMode(latch_pin, OUTPUT);
+  digitalWrite(latch_pin, LOW);
+
+  write(image);
+}
+
+void RelayOutput::set(int relay, byte on){
+  if (on) image &= ~(1 << relay);
+  else image |= (1 << relay);
+}
+
+byte RelayOutput::commit(){
+  if (image == latched){
+    skipped++;
+    return 0;
+  }
+  write(image);
+  return 1;
+}
+
+void RelayOutput::write(byte value){
+#if POOL_RELAY_HW_SPI
+  SPI.write(value);
+#else
+  shiftOut(data_pin, clock_pin, MSBFIRST, value);
+#endif
+
+  //Rising edge copies the shift register to the outputs
+  digitalWrite(latch_pin, HIGH);
+  digitalWrite(latch_pin, LOW);
+
+  latched = value;
+  writes++;
+}
@@ -0,0 +1,47 @@
+#ifndef _RELAY_OUTPUT_H
+#define _RELAY_OUTPUT_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  Driver for the 74HC595 behind the relays. We keep a one-byte image of what
+  we want on the outputs (bit x is relay x, the relay boards are active-low)
+  and only shift it out when it differs from what's already latched. The
+  '595 only moves its outputs on the latch edge, so each change is one clean
+  transition on every relay no matter how the bits get shifted in.
+
+  The byte is bit-banged on the DEFAULT_POOL_RELAY_SHIFT_* pins, or with
+  -DPOOL_RELAY_HW_SPI=1 goes out the HSPI peripheral (MOSI = D7, SCLK = D5).
+*/
+class RelayOutput {
+  public:
+    int latch_pin;
+#if !POOL_RELAY_HW_SPI
+    int data_pin;
+    int clock_pin;
+#endif
+
+    byte image;   //what we want on the outputs
+    byte latched; //what's actually on them
+
+    //Stats
+    unsigned long writes;  //commit()s that shifted/latched a new byte
+    unsigned long skipped; //commit()s with nothing to do
+
+    RelayOutput(int data_pin, int clock_pin, int latch_pin);
+
+    //Set up the pins/SPI and latch all relays off
+    void begin();
+
+    //Update a relay's bit in the image (nothing goes out until commit())
+    void set(int relay, byte on);
+
+    //Shift out and latch the image if it changed. Returns 1 if it wrote.
+    byte commit();
+
+  private:
+    void write(byte value);
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "RelayStats.h"
+#include "ConfigStore.h"
+#include <FS.h>
+
+PoolRelayStats::PoolRelayStats(){
+  memset(&record, 0, sizeof(record));
+  for (int x = 0; x < MAX_RELAY; x++){
+    on[x] = 0;
+    on_cause[x] = POOL_RELAY_CAUSE_SYSTEM;
+    on_since[x] = 0;
+    last_change[x] = 0;
+  }
+  loaded_from = POOL_RELAY_STATS_FROM_NONE;
+  file_saves = 0;
+  last_file_save = 0;
+  save_failures = 0;
+}
+
+void PoolRelayStats::reset(unsigned long now){
+  memset(&record, 0, sizeof(record));
+
+  //Runs in progress start counting from here
+  for (int x = 0; x < MAX_RELAY; x++){
+    on_since[x] = now;
+  }
+}
+
+void PoolRelayStats::changed(int relay, byte now_on, byte cause, unsigned long now){
+  PoolRelayCounters& c = record.relays[relay];
+
+  if (on[relay] && !now_on){
+    c.on_secs[on_cause[relay]] += (now - on_since[relay] + 500) / 1000;
+  }
+  else if (now_on){
+    on_cause[relay] = cause;
+    on_since[relay] = now;
+  }
+  on[relay] = now_on;
+  c.switches[cause]++;
+  last_change[relay] = now;
+}
+
+void PoolRelayStats::checkpoint(unsigned long now){
+  for (int x = 0; x < MAX_RELAY; x++){
+    if (!on[x]) continue;
+
+    //Whole seconds only, the rest stays with the run
+    unsigned long secs = (now - on_since[x]) / 1000;
+    record.relays[x].on_secs[on_cause[x]] += secs;
+    on_since[x] += secs * 1000;
+  }
+}
+
+uint32_t PoolRelayStats::onSecs(int relay, int cause, unsigned long now){
+  uint32_t secs = record.relays[relay].on_secs[cause];
+  if (on[relay] && on_cause[relay] == cause){
+    secs += (now - on_since[relay]) / 1000;
+  }
+  return secs;
+}
+
+uint32_t PoolRelayStats::totalOnSecs(int relay, unsigned long now){
+  uint32_t secs = 0;
+  for (int x = 0; x < POOL_RELAY_NUM_CAUSES; x++){
+    secs += onSecs(relay, x, now);
+  }
+  return secs;
+}
+
+uint32_t PoolRelayStats::totalSwitches(int relay){
+  uint32_t n = 0;
+  for (int x = 0; x < POOL_RELAY_NUM_CAUSES; x++){
+    n += record.relays[relay].switches[x];
+  }
+  return n;
+}
+
+void PoolRelayStats::seal(){
+  record.magic = POOL_RELAY_STATS_MAGIC;
+  record.crc = PoolConfigStore::crc32(record.relays, sizeof(record.relays));
+}
+
+byte PoolRelayStats::valid(){
+  return (record.magic == POOL_RELAY_STATS_MAGIC &&
+          record.crc == PoolConfigStore::crc32(record.relays, sizeof(record.relays))) ? 1 : 0;
+}
+
+byte PoolRelayStats::load(){
+  loaded_from = POOL_RELAY_STATS_FROM_NONE;
+
+  //A reset (crash, OTA, /reset) leaves RTC memory alone
+  if (ESP.rtcUserMemoryRead(POOL_RELAY_STATS_RTC_OFFSET, (uint32_t*)&record, sizeof(record)) && valid()){
+    loaded_from = POOL_RELAY_STATS_FROM_RTC;
+    return 1;
+  }
+
+  //A power cut doesn't
+  File f = SPIFFS.open(POOL_RELAY_STATS_FILE_PATH, "r");
+  if (f){
+    size_t n = f.read((uint8_t*)&record, sizeof(record));
+    f.close();
+    if (n == sizeof(record) && valid()){
+      loaded_from = POOL_RELAY_STATS_FROM_FILE;
+      saveRtc();
+      return 1;
+    }
+  }
+
+  memset(&record, 0, sizeof(record));
+  return 0;
+}
+
+byte PoolRelayStats::saveRtc(){
+  seal();
+  if (!ESP.rtcUserMemoryWrite(POOL_RELAY_STATS_RTC_OFFSET, (uint32_t*)&record, sizeof(record))){
+    save_failures++;
+    return 0;
+  }
+  return 1;
+}
+
+byte PoolRelayStats::saveFile(unsigned long now){
+  seal();
+  last_file_save = now;
+
+  File f = SPIFFS.open(POOL_RELAY_STATS_FILE_PATH, "w");
+  if (!f){
+    save_failures++;
+    return 0;
+  }
+  size_t n = f.write((const uint8_t*)&record, sizeof(record));
+  f.close();
+  if (n != sizeof(record)){
+    save_failures++;
+    return 0;
+  }
+  file_saves++;
+  return 1;
+}
@@ -0,0 +1,78 @@
+#ifndef _RELAY_STATS_H
+#define _RELAY_STATS_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  Lifetime counters for one relay, split by what switched it
+  (PoolRelayCause). A run's on-time goes to whatever turned it on, each
+  on or off edge to whatever made it.
+*/
+struct PoolRelayCounters {
+  uint32_t on_secs[POOL_RELAY_NUM_CAUSES];
+  uint32_t switches[POOL_RELAY_NUM_CAUSES];
+};
+
+//What gets persisted (RTC memory and the SPIFFS file)
+struct PoolRelayStatsRecord {
+  uint32_t magic; //POOL_RELAY_STATS_MAGIC
+  uint32_t crc;   //CRC32 of relays
+  PoolRelayCounters relays[MAX_RELAY];
+};
+
+static_assert(sizeof(PoolRelayStatsRecord) % 4 == 0, "RTC memory is written in 4 byte blocks");
+static_assert(POOL_RELAY_STATS_RTC_OFFSET * 4 + sizeof(PoolRelayStatsRecord) <= 512, "relay stats don't fit in RTC user memory");
+
+/*
+  Relay on-time/switch accounting. changed() is called with every edge the
+  relay outputs actually see and does a constant amount of work. A run
+  that's still going isn't in the counters until it ends or checkpoint()
+  folds the time so far in (so it survives a reset).
+*/
+class PoolRelayStats {
+  public:
+    PoolRelayStatsRecord record;
+
+    //Current state (not persisted)
+    byte on[MAX_RELAY];
+    byte on_cause[MAX_RELAY];           //what started the current run
+    unsigned long on_since[MAX_RELAY];  //millis() the on-time counted so far ends at
+    unsigned long last_change[MAX_RELAY]; //millis() of the last edge (boot if none)
+
+    //Where the counters came from at boot (POOL_RELAY_STATS_FROM_*)
+    byte loaded_from;
+    unsigned long file_saves;
+    unsigned long last_file_save; //millis()
+    unsigned long save_failures;
+
+    PoolRelayStats();
+
+    //A relay output went on/off
+    void changed(int relay, byte now_on, byte cause, unsigned long now);
+
+    //Fold the on-time of the runs in progress into the counters
+    void checkpoint(unsigned long now);
+
+    //Counters including the run in progress
+    uint32_t onSecs(int relay, int cause, unsigned long now);
+    uint32_t totalOnSecs(int relay, unsigned long now);
+    uint32_t totalSwitches(int relay);
+
+    //Zero everything
+    void reset(unsigned long now);
+
+    //Boot: RTC memory if it's good (it's never older than the file),
+    //otherwise the file. Returns 1 if either was.
+    byte load();
+
+    //Returns 1 on success
+    byte saveRtc();
+    byte saveFile(unsigned long now);
+
+  private:
+    byte valid();
+    void seal();
+};
+
+#endif
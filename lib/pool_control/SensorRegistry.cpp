@@ -0,0 +1,154 @@
+#include "SensorRegistry.h"
+
+PoolSensorRegistry::PoolSensorRegistry(){
+  for (int x = 0; x < MAX_SENSORS; x++){
+    slots[x].rom = 0;
+    slots[x].present = 0;
+    slots[x].seen_this_scan = 0;
+    slots[x].misses = 0;
+    slots[x].sensor_idx = -1;
+    slots[x].last_seen = 0;
+    slots[x].last_read = 0;
+  }
+  changed = 0;
+  scans = 0;
+  last_scan = 0;
+  hotplugs = 0;
+  dropouts = 0;
+  read_failures = 0;
+}
+
+int PoolSensorRegistry::find(uint64_t rom){
+  for (int x = 0; x < MAX_SENSORS; x++){
+    if (slots[x].rom == rom) return x;
+  }
+  return -1;
+}
+
+int PoolSensorRegistry::add(uint64_t rom){
+  int slot = find(rom);
+  if (slot >= 0) return slot;
+
+  //Free slot first, otherwise bump whatever's been gone the longest
+  for (int x = 0; x < MAX_SENSORS; x++){
+    if (slots[x].rom == 0){
+      slot = x;
+      break;
+    }
+    if (!slots[x].present && (slot < 0 || slots[x].last_seen < slots[slot].last_seen)){
+      slot = x;
+    }
+  }
+  if (slot < 0) return -1;
+
+  PoolSensorSlot& s = slots[slot];
+  s.rom = rom;
+  s.present = 0;
+  s.seen_this_scan = 0;
+  s.misses = 0;
+  s.sensor_idx = -1;
+  s.last_seen = 0;
+  s.last_read = 0;
+  return slot;
+}
+
+void PoolSensorRegistry::beginScan(){
+  for (int x = 0; x < MAX_SENSORS; x++){
+    slots[x].seen_this_scan = 0;
+  }
+}
+
+void PoolSensorRegistry::seen(uint64_t rom, unsigned long now){
+  int slot = add(rom);
+  if (slot < 0) return;
+
+  PoolSensorSlot& s = slots[slot];
+  s.seen_this_scan = 1;
+  s.last_seen = now;
+  if (!s.present){
+    s.present = 1;
+    s.misses = 0;
+    hotplugs++;
+    changed = 1;
+  }
+}
+
+void PoolSensorRegistry::endScan(unsigned long now){
+  for (int x = 0; x < MAX_SENSORS; x++){
+    PoolSensorSlot& s = slots[x];
+    if (s.present && !s.seen_this_scan){
+      s.present = 0;
+      dropouts++;
+      changed = 1;
+    }
+  }
+  scans++;
+  last_scan = now;
+}
+
+void PoolSensorRegistry::readOk(int slot, unsigned long now){
+  PoolSensorSlot& s = slots[slot];
+  s.misses = 0;
+  s.last_seen = now;
+  s.last_read = now;
+}
+
+void PoolSensorRegistry::readFailed(int slot){
+  PoolSensorSlot& s = slots[slot];
+  read_failures++;
+  if (++s.misses >= POOL_SENSOR_DROPOUT_READS && s.present){
+    s.present = 0;
+    dropouts++;
+    changed = 1;
+  }
+}
+
+int PoolSensorRegistry::numPresent(){
+  int n = 0;
+  for (int x = 0; x < MAX_SENSORS; x++){
+    if (slots[x].present) n++;
+  }
+  return n;
+}
+
+uint64_t PoolSensorRegistry::romFromAddress(const uint8_t* addr){
+  uint64_t rom = 0;
+  for (int b = 7; b >= 0; b--){
+    rom = (rom << 8) | addr[b];
+  }
+  return rom;
+}
+
+void PoolSensorRegistry::romToAddress(uint64_t rom, uint8_t* addr){
+  for (int b = 0; b < 8; b++){
+    addr[b] = (uint8_t)(rom >> (b * 8));
+  }
+}
+
+void PoolSensorRegistry::romToHex(uint64_t rom, char* out){
+  static const char hexDigits[] = "0123456789ABCDEF";
+  for (int b = 0; b < 8; b++){
+    uint8_t v = (uint8_t)(rom >> (b * 8));
+    out[b * 2] = hexDigits[v >> 4];
+    out[b * 2 + 1] = hexDigits[v & 0xF];
+  }
+  out[16] = 0;
+}
+
+byte PoolSensorRegistry::romFromHex(const char* hex, uint64_t& rom){
+  if (strlen(hex) != 16) return 0;
+
+  rom = 0;
+  for (int b = 7; b >= 0; b--){
+    uint8_t v = 0;
+    for (int n = 0; n < 2; n++){
+      char c = hex[b * 2 + n];
+      v <<= 4;
+      if (c >= '0' && c <= '9') v |= c - '0';
+      else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+      else return 0;
+    }
+    rom = (rom << 8) | v;
+  }
+  return rom != 0;
+}
@@ -0,0 +1,73 @@
+#ifndef _SENSOR_REGISTRY_H
+#define _SENSOR_REGISTRY_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  One known DS18B20, keyed by its 64 bit ROM (address byte 0, the family
+  code, in the low byte). A slot keeps its ROM once it's been seen, so a
+  sensor that drops out and comes back lands in the same slot.
+*/
+struct PoolSensorSlot {
+  uint64_t rom;              //0 if the slot is free
+  byte present;              //answering on the bus as far as we know
+  byte seen_this_scan;
+  byte misses;               //failed reads in a row
+  int sensor_idx;            //index in PoolController::temp_sensors, -1 if it isn't listed
+  unsigned long last_seen;   //millis() the last discovery/read found it
+  unsigned long last_read;   //millis() of the last good reading
+};
+
+/*
+  Fixed table of the 1-wire temperature sensors we know about. The full
+  bus search (slow, and it scales with the number of devices) only runs
+  from discovery: beginScan(), seen() for everything the search turns up,
+  then endScan(). In between, the sensors task just reads the present
+  slots by ROM. New ROMs (hot-plugs) and sensors that stop answering
+  (missing from a scan, or POOL_SENSOR_DROPOUT_READS bad reads in a row)
+  set changed so the controller rebuilds its sensor list.
+*/
+class PoolSensorRegistry {
+  public:
+    PoolSensorSlot slots[MAX_SENSORS];
+
+    //Set when a sensor comes or goes (the controller clears it)
+    byte changed;
+
+    //Stats
+    unsigned long scans;
+    unsigned long last_scan; //millis()
+    unsigned long hotplugs;
+    unsigned long dropouts;
+    unsigned long read_failures;
+
+    PoolSensorRegistry();
+
+    //Returns the slot holding rom or -1
+    int find(uint64_t rom);
+
+    //Slot for rom, taking a free one (or the one absent the longest) if it's
+    //new. Returns -1 if every slot has a present sensor in it.
+    int add(uint64_t rom);
+
+    //Discovery
+    void beginScan();
+    void seen(uint64_t rom, unsigned long now);
+    void endScan(unsigned long now);
+
+    //Outcome of reading a present slot
+    void readOk(int slot, unsigned long now);
+    void readFailed(int slot);
+
+    //Number of slots with present sensors
+    int numPresent();
+
+    //DeviceAddress <-> ROM <-> name ("28FF..." hex, byte 0 first)
+    static uint64_t romFromAddress(const uint8_t* addr);
+    static void romToAddress(uint64_t rom, uint8_t* addr);
+    static void romToHex(uint64_t rom, char* out); //out needs POOL_SENSOR_ROM_HEX_LEN
+    static byte romFromHex(const char* hex, uint64_t& rom); //returns 0 if it isn't a ROM
+};
+
+#endif
@@ -0,0 +1,68 @@
+#include "Snapshot.h"
+
+PoolSnapshot::PoolSnapshot(){
+  //Start every section one version ahead of its (empty) JSON
+  for (int x = 0; x < POOL_NUM_SNAPSHOT_SECTIONS; x++){
+    versions[x] = 1;
+    built[x] = 0;
+  }
+  generation = 1;
+  boot_id = 0;
+  rebuilds = 0;
+  hits = 0;
+  not_modified = 0;
+
+  last_wifi_state = POOL_WIFI_IDLE;
+  last_wifi_events = 0;
+  last_rssi = 0;
+  for (int x = 0; x < MAX_RELAY; x++){
+    last_relay_states[x] = POOL_RELAY_OFF;
+  }
+  last_num_sensors = 0;
+  for (int x = 0; x < MAX_SENSORS; x++){
+    last_sensor_names[x] = 0;
+    last_sensor_temps[x] = POOL_TEMP_SENSOR_MISSING;
+  }
+  last_solar_state = SOLAR_DISABLED;
+  last_pool_state = POOL_STATE_UNINITIALIZED;
+  last_errors = 0;
+  last_ntp_update = 0;
+  last_telemetry = 0;
+}
+
+void PoolSnapshot::touch(int section){
+  versions[section]++;
+  generation++;
+}
+
+byte PoolSnapshot::isStale(int section){
+  return built[section] != versions[section];
+}
+
+void PoolSnapshot::store(int section, JsonDocument& doc){
+  const char* name = POOL_SNAPSHOT_SECTION_STRINGS[section];
+  JsonVariant v = doc[name];
+  String& out = sections[section];
+
+  out.reserve(strlen(name) + 3 + measureJson(v));
+  out = "\"";
+  out += name;
+  out += "\":";
+  serializeJson(v, out);
+
+  built[section] = versions[section];
+  rebuilds++;
+}
+
+void PoolSnapshot::etag(char* buffer, size_t size){
+  snprintf(buffer, size, "\"%08lx-%lx\"", (unsigned long)boot_id, generation);
+}
+
+uint32_t PoolSnapshot::hash(const char* c){
+  //djb2
+  uint32_t h = 5381;
+  while (*c){
+    h = ((h << 5) + h) + (uint8_t)*c++;
+  }
+  return h;
+}
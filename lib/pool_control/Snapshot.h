@@ -0,0 +1,71 @@
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Constants.h"
+
+/*
+  Versioned cache of the GET /everything response. Each section (wifi,
+  relays, ...) has a version that only goes up when something in it
+  changes and a copy of its serialized JSON ("name":{...}) from the last
+  time it was built, so a poll only rebuilds the sections that changed
+  since the last one (usually none).
+
+  generation goes up with every section's version, together with boot_id
+  (so versions from before a reboot never match) it's the response's ETag.
+
+  The controller decides when a section changed (see
+  PoolController::check_snapshot()), the last_* fields are what it
+  compares against.
+*/
+class PoolSnapshot {
+  public:
+    unsigned long versions[POOL_NUM_SNAPSHOT_SECTIONS];
+    unsigned long built[POOL_NUM_SNAPSHOT_SECTIONS]; //version each section's JSON is from
+    unsigned long generation;
+    uint32_t boot_id;
+
+    //NOTE: These only ever grow (to the biggest the section's been), so
+    //      after the first few polls rebuilding doesn't touch the heap
+    String sections[POOL_NUM_SNAPSHOT_SECTIONS];
+
+    //Stats
+    unsigned long rebuilds;     //sections re-serialized
+    unsigned long hits;         //responses served without rebuilding anything
+    unsigned long not_modified; //304s
+
+    //What the controller last saw for the state it can't easily flag at
+    //the source (runtime state that changes from all over the place)
+    WifiConnState last_wifi_state;
+    unsigned long last_wifi_events; //sum of the wifi attempt/connect/etc counters
+    long last_rssi;
+    byte last_relay_states[MAX_RELAY];
+    int last_num_sensors;
+    uint32_t last_sensor_names[MAX_SENSORS]; //hashes
+    float last_sensor_temps[MAX_SENSORS];
+    SolarState last_solar_state;
+    PoolState last_pool_state;
+    unsigned long last_errors; //bitmask of Pool_Error_Codes
+    unsigned long last_ntp_update;
+    unsigned long last_telemetry; //millis() the general section last counted as changed
+
+    PoolSnapshot();
+
+    //Note that a section changed
+    void touch(int section);
+
+    //Returns 1 if the section's JSON is older than its version
+    byte isStale(int section);
+
+    //Keep the section's JSON from doc (which holds just that section)
+    void store(int section, JsonDocument& doc);
+
+    //Quoted ETag for the current versions
+    void etag(char* buffer, size_t size);
+
+    //Cheap string hash for spotting renames
+    static uint32_t hash(const char* s);
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "TaskScheduler.h"
+
+PoolTaskScheduler::PoolTaskScheduler(){
+  num_tasks = 0;
+}
+
+int PoolTaskScheduler::addTask(const char* name, unsigned long period_ms, byte priority, unsigned long deadline_ms){
+  if (num_tasks >= MAX_POOL_TASKS){
+    return -1;
+  }
+
+  PoolTask& t = tasks[num_tasks];
+  t.name = name;
+  t.period_ms = period_ms;
+  t.priority = priority;
+  t.deadline_ms = deadline_ms;
+  t.last_run = 0;
+  t.runs = 0;
+  t.deadline_misses = 0;
+  t.last_duration_ms = 0;
+  t.max_duration_ms = 0;
+  t.allocs = 0;
+
+  return num_tasks++;
+}
+
+int PoolTaskScheduler::nextDueTask(unsigned long now){
+  int best = -1;
+  byte best_late = 0;
+  unsigned long best_lateness = 0;
+
+  for (int x=0;x<num_tasks;x++){
+    PoolTask& t = tasks[x];
+    unsigned long lateness = 0;
+
+    //Tasks that have never run are due right away
+    if (t.runs > 0){
+      if (now - t.last_run < t.period_ms) continue;
+      lateness = (now - t.last_run) - t.period_ms;
+    }
+
+    //Anything past its deadline goes ahead of everything that isn't
+    byte late = (lateness > t.deadline_ms) ? 1 : 0;
+
+    if (best < 0 ||
+        late > best_late ||
+        (late == best_late && t.priority < tasks[best].priority) ||
+        (late == best_late && t.priority == tasks[best].priority && lateness > best_lateness)){
+      best = x;
+      best_late = late;
+      best_lateness = lateness;
+    }
+  }
+
+  return best;
+}
+
+void PoolTaskScheduler::taskStarted(int id, unsigned long now){
+  PoolTask& t = tasks[id];
+  if (t.runs > 0 && (now - t.last_run) > (t.period_ms + t.deadline_ms)){
+    t.deadline_misses++;
+  }
+  t.last_run = now;
+  t.runs++;
+}
+
+void PoolTaskScheduler::taskFinished(int id, unsigned long now){
+  PoolTask& t = tasks[id];
+  t.last_duration_ms = now - t.last_run;
+  if (t.last_duration_ms > t.max_duration_ms){
+    t.max_duration_ms = t.last_duration_ms;
+  }
+}
+
+int PoolTaskScheduler::getTaskByName(const char* name){
+  if (name == 0) return -1;
+
+  for (int x=0;x<num_tasks;x++){
+    if (!strcmp(tasks[x].name,name))
+      return x;
+  }
+  return -1;
+}
+
+byte PoolTaskScheduler::validateTask(unsigned long period_ms, int priority, unsigned long deadline_ms){
+  if (period_ms < POOL_TASK_MIN_PERIOD || period_ms > POOL_TASK_MAX_PERIOD) return 0;
+  if (priority < 0 || priority > POOL_TASK_MAX_PRIORITY) return 0;
+  if (deadline_ms > POOL_TASK_MAX_PERIOD) return 0;
+  return 1;
+}
@@ -0,0 +1,58 @@
+#ifndef _TASK_SCHEDULER_H
+#define _TASK_SCHEDULER_H
+
+#include <Arduino.h>
+#include "Constants.h"
+
+/*
+  PoolTask is one stage of the controller's work (wifi, sensors, relays, etc)
+  with its own run period, priority and deadline. The scheduler doesn't know
+  what the task does, it just tracks when it last ran and picks which due task
+  goes next. The owner (PoolController) dispatches on the task's index.
+*/
+struct PoolTask {
+  const char* name;
+  unsigned long period_ms;   //how often we want the task to run
+  unsigned long deadline_ms; //how late (past the period) it can run before it counts as a miss
+  byte priority;             //0 is most important, runs first when several tasks are due
+
+  //Stats/bookkeeping
+  unsigned long last_run;    //millis() when the task was last started
+  unsigned long runs;
+  unsigned long deadline_misses;
+  unsigned long last_duration_ms;
+  unsigned long max_duration_ms;
+  unsigned long allocs;      //heap allocations made while running (see AllocCounter.h)
+};
+
+/*
+  Simple cooperative scheduler. Nothing is preempted, each call to
+  nextDueTask() just hands back (at most) one task to run so a single
+  loop() pass never has to eat every stage at once.
+*/
+class PoolTaskScheduler {
+  public:
+    PoolTask tasks[MAX_POOL_TASKS];
+    int num_tasks;
+
+    PoolTaskScheduler();
+
+    //Returns the new task index, or -1 if we're out of room
+    int addTask(const char* name, unsigned long period_ms, byte priority, unsigned long deadline_ms);
+
+    //Returns the index of the task that should run now, or -1 if nothing is due.
+    //Tasks that have blown their deadline jump the priority queue.
+    int nextDueTask(unsigned long now);
+
+    //Bookkeeping around actually running a task
+    void taskStarted(int id, unsigned long now);
+    void taskFinished(int id, unsigned long now);
+
+    //Returns the index of the named task or -1 if it doesn't exist
+    int getTaskByName(const char* name);
+
+    //Returns 1 if the task can be set to those values, 0 otherwise
+    byte validateTask(unsigned long period_ms, int priority, unsigned long deadline_ms);
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include <Arduino.h>
+#include <chrono>
+#include <ESP8266WebServer.h>
+#include "HalState.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+HalState& hal_state(){
+  static HalState state;
+  return state;
+}
+
+static std::chrono::steady_clock::time_point hal_start(){
+  static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return start;
+}
+
+unsigned long micros(){
+  auto elapsed = std::chrono::steady_clock::now() - hal_start();
+  unsigned long long us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  return (unsigned long)(us + hal_state().skipped_us);
+}
+
+unsigned long millis(){
+  return micros() / 1000UL;
+}
+
+void delay(unsigned long ms){
+  hal_clock_advance_ms(ms);
+}
+
+void yield(){
+}
+
+void hal_clock_advance_ms(unsigned long ms){
+  hal_state().skipped_us += (unsigned long long)ms * 1000ULL;
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+  hal_set_digital(pin, value);
+}
+
+int digitalRead(uint8_t pin){
+  return hal_get_digital(pin);
+}
+
+int analogRead(uint8_t pin){
+  return hal_state().analog[pin % 32];
+}
+
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val){
+  (void)dataPin;
+  (void)clockPin;
+  for (int x=0;x<8;x++){
+    int bit = (bitOrder == MSBFIRST) ? (val >> (7 - x)) & 1 : (val >> x) & 1;
+    hal_state().shift_in = (hal_state().shift_in << 1) | bit;
+  }
+}
+
+void hal_set_digital(uint8_t pin, int value){
+  HalState& hal = hal_state();
+  if (pin == hal.shift_latch_pin && value && !hal.digital[pin % 32]){
+    hal.shift_register = hal.shift_in;
+    hal.shift_latches++;
+  }
+  hal.digital[pin % 32] = value;
+}
+
+int hal_get_digital(uint8_t pin){
+  return hal_state().digital[pin % 32];
+}
+
+void hal_set_analog(uint8_t pin, int value){
+  hal_state().analog[pin % 32] = value;
+}
+
+uint32_t EspClass::getFreeHeap(){ return 40000; }
+uint32_t EspClass::getMaxFreeBlockSize(){ return 32000; }
+uint8_t EspClass::getHeapFragmentation(){ return 0; }
+uint32_t EspClass::getFreeContStack(){ return 2048; }
+uint32_t EspClass::getCycleCount(){ return micros() * getCpuFreqMHz(); }
+uint32_t EspClass::random(){ return (uint32_t)std::chrono::system_clock::now().time_since_epoch().count() ^ (uint32_t)rand(); }
+void EspClass::restart(){ exit(0); }
+
+void hal_tick(){
+  std::vector<std::function<void()>> events;
+  events.swap(hal_state().pending_events);
+  for (auto& e : events){
+    e();
+  }
+}
+
+//Unit tests (test/, "pio test -e native") bring their own main()
+#ifndef PIO_UNIT_TESTING
+/*
+  Like the Arduino core: setup() once then loop() forever (well, for as many
+  simulated seconds as asked for, default 60). Each pass skips the clock ahead
+  POOL_NATIVE_LOOP_STEP_MS so a long run doesn't take that long. At the end we
+  dump /everything, /profile, /memory and /metrics so there's something to look at/diff.
+*/
+int main(int argc, char** argv){
+  unsigned long run_secs = (argc > 1) ? strtoul(argv[1], 0, 10) : 60;
+  unsigned long step_ms = getenv("POOL_NATIVE_LOOP_STEP_MS") ? strtoul(getenv("POOL_NATIVE_LOOP_STEP_MS"), 0, 10) : 1;
+
+  setup();
+  unsigned long start = millis();
+  unsigned long passes = 0;
+  while (millis() - start < run_secs * 1000UL){
+    loop();
+    hal_tick();
+    hal_clock_advance_ms(step_ms);
+    passes++;
+  }
+
+  String response;
+  hal_http_request(HTTP_GET, "/everything", "", response);
+  printf("%s\n", response.c_str());
+  hal_http_request(HTTP_GET, "/profile", "", response);
+  printf("%s\n", response.c_str());
+  hal_http_request(HTTP_GET, "/memory", "", response);
+  printf("%s\n", response.c_str());
+  hal_http_request(HTTP_GET, "/metrics", "", response);
+  printf("%s\n", response.c_str());
+  printf("%lu loop() passes, %lu relay latches, %lu flash writes\n", passes, hal_shift_latches(), hal_fs_writes());
+  return 0;
+}
+#endif
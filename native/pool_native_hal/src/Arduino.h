@@ -0,0 +1,103 @@
+#ifndef _POOL_NATIVE_ARDUINO_H
+#define _POOL_NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "pgmspace.h"
+#include "WString.h"
+#include "Print.h"
+#include "Stream.h"
+#include "PoolNativeHal.h"
+
+typedef uint8_t byte;
+
+//Nothing is special about where code lives on native
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+typedef bool boolean;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+//NodeMCU pin names (same numbers as the ESP8266 core)
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+#define A0 17
+#define LED_BUILTIN 2
+
+//Clock (see hal_clock_advance_ms())
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+//GPIO/ADC
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val);
+
+template <typename T, typename U> static inline auto max(const T& a, const U& b) -> decltype(a > b ? a : b) { return a > b ? a : b; }
+template <typename T, typename U> static inline auto min(const T& a, const U& b) -> decltype(a < b ? a : b) { return a < b ? a : b; }
+
+//Sketch entry points (src/main.cpp)
+void setup();
+void loop();
+
+//stdout-backed Serial
+class HardwareSerial : public Stream {
+  public:
+    using Print::write;
+    void begin(unsigned long baud) { (void)baud; }
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+extern HardwareSerial Serial;
+
+//The bits of the ESP object we use (heap/stack numbers are made up)
+class EspClass {
+  public:
+    uint32_t getFreeHeap();
+    uint32_t getMaxFreeBlockSize();
+    uint8_t getHeapFragmentation();
+    uint32_t getFreeContStack();
+    void resetFreeContStack() {}
+    uint32_t getCycleCount();
+    uint8_t getCpuFreqMHz() { return 80; }
+    uint32_t getChipId() { return 0x00C0FFEE; }
+    uint32_t random();
+
+    //Raw flash (NOR semantics: erase to 0xFF, writes can only clear bits)
+    uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+    bool flashEraseSector(uint32_t sector);
+    bool flashWrite(uint32_t address, const uint32_t* data, size_t size);
+    bool flashRead(uint32_t address, uint32_t* data, size_t size);
+
+    //RTC user memory (512 bytes, offset is in 4 byte blocks)
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size);
+    void restart();
+};
+extern EspClass ESP;
+
+#endif
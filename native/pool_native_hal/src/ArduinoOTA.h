@@ -0,0 +1,34 @@
+#ifndef _POOL_NATIVE_ARDUINOOTA_H
+#define _POOL_NATIVE_ARDUINOOTA_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define U_FLASH 0
+#define U_FS 100
+#define U_SPIFFS U_FS
+
+typedef enum {
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+//No updates ever arrive
+class ArduinoOTAClass {
+  public:
+    void onStart(std::function<void(void)> f) { (void)f; }
+    void onEnd(std::function<void(void)> f) { (void)f; }
+    void onProgress(std::function<void(unsigned int, unsigned int)> f) { (void)f; }
+    void onError(std::function<void(ota_error_t)> f) { (void)f; }
+    void setPassword(const char* password) { (void)password; }
+    void setHostname(const char* hostname) { (void)hostname; }
+    void begin() {}
+    void handle() {}
+    int getCommand() { return U_FLASH; }
+};
+extern ArduinoOTAClass ArduinoOTA;
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _POOL_NATIVE_BOUNCE2_H
+#define _POOL_NATIVE_BOUNCE2_H
+
+#include <Arduino.h>
+
+//Switch reader without the debouncing (the fake pins don't bounce)
+class Bounce {
+  public:
+    uint8_t pin = 0;
+    int state = HIGH;
+    int previous = HIGH;
+
+    void attach(int p) { pin = p; state = previous = digitalRead(pin); }
+    void attach(int p, int mode) { pinMode(p, mode); attach(p); }
+    void interval(uint16_t ms) { (void)ms; }
+    bool update() { previous = state; state = digitalRead(pin); return state != previous; }
+    int read() { return state; }
+    bool fell() { return previous == HIGH && state == LOW; }
+    bool rose() { return previous == LOW && state == HIGH; }
+};
+
+#endif
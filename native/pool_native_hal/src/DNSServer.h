@@ -0,0 +1,13 @@
+#ifndef _POOL_NATIVE_DNSSERVER_H
+#define _POOL_NATIVE_DNSSERVER_H
+
+#include <IPAddress.h>
+
+class DNSServer {
+  public:
+    bool start(uint16_t port, const String& domain, const IPAddress& ip) { (void)port; (void)domain; (void)ip; return true; }
+    void processNextRequest() {}
+    void stop() {}
+};
+
+#endif
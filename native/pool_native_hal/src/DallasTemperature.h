@@ -0,0 +1,48 @@
+#ifndef _POOL_NATIVE_DALLASTEMPERATURE_H
+#define _POOL_NATIVE_DALLASTEMPERATURE_H
+
+#include <Arduino.h>
+#include <OneWire.h>
+
+#define DEVICE_DISCONNECTED_C -127
+#define DEVICE_DISCONNECTED_F -196.6
+
+typedef uint8_t DeviceAddress[8];
+
+/*
+  DS18B20 fake. Conversions "take" the datasheet time on the hal clock, and
+  readings come from the hal device list as of when the conversion started.
+*/
+class DallasTemperature {
+  public:
+    OneWire* wire = 0;
+    uint8_t resolution = 12;
+    bool wait_for_conversion = true;
+    unsigned long conversion_started = 0;
+    uint8_t device_count = 0;
+
+    DallasTemperature() {}
+    DallasTemperature(OneWire* w) : wire(w) {}
+    void setOneWire(OneWire* w) { wire = w; }
+    void begin();
+
+    uint8_t getDeviceCount() { return device_count; }
+    bool getAddress(uint8_t* addr, uint8_t index);
+    bool isConnected(const uint8_t* addr);
+    bool validFamily(const uint8_t* addr) { return addr[0] == 0x10 || addr[0] == 0x28 || addr[0] == 0x22 || addr[0] == 0x3B || addr[0] == 0x42; }
+
+    uint8_t getResolution() { return resolution; }
+    void setResolution(uint8_t bits) { resolution = bits; }
+    void setWaitForConversion(bool wait) { wait_for_conversion = wait; }
+    int16_t millisToWaitForConversion(uint8_t bits);
+
+    void requestTemperatures();
+    bool requestTemperaturesByAddress(const uint8_t* addr) { (void)addr; requestTemperatures(); return true; }
+    bool isConversionComplete();
+
+    float getTempF(const uint8_t* addr);
+    float getTempC(const uint8_t* addr) { float f = getTempF(addr); return f == (float)DEVICE_DISCONNECTED_F ? DEVICE_DISCONNECTED_C : (f - 32.0) * 5.0 / 9.0; }
+    float getTempFByIndex(uint8_t index);
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include <ESP8266WebServer.h>
+
+//The sketch only has one server, requests go to the last one created
+static ESP8266WebServer* hal_server = 0;
+
+ESP8266WebServer::ESP8266WebServer(int port){
+  (void)port;
+  hal_server = this;
+}
+
+String ESP8266WebServer::arg(const String& name){
+  for (auto& a : request_args){
+    if (a.first == name) return a.second;
+  }
+  return String();
+}
+
+bool ESP8266WebServer::hasArg(const String& name){
+  for (auto& a : request_args){
+    if (a.first == name) return true;
+  }
+  return false;
+}
+
+String ESP8266WebServer::header(const String& name){
+  for (auto& h : request_headers){
+    if (h.first.equalsIgnoreCase(name)) return h.second;
+  }
+  return String();
+}
+
+String ESP8266WebServer::responseHeader(const String& name){
+  for (auto& h : response_headers){
+    if (h.first.equalsIgnoreCase(name)) return h.second;
+  }
+  return String();
+}
+
+void ESP8266WebServer::sendHeader(const String& name, const String& value, bool first){
+  if (first) response_headers.insert(response_headers.begin(), {name, value});
+  else response_headers.push_back({name, value});
+}
+
+void ESP8266WebServer::send(int code, const char* content_type, const String& content){
+  (void)content_type;
+  response_code = code;
+  response_body += content;
+}
+
+size_t ESP8266WebServer::streamFile(File& file, const String& content_type){
+  (void)content_type;
+  response_code = 200;
+  size_t n = 0;
+  int c;
+  while ((c = file.read()) >= 0){
+    response_body += (char)c;
+    n++;
+  }
+  return n;
+}
+
+int ESP8266WebServer::dispatch(HTTPMethod method, const char* uri, const char* body){
+  request_method = method;
+  request_args.clear();
+  response_code = 0;
+  response_body = "";
+  response_headers.clear();
+  content_length = CONTENT_LENGTH_UNKNOWN;
+  current_client = WiFiClient(std::make_shared<HalClientState>());
+
+  //Split off and decode the query string (no %-decoding, we don't need it)
+  const char* q = strchr(uri, '?');
+  request_uri = q ? String(uri).substring(0, q - uri) : String(uri);
+  while (q && *q){
+    q++;
+    const char* end = strchr(q, '&');
+    String pair = end ? String(q).substring(0, end - q) : String(q);
+    int eq = pair.indexOf('=');
+    if (eq < 0) request_args.push_back({pair, String()});
+    else request_args.push_back({pair.substring(0, eq), pair.substring(eq + 1)});
+    q = end;
+  }
+  if (body && *body){
+    request_args.push_back({String("plain"), String(body)});
+  }
+
+  byte found = 0;
+  for (auto& r : routes){
+    if (r.uri == request_uri && (r.method == HTTP_ANY || r.method == method)){
+      r.handler();
+      found = 1;
+      break;
+    }
+  }
+
+  if (!found){
+    if (not_found) not_found();
+    else send(404, "text/plain", "Not found");
+  }
+
+  //Headers only last for one request
+  request_headers.clear();
+  return response_code;
+}
+
+void hal_http_header(const char* name, const char* value){
+  if (hal_server) hal_server->request_headers.push_back({String(name), String(value)});
+}
+
+WiFiClient hal_http_client(){
+  return hal_server ? hal_server->current_client : WiFiClient();
+}
+
+String hal_http_response_header(const char* name){
+  return hal_server ? hal_server->responseHeader(name) : String();
+}
+
+int hal_http_request(int method, const char* uri, const char* body, String& response){
+  if (!hal_server){
+    response = "";
+    return 0;
+  }
+
+  int code = hal_server->dispatch((HTTPMethod)method, uri, body);
+  response = hal_server->response_body;
+  return code;
+}
@@ -0,0 +1,81 @@
+#ifndef _POOL_NATIVE_ESP8266WEBSERVER_H
+#define _POOL_NATIVE_ESP8266WEBSERVER_H
+
+#include <ESP8266WiFi.h>
+#include <WiFiClient.h>
+#include <FS.h>
+#include <functional>
+#include <vector>
+
+enum HTTPMethod { HTTP_ANY = 0, HTTP_GET = 1, HTTP_HEAD = 2, HTTP_POST = 3, HTTP_PUT = 4, HTTP_PATCH = 5, HTTP_DELETE = 6, HTTP_OPTIONS = 7 };
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+
+/*
+  Web server fake. Nothing listens on a socket, requests come in through
+  hal_http_request() and are dispatched to the registered handlers just
+  like the real one does.
+*/
+class ESP8266WebServer {
+  public:
+    typedef std::function<void(void)> THandlerFunction;
+
+    struct Route {
+      String uri;
+      HTTPMethod method;
+      THandlerFunction handler;
+    };
+    std::vector<Route> routes;
+    THandlerFunction not_found;
+
+    //Current request
+    String request_uri;
+    HTTPMethod request_method = HTTP_GET;
+    std::vector<std::pair<String, String>> request_args;
+    std::vector<std::pair<String, String>> request_headers;
+
+    //Response
+    int response_code = 0;
+    String response_body;
+    std::vector<std::pair<String, String>> response_headers;
+    size_t content_length = CONTENT_LENGTH_UNKNOWN;
+
+    //Connection the current request came in on (a new one every request)
+    WiFiClient current_client;
+
+    ESP8266WebServer(int port = 80);
+
+    void on(const String& uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+    void on(const String& uri, HTTPMethod method, THandlerFunction handler) { routes.push_back({uri, method, handler}); }
+    void onNotFound(THandlerFunction handler) { not_found = handler; }
+    void begin() {}
+    void handleClient() {}
+
+    WiFiClient& client() { return current_client; }
+    String uri() { return request_uri; }
+    HTTPMethod method() { return request_method; }
+    String arg(const String& name);
+    String arg(int i) { return (i >= 0 && i < args()) ? request_args[i].second : String(); }
+    String argName(int i) { return (i >= 0 && i < args()) ? request_args[i].first : String(); }
+    int args() { return (int)request_args.size(); }
+    bool hasArg(const String& name);
+    String header(const String& name);
+    bool hasHeader(const String& name) { return header(name).length() > 0; }
+    void collectHeaders(const char* header_keys[], const size_t count) { (void)header_keys; (void)count; }
+
+    void setContentLength(size_t len) { content_length = len; }
+    void sendHeader(const String& name, const String& value, bool first = false);
+    void send(int code, const char* content_type = 0, const String& content = String());
+    void send(int code, const String& content_type, const String& content) { send(code, content_type.c_str(), content); }
+    void sendContent(const String& content) { response_body += content; }
+    void sendContent(const char* content, size_t size) { response_body.concat(content, size); }
+    size_t streamFile(File& file, const String& content_type);
+
+    //Response header by name ("" if it wasn't sent)
+    String responseHeader(const String& name);
+
+    //Runs a request through the handlers, returns the status code
+    int dispatch(HTTPMethod method, const char* uri, const char* body);
+};
+
+#endif
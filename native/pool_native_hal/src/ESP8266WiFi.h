@@ -0,0 +1,74 @@
+#ifndef _POOL_NATIVE_ESP8266WIFI_H
+#define _POOL_NATIVE_ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <functional>
+#include <memory>
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} WiFiMode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+struct WiFiEventStationModeGotIP {
+  IPAddress ip;
+  IPAddress mask;
+  IPAddress gw;
+};
+
+struct WiFiEventStationModeDisconnected {
+  String ssid;
+  uint8_t reason;
+};
+
+struct WiFiEventHandlerOpaque {
+  virtual ~WiFiEventHandlerOpaque() {}
+};
+typedef std::shared_ptr<WiFiEventHandlerOpaque> WiFiEventHandler;
+
+/*
+  Station/AP fake. begin() "connects" on the next hal_tick() if
+  hal_wifi_set_available(1), and dropping availability while connected
+  fires the disconnect event.
+*/
+class ESP8266WiFiClass {
+  public:
+    WiFiMode_t wifi_mode = WIFI_OFF;
+    wl_status_t wifi_status = WL_DISCONNECTED;
+    String ssid;
+
+    bool mode(WiFiMode_t m) { wifi_mode = m; return true; }
+    WiFiMode_t getMode() { return wifi_mode; }
+    bool disconnect(bool wifioff = false);
+    bool hostname(const char* name) { (void)name; return true; }
+    wl_status_t begin(const char* ssid, const char* passphrase = 0);
+    wl_status_t status() { return wifi_status; }
+    String SSID() { return ssid; }
+    IPAddress localIP() { return wifi_status == WL_CONNECTED ? IPAddress(10, 0, 0, 42) : IPAddress(); }
+    int32_t RSSI() { return wifi_status == WL_CONNECTED ? -60 : 31; }
+    bool softAPConfig(IPAddress local_ip, IPAddress gateway, IPAddress subnet) { (void)local_ip; (void)gateway; (void)subnet; return true; }
+    bool softAP(const char* ssid, const char* passphrase = 0) { (void)ssid; (void)passphrase; return true; }
+    int hostByName(const char* host, IPAddress& result);
+
+    WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP&)> f);
+    WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected&)> f);
+
+    //Called by the hal
+    void gotIP();
+    void lost();
+};
+extern ESP8266WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef _POOL_NATIVE_ESP8266WIFIMULTI_H
+#define _POOL_NATIVE_ESP8266WIFIMULTI_H
+
+#include <ESP8266WiFi.h>
+
+#endif
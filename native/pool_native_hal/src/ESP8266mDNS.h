@@ -0,0 +1,14 @@
+#ifndef _POOL_NATIVE_ESP8266MDNS_H
+#define _POOL_NATIVE_ESP8266MDNS_H
+
+#include <Arduino.h>
+
+class MDNSResponder {
+  public:
+    bool begin(const char* hostname) { (void)hostname; return true; }
+    bool addService(const char* service, const char* proto, uint16_t port) { (void)service; (void)proto; (void)port; return true; }
+    bool update() { return true; }
+};
+extern MDNSResponder MDNS;
+
+#endif
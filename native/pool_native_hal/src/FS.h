@@ -0,0 +1,41 @@
+#ifndef _POOL_NATIVE_FS_H
+#define _POOL_NATIVE_FS_H
+
+#include <Arduino.h>
+#include <string>
+
+//SPIFFS over the hal's in-memory file map
+class File : public Stream {
+  public:
+    using Print::write;
+    std::string* data = 0;
+    size_t pos = 0;
+    bool writable = false;
+
+    File() {}
+    File(std::string* d, bool w) : data(d), writable(w) {}
+    operator bool() const { return data != 0; }
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override { return data ? (int)(data->size() - pos) : 0; }
+    int read() override { return (data && pos < data->size()) ? (uint8_t)(*data)[pos++] : -1; }
+    int peek() override { return (data && pos < data->size()) ? (uint8_t)(*data)[pos] : -1; }
+    size_t read(uint8_t* buf, size_t size) { return readBytes(buf, size); }
+    bool seek(uint32_t p) { if (!data || p > data->size()) return false; pos = p; return true; }
+    size_t size() const { return data ? data->size() : 0; }
+    void close() { data = 0; }
+};
+
+class FS {
+  public:
+    bool begin() { return true; }
+    void end() {}
+    bool exists(const char* path);
+    bool remove(const char* path);
+    File open(const char* path, const char* mode);
+    File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+};
+extern FS SPIFFS;
+
+#endif
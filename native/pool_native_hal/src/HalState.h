@@ -0,0 +1,76 @@
+#ifndef _POOL_NATIVE_HAL_STATE_H
+#define _POOL_NATIVE_HAL_STATE_H
+
+/*
+  Shared state behind the fakes. Everything lives in one function-local static
+  so it's constructed before any global (e.g. POOL_CONTROLLER) touches it.
+*/
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+#include <OneWire.h>
+
+struct HalOneWireDevice {
+  uint8_t addr[8];
+  float temp_f;
+  bool present;
+};
+
+struct HalState {
+  //Clock
+  unsigned long long skipped_us = 0;
+
+  //GPIO/ADC. Inputs idle high (the switches are wired to ground).
+  int digital[32];
+  int analog[32] = {0};
+
+  //74HC595: bits shift into shift_in (SPI or shiftOut()) and a rising
+  //edge on the latch pin (D6 on the bench) copies them to the outputs
+  uint8_t shift_in = 0;
+  uint8_t shift_register = 0xFF;
+  unsigned long shift_latches = 0;
+  uint8_t shift_latch_pin = 12;
+
+  //1-wire bus
+  std::vector<HalOneWireDevice> onewire;
+
+  //SPIFFS
+  std::map<std::string, std::string> files;
+  unsigned long fs_writes = 0;
+
+  //Raw flash, only the sectors that have been touched (4K each)
+  std::map<uint32_t, std::vector<uint8_t>> flash;
+  unsigned long flash_erases = 0;
+
+  //RTC user memory (garbage until written, like after a power cut)
+  uint8_t rtc_memory[512];
+
+  //Network
+  bool wifi_available = true;
+  unsigned long ntp_epoch = 1717236000UL; //2024-06-01 10:00:00 UTC
+  std::vector<std::function<void()>> pending_events;
+
+  //Default bench: water/roof/air probes and something sensible on the ADC.
+  //Set up here (not in main()) because the controller is a global and
+  //enumerates the 1-wire bus in its constructor.
+  HalState() {
+    for (int x=0;x<32;x++) digital[x] = 1;
+    for (size_t x=0;x<sizeof(rtc_memory);x++) rtc_memory[x] = 0xA5;
+    analog[17 % 32] = 512;
+    for (uint8_t x=1;x<=3;x++){
+      HalOneWireDevice d = {{0x28, x, 0, 0, 0, 0, 0, 0}, 0, true};
+      d.addr[7] = OneWire::crc8(d.addr, 7);
+      onewire.push_back(d);
+    }
+    onewire[0].temp_f = 78.5;
+    onewire[1].temp_f = 104.0;
+    onewire[2].temp_f = 85.25;
+  }
+};
+
+HalState& hal_state();
+
+#endif
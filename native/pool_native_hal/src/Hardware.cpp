@@ -0,0 +1,226 @@
+#include <Arduino.h>
+#include <OneWire.h>
+#include <DallasTemperature.h>
+#include <FS.h>
+#include <SPI.h>
+#include "HalState.h"
+
+FS SPIFFS;
+SPIClass SPI;
+
+uint8_t hal_shift_register(){
+  return hal_state().shift_register;
+}
+
+unsigned long hal_shift_latches(){
+  return hal_state().shift_latches;
+}
+
+int hal_onewire_add_device(const uint8_t addr[8], float temp_f){
+  HalOneWireDevice d;
+  memcpy(d.addr, addr, 8);
+  d.temp_f = temp_f;
+  d.present = true;
+  hal_state().onewire.push_back(d);
+  return hal_state().onewire.size() - 1;
+}
+
+void hal_onewire_set_temp(int index, float temp_f){
+  hal_state().onewire[index].temp_f = temp_f;
+}
+
+void hal_onewire_remove_device(int index){
+  hal_state().onewire[index].present = false;
+}
+
+static HalOneWireDevice* onewire_find(const uint8_t* addr){
+  for (auto& d : hal_state().onewire){
+    if (d.present && !memcmp(d.addr, addr, 8)) return &d;
+  }
+  return 0;
+}
+
+bool OneWire::search(uint8_t* newAddr, bool search_mode){
+  (void)search_mode;
+  auto& devices = hal_state().onewire;
+  while (search_index < (int)devices.size()){
+    HalOneWireDevice& d = devices[search_index++];
+    if (d.present){
+      memcpy(newAddr, d.addr, 8);
+      return true;
+    }
+  }
+  return false;
+}
+
+uint8_t OneWire::crc8(const uint8_t* addr, uint8_t len){
+  uint8_t crc = 0;
+  while (len--){
+    uint8_t inbyte = *addr++;
+    for (uint8_t i = 8; i; i--){
+      uint8_t mix = (crc ^ inbyte) & 0x01;
+      crc >>= 1;
+      if (mix) crc ^= 0x8C;
+      inbyte >>= 1;
+    }
+  }
+  return crc;
+}
+
+void DallasTemperature::begin(){
+  device_count = 0;
+  for (auto& d : hal_state().onewire){
+    if (d.present) device_count++;
+  }
+}
+
+bool DallasTemperature::getAddress(uint8_t* addr, uint8_t index){
+  uint8_t n = 0;
+  for (auto& d : hal_state().onewire){
+    if (!d.present) continue;
+    if (n++ == index){
+      memcpy(addr, d.addr, 8);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DallasTemperature::isConnected(const uint8_t* addr){
+  return onewire_find(addr) != 0;
+}
+
+int16_t DallasTemperature::millisToWaitForConversion(uint8_t bits){
+  switch (bits){
+    case 9: return 94;
+    case 10: return 188;
+    case 11: return 375;
+    default: return 750;
+  }
+}
+
+void DallasTemperature::requestTemperatures(){
+  conversion_started = millis();
+  if (wait_for_conversion){
+    delay(millisToWaitForConversion(resolution));
+  }
+}
+
+bool DallasTemperature::isConversionComplete(){
+  return millis() - conversion_started >= (unsigned long)millisToWaitForConversion(resolution);
+}
+
+float DallasTemperature::getTempF(const uint8_t* addr){
+  HalOneWireDevice* d = onewire_find(addr);
+  return d ? d->temp_f : DEVICE_DISCONNECTED_F;
+}
+
+float DallasTemperature::getTempFByIndex(uint8_t index){
+  DeviceAddress addr;
+  if (!getAddress(addr, index)) return DEVICE_DISCONNECTED_F;
+  return getTempF(addr);
+}
+
+size_t File::write(uint8_t c){
+  if (!data || !writable) return 0;
+  data->push_back((char)c);
+  return 1;
+}
+
+size_t File::write(const uint8_t* buffer, size_t size){
+  if (!data || !writable) return 0;
+  data->append((const char*)buffer, size);
+  return size;
+}
+
+bool FS::exists(const char* path){
+  return hal_state().files.count(path) > 0;
+}
+
+bool FS::remove(const char* path){
+  return hal_state().files.erase(path) > 0;
+}
+
+File FS::open(const char* path, const char* mode){
+  auto& files = hal_state().files;
+  if (mode[0] == 'r'){
+    auto f = files.find(path);
+    if (f == files.end()) return File();
+    return File(&f->second, false);
+  }
+
+  hal_state().fs_writes++;
+  std::string& data = files[path];
+  if (mode[0] == 'w') data.clear();
+  return File(&data, true);
+}
+
+String hal_fs_read(const char* path){
+  auto f = hal_state().files.find(path);
+  return (f == hal_state().files.end()) ? String() : String(f->second);
+}
+
+unsigned long hal_fs_writes(){
+  return hal_state().fs_writes;
+}
+
+//// Raw flash
+
+#define HAL_FLASH_SECTOR 4096
+
+static std::vector<uint8_t>& hal_flash_sector(uint32_t sector){
+  auto& s = hal_state().flash[sector];
+  if (s.empty()) s.assign(HAL_FLASH_SECTOR, 0xFF);
+  return s;
+}
+
+bool EspClass::flashEraseSector(uint32_t sector){
+  if (sector >= getFlashChipSize() / HAL_FLASH_SECTOR) return false;
+  hal_flash_sector(sector).assign(HAL_FLASH_SECTOR, 0xFF);
+  hal_state().flash_erases++;
+  return true;
+}
+
+bool EspClass::flashWrite(uint32_t address, const uint32_t* data, size_t size){
+  if ((address & 3) || (size & 3) || address + size > getFlashChipSize()) return false;
+  const uint8_t* p = (const uint8_t*)data;
+  for (size_t x = 0; x < size; x++){
+    hal_flash_sector((address + x) / HAL_FLASH_SECTOR)[(address + x) % HAL_FLASH_SECTOR] &= p[x];
+  }
+  return true;
+}
+
+bool EspClass::flashRead(uint32_t address, uint32_t* data, size_t size){
+  if ((address & 3) || address + size > getFlashChipSize()) return false;
+  uint8_t* p = (uint8_t*)data;
+  for (size_t x = 0; x < size; x++){
+    p[x] = hal_flash_sector((address + x) / HAL_FLASH_SECTOR)[(address + x) % HAL_FLASH_SECTOR];
+  }
+  return true;
+}
+
+//// RTC user memory
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t* data, size_t size){
+  if (offset * 4 + size > sizeof(hal_state().rtc_memory)) return false;
+  memcpy(data, hal_state().rtc_memory + offset * 4, size);
+  return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t* data, size_t size){
+  if (offset * 4 + size > sizeof(hal_state().rtc_memory)) return false;
+  memcpy(hal_state().rtc_memory + offset * 4, data, size);
+  return true;
+}
+
+void hal_rtc_memory_clear(){
+  memset(hal_state().rtc_memory, 0xA5, sizeof(hal_state().rtc_memory));
+}
+
+unsigned long hal_flash_erases(){
+  return hal_state().flash_erases;
+}
+
+void hal_flash_corrupt(uint32_t address){
+  hal_flash_sector(address / HAL_FLASH_SECTOR)[address % HAL_FLASH_SECTOR] ^= 0x01;
+}
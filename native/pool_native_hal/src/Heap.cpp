@@ -0,0 +1,22 @@
+#include <stdlib.h>
+#include <new>
+
+/*
+  Route new/delete through malloc/free so the controller's allocation counter
+  (lib/pool_control/AllocCounter.h, hooked in with --wrap=malloc) sees the
+  std::string behind our String too, like it sees String on the ESP8266.
+*/
+void* operator new(size_t size){
+  void* p = malloc(size ? size : 1);
+  if (p == 0) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size){
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
@@ -0,0 +1,29 @@
+#ifndef _POOL_NATIVE_IPADDRESS_H
+#define _POOL_NATIVE_IPADDRESS_H
+
+#include <Arduino.h>
+#include <lwip/dns.h>
+
+class IPAddress {
+  public:
+    uint8_t bytes[4] = {0, 0, 0, 0};
+
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { bytes[0] = a; bytes[1] = b; bytes[2] = c; bytes[3] = d; }
+    IPAddress(uint32_t addr) { memcpy(bytes, &addr, 4); }
+    IPAddress(const ip_addr_t* addr) { memcpy(bytes, &addr->addr, 4); }
+
+    operator uint32_t() const { uint32_t a; memcpy(&a, bytes, 4); return a; }
+    bool operator==(const IPAddress& o) const { return !memcmp(bytes, o.bytes, 4); }
+    bool operator!=(const IPAddress& o) const { return !(*this == o); }
+    uint8_t operator[](int i) const { return bytes[i]; }
+    bool isSet() const { return (uint32_t)*this != 0; }
+
+    String toString() const {
+      char buf[16];
+      snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+      return String(buf);
+    }
+};
+
+#endif
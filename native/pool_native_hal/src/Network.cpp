@@ -0,0 +1,253 @@
+#include <ESP8266WiFi.h>
+#include <WiFiClient.h>
+#include <WiFiUdp.h>
+#include <ESP8266mDNS.h>
+#include <lwip/dns.h>
+#include <RemoteDebug.h>
+#include <ArduinoOTA.h>
+#include "HalState.h"
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+ArduinoOTAClass ArduinoOTA;
+
+RemoteDebug::RemoteDebug(){
+  static const char* names[] = {"profiler", "verbose", "debug", "info", "warning", "error", "any"};
+  const char* env = getenv("POOL_NATIVE_DEBUG");
+  level = INFO;
+  if (env){
+    level = ANY + 1; //"none" (or anything we don't know)
+    for (uint8_t x=0;x<=ANY;x++){
+      if (!strcmp(env, names[x])) level = x;
+    }
+  }
+}
+
+//Registered event callbacks (the handler keeps its entry alive)
+template <typename E>
+struct WiFiEventCallback : public WiFiEventHandlerOpaque {
+  std::function<void(const E&)> f;
+  bool active = true;
+  ~WiFiEventCallback() { active = false; }
+};
+
+static std::vector<std::weak_ptr<WiFiEventCallback<WiFiEventStationModeGotIP>>> got_ip_callbacks;
+static std::vector<std::weak_ptr<WiFiEventCallback<WiFiEventStationModeDisconnected>>> disconnected_callbacks;
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP&)> f){
+  auto h = std::make_shared<WiFiEventCallback<WiFiEventStationModeGotIP>>();
+  h->f = f;
+  got_ip_callbacks.push_back(h);
+  return h;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected&)> f){
+  auto h = std::make_shared<WiFiEventCallback<WiFiEventStationModeDisconnected>>();
+  h->f = f;
+  disconnected_callbacks.push_back(h);
+  return h;
+}
+
+void ESP8266WiFiClass::gotIP(){
+  if (wifi_status == WL_CONNECTED) return;
+  wifi_status = WL_CONNECTED;
+  WiFiEventStationModeGotIP e;
+  e.ip = localIP();
+  e.mask = IPAddress(255, 255, 255, 0);
+  e.gw = IPAddress(10, 0, 0, 1);
+  for (auto& w : got_ip_callbacks){
+    if (auto h = w.lock()) h->f(e);
+  }
+}
+
+void ESP8266WiFiClass::lost(){
+  if (wifi_status != WL_CONNECTED) return;
+  wifi_status = WL_CONNECTION_LOST;
+  WiFiEventStationModeDisconnected e;
+  e.ssid = ssid;
+  e.reason = 8;
+  for (auto& w : disconnected_callbacks){
+    if (auto h = w.lock()) h->f(e);
+  }
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifioff){
+  (void)wifioff;
+  lost();
+  wifi_status = WL_DISCONNECTED;
+  return true;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char* s, const char* passphrase){
+  (void)passphrase;
+  ssid = s;
+  wifi_status = WL_DISCONNECTED;
+  if (hal_state().wifi_available){
+    hal_state().pending_events.push_back([this](){
+      if (hal_state().wifi_available && (wifi_mode & WIFI_STA)) gotIP();
+    });
+  }
+  return wifi_status;
+}
+
+int ESP8266WiFiClass::hostByName(const char* host, IPAddress& result){
+  (void)host;
+  if (wifi_status != WL_CONNECTED) return 0;
+  result = IPAddress(127, 0, 0, 1);
+  return 1;
+}
+
+void hal_wifi_set_available(int available){
+  hal_state().wifi_available = available;
+  if (!available) WiFi.lost();
+}
+
+void hal_ntp_set_epoch(unsigned long unix_secs){
+  hal_state().ntp_epoch = unix_secs;
+}
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg){
+  if (!hostname || !*hostname) return ERR_ARG;
+  if (WiFi.status() == WL_CONNECTED){
+    addr->addr = (uint32_t)IPAddress(127, 0, 0, 1);
+    return ERR_OK;
+  }
+
+  std::string name(hostname);
+  hal_state().pending_events.push_back([name, found, callback_arg](){
+    found(name.c_str(), 0, callback_arg);
+  });
+  return ERR_INPROGRESS;
+}
+
+static void ntp_write32(std::string& p, int offset, uint32_t v){
+  p[offset] = (char)(v >> 24);
+  p[offset + 1] = (char)(v >> 16);
+  p[offset + 2] = (char)(v >> 8);
+  p[offset + 3] = (char)v;
+}
+
+int WiFiUDP::endPacket(){
+  if (tx_port != 123 || tx.size() < 48 || WiFi.status() != WL_CONNECTED){
+    return 1;
+  }
+
+  //NTP time is seconds since 1900, the fraction is in 1/2^32 secs
+  unsigned long ms = millis();
+  uint32_t secs = hal_state().ntp_epoch + 2208988800UL + ms / 1000;
+  uint32_t frac = (uint32_t)(((unsigned long long)(ms % 1000) << 32) / 1000);
+
+  rx.assign(48, '\0');
+  rx[0] = 0x24; //no leap, v4, server
+  rx[1] = 1;    //stratum 1
+  ntp_write32(rx, 32, secs);
+  ntp_write32(rx, 36, frac);
+  ntp_write32(rx, 40, secs);
+  ntp_write32(rx, 44, frac);
+  rx_ip = tx_ip;
+  rx_pending = true;
+  return 1;
+}
+
+int WiFiUDP::parsePacket(){
+  if (!rx_pending){
+    rx.clear();
+    rx_pos = 0;
+    return 0;
+  }
+  rx_pending = false;
+  rx_pos = 0;
+  return (int)rx.size();
+}
+
+//Real sockets for connect()ed WiFiClients (the MQTT client against a
+//local broker). Nothing gets through while the fake wifi is down.
+HalClientState::~HalClientState(){
+  if (fd >= 0) close(fd);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port){
+  stop();
+  state = std::make_shared<HalClientState>();
+  state->open = false;
+  if (WiFi.status() != WL_CONNECTED) return 0;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return 0;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = (uint32_t)ip;
+  if (::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+    close(fd);
+    return 0;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  state->fd = fd;
+  state->open = true;
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size){
+  if (!connected()) return 0;
+  if (state->fd < 0){
+    state->sent.append((const char*)buffer, size);
+    return size;
+  }
+  ssize_t n = send(state->fd, buffer, size, MSG_NOSIGNAL);
+  if (n < 0){
+    if (errno != EAGAIN && errno != EWOULDBLOCK) state->open = false;
+    return 0;
+  }
+  return (size_t)n;
+}
+
+int WiFiClient::available(){
+  if (!connected() || state->fd < 0) return 0;
+  int n = 0;
+  if (ioctl(state->fd, FIONREAD, &n) != 0) return 0;
+  return n;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size){
+  if (!connected() || state->fd < 0) return -1;
+  ssize_t n = recv(state->fd, buffer, size, 0);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)){
+    state->open = false;
+    return -1;
+  }
+  return (n < 0) ? -1 : (int)n;
+}
+
+uint8_t WiFiClient::connected(){
+  if (!state || !state->open) return 0;
+  if (state->fd >= 0){
+    //The peer closing shows up as a 0 byte read
+    uint8_t c;
+    ssize_t n = recv(state->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)){
+      state->open = false;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void WiFiClient::stop(){
+  if (!state) return;
+  state->open = false;
+  if (state->fd >= 0){
+    close(state->fd);
+    state->fd = -1;
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef _POOL_NATIVE_ONEWIRE_H
+#define _POOL_NATIVE_ONEWIRE_H
+
+#include <Arduino.h>
+
+//1-wire bus over the hal's device list (hal_onewire_add_device())
+class OneWire {
+  public:
+    uint8_t pin = 0;
+    int search_index = 0;
+
+    OneWire() {}
+    OneWire(uint8_t p) : pin(p) {}
+    void begin(uint8_t p) { pin = p; }
+    uint8_t reset() { return 1; }
+    void reset_search() { search_index = 0; }
+
+    //Copies the next present device's ROM into newAddr, returns 0 when we run out
+    bool search(uint8_t* newAddr, bool search_mode = true);
+
+    static uint8_t crc8(const uint8_t* addr, uint8_t len);
+};
+
+#endif
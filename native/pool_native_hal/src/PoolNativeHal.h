@@ -0,0 +1,71 @@
+#ifndef _POOL_NATIVE_HAL_H
+#define _POOL_NATIVE_HAL_H
+
+/*
+  Native (Linux) hardware abstraction layer for the pool controller.
+
+  The headers next to this one (Arduino.h, WiFiUdp.h, OneWire.h, FS.h, ...)
+  stand in for the Arduino/ESP8266 ones so lib/pool_control and src/main.cpp
+  build unchanged with "pio run -e native". Everything is in-memory: the
+  hal_* calls below are how a benchmark or regression run drives the fake
+  hardware and looks at what the controller did with it.
+*/
+
+#include <stdint.h>
+#include "WString.h"
+#include "WiFiClient.h"
+
+//Clock (millis()/micros() and TimeLib). Real elapsed time plus whatever
+//we've skipped ahead.
+void hal_clock_advance_ms(unsigned long ms);
+
+//GPIO / ADC
+void hal_set_digital(uint8_t pin, int value);
+int hal_get_digital(uint8_t pin);
+void hal_set_analog(uint8_t pin, int value);
+
+//74HC595 relay shift register: last latched byte and number of latches
+//(active-low, 0xFF is everything off)
+uint8_t hal_shift_register();
+unsigned long hal_shift_latches();
+
+//1-wire bus (DS18B20s). Returns the device index.
+//NOTE: addr[7] has to be the ROM's CRC (OneWire::crc8() of the first 7
+//      bytes), the controller ignores devices where it doesn't check out
+int hal_onewire_add_device(const uint8_t addr[8], float temp_f);
+void hal_onewire_set_temp(int index, float temp_f);
+void hal_onewire_remove_device(int index);
+
+//SPIFFS. Returns "" if the file doesn't exist
+String hal_fs_read(const char* path);
+unsigned long hal_fs_writes();
+
+//Raw flash: sector erases so far, and a way to flip bits (to test CRCs)
+unsigned long hal_flash_erases();
+void hal_flash_corrupt(uint32_t address);
+
+//Scribble over RTC user memory (what a power cut leaves behind)
+void hal_rtc_memory_clear();
+
+//Network: whether the access point/internet are reachable, and the unix
+//time the fake NTP server hands out at hal clock 0
+void hal_wifi_set_available(int available);
+void hal_ntp_set_epoch(unsigned long unix_secs);
+
+//HTTP: run a request through the registered ESP8266WebServer handlers.
+//Returns the status code and fills in the response body.
+int hal_http_request(int method, const char* uri, const char* body, String& response);
+
+//Add a header to the next hal_http_request() (cleared after it runs), and
+//look up a header from the last response ("" if it wasn't sent)
+void hal_http_header(const char* name, const char* value);
+String hal_http_response_header(const char* name);
+
+//The last request's connection (anything a handler wrote to it straight,
+//e.g. an event stream, is in state->sent; stop() it to hang up)
+WiFiClient hal_http_client();
+
+//Deliver anything async (wifi/DNS events). Called after every loop().
+void hal_tick();
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef _POOL_NATIVE_PRINT_H
+#define _POOL_NATIVE_PRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include "WString.h"
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+      size_t n = 0;
+      while (size--) n += write(*buffer++);
+      return n;
+    }
+    size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+    virtual void flush() {}
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(const String& str) { return write((const uint8_t*)str.c_str(), str.length()); }
+    size_t print(const __FlashStringHelper* f) { return write(reinterpret_cast<const char*>(f)); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int v) { return printf("%d", v); }
+    size_t print(unsigned int v) { return printf("%u", v); }
+    size_t print(long v) { return printf("%ld", v); }
+    size_t print(unsigned long v) { return printf("%lu", v); }
+    size_t print(double v, int digits = 2) { return printf("%.*f", digits, v); }
+    template <typename T> size_t println(const T& v) { return print(v) + println(); }
+    size_t println() { return write("\r\n"); }
+
+    size_t printf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+      char buf[512];
+      va_list args;
+      va_start(args, fmt);
+      int len = vsnprintf(buf, sizeof(buf), fmt, args);
+      va_end(args);
+      if (len < 0) return 0;
+      if (len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+      return write((const uint8_t*)buf, len);
+    }
+
+    //No separate flash on native, the format is already in memory
+    size_t printf_P(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+      char buf[512];
+      va_list args;
+      va_start(args, fmt);
+      int len = vsnprintf(buf, sizeof(buf), fmt, args);
+      va_end(args);
+      if (len < 0) return 0;
+      if (len >= (int)sizeof(buf)) len = sizeof(buf) - 1;
+      return write((const uint8_t*)buf, len);
+    }
+};
+
+#endif
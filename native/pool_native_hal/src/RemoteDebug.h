@@ -0,0 +1,39 @@
+#ifndef _POOL_NATIVE_REMOTEDEBUG_H
+#define _POOL_NATIVE_REMOTEDEBUG_H
+
+#include <Arduino.h>
+
+/*
+  RemoteDebug fake: everything at or above POOL_NATIVE_DEBUG (a level name,
+  default "info", "none" for silence) goes to stdout.
+*/
+class RemoteDebug : public Print {
+  public:
+    using Print::write;
+    static const uint8_t PROFILER = 0;
+    static const uint8_t VERBOSE = 1;
+    static const uint8_t DEBUG = 2;
+    static const uint8_t INFO = 3;
+    static const uint8_t WARNING = 4;
+    static const uint8_t ERROR = 5;
+    static const uint8_t ANY = 6;
+
+    uint8_t level;
+    String last_command;
+    void (*project_cmds)() = 0;
+
+    RemoteDebug();
+    bool begin(const String& hostname, uint16_t port = 23, uint8_t startingDebugLevel = DEBUG) { (void)hostname; (void)port; (void)startingDebugLevel; return true; }
+    void setSerialEnabled(bool enable) { (void)enable; }
+    void setResetCmdEnabled(bool enable) { (void)enable; }
+    void setHelpProjectsCmds(String help) { (void)help; }
+    void setCallBackProjectCmds(void (*callback)()) { project_cmds = callback; }
+    String getLastCommand() { return last_command; }
+    void handle() {}
+    bool isActive(uint8_t debugLevel = DEBUG) { return debugLevel >= level; }
+
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t* buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _POOL_NATIVE_SPI_H
+#define _POOL_NATIVE_SPI_H
+
+#include <Arduino.h>
+#include "HalState.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+class SPISettings {
+  public:
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+    SPISettings(uint32_t c = 1000000, uint8_t o = MSBFIRST, uint8_t m = SPI_MODE0) : clock(c), bitOrder(o), dataMode(m) {}
+};
+
+//HSPI with the 74HC595 on the other end (see HalState::shift_in)
+class SPIClass {
+  public:
+    uint8_t bit_order = MSBFIRST;
+
+    void begin() {}
+    void end() {}
+    void beginTransaction(SPISettings settings) { bit_order = settings.bitOrder; }
+    void endTransaction() {}
+    void setFrequency(uint32_t freq) { (void)freq; }
+    void setDataMode(uint8_t mode) { (void)mode; }
+    void setBitOrder(uint8_t order) { bit_order = order; }
+    uint8_t transfer(uint8_t data) {
+      uint8_t out = hal_state().shift_in;
+      shiftOut(0, 0, bit_order, data);
+      return out;
+    }
+    void write(uint8_t data) { transfer(data); }
+};
+extern SPIClass SPI;
+
+#endif
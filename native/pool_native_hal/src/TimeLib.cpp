@@ -0,0 +1,59 @@
+#include <Arduino.h>
+#include <TimeLib.h>
+
+static time_t sys_time = 0;
+static unsigned long sys_time_set_at = 0;
+
+time_t now(){
+  return sys_time + (millis() - sys_time_set_at) / 1000UL;
+}
+
+void setTime(time_t t){
+  sys_time = t;
+  sys_time_set_at = millis();
+}
+
+void setTime(int hr, int min, int sec, int dy, int mnth, int yr){
+  tmElements_t tm;
+  tm.Year = (yr > 99) ? yr - 1970 : yr + 30;
+  tm.Month = mnth;
+  tm.Day = dy;
+  tm.Hour = hr;
+  tm.Minute = min;
+  tm.Second = sec;
+  setTime(makeTime(tm));
+}
+
+int hour(time_t t){ return (t % SECS_PER_DAY) / SECS_PER_HOUR; }
+int minute(time_t t){ return (t % SECS_PER_HOUR) / SECS_PER_MIN; }
+int second(time_t t){ return t % SECS_PER_MIN; }
+int hour(){ return hour(now()); }
+int minute(){ return minute(now()); }
+int second(){ return second(now()); }
+
+int day(){ tmElements_t tm; breakTime(now(), tm); return tm.Day; }
+int month(){ tmElements_t tm; breakTime(now(), tm); return tm.Month; }
+int year(){ tmElements_t tm; breakTime(now(), tm); return tm.Year + 1970; }
+
+void breakTime(time_t t, tmElements_t& tm){
+  struct tm parts;
+  gmtime_r(&t, &parts);
+  tm.Second = parts.tm_sec;
+  tm.Minute = parts.tm_min;
+  tm.Hour = parts.tm_hour;
+  tm.Wday = parts.tm_wday + 1;
+  tm.Day = parts.tm_mday;
+  tm.Month = parts.tm_mon + 1;
+  tm.Year = parts.tm_year - 70;
+}
+
+time_t makeTime(const tmElements_t& tm){
+  struct tm parts = {};
+  parts.tm_sec = tm.Second;
+  parts.tm_min = tm.Minute;
+  parts.tm_hour = tm.Hour;
+  parts.tm_mday = tm.Day;
+  parts.tm_mon = tm.Month - 1;
+  parts.tm_year = tm.Year + 70;
+  return timegm(&parts);
+}
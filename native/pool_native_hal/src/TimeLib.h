@@ -0,0 +1,41 @@
+#ifndef _POOL_NATIVE_TIMELIB_H
+#define _POOL_NATIVE_TIMELIB_H
+
+#include <time.h>
+#include <stdint.h>
+
+//Same shape as the TimeLib (Time) library, backed by millis()
+#define SECS_PER_MIN  (60UL)
+#define SECS_PER_HOUR (3600UL)
+#define SECS_PER_DAY  (SECS_PER_HOUR * 24UL)
+
+#define elapsedSecsToday(_time_) ((_time_) % SECS_PER_DAY)
+#define previousMidnight(_time_) (((_time_) / SECS_PER_DAY) * SECS_PER_DAY)
+#define nextMidnight(_time_) (previousMidnight(_time_) + SECS_PER_DAY)
+
+typedef struct {
+  uint8_t Second;
+  uint8_t Minute;
+  uint8_t Hour;
+  uint8_t Wday; //day of week, sunday is day 1
+  uint8_t Day;
+  uint8_t Month;
+  uint8_t Year; //offset from 1970
+} tmElements_t, TimeElements, *tmElementsPtr_t;
+
+time_t now();
+void setTime(time_t t);
+void setTime(int hr, int min, int sec, int day, int month, int yr);
+int hour();
+int hour(time_t t);
+int minute();
+int minute(time_t t);
+int second();
+int second(time_t t);
+int day();
+int month();
+int year();
+void breakTime(time_t time, tmElements_t& tm);
+time_t makeTime(const tmElements_t& tm);
+
+#endif
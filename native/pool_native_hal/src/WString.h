@@ -0,0 +1,109 @@
+#ifndef _POOL_NATIVE_WSTRING_H
+#define _POOL_NATIVE_WSTRING_H
+
+#include <string>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+//PROGMEM strings are just regular strings on native
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+/*
+  Arduino String on top of std::string (just the parts we and ArduinoJson use)
+*/
+class String {
+  public:
+    std::string s;
+
+    String() {}
+    String(const char* c) : s(c ? c : "") {}
+    String(const __FlashStringHelper* f) : s(f ? reinterpret_cast<const char*>(f) : "") {}
+    String(const std::string& str) : s(str) {}
+    explicit String(char c) : s(1, c) {}
+    explicit String(int v) : s(std::to_string(v)) {}
+    explicit String(unsigned int v) : s(std::to_string(v)) {}
+    explicit String(long v) : s(std::to_string(v)) {}
+    explicit String(unsigned long v) : s(std::to_string(v)) {}
+    explicit String(float v, unsigned int decimals = 2) { fromFloat(v, decimals); }
+    explicit String(double v, unsigned int decimals = 2) { fromFloat(v, decimals); }
+
+    const char* c_str() const { return s.c_str(); }
+    unsigned int length() const { return s.length(); }
+    bool isEmpty() const { return s.empty(); }
+    bool reserve(unsigned int size) { s.reserve(size); return true; }
+    char operator[](unsigned int i) const { return i < s.length() ? s[i] : 0; }
+    char& operator[](unsigned int i) { return s[i]; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    bool concat(const String& o) { s += o.s; return true; }
+    bool concat(const char* c) { if (c) s += c; return c != 0; }
+    bool concat(const char* c, unsigned int len) { if (c) s.append(c, len); return c != 0; }
+    bool concat(char c) { s += c; return true; }
+    bool concat(int v) { s += std::to_string(v); return true; }
+    bool concat(unsigned int v) { s += std::to_string(v); return true; }
+    bool concat(long v) { s += std::to_string(v); return true; }
+    bool concat(unsigned long v) { s += std::to_string(v); return true; }
+    bool concat(const __FlashStringHelper* f) { return concat(reinterpret_cast<const char*>(f)); }
+
+    template <typename T> String& operator+=(const T& v) { concat(v); return *this; }
+    String& operator=(const char* c) { s = c ? c : ""; return *this; }
+    String& operator=(const __FlashStringHelper* f) { return (*this = reinterpret_cast<const char*>(f)); }
+
+    bool equals(const String& o) const { return s == o.s; }
+    bool equals(const char* c) const { return c ? s == c : s.empty(); }
+    bool equalsIgnoreCase(const String& o) const { return s.length() == o.s.length() && strncasecmp(s.c_str(), o.s.c_str(), s.length()) == 0; }
+    bool operator==(const String& o) const { return equals(o); }
+    bool operator==(const char* c) const { return equals(c); }
+    bool operator!=(const String& o) const { return !equals(o); }
+    bool operator!=(const char* c) const { return !equals(c); }
+    bool operator<(const String& o) const { return s < o.s; }
+
+    bool startsWith(const String& p) const { return s.compare(0, p.s.length(), p.s) == 0; }
+    bool endsWith(const String& p) const {
+      return s.length() >= p.s.length() && s.compare(s.length() - p.s.length(), p.s.length(), p.s) == 0;
+    }
+    int indexOf(char c, unsigned int from = 0) const {
+      size_t i = s.find(c, from);
+      return i == std::string::npos ? -1 : (int)i;
+    }
+    int indexOf(const String& str, unsigned int from = 0) const {
+      size_t i = s.find(str.s, from);
+      return i == std::string::npos ? -1 : (int)i;
+    }
+    String substring(unsigned int from) const { return from < s.length() ? String(s.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+      if (from >= s.length() || to <= from) return String();
+      return String(s.substr(from, to - from));
+    }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    void toUpperCase() { for (auto& c : s) c = toupper(c); }
+    void toLowerCase() { for (auto& c : s) c = tolower(c); }
+    void trim() {
+      size_t b = s.find_first_not_of(" \t\r\n");
+      size_t e = s.find_last_not_of(" \t\r\n");
+      s = (b == std::string::npos) ? "" : s.substr(b, e - b + 1);
+    }
+
+  private:
+    void fromFloat(double v, unsigned int decimals) {
+      char buf[64];
+      snprintf(buf, sizeof(buf), "%.*f", decimals, v);
+      s = buf;
+    }
+};
+
+inline String operator+(const String& a, const String& b) { String r(a); r.concat(b); return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r.concat(b); return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r.concat(b); return r; }
+inline String operator+(const String& a, char b) { String r(a); r.concat(b); return r; }
+inline String operator+(const String& a, int b) { String r(a); r.concat(b); return r; }
+inline String operator+(const String& a, unsigned long b) { String r(a); r.concat(b); return r; }
+inline bool operator==(const char* a, const String& b) { return b.equals(a); }
+inline bool operator!=(const char* a, const String& b) { return !b.equals(a); }
+
+#endif
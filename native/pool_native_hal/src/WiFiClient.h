@@ -0,0 +1,45 @@
+#ifndef _POOL_NATIVE_WIFICLIENT_H
+#define _POOL_NATIVE_WIFICLIENT_H
+
+#include <ESP8266WiFi.h>
+#include <IPAddress.h>
+#include <memory>
+#include <string>
+
+//One TCP connection. Copies share it (like the real WiFiClient's
+//refcounted context), so a handler can hang on to the request's client.
+//The HTTP server's are fake (writes are kept in sent), ones made with
+//connect() are real sockets so the MQTT client can talk to a local broker.
+struct HalClientState {
+  std::string sent;       //everything written to it (fake connections)
+  bool open = true;
+  size_t window = 1460;   //what availableForWrite() reports
+  int fd = -1;            //socket for connect()ed clients
+  ~HalClientState();
+};
+
+class WiFiClient : public Stream {
+  public:
+    using Print::write;
+    std::shared_ptr<HalClientState> state;
+
+    WiFiClient() {}
+    WiFiClient(std::shared_ptr<HalClientState> s) : state(s) {}
+
+    //Real TCP connection (blocking connect, non-blocking after that)
+    int connect(IPAddress ip, uint16_t port);
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override;
+    int available() override;
+    int read() override { uint8_t c; return (read(&c, 1) == 1) ? c : -1; }
+    int read(uint8_t* buffer, size_t size);
+    int peek() override { return -1; }
+    int availableForWrite() { return connected() ? (int)state->window : 0; }
+    uint8_t connected();
+    void setNoDelay(bool nodelay) { (void)nodelay; }
+    void stop();
+    operator bool() { return connected(); }
+};
+
+#endif
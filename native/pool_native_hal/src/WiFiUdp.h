@@ -0,0 +1,40 @@
+#ifndef _POOL_NATIVE_WIFIUDP_H
+#define _POOL_NATIVE_WIFIUDP_H
+
+#include <ESP8266WiFi.h>
+#include <string>
+
+/*
+  UDP fake. The only thing on the other end is an NTP server on port 123:
+  a request sent there gets a reply (with the hal's epoch + clock in the
+  receive/transmit timestamps) on the next parsePacket().
+*/
+class WiFiUDP : public Stream {
+  public:
+    using Print::write;
+    std::string tx;
+    uint16_t tx_port = 0;
+    IPAddress tx_ip;
+
+    std::string rx;
+    size_t rx_pos = 0;
+    bool rx_pending = false;
+    IPAddress rx_ip;
+
+    uint8_t begin(uint16_t port) { (void)port; return 1; }
+    void stop() {}
+    int beginPacket(IPAddress ip, uint16_t port) { tx.clear(); tx_ip = ip; tx_port = port; return 1; }
+    int endPacket();
+    size_t write(uint8_t c) override { tx.push_back((char)c); return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { tx.append((const char*)buffer, size); return size; }
+
+    int parsePacket();
+    int available() override { return (int)(rx.size() - rx_pos); }
+    int read() override { return rx_pos < rx.size() ? (uint8_t)rx[rx_pos++] : -1; }
+    int read(uint8_t* buffer, size_t len) { return (int)readBytes(buffer, len); }
+    int peek() override { return rx_pos < rx.size() ? (uint8_t)rx[rx_pos] : -1; }
+    void flush() override { rx_pos = rx.size(); }
+    IPAddress remoteIP() { return rx_ip; }
+};
+
+#endif
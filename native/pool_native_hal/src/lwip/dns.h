@@ -0,0 +1,21 @@
+#ifndef _POOL_NATIVE_LWIP_DNS_H
+#define _POOL_NATIVE_LWIP_DNS_H
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_INPROGRESS -5
+#define ERR_ARG -16
+
+typedef struct ip_addr {
+  uint32_t addr;
+} ip_addr_t;
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callback_arg);
+
+//Every name resolves to 127.0.0.1 while the network is up (answered from
+//"cache"). Otherwise the lookup fails on the next hal_tick().
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _POOL_NATIVE_PGMSPACE_H
+#define _POOL_NATIVE_PGMSPACE_H
+
+#include <string.h>
+#include <stdint.h>
+
+//No separate flash address space on native, PROGMEM is plain memory
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_float(addr) (*(const float*)(addr))
+#define pgm_read_double(addr) (*(const double*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+
+#endif
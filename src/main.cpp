@@ -12,7 +12,7 @@
 #include <DallasTemperature.h>
 #include <FS.h>
 
-#include <ShiftRegister74HC595.h>
+#include <SPI.h>
 #include <Bounce2.h>
 #include <TimeLib.h>
 #include <DNSServer.h>
@@ -29,6 +29,7 @@
 #include "Constants.h"
 #include "Relay.h"
 #include "PoolController.h"
+#include "JsonStream.h"
 
 
 //const byte        DNS_PORT = 53;          // Capture DNS requests on port 53
@@ -45,6 +46,16 @@ PoolController POOL_CONTROLLER(&POOL_DEBUG);
 //Our web server
 ESP8266WebServer SERVER(80);
 
+//Streams a JSON response out in chunks instead of building it in a String first
+void sendJSON(JsonDocument& doc){
+  SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+  SERVER.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  SERVER.send(200,"application/json","");
+  PoolJsonChunkWriter out(SERVER);
+  serializeJson(doc,out);
+  out.finish();
+}
+
 void handleNotFound(){
   digitalWrite(LED_BUILTIN, 0);
   String message = "File Not Found\n\n";
@@ -77,7 +88,7 @@ void handleNotFound(){
 }
 
 void setSensors(){
-  DynamicJsonDocument sched(2048);
+  PoolJsonDocument sched(POOL_JSON_REQUEST_SIZE);
   //pdebugI("MM: \"%s\"\n",SERVER.arg("plain").c_str());
   DeserializationError error = deserializeJson(sched,SERVER.arg("plain"));
 
@@ -103,7 +114,7 @@ void setSensors(){
 }
 
 void setRelays(){
-  DynamicJsonDocument sched(2048);
+  PoolJsonDocument sched(POOL_JSON_REQUEST_SIZE);
   //pdebugI("MM: \"%s\"\n",SERVER.arg("plain").c_str());
   DeserializationError error = deserializeJson(sched,SERVER.arg("plain"));
 
@@ -132,12 +143,9 @@ void getSchedule(){
     digitalWrite(LED_BUILTIN, 0);
     pdebugD("Getting relay schedule from pool controller\n");
     //DynamicJsonDocument jsonBuffer=POOL_CONTROLLER.dumpJSONRelaySchedule(); 
-    DynamicJsonDocument jsonBuffer(100); 
+    PoolJsonDocument jsonBuffer(POOL_JSON_SMALL_SIZE); 
     jsonBuffer["now"] = millis();
-    String status;
-    serializeJson(jsonBuffer, status);
-    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
-    SERVER.send(200,"application/json",status);
+    sendJSON(jsonBuffer);
     digitalWrite(LED_BUILTIN, 1);
 }
 
@@ -145,13 +153,10 @@ void resetController(){
     digitalWrite(LED_BUILTIN, 0);
     pdebugD("Resetting pool controller config to defaults\n");
     POOL_CONTROLLER.reset_config();
-    DynamicJsonDocument jsonBuffer(100); 
+    PoolJsonDocument jsonBuffer(POOL_JSON_SMALL_SIZE); 
     jsonBuffer["now"] = millis();
     //jsonBuffer["success"] = (POOL_CONTROLLER.initialized == 1);
-    String status;
-    serializeJson(jsonBuffer, status);
-    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
-    SERVER.send(200,"application/json",status);
+    sendJSON(jsonBuffer);
     digitalWrite(LED_BUILTIN, 1);
 }
 
@@ -162,57 +167,120 @@ void tempRequest(){
 
     pdebugD("Getting temp sensors from pool controller\n");
 
-    DynamicJsonDocument jsonBuffer(512);
+    PoolJsonDocument jsonBuffer(POOL_JSON_SENSORS_SIZE);
     POOL_CONTROLLER.getJSONSensorsDetails(jsonBuffer); 
     jsonBuffer["now"] = millis();
-    String status;
-    serializeJson(jsonBuffer, status);
+    sendJSON(jsonBuffer);
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void scanSensors(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Requesting a 1-wire sensor search\n");
+    POOL_CONTROLLER.request_sensor_scan();
     SERVER.sendHeader("Access-Control-Allow-Origin", "*");
-    SERVER.send(200,"application/json",status);
+    SERVER.send(200,"text/plain","");
     digitalWrite(LED_BUILTIN, 1);
 }
 
+void subscribeEvents(){
+    pdebugD("New /events subscriber\n");
+
+    //The connection's ours from here on (headers included), the server just
+    //lets go of it when we return
+    if (!POOL_CONTROLLER.events.subscribe(SERVER.client(), millis())){
+      SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+      SERVER.send(503,"text/plain","Too many event subscribers");
+    }
+}
+
 void getRelays(){
     digitalWrite(LED_BUILTIN, 0);
     pdebugD("Getting relay states from pool controller\n");
-    DynamicJsonDocument jsonBuffer(2048);
+    PoolJsonDocument jsonBuffer(POOL_JSON_RELAYS_RUNTIME_SIZE);
     POOL_CONTROLLER.getJSONRelayDetails(jsonBuffer); 
+    POOL_CONTROLLER.getJSONRelayRuntime(jsonBuffer);
+    jsonBuffer["now"] = millis();
+    sendJSON(jsonBuffer);
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void getRelayStats(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Getting relay stats from pool controller\n");
+    PoolJsonDocument jsonBuffer(POOL_JSON_RELAY_STATS_SIZE);
+    POOL_CONTROLLER.getJSONRelayStats(jsonBuffer);
     jsonBuffer["now"] = millis();
-    String status;
-    serializeJson(jsonBuffer, status);
+    sendJSON(jsonBuffer);
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void resetRelayStats(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Resetting relay stats\n");
+    POOL_CONTROLLER.reset_relay_stats();
     SERVER.sendHeader("Access-Control-Allow-Origin", "*");
-    SERVER.send(200,"application/json",status);
+    SERVER.send(200,"text/plain","");
     digitalWrite(LED_BUILTIN, 1);
 }
 
 void getWifi(){
     digitalWrite(LED_BUILTIN, 0);
     pdebugD("Getting wifi info from pool controller\n");
-    DynamicJsonDocument jsonBuffer(512);
+    PoolJsonDocument jsonBuffer(POOL_JSON_WIFI_SIZE);
     POOL_CONTROLLER.getJSONWifiDetails(jsonBuffer);
     jsonBuffer["now"] = millis();
-    String status;
-    serializeJson(jsonBuffer, status);
-    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
-    SERVER.send(200,"application/json",status);
+    sendJSON(jsonBuffer);
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void getMqtt(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Getting MQTT info from pool controller\n");
+    PoolJsonDocument jsonBuffer(POOL_JSON_MQTT_SIZE);
+    POOL_CONTROLLER.getJSONMqttDetails(jsonBuffer);
+    //Don't hand out the broker password (same as /config)
+    jsonBuffer["mqtt"].remove("pw");
+    jsonBuffer["now"] = millis();
+    sendJSON(jsonBuffer);
     digitalWrite(LED_BUILTIN, 1);
 }
 
+void setMqtt(){
+  PoolJsonDocument doc(POOL_JSON_REQUEST_SIZE);
+  DeserializationError error = deserializeJson(doc,SERVER.arg("plain"));
+
+  if (error == DeserializationError::Ok){
+    pdebugD("Successfully parsed MQTT update request, submitting to controller\n");
+    String err="";
+    JsonObject mqtt = doc.as<JsonObject>();
+    byte success = POOL_CONTROLLER.setJSONMqttDetails(mqtt,err);
+
+    if (success == 0){
+      pdebugW("Failed to update JSON MQTT details:\n%s\n",err.c_str());
+      SERVER.send(400, "text/plain", err);
+      return;
+    }
+
+    SERVER.send(200,"text/plain","");
+    return;
+  }
+
+  SERVER.send(400, "text/plain", "Invalid JSON");
+}
+
 void getSolar(){
     digitalWrite(LED_BUILTIN, 0);
     pdebugD("Getting solar info from pool controller\n");
-    DynamicJsonDocument jsonBuffer(256);
+    PoolJsonDocument jsonBuffer(POOL_JSON_SOLAR_SIZE);
     POOL_CONTROLLER.getJSONSolarDetails(jsonBuffer);
     jsonBuffer["now"] = millis();
-    String status;
-    serializeJson(jsonBuffer, status);
-    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
-    SERVER.send(200,"application/json",status);
+    sendJSON(jsonBuffer);
     digitalWrite(LED_BUILTIN, 1);
 }
 
 void setSolar(){
-  DynamicJsonDocument sched(256);
+  PoolJsonDocument sched(POOL_JSON_REQUEST_SIZE);
   DeserializationError error = deserializeJson(sched,SERVER.arg("plain"));
 
   if (error == DeserializationError::Ok){
@@ -240,18 +308,15 @@ void setSolar(){
 void getGeneral(){
     digitalWrite(LED_BUILTIN, 0);
     pdebugD("Getting general info from pool controller\n");
-    DynamicJsonDocument jsonBuffer(512);
+    PoolJsonDocument jsonBuffer(POOL_JSON_GENERAL_SIZE);
     POOL_CONTROLLER.getJSONGeneralDetails(jsonBuffer); 
     jsonBuffer["now"] = millis();
-    String status;
-    serializeJson(jsonBuffer, status);
-    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
-    SERVER.send(200,"application/json",status);
+    sendJSON(jsonBuffer);
     digitalWrite(LED_BUILTIN, 1);
 }
 
 void setWifi(){
-  DynamicJsonDocument sched(256);
+  PoolJsonDocument sched(POOL_JSON_REQUEST_SIZE);
   DeserializationError error = deserializeJson(sched,SERVER.arg("plain"));
 
   if (error == DeserializationError::Ok){
@@ -278,7 +343,7 @@ void setWifi(){
 
 
 void setGeneral(){
-  DynamicJsonDocument sched(256);
+  PoolJsonDocument sched(POOL_JSON_REQUEST_SIZE);
   DeserializationError error = deserializeJson(sched,SERVER.arg("plain"));
 
   if (error == DeserializationError::Ok){
@@ -306,25 +371,246 @@ void setGeneral(){
 void getEverything(){
     digitalWrite(LED_BUILTIN, 0);
     pdebugD("Getting everything from pool controller\n");
-    DynamicJsonDocument config(4096);
-    POOL_CONTROLLER.getJSONWifiDetails(config);
-    //NOTE Don't return our wifi password (if somebody puts the controller in manual
-    // it could result in a real-world security issue)
-    config["wifi"].remove("pw");
-
-    POOL_CONTROLLER.getJSONRelayDetails(config);
-    POOL_CONTROLLER.getJSONSensorsDetails(config);
-    POOL_CONTROLLER.getJSONSolarDetails(config);
-    POOL_CONTROLLER.getJSONGeneralDetails(config);
-   
-    config["now"] = millis();
-    String status;
-    serializeJson(config, status);
+
+    //Only the sections that changed since the last poll get rebuilt
+    POOL_CONTROLLER.refresh_snapshot();
+    PoolSnapshot& snapshot = POOL_CONTROLLER.snapshot;
+
+    char etag[32];
+    snapshot.etag(etag,sizeof(etag));
+    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+    SERVER.sendHeader("ETag", etag);
+    SERVER.sendHeader("Cache-Control", "no-cache");
+
+    //Nothing's changed since the client's copy
+    if (SERVER.header("If-None-Match") == etag){
+      snapshot.not_modified++;
+      SERVER.send(304);
+      digitalWrite(LED_BUILTIN, 1);
+      return;
+    }
+
+    SERVER.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    SERVER.send(200,"application/json","");
+    PoolJsonChunkWriter out(SERVER);
+    out.write('{');
+    for (int x = 0; x < POOL_NUM_SNAPSHOT_SECTIONS; x++){
+      out.print(snapshot.sections[x]);
+      out.write(',');
+    }
+    char now[24];
+    snprintf(now,sizeof(now),"\"now\":%lu}",millis());
+    out.print(now);
+    out.finish();
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void getProfile(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Getting loop profile from pool controller\n");
+    PoolJsonDocument jsonBuffer(POOL_JSON_PROFILE_SIZE);
+    POOL_CONTROLLER.profiler.getJSONProfileDetails(jsonBuffer);
+    jsonBuffer["now"] = millis();
+    sendJSON(jsonBuffer);
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void resetProfile(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Resetting loop profile\n");
+    POOL_CONTROLLER.profiler.reset();
+    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+    SERVER.send(200,"text/plain","");
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void getHistory(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Getting history from pool controller\n");
+
+    int series = POOL_CONTROLLER.historySeries(SERVER.arg("series").c_str());
+    if (series < 0){
+      SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+      SERVER.send(400,"text/plain","Unknown series");
+      digitalWrite(LED_BUILTIN, 1);
+      return;
+    }
+
+    //Times are the controller's clock (unix secs), resolution is secs
+    PoolHistory& history = POOL_CONTROLLER.history;
+    unsigned long to = SERVER.hasArg("to") ? strtoul(SERVER.arg("to").c_str(),NULL,10) : (unsigned long)now();
+    unsigned long resolution = strtoul(SERVER.arg("resolution").c_str(),NULL,10);
+    unsigned long from = strtoul(SERVER.arg("from").c_str(),NULL,10);
+    int tier = history.pickTier(resolution, SERVER.hasArg("from") ? from : 0, to);
+    PoolHistoryTier& t = history.tiers[tier];
+
+    //No from means as far back as that tier goes
+    if (!SERVER.hasArg("from")){
+      unsigned long span = t.bucket_secs * (unsigned long)t.capacity;
+      from = (to > span) ? to - span : 0;
+    }
+
+    //Points go straight from the buckets to the socket, nothing's built up
+    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+    SERVER.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    SERVER.send(200,"application/json","");
+    PoolJsonChunkWriter out(SERVER);
+    out.printf("{\"history\":{\"resolution\":%lu,\"from\":%lu,\"to\":%lu,\"points\":[",
+               t.bucket_secs, from, to);
+    t.writeJSONPoints(out, series, from, to);
+    out.printf("]},\"now\":%lu}", millis());
+    out.finish();
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void getMetrics(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Getting metrics from pool controller\n");
+
+    //Written a line at a time into the chunk buffer, no JSON/Strings involved
+    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+    SERVER.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    SERVER.send(200,"text/plain; version=0.0.4","");
+    PoolJsonChunkWriter out(SERVER);
+    POOL_CONTROLLER.writeMetrics(out);
+    out.finish();
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void getMemory(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Getting memory stats from pool controller\n");
+
+    //Written straight into the chunk buffer so looking doesn't move the heap
+    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+    SERVER.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    SERVER.send(200,"application/json","");
+    PoolJsonChunkWriter out(SERVER);
+    POOL_CONTROLLER.memory.writeJSON(out);
+    char now[24];
+    snprintf(now,sizeof(now),",\"now\":%lu}",millis());
+    out.print(now);
+    out.finish();
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void resetMemory(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Resetting memory stats\n");
+    POOL_CONTROLLER.memory.reset();
     SERVER.sendHeader("Access-Control-Allow-Origin", "*");
-    SERVER.send(200,"application/json",status);
+    SERVER.send(200,"text/plain","");
     digitalWrite(LED_BUILTIN, 1);
 }
 
+void getLog(){
+    digitalWrite(LED_BUILTIN, 0);
+
+    //Records are only formatted now, a line at a time into the chunk buffer
+    unsigned long since = strtoul(SERVER.arg("since").c_str(),NULL,10);
+    uint8_t level = POOL_LOG_PROFILER;
+    if (SERVER.hasArg("level")){
+      int x = 0;
+      while (x < POOL_NUM_LOG_LEVELS && SERVER.arg("level") != POOL_LOG_LEVEL_STRINGS[x]) x++;
+      if (x == POOL_NUM_LOG_LEVELS){
+        SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+        SERVER.send(400,"text/plain","Unknown level");
+        digitalWrite(LED_BUILTIN, 1);
+        return;
+      }
+      level = x;
+    }
+
+    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+    SERVER.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    SERVER.send(200,"text/plain","");
+    PoolJsonChunkWriter out(SERVER);
+    POOL_LOG.print(out, since, level);
+    out.finish();
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void clearLog(){
+    digitalWrite(LED_BUILTIN, 0);
+    POOL_LOG.clear();
+    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+    SERVER.send(200,"text/plain","");
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void clearHistory(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Clearing history\n");
+    POOL_CONTROLLER.history.clear();
+    SERVER.sendHeader("Access-Control-Allow-Origin", "*");
+    SERVER.send(200,"text/plain","");
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void getConfig(){
+    digitalWrite(LED_BUILTIN, 0);
+    pdebugD("Exporting config from pool controller\n");
+    PoolJsonDocument jsonBuffer(POOL_JSON_CONFIG_SIZE);
+    POOL_CONTROLLER.getJSONConfig(jsonBuffer);
+
+    //Don't hand out the wifi/MQTT passwords
+    jsonBuffer["wifi"].remove("pw");
+    jsonBuffer["mqtt"].remove("pw");
+    sendJSON(jsonBuffer);
+    digitalWrite(LED_BUILTIN, 1);
+}
+
+void setConfig(){
+  PoolJsonDocument config(POOL_JSON_REQUEST_SIZE);
+  DeserializationError error = deserializeJson(config,SERVER.arg("plain"));
+
+  if (error == DeserializationError::Ok){
+    pdebugD("Successfully parsed config import request, submitting to controller\n");
+    String err="";
+    byte success = POOL_CONTROLLER.importJSONConfig(config,err);
+
+    if (success == 0){
+      pdebugW("Failed to import JSON config:\n%s\n",err.c_str());
+      SERVER.send(400, "text/plain", err);
+      return;
+    }
+
+    POOL_CONTROLLER.mark_config_dirty();
+    SERVER.send(200,"text/plain","");
+    return;
+  }
+
+  SERVER.send(400, "text/plain", "Invalid JSON");
+}
+
+//Registers a handler with its heap/stack use tracked (see MemoryStats.h)
+void serve(const char* uri, HTTPMethod method, void (*handler)()){
+  int entry = POOL_CONTROLLER.memory.addHandler(uri, (method == HTTP_POST) ? "POST" : "GET");
+  SERVER.on(uri, method, [handler, entry](){
+    PoolMemoryProbe probe(POOL_CONTROLLER.memory, entry);
+    handler();
+  });
+}
+
+//RemoteDebug project commands
+void processDebugCmd(){
+  String cmd = POOL_DEBUG.getLastCommand();
+  if (cmd == "profile"){
+    POOL_CONTROLLER.profiler.print();
+  }
+  else if (cmd == "profile reset"){
+    POOL_CONTROLLER.profiler.reset();
+    pdebugA("Loop profile reset\n");
+  }
+  else if (cmd == "log"){
+    POOL_LOG.print(POOL_DEBUG, 0, POOL_LOG_PROFILER);
+  }
+  else if (cmd == "log clear"){
+    POOL_LOG.clear();
+    pdebugA("Log cleared\n");
+  }
+}
+
 void setup()
 {
   SPIFFS.begin();
@@ -340,6 +626,9 @@ void setup()
   POOL_DEBUG.setSerialEnabled(true);
   POOL_DEBUG.begin("pool_controller");
   POOL_DEBUG.setResetCmdEnabled(true);
+  POOL_DEBUG.setHelpProjectsCmds("profile - show loop latency per stage\nprofile reset - clear loop latency stats\n"
+                                 "log - show the whole event log\nlog clear - clear the event log");
+  POOL_DEBUG.setCallBackProjectCmds(&processDebugCmd);
 
     // if DNSServer is started with "*" for domain name, it will reply with
     // provided IP to all DNS request
@@ -349,21 +638,42 @@ void setup()
     //SERVER.on("/infojson", HTTP_GET, infoJSONRequest);
     //SERVER.on("/update", HTTP_GET, targetRequest);
     //SERVER.serveStatic("/recipe.html", SPIFFS, "/recipe.html");
-    SERVER.on("/sensors",HTTP_GET,tempRequest);
-    SERVER.on("/sensors",HTTP_POST,setSensors);
-    SERVER.on("/wifi",HTTP_POST,setWifi);
-    SERVER.on("/wifi",HTTP_GET,getWifi);
-    SERVER.on("/solar",HTTP_GET,getSolar);
-    SERVER.on("/solar",HTTP_POST,setSolar);
-    SERVER.on("/relays",HTTP_GET,getRelays);
-    SERVER.on("/relays",HTTP_POST,setRelays);
-    SERVER.on("/reset",HTTP_GET,resetController);
-    SERVER.on("/everything",HTTP_GET,getEverything);
-    SERVER.on("/general",HTTP_GET,getGeneral);
-    SERVER.on("/general",HTTP_POST,setGeneral);
+    serve("/sensors",HTTP_GET,tempRequest);
+    serve("/sensors",HTTP_POST,setSensors);
+    serve("/sensors/scan",HTTP_GET,scanSensors);
+    serve("/wifi",HTTP_POST,setWifi);
+    serve("/wifi",HTTP_GET,getWifi);
+    serve("/mqtt",HTTP_GET,getMqtt);
+    serve("/mqtt",HTTP_POST,setMqtt);
+    serve("/solar",HTTP_GET,getSolar);
+    serve("/solar",HTTP_POST,setSolar);
+    serve("/relays",HTTP_GET,getRelays);
+    serve("/relays",HTTP_POST,setRelays);
+    serve("/relays/stats",HTTP_GET,getRelayStats);
+    serve("/relays/stats/reset",HTTP_GET,resetRelayStats);
+    serve("/reset",HTTP_GET,resetController);
+    serve("/everything",HTTP_GET,getEverything);
+    serve("/events",HTTP_GET,subscribeEvents);
+    serve("/general",HTTP_GET,getGeneral);
+    serve("/general",HTTP_POST,setGeneral);
+    serve("/profile",HTTP_GET,getProfile);
+    serve("/profile/reset",HTTP_GET,resetProfile);
+    serve("/memory",HTTP_GET,getMemory);
+    serve("/memory/reset",HTTP_GET,resetMemory);
+    serve("/history",HTTP_GET,getHistory);
+    serve("/history/clear",HTTP_GET,clearHistory);
+    serve("/log",HTTP_GET,getLog);
+    serve("/log/clear",HTTP_GET,clearLog);
+    serve("/metrics",HTTP_GET,getMetrics);
+    serve("/config",HTTP_GET,getConfig);
+    serve("/config",HTTP_POST,setConfig);
 
     SERVER.onNotFound(handleNotFound);
 
+    //Needed for the /everything ETag
+    const char* headers[] = {"If-None-Match"};
+    SERVER.collectHeaders(headers,1);
+
     SERVER.begin();
 
     MDNS.begin(HOSTNAME);
@@ -418,8 +728,15 @@ void setup()
 
 void loop()
 {
-    MDNS.update();
+    PoolProfiler& profiler = POOL_CONTROLLER.profiler;
+    PoolProfileTimer loop_timer(profiler, POOL_PROFILE_LOOP);
 
+    {
+      PoolProfileTimer t(profiler, POOL_PROFILE_MDNS);
+      MDNS.update();
+    }
+
+    //NOTE: update() profiles its own stages
     POOL_CONTROLLER.update(); 
     //delay(1000);
 
@@ -429,8 +746,26 @@ void loop()
     //dnsServer.processNextRequest();
 
     //Uncomment for OTA stuff
-    ArduinoOTA.handle();
+    {
+      PoolProfileTimer t(profiler, POOL_PROFILE_OTA);
+      ArduinoOTA.handle();
+    }
+
+    {
+      PoolProfileTimer t(profiler, POOL_PROFILE_HTTP);
+      SERVER.handleClient();
+    }
 
-    SERVER.handleClient();
-    POOL_DEBUG.handle();
+    {
+      PoolProfileTimer t(profiler, POOL_PROFILE_EVENTS);
+      POOL_CONTROLLER.events.handle(millis());
+    }
+
+    {
+      PoolProfileTimer t(profiler, POOL_PROFILE_DEBUG);
+      POOL_DEBUG.handle();
+
+      //Format/send the event log records the debugger's watching for
+      POOL_LOG.tail(POOL_DEBUG);
+    }
 }
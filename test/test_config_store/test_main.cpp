@@ -0,0 +1,256 @@
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <unity.h>
+#include "ConfigStore.h"
+#include "Names.h"
+#include "PoolNativeHal.h"
+
+//Both slots blank, like a new board
+static void eraseSlots(){
+  PoolConfigStore store;
+  for (int slot = 0; slot < POOL_CONFIG_NUM_SLOTS; slot++){
+    ESP.flashEraseSector(store.slotSector(slot));
+  }
+}
+
+//A record with something in every section
+static void fillRecord(PoolConfigRecord& r, const char* ssid){
+  memset(&r, 0, sizeof(r));
+  POOL_SET_NAME(r.wifi_ssid, ssid);
+  POOL_SET_NAME(r.wifi_pw, "hunter2");
+  POOL_SET_NAME(r.ntp_server, "pool.ntp.org");
+  r.tz_offset = -4;
+  POOL_SET_NAME(r.relays[0].name, "pump");
+  r.relays[0].num_schedules = 1;
+  r.relays[0].on_secs[0] = 10 * SECS_PER_HOUR;
+  r.relays[0].off_secs[0] = 17 * SECS_PER_HOUR;
+  r.num_sensors = 1;
+  POOL_SET_NAME(r.sensors[0], "28FFCFE4021502A2");
+  POOL_SET_NAME(r.pool_water_sensor, "analog");
+  r.solar_enabled = 1;
+  r.solar_target_temp = 88.5;
+  POOL_SET_NAME(r.mqtt_host, "broker.local");
+  POOL_SET_NAME(r.mqtt_prefix, "pool");
+  r.mqtt_port = 1883;
+  r.mqtt_temp_deadband = 1.5;
+}
+
+//Save a record with the given ssid (so we can tell the slots apart)
+static void saveRecord(PoolConfigStore& store, const char* ssid){
+  fillRecord(store.record, ssid);
+  TEST_ASSERT_TRUE(store.save());
+}
+
+//Replace what's in a slot with r exactly as given (header and all)
+static void writeSlot(PoolConfigStore& store, int slot, PoolConfigRecord& r, size_t size){
+  TEST_ASSERT_TRUE(ESP.flashEraseSector(store.slotSector(slot)));
+  TEST_ASSERT_TRUE(ESP.flashWrite(store.slotAddress(slot), (uint32_t*)&r, size));
+}
+
+void setUp(){
+  eraseSlots();
+}
+
+void tearDown(){
+}
+
+void test_blank_flash_has_no_config(){
+  PoolConfigStore store;
+  TEST_ASSERT_FALSE(store.load());
+  TEST_ASSERT_EQUAL(-1, store.current_slot);
+}
+
+void test_round_trip(){
+  PoolConfigStore writer;
+  saveRecord(writer, "home");
+  TEST_ASSERT_EQUAL(1, writer.generation);
+
+  PoolConfigStore reader;
+  TEST_ASSERT_TRUE(reader.load());
+  TEST_ASSERT_EQUAL(writer.current_slot, reader.current_slot);
+  TEST_ASSERT_EQUAL(1, reader.generation);
+  TEST_ASSERT_EQUAL_MEMORY(&writer.record, &reader.record, sizeof(PoolConfigRecord));
+  TEST_ASSERT_EQUAL_STRING("home", reader.record.wifi_ssid);
+  TEST_ASSERT_EQUAL(17 * SECS_PER_HOUR, reader.record.relays[0].off_secs[0]);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 88.5, reader.record.solar_target_temp);
+  TEST_ASSERT_TRUE(POOL_CONFIG_HAS(reader.record, mqtt_temp_deadband));
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 1.5, reader.record.mqtt_temp_deadband);
+}
+
+void test_saves_alternate_slots_and_newest_wins(){
+  PoolConfigStore writer;
+  saveRecord(writer, "first");
+  int first_slot = writer.current_slot;
+  saveRecord(writer, "second");
+  TEST_ASSERT_TRUE(writer.current_slot != first_slot);
+  TEST_ASSERT_EQUAL(2, writer.generation);
+
+  PoolConfigStore reader;
+  TEST_ASSERT_TRUE(reader.load());
+  TEST_ASSERT_EQUAL(writer.current_slot, reader.current_slot);
+  TEST_ASSERT_EQUAL_STRING("second", reader.record.wifi_ssid);
+
+  //A third save goes back over the oldest one
+  saveRecord(writer, "third");
+  TEST_ASSERT_EQUAL(first_slot, writer.current_slot);
+  TEST_ASSERT_TRUE(reader.load());
+  TEST_ASSERT_EQUAL_STRING("third", reader.record.wifi_ssid);
+  TEST_ASSERT_EQUAL(3, reader.generation);
+}
+
+void test_corrupt_newest_falls_back_to_other_slot(){
+  PoolConfigStore writer;
+  saveRecord(writer, "old");
+  int old_slot = writer.current_slot;
+  saveRecord(writer, "new");
+
+  //Flip a bit in the middle of the newest record's payload
+  hal_flash_corrupt(writer.slotAddress(writer.current_slot) + offsetof(PoolConfigRecord, relays));
+
+  PoolConfigStore reader;
+  TEST_ASSERT_TRUE(reader.load());
+  TEST_ASSERT_EQUAL(old_slot, reader.current_slot);
+  TEST_ASSERT_EQUAL_STRING("old", reader.record.wifi_ssid);
+  TEST_ASSERT_EQUAL(1, reader.generation);
+
+  //The next save goes over the bad one, not the one we loaded
+  saveRecord(reader, "newer");
+  TEST_ASSERT_TRUE(reader.current_slot != old_slot);
+  TEST_ASSERT_EQUAL(2, reader.generation);
+}
+
+void test_both_slots_corrupt(){
+  PoolConfigStore writer;
+  saveRecord(writer, "a");
+  saveRecord(writer, "b");
+  for (int slot = 0; slot < POOL_CONFIG_NUM_SLOTS; slot++){
+    hal_flash_corrupt(writer.slotAddress(slot) + sizeof(PoolConfigRecord) - 1);
+  }
+
+  PoolConfigStore reader;
+  TEST_ASSERT_FALSE(reader.load());
+  TEST_ASSERT_EQUAL(-1, reader.current_slot);
+}
+
+void test_torn_write_is_rejected(){
+  PoolConfigStore writer;
+  saveRecord(writer, "old");
+  int old_slot = writer.current_slot;
+
+  //A save that lost power halfway: the header made it (with the next
+  //generation) but the rest of the sector is still erased
+  PoolConfigRecord torn;
+  fillRecord(torn, "torn");
+  memcpy(torn.header.version, CONFIG_VERSION, sizeof(torn.header.version));
+  torn.header.generation = 2;
+  torn.header.size = sizeof(PoolConfigRecord);
+  torn.header.crc = PoolConfigStore::crc32(((const uint8_t*)&torn) + sizeof(PoolConfigHeader),
+                                           sizeof(PoolConfigRecord) - sizeof(PoolConfigHeader));
+  writeSlot(writer, 1 - old_slot, torn, (sizeof(PoolConfigRecord) / 2) & ~3);
+
+  PoolConfigStore reader;
+  TEST_ASSERT_TRUE(reader.load());
+  TEST_ASSERT_EQUAL(old_slot, reader.current_slot);
+  TEST_ASSERT_EQUAL_STRING("old", reader.record.wifi_ssid);
+}
+
+void test_bad_size_is_rejected(){
+  PoolConfigStore writer;
+  saveRecord(writer, "old");
+  int old_slot = writer.current_slot;
+  saveRecord(writer, "new");
+
+  //Sizes we'd never have written: bigger than the record (would read past
+  //it), smaller than the oldest we load, and not a multiple of 4. The CRC
+  //is right for whatever the size says.
+  size_t sizes[] = {sizeof(PoolConfigRecord) + 4, POOL_CONFIG_MIN_RECORD_SIZE - 4, sizeof(PoolConfigRecord) - 2};
+  for (size_t x = 0; x < sizeof(sizes) / sizeof(sizes[0]); x++){
+    PoolConfigRecord bad = writer.record;
+    bad.header.size = sizes[x];
+    bad.header.generation = 10;
+    size_t crc_size = (sizes[x] < sizeof(PoolConfigRecord)) ? sizes[x] : sizeof(PoolConfigRecord);
+    bad.header.crc = PoolConfigStore::crc32(((const uint8_t*)&bad) + sizeof(PoolConfigHeader),
+                                            crc_size - sizeof(PoolConfigHeader));
+    writeSlot(writer, 1 - old_slot, bad, sizeof(PoolConfigRecord));
+
+    PoolConfigStore reader;
+    TEST_ASSERT_TRUE(reader.load());
+    TEST_ASSERT_EQUAL(old_slot, reader.current_slot);
+    TEST_ASSERT_EQUAL_STRING("old", reader.record.wifi_ssid);
+  }
+}
+
+void test_older_shorter_record_loads_zeroed(){
+  //What firmware from before the MQTT settings saved
+  PoolConfigRecord r;
+  fillRecord(r, "legacy");
+  memset(((uint8_t*)&r) + POOL_CONFIG_MIN_RECORD_SIZE, 0, sizeof(r) - POOL_CONFIG_MIN_RECORD_SIZE);
+  memcpy(r.header.version, CONFIG_VERSION, sizeof(r.header.version));
+  r.header.generation = 5;
+  r.header.size = POOL_CONFIG_MIN_RECORD_SIZE;
+  r.header.crc = PoolConfigStore::crc32(((const uint8_t*)&r) + sizeof(PoolConfigHeader),
+                                        POOL_CONFIG_MIN_RECORD_SIZE - sizeof(PoolConfigHeader));
+  PoolConfigStore store;
+  writeSlot(store, 0, r, POOL_CONFIG_MIN_RECORD_SIZE);
+
+  TEST_ASSERT_TRUE(store.load());
+  TEST_ASSERT_EQUAL_STRING("legacy", store.record.wifi_ssid);
+  TEST_ASSERT_EQUAL_STRING("", store.record.mqtt_host);
+  TEST_ASSERT_EQUAL(0, store.record.mqtt_port);
+  TEST_ASSERT_FALSE(POOL_CONFIG_HAS(store.record, mqtt_host));
+}
+
+void test_record_from_before_the_deadband(){
+  //MQTT settings, but saved before temp_deadband went on the end
+  size_t size = offsetof(PoolConfigRecord, mqtt_temp_deadband);
+  PoolConfigRecord r;
+  fillRecord(r, "no deadband");
+  memcpy(r.header.version, CONFIG_VERSION, sizeof(r.header.version));
+  r.header.generation = 5;
+  r.header.size = size;
+  r.header.crc = PoolConfigStore::crc32(((const uint8_t*)&r) + sizeof(PoolConfigHeader),
+                                        size - sizeof(PoolConfigHeader));
+  PoolConfigStore store;
+  writeSlot(store, 0, r, size);
+
+  TEST_ASSERT_TRUE(store.load());
+  TEST_ASSERT_EQUAL_STRING("broker.local", store.record.mqtt_host);
+  TEST_ASSERT_TRUE(POOL_CONFIG_HAS(store.record, mqtt_port));
+  TEST_ASSERT_FALSE(POOL_CONFIG_HAS(store.record, mqtt_temp_deadband));
+}
+
+void test_skip_slot_loads_the_other_one(){
+  PoolConfigStore writer;
+  saveRecord(writer, "old");
+  int old_slot = writer.current_slot;
+  saveRecord(writer, "new");
+  int new_slot = writer.current_slot;
+
+  //What load_config() does when the newest one's settings don't check out
+  PoolConfigStore reader;
+  TEST_ASSERT_TRUE(reader.load());
+  TEST_ASSERT_EQUAL(new_slot, reader.current_slot);
+  TEST_ASSERT_TRUE(reader.load(reader.current_slot));
+  TEST_ASSERT_EQUAL(old_slot, reader.current_slot);
+  TEST_ASSERT_EQUAL_STRING("old", reader.record.wifi_ssid);
+  TEST_ASSERT_EQUAL(1, reader.generation);
+
+  //Nothing else to fall back to if the other one's bad too
+  hal_flash_corrupt(writer.slotAddress(old_slot) + sizeof(PoolConfigRecord) - 1);
+  TEST_ASSERT_FALSE(reader.load(new_slot));
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_blank_flash_has_no_config);
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_saves_alternate_slots_and_newest_wins);
+  RUN_TEST(test_corrupt_newest_falls_back_to_other_slot);
+  RUN_TEST(test_both_slots_corrupt);
+  RUN_TEST(test_torn_write_is_rejected);
+  RUN_TEST(test_bad_size_is_rejected);
+  RUN_TEST(test_older_shorter_record_loads_zeroed);
+  RUN_TEST(test_record_from_before_the_deadband);
+  RUN_TEST(test_skip_slot_loads_the_other_one);
+  return UNITY_END();
+}
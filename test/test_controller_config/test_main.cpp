@@ -0,0 +1,162 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <FS.h>
+#include "PoolController.h"
+
+RemoteDebug debug;
+PoolController controller(&debug);
+
+//What the constructor set up, to put back between tests
+static PoolTaskScheduler default_scheduler;
+
+void setUp(){
+  for (int slot = 0; slot < POOL_CONFIG_NUM_SLOTS; slot++){
+    ESP.flashEraseSector(controller.config_store.slotSector(slot));
+  }
+  controller.config_store = PoolConfigStore();
+  controller.config_persist = PoolConfigPersist();
+  SPIFFS.remove(CONFIG_FILE_PATH);
+
+  controller.scheduler = default_scheduler;
+  controller.config_persist.save_delay_ms = POOL_CONFIG_SAVE_DELAY;
+  controller.events.temp_deadband = POOL_EVENTS_TEMP_DEADBAND;
+  controller.analog_temp->setFilter(POOL_THERM_DEFAULT_FILTER_DEPTH, POOL_THERM_DEFAULT_EMA_ALPHA);
+}
+
+void tearDown(){
+}
+
+//Everything /general can change, set to something other than the defaults
+static void changeGeneralSettings(){
+  controller.scheduler.tasks[POOL_TASK_SENSORS].period_ms = 10000;
+  controller.scheduler.tasks[POOL_TASK_SENSORS].priority = 3;
+  controller.scheduler.tasks[POOL_TASK_MQTT].deadline_ms = 2500;
+  controller.config_persist.save_delay_ms = 30000;
+  controller.events.temp_deadband = 2.0;
+  controller.analog_temp->setFilter(9, 0.1);
+}
+
+void test_general_settings_round_trip(){
+  changeGeneralSettings();
+  PoolConfigRecord r;
+  controller.fill_config_record(r);
+  r.header.size = sizeof(r);
+
+  setUp();
+  TEST_ASSERT_TRUE(controller.apply_config_record(r));
+  TEST_ASSERT_EQUAL(10000, controller.scheduler.tasks[POOL_TASK_SENSORS].period_ms);
+  TEST_ASSERT_EQUAL(3, controller.scheduler.tasks[POOL_TASK_SENSORS].priority);
+  TEST_ASSERT_EQUAL(2500, controller.scheduler.tasks[POOL_TASK_MQTT].deadline_ms);
+  TEST_ASSERT_EQUAL(default_scheduler.tasks[POOL_TASK_NTP].period_ms, controller.scheduler.tasks[POOL_TASK_NTP].period_ms);
+  TEST_ASSERT_EQUAL(30000, controller.config_persist.save_delay_ms);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 2.0, controller.events.temp_deadband);
+  TEST_ASSERT_EQUAL(9, controller.analog_temp->median_depth);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, 0.1, controller.analog_temp->ema_alpha);
+}
+
+void test_record_from_before_the_general_settings(){
+  changeGeneralSettings();
+  PoolConfigRecord r;
+  controller.fill_config_record(r);
+  r.header.size = offsetof(PoolConfigRecord, config_save_delay_ms);
+  memset(((uint8_t*)&r) + r.header.size, 0, sizeof(r) - r.header.size);
+
+  //Nothing was saved for them, so they stay what we booted with
+  setUp();
+  TEST_ASSERT_TRUE(controller.apply_config_record(r));
+  TEST_ASSERT_EQUAL(default_scheduler.tasks[POOL_TASK_SENSORS].period_ms, controller.scheduler.tasks[POOL_TASK_SENSORS].period_ms);
+  TEST_ASSERT_EQUAL(POOL_CONFIG_SAVE_DELAY, controller.config_persist.save_delay_ms);
+  TEST_ASSERT_FLOAT_WITHIN(0.001, POOL_EVENTS_TEMP_DEADBAND, controller.events.temp_deadband);
+  TEST_ASSERT_EQUAL(POOL_THERM_DEFAULT_FILTER_DEPTH, controller.analog_temp->median_depth);
+}
+
+void test_bad_general_settings_reject_the_record(){
+  PoolConfigRecord r;
+  controller.fill_config_record(r);
+  r.header.size = sizeof(r);
+  PoolConfigRecord bad;
+
+  bad = r;
+  bad.tasks[POOL_TASK_SENSORS].period_ms = 0;
+  TEST_ASSERT_FALSE(controller.apply_config_record(bad));
+  bad = r;
+  bad.analog_median_depth = 0;
+  TEST_ASSERT_FALSE(controller.apply_config_record(bad));
+  bad = r;
+  bad.analog_ema_alpha = NAN;
+  TEST_ASSERT_FALSE(controller.apply_config_record(bad));
+  bad = r;
+  bad.events_temp_deadband = -1;
+  TEST_ASSERT_FALSE(controller.apply_config_record(bad));
+  bad = r;
+  bad.config_save_delay_ms = POOL_CONFIG_SAVE_MAX_DELAY + 1;
+  TEST_ASSERT_FALSE(controller.apply_config_record(bad));
+  bad = r;
+  bad.num_tasks = POOL_CONFIG_MAX_TASKS + 1;
+  TEST_ASSERT_FALSE(controller.apply_config_record(bad));
+
+  TEST_ASSERT_TRUE(controller.apply_config_record(r));
+}
+
+//What an older firmware left in SPIFFS
+static void writeLegacyConfig(){
+  File f = SPIFFS.open(CONFIG_FILE_PATH, "w");
+  f.print("{\"wifi\":{\"ssid\":\"legacy\"}}");
+  f.close();
+}
+
+//Save what the controller has now to flash as ssid
+static void saveToFlash(const char* ssid){
+  POOL_SET_NAME(controller.wifi_ssid, ssid);
+  TEST_ASSERT_TRUE(controller.save_config());
+}
+
+void test_boot_with_flash_and_legacy_file(){
+  saveToFlash("flash");
+  writeLegacyConfig();
+
+  //Flash wins, the file isn't imported over it (or marked dirty) and goes away
+  POOL_SET_NAME(controller.wifi_ssid, "");
+  controller.config_persist = PoolConfigPersist();
+  TEST_ASSERT_TRUE(controller.load_config());
+  TEST_ASSERT_EQUAL_STRING("flash", controller.wifi_ssid);
+  TEST_ASSERT_FALSE(controller.config_persist.dirty);
+  TEST_ASSERT_FALSE(SPIFFS.exists(CONFIG_FILE_PATH));
+
+  //Same on the next boot after a change
+  saveToFlash("changed");
+  controller.config_persist = PoolConfigPersist();
+  TEST_ASSERT_TRUE(controller.load_config());
+  TEST_ASSERT_EQUAL_STRING("changed", controller.wifi_ssid);
+  TEST_ASSERT_FALSE(controller.config_persist.dirty);
+}
+
+void test_legacy_file_imported_once(){
+  writeLegacyConfig();
+
+  //Nothing on flash, so it's imported and marked for saving
+  TEST_ASSERT_TRUE(controller.load_config());
+  TEST_ASSERT_TRUE(controller.config_persist.dirty);
+  TEST_ASSERT_TRUE(SPIFFS.exists(CONFIG_FILE_PATH));
+
+  //Once it's on flash the file is gone and the next boot loads from flash
+  TEST_ASSERT_TRUE(controller.save_config());
+  TEST_ASSERT_FALSE(SPIFFS.exists(CONFIG_FILE_PATH));
+  controller.config_persist = PoolConfigPersist();
+  TEST_ASSERT_TRUE(controller.load_config());
+  TEST_ASSERT_EQUAL(1, controller.config_store.generation);
+  TEST_ASSERT_FALSE(controller.config_persist.dirty);
+}
+
+int main(int argc, char** argv){
+  default_scheduler = controller.scheduler;
+  controller.solar_target_temp = 85.0; //reset_config() would have set it
+
+  UNITY_BEGIN();
+  RUN_TEST(test_general_settings_round_trip);
+  RUN_TEST(test_record_from_before_the_general_settings);
+  RUN_TEST(test_bad_general_settings_reject_the_record);
+  RUN_TEST(test_boot_with_flash_and_legacy_file);
+  RUN_TEST(test_legacy_file_imported_once);
+  return UNITY_END();
+}
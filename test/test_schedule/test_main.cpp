@@ -0,0 +1,226 @@
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <unity.h>
+#include "DailySchedule.h"
+#include "PoolController.h"
+
+RemoteDebug debug;
+PoolController controller(&debug);
+
+//The HH:MM:SS parser /relays and /general use (PoolController.cpp)
+int createElements(const char *str,tmElements_t *target);
+
+//The per-relay evaluation the compiled schedule replaced: on if any
+//entry has on <= now < off
+static byte oldScheduledOn(PoolDailySchedule& sched, unsigned long sod){
+  unsigned long on_buff, off_buff;
+  for (int x = 0; x < sched.num_schedules; x++){
+    on_buff = timeOfDay(sched.on_time[x].Hour, sched.on_time[x].Minute, sched.on_time[x].Second);
+    off_buff = timeOfDay(sched.off_time[x].Hour, sched.off_time[x].Minute, sched.off_time[x].Second);
+    if (on_buff <= sod && sod < off_buff)
+      return 1;
+  }
+  return 0;
+}
+
+//What the old update_relays() came up with for every relay at t
+static byte oldScheduleBits(time_t t){
+  byte bits = 0;
+  unsigned long sod = timeOfDay(hour(t), minute(t), second(t));
+  for (int x = 0; x < MAX_RELAY; x++){
+    if (oldScheduledOn(controller.relays[x].schedule, sod)) bits |= (1 << x);
+  }
+  return bits;
+}
+
+//{on, off} pairs in seconds since midnight, in whatever order
+static void makeSchedule(PoolDailySchedule& d, const unsigned long ranges[][2], int n){
+  d.clear();
+  for (int x = 0; x < n; x++){
+    TEST_ASSERT_TRUE(d.add(ranges[x][0], ranges[x][1]));
+  }
+  d.compile();
+}
+
+#define HMS(h, m, s) ((h) * SECS_PER_HOUR + (m) * SECS_PER_MIN + (s))
+
+static const unsigned long MIDNIGHT[][2] = {{HMS(0,0,0), HMS(1,0,0)}, {HMS(23,0,0), HMS(23,59,59)}};
+static const unsigned long WHOLE_DAY[][2] = {{HMS(0,0,0), HMS(23,59,59)}};
+static const unsigned long BACK_TO_BACK[][2] = {{HMS(11,0,0), HMS(12,0,0)}, {HMS(10,0,0), HMS(11,0,0)},
+                                                {HMS(12,0,0), HMS(12,0,1)}};
+static const unsigned long ONE_SECOND[][2] = {{HMS(6,30,0), HMS(6,30,1)}};
+static const unsigned long FULL[MAX_SCHEDULES][2] = {{HMS(20,0,0), HMS(21,0,0)}, {HMS(1,0,0), HMS(2,0,0)},
+                                                     {HMS(14,0,0), HMS(15,0,0)}, {HMS(2,0,0), HMS(3,0,0)}};
+
+#define JUNE_1_2021 1622505600UL //midnight UTC
+
+/*
+  Every second of the day: isOnAt() agrees with the old evaluation, and
+  nextTransition() is an edge that comes no later than the next time the
+  old evaluation changes (earlier is fine, back-to-back ranges have edges
+  that don't change anything)
+*/
+static void checkAgainstOld(PoolDailySchedule& d){
+  static byte old[2 * SECS_PER_DAY];
+  for (unsigned long sod = 0; sod < 2 * SECS_PER_DAY; sod++){
+    old[sod] = oldScheduledOn(d, sod % SECS_PER_DAY);
+  }
+
+  //Walk backwards so we always know when the state next changes
+  unsigned long next_change = POOL_SCHEDULE_NO_TRANSITION;
+  for (long sod = 2 * SECS_PER_DAY - 2; sod >= 0; sod--){
+    if (old[sod] != old[sod + 1]) next_change = sod + 1;
+    if (sod >= (long)SECS_PER_DAY) continue;
+
+    char msg[64];
+    snprintf(msg, sizeof(msg), "at %ld", sod);
+    TEST_ASSERT_EQUAL_MESSAGE(old[sod], d.isOnAt(sod), msg);
+
+    unsigned long n = d.nextTransition(sod);
+    if (d.num_schedules == 0){
+      TEST_ASSERT_EQUAL_MESSAGE(POOL_SCHEDULE_NO_TRANSITION, n, msg);
+      continue;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(n > (unsigned long)sod && n <= (unsigned long)sod + SECS_PER_DAY, msg);
+    TEST_ASSERT_TRUE_MESSAGE(n <= next_change, msg);
+
+    //It has to be one of the schedule's edges
+    byte edge = 0;
+    for (int x = 0; x < d.num_schedules; x++){
+      unsigned long e = n % SECS_PER_DAY;
+      if (e == d.on_secs[x] || e == d.off_secs[x]) edge = 1;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(edge, msg);
+  }
+}
+
+void setUp(){
+  for (int x = 0; x < MAX_RELAY; x++){
+    controller.relays[x].schedule.clear();
+  }
+  controller.schedule_dirty = 1;
+}
+
+void tearDown(){
+}
+
+void test_empty_schedule(){
+  PoolDailySchedule d;
+  d.compile();
+  checkAgainstOld(d);
+}
+
+void test_ranges_touching_midnight(){
+  PoolDailySchedule d;
+  makeSchedule(d, MIDNIGHT, 2);
+  TEST_ASSERT_TRUE(d.isOnAt(0));
+  TEST_ASSERT_FALSE(d.isOnAt(HMS(23,59,59)));
+  TEST_ASSERT_EQUAL(SECS_PER_DAY + HMS(0,0,0), d.nextTransition(HMS(23,59,59)));
+  checkAgainstOld(d);
+
+  makeSchedule(d, WHOLE_DAY, 1);
+  checkAgainstOld(d);
+}
+
+void test_back_to_back_ranges(){
+  PoolDailySchedule d;
+  makeSchedule(d, BACK_TO_BACK, 3);
+  TEST_ASSERT_EQUAL(HMS(10,0,0), d.on_secs[0]);
+  TEST_ASSERT_TRUE(d.isOnAt(HMS(11,0,0)));
+  TEST_ASSERT_TRUE(d.isOnAt(HMS(12,0,0)));
+  TEST_ASSERT_FALSE(d.isOnAt(HMS(12,0,1)));
+  checkAgainstOld(d);
+}
+
+void test_short_and_full_schedules(){
+  PoolDailySchedule d;
+  makeSchedule(d, ONE_SECOND, 1);
+  checkAgainstOld(d);
+  makeSchedule(d, FULL, MAX_SCHEDULES);
+  checkAgainstOld(d);
+}
+
+//Anything the API takes has to fit in the config record (which turns
+//away off_secs >= SECS_PER_DAY)
+void test_time_strings(){
+  TimeElements t;
+  TEST_ASSERT_TRUE(createElements("23:59:59", &t));
+  TEST_ASSERT_EQUAL(SECS_PER_DAY - 1, timeOfDay(t.Hour, t.Minute, t.Second));
+  TEST_ASSERT_TRUE(createElements("0:0:0", &t));
+  TEST_ASSERT_EQUAL(0, timeOfDay(t.Hour, t.Minute, t.Second));
+
+  const char* bad[] = {"23:59:60", "23:60:00", "24:00:00", "-1:00:00", "12:00", "noon"};
+  for (size_t x = 0; x < sizeof(bad) / sizeof(bad[0]); x++){
+    TEST_ASSERT_FALSE_MESSAGE(createElements(bad[x], &t), bad[x]);
+  }
+}
+
+//Different schedules on the relays (and two without one)
+static void setupRelays(){
+  makeSchedule(controller.relays[0].schedule, MIDNIGHT, 2);
+  makeSchedule(controller.relays[1].schedule, WHOLE_DAY, 1);
+  makeSchedule(controller.relays[2].schedule, BACK_TO_BACK, 3);
+  makeSchedule(controller.relays[3].schedule, ONE_SECOND, 1);
+  makeSchedule(controller.relays[4].schedule, FULL, MAX_SCHEDULES);
+  makeSchedule(controller.relays[6].schedule, BACK_TO_BACK, 2);
+  controller.schedule_dirty = 1;
+}
+
+//Same bits as the old evaluation at t, however update_schedule() got there
+static void checkBitsAt(time_t t){
+  setTime(t);
+  controller.update_schedule();
+  char msg[64];
+  snprintf(msg, sizeof(msg), "at %02d:%02d:%02d", hour(t), minute(t), second(t));
+  TEST_ASSERT_EQUAL_HEX8_MESSAGE(oldScheduleBits(t), controller.schedule_bits, msg);
+}
+
+void test_controller_bits_across_midnight(){
+  setupRelays();
+
+  //A second at a time from the evening before, through midnight, to the
+  //next morning. It only re-evaluates at edges/midnight.
+  time_t start = JUNE_1_2021 + HMS(22,0,0);
+  unsigned long evaluations = 0;
+  for (time_t t = start; t < start + 14 * SECS_PER_HOUR; t++){
+    setTime(t);
+    evaluations += controller.update_schedule();
+    TEST_ASSERT_EQUAL_HEX8(oldScheduleBits(t), controller.schedule_bits);
+    TEST_ASSERT_TRUE(t < controller.schedule_next_transition);
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(30, evaluations);
+}
+
+void test_controller_clock_moves_backwards(){
+  setupRelays();
+
+  //Evaluated mid-range, then NTP pulls the clock back before the range
+  time_t day = JUNE_1_2021;
+  checkBitsAt(day + HMS(14,30,0));
+  TEST_ASSERT_EQUAL(day + HMS(15,0,0), controller.schedule_next_transition);
+  setTime(day + HMS(13,59,0));
+  TEST_ASSERT_EQUAL(1, controller.update_schedule());
+  TEST_ASSERT_EQUAL_HEX8(oldScheduleBits(day + HMS(13,59,0)), controller.schedule_bits);
+
+  //And back across midnight into yesterday
+  checkBitsAt(day + SECS_PER_DAY + HMS(0,0,30));
+  checkBitsAt(day + HMS(23,59,50));
+  checkBitsAt(day + HMS(23,0,0) - 1);
+
+  //Random jumps both ways
+  for (unsigned long x = 0; x < 2000; x++){
+    checkBitsAt(day + (x * 7919UL * 13UL) % (3 * SECS_PER_DAY));
+  }
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_schedule);
+  RUN_TEST(test_ranges_touching_midnight);
+  RUN_TEST(test_back_to_back_ranges);
+  RUN_TEST(test_short_and_full_schedules);
+  RUN_TEST(test_time_strings);
+  RUN_TEST(test_controller_bits_across_midnight);
+  RUN_TEST(test_controller_clock_moves_backwards);
+  return UNITY_END();
+}
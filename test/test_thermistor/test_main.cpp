@@ -0,0 +1,78 @@
+#include <Arduino.h>
+#include <math.h>
+#include <unity.h>
+#include "FilteredThermistor.h"
+#include "PoolNativeHal.h"
+
+/*
+  The conversion the controller used before FilteredThermistor: the
+  Thermistor library's readTempF() on an average ADC reading, set up the
+  way PoolController's constructor did it
+    Thermistor(A0, 3.3 (VCC), 1.0 (vRef), 1023, POOL_THERM_SERIES_RES,
+               POOL_THERM_NOM_RES, POOL_THERM_NOM_TEMP_C, POOL_THERM_BETA, ...)
+*/
+static double libraryReadTempF(double average){
+  double vcc = 3.3, analog_reference = 1.0, adc_max = 1023;
+  average = (adc_max * vcc) / (analog_reference * average) - 1;
+  average = POOL_THERM_SERIES_RES / average;
+
+  double steinhart;
+  steinhart = average / POOL_THERM_NOM_RES;
+  steinhart = log(steinhart);
+  steinhart /= POOL_THERM_BETA;
+  steinhart += 1.0 / (POOL_THERM_NOM_TEMP_C + 273.15);
+  steinhart = 1.0 / steinhart;
+  steinhart -= 273.15;
+  return steinhart * 9.0 / 5.0 + 32.0;
+}
+
+FilteredThermistor therm(DEFAULT_ANALOG_THERM_PIN);
+
+void setUp(){
+  therm = FilteredThermistor(DEFAULT_ANALOG_THERM_PIN);
+}
+
+void tearDown(){
+}
+
+void test_matches_library_across_the_adc_range(){
+  for (int adc = 1; adc <= POOL_THERM_ADC_MAX; adc++){
+    char msg[32];
+    snprintf(msg, sizeof(msg), "adc %d", adc);
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.001, libraryReadTempF(adc), therm.adcToTempF(adc), msg);
+  }
+
+  //Filtered readings aren't whole numbers
+  TEST_ASSERT_FLOAT_WITHIN(0.001, libraryReadTempF(211.4), therm.adcToTempF(211.4));
+}
+
+//A few points worked out by hand, in case both of the above change together
+void test_known_points(){
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 110.625, therm.adcToTempF(100));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 76.999, therm.adcToTempF(211)); //10K, i.e. 25C
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 62.018, therm.adcToTempF(300));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 40.791, therm.adcToTempF(500));
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 10.459, therm.adcToTempF(1023));
+}
+
+void test_no_reading_is_missing(){
+  TEST_ASSERT_EQUAL(POOL_TEMP_SENSOR_MISSING, therm.readTempF());
+  TEST_ASSERT_EQUAL(POOL_TEMP_SENSOR_MISSING, therm.adcToTempF(0));
+}
+
+void test_steady_input_reads_the_same_as_the_library(){
+  hal_set_analog(DEFAULT_ANALOG_THERM_PIN, 250);
+  for (int x = 0; x < 20; x++){
+    therm.sample();
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.001, libraryReadTempF(250), therm.readTempF());
+}
+
+int main(int argc, char** argv){
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_library_across_the_adc_range);
+  RUN_TEST(test_known_points);
+  RUN_TEST(test_no_reading_is_missing);
+  RUN_TEST(test_steady_input_reads_the_same_as_the_library);
+  return UNITY_END();
+}